@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Keeps the compiler from optimizing away a value the benchmark computed.
+template <class T> inline void DoNotOptimize(const T &Value) { asm volatile("" : : "r,m"(Value) : "memory"); }
+// Hides a value's origin so computations on constants are not folded at compile time.
+template <class T> inline auto Opaque(T Value) -> T {
+  asm volatile("" : "+m"(Value));
+  return Value;
+}
+
+// Minimal benchmark harness. Every benchmark is run in batches sized so one batch takes at least
+// MinBatchTime, and the per-operation time is taken from the median batch.
+class bench_runner {
+public:
+  struct result {
+    std::string Name;
+    uint64_t Iterations;
+    double MedianNs, MinNs, MeanNs;
+  };
+
+  explicit bench_runner(std::string Filter = "") : Filter(std::move(Filter)) {}
+
+  void Run(const std::string &Name, const std::function<void()> &Body) {
+    if (!Filter.empty() && Name.find(Filter) == std::string::npos) {
+      return;
+    }
+    using clock = std::chrono::steady_clock;
+    auto TimeBatch = [&](uint64_t Batch) {
+      const auto Start = clock::now();
+      for (uint64_t i = 0; i < Batch; i++) {
+        Body();
+      }
+      return std::chrono::duration<double, std::nano>(clock::now() - Start).count();
+    };
+
+    uint64_t Batch = 1;
+    while (TimeBatch(Batch) < MinBatchTime && Batch < (uint64_t{1} << 40)) {
+      Batch *= 2;
+    }
+    std::vector<double> Samples(SampleCount);
+    for (double &Sample : Samples) {
+      Sample = TimeBatch(Batch) / static_cast<double>(Batch);
+    }
+    std::ranges::sort(Samples);
+    double Sum = 0;
+    for (double Sample : Samples) {
+      Sum += Sample;
+    }
+    Results.push_back({.Name = Name,
+                       .Iterations = Batch * SampleCount,
+                       .MedianNs = Samples[SampleCount / 2],
+                       .MinNs = Samples.front(),
+                       .MeanNs = Sum / SampleCount});
+    const result &Result = Results.back();
+    std::cout << std::left << std::setw(40) << Name << std::right << std::setw(14) << std::fixed
+              << std::setprecision(2) << Result.MedianNs << " ns/op (min " << Result.MinNs << ")\n";
+  }
+
+  // One benchmark per line so the file diffs cleanly and can be read back without a JSON library.
+  void WriteJson(const std::string &Path) const {
+    std::ofstream File(Path);
+    if (!File) {
+      throw std::runtime_error("failed to open " + Path);
+    }
+    File << "{\"benchmarks\": [\n";
+    for (size_t i = 0; i < Results.size(); i++) {
+      const result &Result = Results[i];
+      File << "  {\"name\": \"" << Result.Name << "\", \"iterations\": " << Result.Iterations
+           << ", \"median_ns\": " << Result.MedianNs << ", \"min_ns\": " << Result.MinNs
+           << ", \"mean_ns\": " << Result.MeanNs << "}" << (i + 1 == Results.size() ? "\n" : ",\n");
+    }
+    File << "]}\n";
+  }
+
+  // Prints the median against a baseline written by WriteJson. Returns the number of benchmarks that
+  // got slower by more than Threshold (relative).
+  [[nodiscard]] auto CompareTo(const std::string &Path, double Threshold) const -> int {
+    std::ifstream File(Path);
+    if (!File) {
+      throw std::runtime_error("failed to open baseline " + Path);
+    }
+    std::map<std::string, double> Baseline;
+    const std::regex Entry(R"re("name": "([^"]+)".*"median_ns": ([0-9.eE+-]+))re");
+    std::string Line;
+    while (std::getline(File, Line)) {
+      if (std::smatch Match; std::regex_search(Line, Match, Entry)) {
+        Baseline[Match[1]] = std::stod(Match[2]);
+      }
+    }
+
+    int Regressions = 0;
+    std::cout << "\ncomparison against " << Path << '\n';
+    for (const result &Result : Results) {
+      const auto It = Baseline.find(Result.Name);
+      if (It == Baseline.end()) {
+        std::cout << std::left << std::setw(40) << Result.Name << "      (new)\n";
+        continue;
+      }
+      const double Ratio = Result.MedianNs / It->second;
+      const bool Regressed = Ratio > 1 + Threshold;
+      Regressions += static_cast<int>(Regressed);
+      std::cout << std::left << std::setw(40) << Result.Name << std::right << std::setw(10) << std::fixed
+                << std::setprecision(3) << Ratio << "x" << (Regressed ? "  REGRESSION" : "") << '\n';
+    }
+    return Regressions;
+  }
+
+private:
+  static constexpr double MinBatchTime = 2e6; // 2 ms
+  static constexpr uint64_t SampleCount = 15;
+
+  std::string Filter;
+  std::vector<result> Results;
+};
@@ -0,0 +1,217 @@
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "mth/mth.h"
+#include "mth/mth_solver.h"
+
+#ifdef KALAN_BENCH_VULKAN
+#include <vulkan/vulkan.h>
+#endif
+
+namespace {
+void MthBenchmarks(bench_runner &Bench) {
+  const matr A = matr::Translate(vec3(1, 2, 3)) * matr::Scale(vec3(2, 3, 4));
+  const matr B = matr::Scale(0.5F) * matr::Translate(vec3(-4, 5, 6));
+  Bench.Run("mth/matr/multiply", [&] { DoNotOptimize(Opaque(A) * B); });
+  Bench.Run("mth/matr/inverse", [&] { DoNotOptimize(Opaque(A).Inverse()); });
+  const vec3 V(3, -4, 12);
+  Bench.Run("mth/matr/point_transform", [&] { DoNotOptimize(Opaque(A).PointTransform(V)); });
+
+  const vec3 W(-1, 7, 2);
+  Bench.Run("mth/vec3/normalize", [&] {
+    vec3 U = Opaque(V);
+    DoNotOptimize(U.Normalize());
+  });
+  Bench.Run("mth/vec3/cross", [&] { DoNotOptimize(Opaque(V) % W); });
+
+  const quat Q1(1, 0, 0, 0);
+  const quat Q2(0.7071F, 0, 0.7071F, 0);
+  FLT T = 0;
+  Bench.Run("mth/quat/slerp", [&] {
+    T = T > 1 ? 0 : T + 0.001F;
+    DoNotOptimize(quat::SLerp(T, Opaque(Q1), Q2));
+  });
+
+  const ray Ray(vec3(0, 0, 0), vec3(0.1F, 0.2F, 1));
+  const vec3 Center(0, 0, 10);
+  Bench.Run("mth/ray/intersect_sphere", [&] { DoNotOptimize(Opaque(Ray).Intersect(Center, 2)); });
+
+  const noise Noise;
+  FLT X = 0;
+  Bench.Run("mth/noise/noise2d", [&] {
+    X += 0.37F;
+    DoNotOptimize(Noise.Noise2D(X, X * 0.5F));
+  });
+
+  std::array<DBL, 3> Roots{};
+  Bench.Run("mth/solver/square", [&] {
+    mth::solver::SquareSolver(Opaque(1.0), -3, 2, Roots.data());
+    DoNotOptimize(Roots);
+  });
+  Bench.Run("mth/solver/cubic", [&] {
+    mth::solver::CubicSolver(Opaque(1.0), -6, 11, -6, Roots.data());
+    DoNotOptimize(Roots);
+  });
+}
+
+#ifdef KALAN_BENCH_VULKAN
+// Headless setup and submission cost. Runs on whatever device the loader exposes, including lavapipe,
+// and is skipped when there is none.
+void VulkanBenchmarks(bench_runner &Bench) {
+  const VkApplicationInfo AppInfo{
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "Kalan Bench",
+      .apiVersion = VK_API_VERSION_1_0,
+  };
+  const VkInstanceCreateInfo InstanceInfo{
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &AppInfo,
+  };
+  VkInstance Instance = VK_NULL_HANDLE;
+  if (vkCreateInstance(&InstanceInfo, nullptr, &Instance) != VK_SUCCESS) {
+    std::cout << "vulkan: no instance, skipping\n";
+    return;
+  }
+  Bench.Run("vulkan/instance/create_destroy", [&] {
+    VkInstance Temporary = VK_NULL_HANDLE;
+    vkCreateInstance(&InstanceInfo, nullptr, &Temporary);
+    vkDestroyInstance(Temporary, nullptr);
+  });
+
+  uint32_t DeviceCount = 0;
+  vkEnumeratePhysicalDevices(Instance, &DeviceCount, nullptr);
+  std::vector<VkPhysicalDevice> Devices(DeviceCount);
+  vkEnumeratePhysicalDevices(Instance, &DeviceCount, Devices.data());
+  VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+  uint32_t QueueFamily = 0;
+  for (VkPhysicalDevice Candidate : Devices) {
+    uint32_t FamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(Candidate, &FamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> Families(FamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(Candidate, &FamilyCount, Families.data());
+    for (uint32_t i = 0; i < FamilyCount && PhysicalDevice == VK_NULL_HANDLE; i++) {
+      if ((Families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0U) {
+        PhysicalDevice = Candidate;
+        QueueFamily = i;
+      }
+    }
+  }
+  if (PhysicalDevice == VK_NULL_HANDLE) {
+    std::cout << "vulkan: no graphics device, skipping\n";
+    vkDestroyInstance(Instance, nullptr);
+    return;
+  }
+  VkPhysicalDeviceProperties Properties;
+  vkGetPhysicalDeviceProperties(PhysicalDevice, &Properties);
+  std::cout << "vulkan: running on " << Properties.deviceName << '\n';
+
+  const float Priority = 1.0F;
+  const VkDeviceQueueCreateInfo QueueInfo{
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = QueueFamily,
+      .queueCount = 1,
+      .pQueuePriorities = &Priority,
+  };
+  const VkDeviceCreateInfo DeviceInfo{
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &QueueInfo,
+  };
+  Bench.Run("vulkan/device/create_destroy", [&] {
+    VkDevice Temporary = VK_NULL_HANDLE;
+    vkCreateDevice(PhysicalDevice, &DeviceInfo, nullptr, &Temporary);
+    vkDestroyDevice(Temporary, nullptr);
+  });
+
+  VkDevice Device = VK_NULL_HANDLE;
+  if (vkCreateDevice(PhysicalDevice, &DeviceInfo, nullptr, &Device) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create logical device!");
+  }
+  VkQueue Queue = VK_NULL_HANDLE;
+  vkGetDeviceQueue(Device, QueueFamily, 0, &Queue);
+
+  const VkCommandPoolCreateInfo PoolInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = QueueFamily,
+  };
+  VkCommandPool Pool = VK_NULL_HANDLE;
+  vkCreateCommandPool(Device, &PoolInfo, nullptr, &Pool);
+  const VkCommandBufferAllocateInfo AllocateInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = Pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+  };
+  VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+  vkAllocateCommandBuffers(Device, &AllocateInfo, &CommandBuffer);
+  const VkFenceCreateInfo FenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  VkFence Fence = VK_NULL_HANDLE;
+  vkCreateFence(Device, &FenceInfo, nullptr, &Fence);
+
+  const VkCommandBufferBeginInfo BeginInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  Bench.Run("vulkan/submit/record_empty", [&] {
+    vkResetCommandBuffer(CommandBuffer, 0);
+    vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+    vkEndCommandBuffer(CommandBuffer);
+  });
+  const VkSubmitInfo SubmitInfo{
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &CommandBuffer,
+  };
+  Bench.Run("vulkan/submit/submit_wait_fence", [&] {
+    vkQueueSubmit(Queue, 1, &SubmitInfo, Fence);
+    vkWaitForFences(Device, 1, &Fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(Device, 1, &Fence);
+  });
+
+  vkDestroyFence(Device, Fence, nullptr);
+  vkDestroyCommandPool(Device, Pool, nullptr);
+  vkDestroyDevice(Device, nullptr);
+  vkDestroyInstance(Instance, nullptr);
+}
+#endif
+} // namespace
+
+// Usage: KalanBench [--filter substring] [--out results.json] [--baseline baseline.json] [--threshold 0.05]
+// Exits with 1 if any benchmark regressed against the baseline by more than the threshold.
+auto main(int argc, char *argv[]) -> int {
+  std::string Filter;
+  std::string Out = "bench_results.json";
+  std::string Baseline;
+  double Threshold = 0.05;
+  const std::vector<std::string> Args(argv + 1, argv + argc);
+  for (size_t i = 0; i + 1 < Args.size(); i += 2) {
+    if (Args[i] == "--filter") {
+      Filter = Args[i + 1];
+    } else if (Args[i] == "--out") {
+      Out = Args[i + 1];
+    } else if (Args[i] == "--baseline") {
+      Baseline = Args[i + 1];
+    } else if (Args[i] == "--threshold") {
+      Threshold = std::stod(Args[i + 1]);
+    } else {
+      std::cerr << "unknown option " << Args[i] << '\n';
+      return 2;
+    }
+  }
+
+  bench_runner Bench{Filter};
+  MthBenchmarks(Bench);
+#ifdef KALAN_BENCH_VULKAN
+  VulkanBenchmarks(Bench);
+#endif
+  Bench.WriteJson(Out);
+  if (!Baseline.empty() && Bench.CompareTo(Baseline, Threshold) > 0) {
+    return 1;
+  }
+  return 0;
+}
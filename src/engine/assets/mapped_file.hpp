@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. Pages are faulted in by the kernel on first touch,
+// so loading costs I/O only for the bytes actually used.
+class mapped_file {
+public:
+  enum class access_pattern { Sequential, Random };
+
+  explicit mapped_file(const std::string &Path, access_pattern Pattern = access_pattern::Sequential) {
+    const int Descriptor = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (Descriptor < 0) {
+      throw std::runtime_error("failed to open " + Path);
+    }
+    struct stat Stat {};
+    if (fstat(Descriptor, &Stat) != 0) {
+      close(Descriptor);
+      throw std::runtime_error("failed to stat " + Path);
+    }
+    Size = static_cast<size_t>(Stat.st_size);
+    if (Size != 0) {
+      Data = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, Descriptor, 0);
+    }
+    close(Descriptor); // The mapping keeps its own reference
+    if (Data == MAP_FAILED) {
+      Data = nullptr;
+      throw std::runtime_error("failed to map " + Path);
+    }
+    if (Data != nullptr) {
+      madvise(Data, Size, Pattern == access_pattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+  }
+  mapped_file(const mapped_file &) = delete;
+  mapped_file(mapped_file &&) = delete;
+  auto operator=(const mapped_file &) -> mapped_file & = delete;
+  auto operator=(mapped_file &&) -> mapped_file & = delete;
+  ~mapped_file() {
+    if (Data != nullptr) {
+      munmap(Data, Size);
+    }
+  }
+
+  [[nodiscard]] auto Bytes() const -> std::span<const std::byte> { return {static_cast<const std::byte *>(Data), Size}; }
+  // Asks the kernel to start reading a range in the background.
+  void Prefetch(size_t Offset, size_t Length) const {
+    const auto PageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t Begin = Offset / PageSize * PageSize;
+    if (Data != nullptr && Begin < Size) {
+      madvise(static_cast<std::byte *>(Data) + Begin, std::min(Size - Begin, Length + Offset - Begin), MADV_WILLNEED);
+    }
+  }
+
+private:
+  void *Data = nullptr;
+  size_t Size = 0;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "../profiler.hpp"
+#include "mapped_file.hpp"
+#include "mesh_format.hpp"
+
+// A .kmesh file mapped into memory. Nothing is parsed or copied: the spans point straight into the
+// mapping and stay valid for the lifetime of the object.
+class mesh_file {
+public:
+  explicit mesh_file(const std::string &Path) : File(Path) {
+    KPROFILE_SCOPE("mesh_file::load");
+    const std::span<const std::byte> Bytes = File.Bytes();
+    if (Bytes.size() < sizeof(mesh_format::header)) {
+      throw std::runtime_error(Path + ": not a mesh file");
+    }
+    const auto &Header = *reinterpret_cast<const mesh_format::header *>(Bytes.data());
+    if (Header.Magic != mesh_format::Magic || Header.Version != mesh_format::Version ||
+        Header.VertexStride != sizeof(mesh_format::vertex) || Header.FileSize != Bytes.size()) {
+      throw std::runtime_error(Path + ": unsupported or truncated mesh file");
+    }
+    Meshes = Section<mesh_format::mesh>(Path, Header.MeshTableOffset, Header.MeshCount);
+    Vertices = Section<mesh_format::vertex>(Path, Header.VertexOffset, Header.VertexCount);
+    Indices = Section<uint32_t>(Path, Header.IndexOffset, Header.IndexCount);
+    for (const mesh_format::mesh &Mesh : Meshes) {
+      if (uint64_t{Mesh.FirstIndex} + Mesh.IndexCount > Indices.size() || Mesh.VertexOffset < 0 ||
+          uint64_t(Mesh.VertexOffset) + Mesh.VertexCount > Vertices.size()) {
+        throw std::runtime_error(Path + ": mesh range out of bounds");
+      }
+    }
+    // The streams are about to be copied to the GPU, start reading them now
+    File.Prefetch(Header.VertexOffset, Header.IndexOffset + Header.IndexCount * sizeof(uint32_t) - Header.VertexOffset);
+  }
+
+  [[nodiscard]] auto GetMeshes() const -> std::span<const mesh_format::mesh> { return Meshes; }
+  [[nodiscard]] auto GetVertices() const -> std::span<const mesh_format::vertex> { return Vertices; }
+  [[nodiscard]] auto GetIndices() const -> std::span<const uint32_t> { return Indices; }
+  [[nodiscard]] auto VertexBytes() const -> std::span<const std::byte> { return std::as_bytes(Vertices); }
+  [[nodiscard]] auto IndexBytes() const -> std::span<const std::byte> { return std::as_bytes(Indices); }
+
+  [[nodiscard]] auto Find(std::string_view Name) const -> const mesh_format::mesh * {
+    for (const mesh_format::mesh &Mesh : Meshes) {
+      if (Name == std::string_view(Mesh.Name.data(), strnlen(Mesh.Name.data(), Mesh.Name.size()))) {
+        return &Mesh;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  mapped_file File;
+
+  template <class T> auto Section(const std::string &Path, uint64_t Offset, uint64_t Count) const -> std::span<const T> {
+    const std::span<const std::byte> Bytes = File.Bytes();
+    if (Offset % mesh_format::Alignment != 0 || Offset > Bytes.size() || Count > (Bytes.size() - Offset) / sizeof(T)) {
+      throw std::runtime_error(Path + ": section out of bounds");
+    }
+    return {reinterpret_cast<const T *>(Bytes.data() + Offset), static_cast<size_t>(Count)};
+  }
+
+  std::span<const mesh_format::mesh> Meshes;
+  std::span<const mesh_format::vertex> Vertices;
+  std::span<const uint32_t> Indices;
+};
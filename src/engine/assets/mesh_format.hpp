@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// On-disk layout of .kmesh files, written by tools/meshconv and mapped as-is at runtime.
+//
+//   header                                     at 0
+//   mesh[MeshCount]                            at MeshTableOffset
+//   vertex[VertexCount]                        at VertexOffset
+//   uint32_t[IndexCount]                       at IndexOffset
+//
+// Every section starts on an Alignment boundary, all values are little-endian. Index values are
+// relative to the mesh's VertexOffset, so the streams can be copied straight into GPU buffers and drawn
+// with vkCmdDrawIndexed(IndexCount, 1, FirstIndex, VertexOffset, 0).
+namespace mesh_format {
+inline constexpr std::array<char, 4> Magic = {'K', 'M', 'S', 'H'};
+inline constexpr uint32_t Version = 1;
+inline constexpr uint64_t Alignment = 16;
+
+struct header {
+  std::array<char, 4> Magic;
+  uint32_t Version;
+  uint32_t MeshCount;
+  uint32_t VertexStride; // sizeof(vertex), checked on load
+  uint64_t MeshTableOffset;
+  uint64_t VertexOffset;
+  uint64_t VertexCount;
+  uint64_t IndexOffset;
+  uint64_t IndexCount;
+  uint64_t FileSize;
+};
+static_assert(sizeof(header) == 64);
+
+struct vertex {
+  std::array<float, 3> Position;
+  std::array<float, 3> Normal;
+  std::array<float, 2> UV;
+};
+static_assert(sizeof(vertex) == 32);
+
+// Both an AABB and a bounding sphere, so culling can pick whichever test is cheaper.
+struct bounds {
+  std::array<float, 3> Center;
+  float Radius;
+  std::array<float, 3> Min;
+  float Pad0;
+  std::array<float, 3> Max;
+  float Pad1;
+};
+static_assert(sizeof(bounds) == 48);
+
+struct mesh {
+  std::array<char, 32> Name; // Zero terminated, truncated if longer
+  uint32_t FirstIndex;
+  uint32_t IndexCount;
+  int32_t VertexOffset;
+  uint32_t VertexCount;
+  bounds Bounds;
+};
+static_assert(sizeof(mesh) == 96);
+static_assert(sizeof(mesh) % Alignment == 0 && sizeof(header) % Alignment == 0);
+
+constexpr auto AlignUp(uint64_t Value) -> uint64_t { return (Value + Alignment - 1) & ~(Alignment - 1); }
+} // namespace mesh_format
@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "../profiler.hpp"
+#include "mapped_file.hpp"
+
+// A block-compressed texture (KTX2 or DDS) mapped into memory. Mip levels are spans into the mapping,
+// so a level costs I/O only when it is actually uploaded. Only BC1-BC7 2D textures are accepted; any
+// other layout is an authoring error and is rejected at load time.
+class texture_file {
+public:
+  struct level {
+    uint32_t Width, Height;
+    std::span<const std::byte> Data;
+  };
+  // Levels at or below this size form the mip tail that stays resident for as long as the texture is loaded.
+  static constexpr size_t MipTailBytes = 64 * 1024;
+
+  explicit texture_file(const std::string &Path) : File(Path, mapped_file::access_pattern::Random) {
+    KPROFILE_SCOPE("texture_file::load");
+    const std::span<const std::byte> Bytes = File.Bytes();
+    static constexpr std::array<uint8_t, 12> Ktx2Magic = {0xAB, 'K', 'T', 'X', ' ', '2',
+                                                          '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+    if (Bytes.size() >= Ktx2Magic.size() && std::memcmp(Bytes.data(), Ktx2Magic.data(), Ktx2Magic.size()) == 0) {
+      LoadKtx2(Path, Bytes);
+    } else if (Bytes.size() >= 4 && std::memcmp(Bytes.data(), "DDS ", 4) == 0) {
+      LoadDds(Path, Bytes);
+    } else {
+      throw std::runtime_error(Path + ": not a KTX2 or DDS file");
+    }
+    if (BlockBytes(Format) == 0) {
+      throw std::runtime_error(Path + ": only BC1-BC7 textures are supported");
+    }
+    MipTail = static_cast<uint32_t>(Levels.size() - 1);
+    while (MipTail > 0 && Levels[MipTail - 1].Data.size() <= MipTailBytes) {
+      MipTail--;
+    }
+  }
+
+  [[nodiscard]] auto GetFormat() const -> VkFormat { return Format; }
+  [[nodiscard]] auto GetLevels() const -> std::span<const level> { return Levels; }
+  [[nodiscard]] auto LevelCount() const -> uint32_t { return static_cast<uint32_t>(Levels.size()); }
+  // First level of the mip tail; levels below it are streamed.
+  [[nodiscard]] auto MipTailStart() const -> uint32_t { return MipTail; }
+  // Starts reading a level in the background ahead of its upload.
+  void Prefetch(uint32_t Level) const {
+    const std::span<const std::byte> Data = Levels[Level].Data;
+    File.Prefetch(static_cast<size_t>(Data.data() - File.Bytes().data()), Data.size());
+  }
+
+  // Bytes per 4x4 block, or 0 if the format is not block compressed.
+  static constexpr auto BlockBytes(VkFormat Format) -> uint32_t {
+    switch (Format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+      return 8;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return 16;
+    default:
+      return 0;
+    }
+  }
+
+private:
+  mapped_file File;
+  VkFormat Format = VK_FORMAT_UNDEFINED;
+  std::vector<level> Levels;
+  uint32_t MipTail = 0;
+
+  template <class T> static auto Read(std::span<const std::byte> Bytes, size_t Offset) -> T {
+    T Value{};
+    std::memcpy(&Value, Bytes.data() + Offset, sizeof(T));
+    return Value;
+  }
+  static auto LevelSize(VkFormat Format, uint32_t Width, uint32_t Height) -> size_t {
+    return size_t{(Width + 3) / 4} * ((Height + 3) / 4) * BlockBytes(Format);
+  }
+  void AddLevel(const std::string &Path, std::span<const std::byte> Bytes, uint64_t Offset, uint32_t Width,
+                uint32_t Height) {
+    const size_t Size = LevelSize(Format, Width, Height);
+    if (Offset > Bytes.size() || Size > Bytes.size() - Offset) {
+      throw std::runtime_error(Path + ": mip level out of bounds");
+    }
+    Levels.push_back({.Width = Width, .Height = Height, .Data = Bytes.subspan(static_cast<size_t>(Offset), Size)});
+  }
+
+  void LoadKtx2(const std::string &Path, std::span<const std::byte> Bytes) {
+    static constexpr size_t HeaderSize = 80, LevelIndexEntry = 24;
+    if (Bytes.size() < HeaderSize) {
+      throw std::runtime_error(Path + ": truncated KTX2 header");
+    }
+    Format = static_cast<VkFormat>(Read<uint32_t>(Bytes, 12));
+    const auto Width = Read<uint32_t>(Bytes, 20);
+    const auto Height = Read<uint32_t>(Bytes, 24);
+    const auto Depth = Read<uint32_t>(Bytes, 28);
+    const auto Layers = Read<uint32_t>(Bytes, 32);
+    const auto Faces = Read<uint32_t>(Bytes, 36);
+    const uint32_t LevelCount = std::max(Read<uint32_t>(Bytes, 40), 1U);
+    const auto Supercompression = Read<uint32_t>(Bytes, 44);
+    if (Depth > 1 || Layers > 1 || Faces != 1 || Supercompression != 0 || Width == 0 || Height == 0) {
+      throw std::runtime_error(Path + ": only plain 2D KTX2 textures are supported");
+    }
+    if (Bytes.size() < HeaderSize + LevelCount * LevelIndexEntry) {
+      throw std::runtime_error(Path + ": truncated KTX2 level index");
+    }
+    for (uint32_t i = 0; i < LevelCount; i++) {
+      AddLevel(Path, Bytes, Read<uint64_t>(Bytes, HeaderSize + i * LevelIndexEntry), std::max(Width >> i, 1U),
+               std::max(Height >> i, 1U));
+    }
+  }
+
+  void LoadDds(const std::string &Path, std::span<const std::byte> Bytes) {
+    static constexpr size_t HeaderEnd = 4 + 124, Dx10End = HeaderEnd + 20;
+    if (Bytes.size() < HeaderEnd) {
+      throw std::runtime_error(Path + ": truncated DDS header");
+    }
+    const auto Height = Read<uint32_t>(Bytes, 12);
+    const auto Width = Read<uint32_t>(Bytes, 16);
+    const uint32_t LevelCount = std::max(Read<uint32_t>(Bytes, 28), 1U);
+    const auto FourCC = Read<std::array<char, 4>>(Bytes, 84);
+    auto Is = [&](const char *Code) { return std::memcmp(FourCC.data(), Code, 4) == 0; };
+    size_t Offset = HeaderEnd;
+    if (Is("DX10")) {
+      if (Bytes.size() < Dx10End || Read<uint32_t>(Bytes, HeaderEnd + 12) > 1) {
+        throw std::runtime_error(Path + ": truncated DDS header or texture array");
+      }
+      Format = FromDxgi(Read<uint32_t>(Bytes, HeaderEnd));
+      Offset = Dx10End;
+    } else if (Is("DXT1")) {
+      Format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    } else if (Is("DXT3")) {
+      Format = VK_FORMAT_BC2_UNORM_BLOCK;
+    } else if (Is("DXT5")) {
+      Format = VK_FORMAT_BC3_UNORM_BLOCK;
+    } else if (Is("ATI1") || Is("BC4U")) {
+      Format = VK_FORMAT_BC4_UNORM_BLOCK;
+    } else if (Is("ATI2") || Is("BC5U")) {
+      Format = VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+    if (BlockBytes(Format) == 0 || Width == 0 || Height == 0) {
+      return; // Rejected by the caller
+    }
+    // DDS levels are stored back to back, largest first
+    for (uint32_t i = 0; i < LevelCount; i++) {
+      const uint32_t W = std::max(Width >> i, 1U), H = std::max(Height >> i, 1U);
+      AddLevel(Path, Bytes, Offset, W, H);
+      Offset += LevelSize(Format, W, H);
+    }
+  }
+
+  static auto FromDxgi(uint32_t DxgiFormat) -> VkFormat {
+    switch (DxgiFormat) {
+    case 71:
+      return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case 72:
+      return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case 74:
+      return VK_FORMAT_BC2_UNORM_BLOCK;
+    case 75:
+      return VK_FORMAT_BC2_SRGB_BLOCK;
+    case 77:
+      return VK_FORMAT_BC3_UNORM_BLOCK;
+    case 78:
+      return VK_FORMAT_BC3_SRGB_BLOCK;
+    case 80:
+      return VK_FORMAT_BC4_UNORM_BLOCK;
+    case 81:
+      return VK_FORMAT_BC4_SNORM_BLOCK;
+    case 83:
+      return VK_FORMAT_BC5_UNORM_BLOCK;
+    case 84:
+      return VK_FORMAT_BC5_SNORM_BLOCK;
+    case 95:
+      return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    case 96:
+      return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+    case 98:
+      return VK_FORMAT_BC7_UNORM_BLOCK;
+    case 99:
+      return VK_FORMAT_BC7_SRGB_BLOCK;
+    default:
+      return VK_FORMAT_UNDEFINED;
+    }
+  }
+};
@@ -0,0 +1,243 @@
+#pragma once
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "log.hpp"
+
+// Validation layers and the debug messenger only exist in builds with KALAN_VALIDATION set, which is the
+// default unless NDEBUG is defined. Release builds compile them out and ignore the settings below.
+#ifndef KALAN_VALIDATION
+#ifdef NDEBUG
+#define KALAN_VALIDATION 0
+#else
+#define KALAN_VALIDATION 1
+#endif
+#endif
+
+enum class renderer_backend : uint8_t { Vulkan, Software };
+
+// Engine settings, read once at startup. Each layer overrides the one before it:
+//  1. the defaults below;
+//  2. the config file, kalan.cfg in the working directory unless KALAN_CONFIG or --config names another;
+//  3. environment variables, the key in upper case with a KALAN_ prefix, e.g. KALAN_PRESENT_MODE=mailbox;
+//  4. the command line, as --key=value or --key value.
+// The file holds one "key = value" per line; '#' starts a comment. Unknown keys and unparsable values are
+// logged and skipped, so a stale config never stops the engine from starting.
+struct engine_config {
+  renderer_backend Renderer = renderer_backend::Vulkan; // software rasterizes on the CPU, for hosts without a GPU
+  bool Validation = KALAN_VALIDATION != 0; // VK_LAYER_KHRONOS_validation
+  bool DebugMessenger = KALAN_VALIDATION != 0;
+  VkDebugUtilsMessageSeverityFlagBitsEXT DebugSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+  std::vector<int32_t> MutedMessages; // Validation message IDs never reported, e.g. 0x609a13b
+  uint32_t FramesInFlight = 2;
+  VkPresentModeKHR PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+  uint32_t Width = 1920;
+  uint32_t Height = 1080;
+  uint32_t WorkerThreads = 0; // 0 picks one less than the hardware threads
+  uint32_t MaxFps = 300;      // Caps the render loop when nothing else paces it, e.g. without vsync; 0 for none
+  // Watches the shader sources and rebuilds pipelines when they change; off in release builds by default
+  bool ShaderHotReload = KALAN_VALIDATION != 0;
+  log_level LogLevel = log_level::Info;
+
+  static auto Load(int argc, char *argv[]) -> engine_config {
+    engine_config Config;
+    std::string Path = "kalan.cfg";
+    if (const char *Env = std::getenv("KALAN_CONFIG"); Env != nullptr) {
+      Path = Env;
+    }
+    const std::vector<std::pair<std::string, std::string>> Arguments = ParseArguments(argc, argv);
+    for (const auto &[Key, Value] : Arguments) {
+      if (Key == "config") {
+        Path = Value;
+      }
+    }
+
+    if (std::ifstream File(Path); File) {
+      int LineNumber = 0;
+      for (std::string Line; std::getline(File, Line);) {
+        LineNumber++;
+        Line = Line.substr(0, Line.find('#'));
+        const size_t Equals = Line.find('=');
+        if (Trim(Line).empty()) {
+          continue;
+        }
+        if (Equals == std::string::npos) {
+          KLOG(Warning, Engine, "{}:{}: expected key = value", Path, LineNumber);
+          continue;
+        }
+        Config.Set(Trim(std::string_view(Line).substr(0, Equals)), Trim(std::string_view(Line).substr(Equals + 1)));
+      }
+    }
+    for (std::string_view Key : Keys) {
+      std::string Name = "KALAN_";
+      for (char C : Key) {
+        Name += static_cast<char>(std::toupper(static_cast<unsigned char>(C)));
+      }
+      if (const char *Env = std::getenv(Name.c_str()); Env != nullptr) {
+        Config.Set(Key, Env);
+      }
+    }
+    for (const auto &[Key, Value] : Arguments) {
+      if (Key != "config") {
+        Config.Set(Key, Value);
+      }
+    }
+
+#if !KALAN_VALIDATION
+    if (Config.Validation || Config.DebugMessenger) {
+      KLOG(Warning, Engine, "validation is compiled out of this build, ignoring the setting");
+    }
+    Config.Validation = Config.DebugMessenger = false;
+#endif
+    logger::Get().SetLevel(Config.LogLevel);
+    return Config;
+  }
+
+private:
+  static constexpr std::array<std::string_view, 13> Keys = {
+      "renderer", "validation", "debug_messenger", "debug_severity", "mute_messages", "frames_in_flight",
+      "present_mode", "width", "height", "worker_threads", "max_fps", "shader_hot_reload", "log_level"};
+
+  static auto Trim(std::string_view Text) -> std::string_view {
+    const size_t First = Text.find_first_not_of(" \t\r");
+    if (First == std::string_view::npos) {
+      return {};
+    }
+    return Text.substr(First, Text.find_last_not_of(" \t\r") - First + 1);
+  }
+
+  static auto ParseArguments(int argc, char *argv[]) -> std::vector<std::pair<std::string, std::string>> {
+    std::vector<std::pair<std::string, std::string>> Arguments;
+    for (int i = 1; i < argc; i++) {
+      const std::string_view Argument = argv[i];
+      if (!Argument.starts_with("--")) {
+        KLOG(Warning, Engine, "ignoring argument {}", Argument);
+        continue;
+      }
+      const size_t Equals = Argument.find('=');
+      if (Equals != std::string_view::npos) {
+        Arguments.emplace_back(Argument.substr(2, Equals - 2), Argument.substr(Equals + 1));
+      } else if (i + 1 < argc) {
+        Arguments.emplace_back(Argument.substr(2), argv[++i]);
+      } else {
+        KLOG(Warning, Engine, "{} needs a value", Argument);
+      }
+    }
+    return Arguments;
+  }
+
+  static auto ParseNumber(std::string_view Text, uint32_t Min, uint32_t Max, uint32_t &Out) -> bool {
+    uint32_t Number = 0;
+    const auto [End, Error] = std::from_chars(Text.data(), Text.data() + Text.size(), Number);
+    if (Error != std::errc{} || End != Text.data() + Text.size() || Number < Min || Number > Max) {
+      return false;
+    }
+    Out = Number;
+    return true;
+  }
+  static auto ParseBool(std::string_view Text, bool &Out) -> bool {
+    if (Text == "1" || Text == "true" || Text == "on") {
+      Out = true;
+    } else if (Text == "0" || Text == "false" || Text == "off") {
+      Out = false;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  // Decimal, or hex with 0x, as validation messages print their IDs
+  static auto ParseIds(std::string_view Text, std::vector<int32_t> &Out) -> bool {
+    std::vector<int32_t> Ids;
+    while (!Text.empty()) {
+      const size_t Comma = Text.find(',');
+      std::string_view Item = Trim(Text.substr(0, Comma));
+      Text = Comma == std::string_view::npos ? std::string_view{} : Text.substr(Comma + 1);
+      const int Base = Item.starts_with("0x") ? 16 : 10;
+      Item.remove_prefix(Base == 16 ? 2 : 0);
+      uint32_t Id = 0; // IDs are hashes and print as unsigned
+      const auto [End, Error] = std::from_chars(Item.data(), Item.data() + Item.size(), Id, Base);
+      if (Error != std::errc{} || End != Item.data() + Item.size()) {
+        return false;
+      }
+      Ids.push_back(static_cast<int32_t>(Id));
+    }
+    Out = std::move(Ids);
+    return true;
+  }
+  template <typename Type>
+  static auto ParseEnum(std::string_view Text, std::initializer_list<std::pair<std::string_view, Type>> Names,
+                        Type &Out) -> bool {
+    for (const auto &[Name, Value] : Names) {
+      if (Text == Name) {
+        Out = Value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Set(std::string_view Key, std::string_view Value) {
+    bool Ok = true;
+    if (Key == "renderer") {
+      Ok = ParseEnum<renderer_backend>(
+          Value, {{"vulkan", renderer_backend::Vulkan}, {"software", renderer_backend::Software}}, Renderer);
+    } else if (Key == "validation") {
+      Ok = ParseBool(Value, Validation);
+    } else if (Key == "debug_messenger") {
+      Ok = ParseBool(Value, DebugMessenger);
+    } else if (Key == "debug_severity") {
+      Ok = ParseEnum<VkDebugUtilsMessageSeverityFlagBitsEXT>(
+          Value,
+          {{"verbose", VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT},
+           {"info", VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT},
+           {"warning", VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT},
+           {"error", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT}},
+          DebugSeverity);
+    } else if (Key == "mute_messages") {
+      Ok = ParseIds(Value, MutedMessages);
+    } else if (Key == "frames_in_flight") {
+      Ok = ParseNumber(Value, 1, 4, FramesInFlight);
+    } else if (Key == "present_mode") {
+      Ok = ParseEnum<VkPresentModeKHR>(Value,
+                                       {{"fifo", VK_PRESENT_MODE_FIFO_KHR},
+                                        {"fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+                                        {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+                                        {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR}},
+                                       PresentMode);
+    } else if (Key == "width") {
+      Ok = ParseNumber(Value, 1, 16384, Width);
+    } else if (Key == "height") {
+      Ok = ParseNumber(Value, 1, 16384, Height);
+    } else if (Key == "worker_threads") {
+      Ok = ParseNumber(Value, 0, 256, WorkerThreads);
+    } else if (Key == "max_fps") {
+      Ok = ParseNumber(Value, 0, 10000, MaxFps);
+    } else if (Key == "shader_hot_reload") {
+      Ok = ParseBool(Value, ShaderHotReload);
+    } else if (Key == "log_level") {
+      Ok = ParseEnum<log_level>(Value,
+                                {{"trace", log_level::Trace},
+                                 {"debug", log_level::Debug},
+                                 {"info", log_level::Info},
+                                 {"warning", log_level::Warning},
+                                 {"error", log_level::Error},
+                                 {"off", log_level::Off}},
+                                LogLevel);
+    } else {
+      KLOG(Warning, Engine, "unknown setting {}", Key);
+      return;
+    }
+    if (!Ok) {
+      KLOG(Warning, Engine, "bad value for {}: {}", Key, Value);
+    }
+  }
+};
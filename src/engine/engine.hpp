@@ -5,21 +5,33 @@
 #include <SDL2/SDL_vulkan.h>
 #include <vulkan/vulkan.h>
 
+#include <atomic>
 #include <cassert>
 #include <iostream>
 #include <thread>
 
+#include "config.hpp"
+#include "frame_timer.hpp"
+#include "job_system.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+#include "shader/shader_library.hpp"
+#include "simulation.hpp"
+#include "software/software_renderer.hpp"
 #include "vulkan/vulkan.hpp"
 class sdl {
 public:
   SDL_Window *Window;
-  sdl() {
+  sdl(uint32_t Width, uint32_t Height, renderer_backend Renderer) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
       throw std::runtime_error("Failed to initialize SDL:" + std::string(SDL_GetError()));
     }
-    Window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1920, 1080,
-                              SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-    SDL_Vulkan_LoadLibrary(nullptr);
+    const Uint32 Api = Renderer == renderer_backend::Vulkan ? SDL_WINDOW_VULKAN : 0;
+    Window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, static_cast<int>(Width),
+                              static_cast<int>(Height), Api | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (Renderer == renderer_backend::Vulkan) {
+      SDL_Vulkan_LoadLibrary(nullptr);
+    }
     if (Window == nullptr) {
       std::cout << SDL_GetError() << std::endl;
       throw std::runtime_error("Failed to create window");
@@ -36,21 +48,92 @@ public:
 };
 class engine { // NOLINT
 private:
-  sdl SDL;
-  vulkan Vulkan;
+  engine_config Config;
+  sdl SDL{Config.Width, Config.Height, Config.Renderer};
+  job_system Jobs{Config.WorkerThreads != 0 ? Config.WorkerThreads
+                                            : std::max(2U, std::thread::hardware_concurrency()) - 1};
+  shader_library Shaders{Jobs, KALAN_SHADER_DIR, ".shader_cache", Config.ShaderHotReload};
+  std::unique_ptr<vulkan> Vulkan; // Exactly one of these, per Config.Renderer
+  std::unique_ptr<software_renderer> Software;
+  input_queue Input;
+  simulation Simulation{Input, Jobs};
+  std::atomic<bool> IsRendering{true};
+  frame_timer FrameTimer;
+  std::atomic<bool> ExportFrameStats{false};
+
+  void WriteFrameStats() {
+    const frame_timer::summary Cpu = FrameTimer.CpuSummary();
+    KLOG(Info, Render, "cpu frame ms p50 {:.2f} p95 {:.2f} p99 {:.2f} max {:.2f}, {} hitches", Cpu.P50, Cpu.P95,
+         Cpu.P99, Cpu.Max, FrameTimer.HitchCount());
+    FrameTimer.ExportCsv("frame_times.csv");
+    FrameTimer.ExportJson("frame_times.json");
+  }
+
+  void RenderLoop(const std::stop_token &Stop) {
+    int frame_number = 0;
+    KPROFILE_THREAD("render");
+    const auto FrameInterval = Config.MaxFps != 0 ? sim_clock::duration{std::chrono::seconds{1}} / Config.MaxFps
+                                                  : sim_clock::duration::zero();
+    auto NextFrame = sim_clock::now();
+    while (!Stop.stop_requested()) {
+      // do not draw if we are minimized
+      if (!IsRendering) {
+        FrameTimer.Pause();
+        IsRendering.wait(false);
+      }
+      if (Stop.stop_requested()) {
+        break;
+      }
+      KPROFILE_FRAME();
+      const world_state State = Simulation.Sample(sim_clock::now());
+      {
+        KPROFILE_SCOPE("engine::Render");
+        if (Vulkan) {
+          Vulkan->Render();
+        } else {
+          Software->Render();
+        }
+      }
+      FrameTimer.Tick(Vulkan ? Vulkan->GetGpuTime() : std::nullopt);
+      if (ExportFrameStats.exchange(false)) {
+        WriteFrameStats();
+      }
+      KLOG(Trace, Render, "rendered frame {} at tick {}", frame_number, State.Tick);
+      frame_number++;
+      // Vsync and the frame fences pace the GPU path; this keeps a loop without them from spinning a core
+      NextFrame = std::max(NextFrame + FrameInterval, sim_clock::now()); // A slow frame is not made up for
+      std::this_thread::sleep_until(NextFrame);
+    }
+  }
 
 public:
-  engine() : Vulkan{SDL.Window} { std::cout << "Engine constructed!\n"; }
+  // Settings come from kalan.cfg, KALAN_* environment variables and --key=value arguments, see engine_config.
+  engine(int argc, char *argv[]) : Config(engine_config::Load(argc, argv)) {
+    if (Config.Renderer == renderer_backend::Software) {
+      Software = std::make_unique<software_renderer>(SDL.Window, Jobs);
+    } else {
+      Vulkan = std::make_unique<vulkan>(SDL.Window, Shaders, Config);
+    }
+    KLOG(Info, Engine, "Engine constructed!");
+  }
 
+  // The calling thread only samples input; simulation and rendering run on their own threads,
+  // so neither render jitter nor a slow frame delays input or perturbs the fixed timestep.
   void Run() {
-    using namespace std::chrono_literals;
+    constexpr int IdleTimeoutMs = 100;
+    std::jthread SimulationThread{[this](const std::stop_token &Stop) { Simulation.Run(Stop); }};
+    std::jthread RenderThread{[this](const std::stop_token &Stop) { RenderLoop(Stop); }};
+
+    KPROFILE_THREAD("input");
     SDL_Event Event;
     bool bQuit = false;
-    bool IsRendering = true;
-    int frame_number = 0;
     while (!bQuit) {
-      // Handle events on queue
-      while (SDL_PollEvent(&Event) != 0) {
+      // Block until something happens instead of polling and sleeping
+      if (SDL_WaitEventTimeout(&Event, IdleTimeoutMs) == 0) {
+        continue;
+      }
+      KPROFILE_SCOPE("engine::PollEvents");
+      do {
         switch (Event.type) {
         case SDL_QUIT:
           bQuit = true;
@@ -61,18 +144,25 @@ public:
           }
           if (Event.window.event == SDL_WINDOWEVENT_RESTORED) {
             IsRendering = true;
+            IsRendering.notify_all();
+          }
+          break;
+        case SDL_KEYDOWN:
+          if (Event.key.keysym.sym == SDLK_F12) {
+            ExportFrameStats = true;
           }
         }
-      }
-      // do not draw if we are minimized
-      if (IsRendering) {
-        Vulkan.Render();
-        std::cout << "rendered frame " << frame_number++ << std::endl;
-        std::cout << "Enough. finishing";
-        IsRendering = false;
-      } else {
-        std::this_thread::sleep_for(100ms);
-      }
+        Input.Push(Event);
+      } while (SDL_PollEvent(&Event) != 0);
     }
+
+    SimulationThread.request_stop();
+    RenderThread.request_stop();
+    IsRendering = true;
+    IsRendering.notify_all();
+    SimulationThread.join();
+    RenderThread.join();
+    WriteFrameStats();
+    KPROFILE_EXPORT("kalan_trace.json");
   }
 };
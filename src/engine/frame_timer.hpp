@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Histogram over the last WindowSize samples with logarithmic buckets, so percentiles stay O(buckets)
+// no matter how long the window is. Resolution is about 3% of the value between MinMs and MaxMs.
+class rolling_histogram {
+public:
+  static constexpr size_t BucketCount = 256;
+  static constexpr double MinMs = 0.05;
+  static constexpr double MaxMs = 2000.0;
+
+  explicit rolling_histogram(size_t WindowSize = 1024) : Window(WindowSize) {}
+
+  void Add(double Ms) {
+    if (Count == Window.size()) {
+      Buckets[BucketOf(Window[Next])]--;
+    } else {
+      Count++;
+    }
+    Window[Next] = Ms;
+    Next = (Next + 1) % Window.size();
+    Buckets[BucketOf(Ms)]++;
+  }
+
+  // Upper edge of the bucket holding the P-th percentile, P in [0, 1].
+  [[nodiscard]] auto Percentile(double P) const -> double {
+    if (Count == 0) {
+      return 0;
+    }
+    const auto Rank = static_cast<size_t>(std::ceil(P * static_cast<double>(Count)));
+    size_t Seen = 0;
+    for (size_t i = 0; i < BucketCount; i++) {
+      Seen += Buckets[i];
+      if (Seen >= std::max<size_t>(Rank, 1)) {
+        return std::min(UpperEdge(i), Max());
+      }
+    }
+    return Max();
+  }
+  // Exact, not bucketed: the tail is what people look at.
+  [[nodiscard]] auto Max() const -> double {
+    return Count == 0 ? 0 : *std::max_element(Window.begin(), Window.begin() + static_cast<ptrdiff_t>(Count));
+  }
+  [[nodiscard]] auto Size() const -> size_t { return Count; }
+
+private:
+  std::vector<double> Window;
+  size_t Next = 0, Count = 0;
+  std::array<uint32_t, BucketCount> Buckets{};
+
+  static auto BucketOf(double Ms) -> size_t {
+    const double T = std::log(std::clamp(Ms, MinMs, MaxMs) / MinMs) / std::log(MaxMs / MinMs);
+    return std::min(static_cast<size_t>(T * BucketCount), BucketCount - 1);
+  }
+  static auto UpperEdge(size_t Bucket) -> double {
+    return MinMs * std::pow(MaxMs / MinMs, static_cast<double>(Bucket + 1) / BucketCount);
+  }
+};
+
+// Per-frame CPU and GPU times with rolling percentiles, hitch detection against a frame budget
+// and CSV/JSON export of the full history.
+class frame_timer {
+public:
+  struct sample {
+    uint64_t Frame;
+    double CpuMs;
+    std::optional<double> GpuMs; // Empty when the device has no timestamp support
+    bool Hitch;
+  };
+  struct summary {
+    size_t Frames;
+    double P50, P95, P99, Max;
+  };
+
+  explicit frame_timer(double BudgetMs = 1000.0 / 60.0, size_t WindowSize = 1024)
+      : BudgetMs(BudgetMs), Cpu(WindowSize), Gpu(WindowSize) {
+    History.reserve(size_t{1} << 14);
+  }
+
+  // Call once per frame, at the same point of the loop. Returns the CPU time of the previous frame.
+  auto Tick(std::optional<double> GpuMs) -> double {
+    const auto Now = std::chrono::steady_clock::now();
+    if (!LastTick) {
+      LastTick = Now;
+      return 0;
+    }
+    const double CpuMs = std::chrono::duration<double, std::milli>(Now - *LastTick).count();
+    LastTick = Now;
+
+    std::scoped_lock Lock{Mutex};
+    const bool Hitch = CpuMs > BudgetMs || (GpuMs && *GpuMs > BudgetMs);
+    Hitches += static_cast<uint64_t>(Hitch);
+    Cpu.Add(CpuMs);
+    if (GpuMs) {
+      Gpu.Add(*GpuMs);
+    }
+    if (History.size() < MaxHistory) {
+      History.push_back({.Frame = FrameCount, .CpuMs = CpuMs, .GpuMs = GpuMs, .Hitch = Hitch});
+    }
+    FrameCount++;
+    return CpuMs;
+  }
+
+  // Forget the last tick so time spent paused (minimized) is not reported as one long frame.
+  void Pause() { LastTick.reset(); }
+
+  [[nodiscard]] auto CpuSummary() const -> summary {
+    std::scoped_lock Lock{Mutex};
+    return Summarize(Cpu);
+  }
+  [[nodiscard]] auto GpuSummary() const -> summary {
+    std::scoped_lock Lock{Mutex};
+    return Summarize(Gpu);
+  }
+  [[nodiscard]] auto HitchCount() const -> uint64_t {
+    std::scoped_lock Lock{Mutex};
+    return Hitches;
+  }
+
+  void ExportCsv(const std::string &Path) const {
+    std::ofstream File = Open(Path);
+    std::scoped_lock Lock{Mutex};
+    File << "frame,cpu_ms,gpu_ms,hitch\n";
+    for (const sample &Sample : History) {
+      File << Sample.Frame << ',' << Sample.CpuMs << ',';
+      if (Sample.GpuMs) {
+        File << *Sample.GpuMs;
+      }
+      File << ',' << static_cast<int>(Sample.Hitch) << '\n';
+    }
+  }
+  void ExportJson(const std::string &Path) const {
+    std::ofstream File = Open(Path);
+    std::scoped_lock Lock{Mutex};
+    auto Write = [&](const char *Name, const summary &Summary) {
+      File << '"' << Name << "\": {\"frames\": " << Summary.Frames << ", \"p50_ms\": " << Summary.P50
+           << ", \"p95_ms\": " << Summary.P95 << ", \"p99_ms\": " << Summary.P99 << ", \"max_ms\": " << Summary.Max
+           << '}';
+    };
+    File << "{\"budget_ms\": " << BudgetMs << ", \"frames\": " << FrameCount << ", \"hitches\": " << Hitches
+         << ",\n ";
+    Write("cpu", Summarize(Cpu));
+    File << ",\n ";
+    Write("gpu", Summarize(Gpu));
+    File << "\n}\n";
+  }
+
+private:
+  static constexpr size_t MaxHistory = size_t{1} << 20; // A bit over two hours at 120 Hz
+
+  double BudgetMs;
+  mutable std::mutex Mutex;
+  rolling_histogram Cpu, Gpu;
+  std::vector<sample> History;
+  std::optional<std::chrono::steady_clock::time_point> LastTick;
+  uint64_t FrameCount = 0, Hitches = 0;
+
+  static auto Summarize(const rolling_histogram &Histogram) -> summary {
+    return {.Frames = Histogram.Size(),
+            .P50 = Histogram.Percentile(0.50),
+            .P95 = Histogram.Percentile(0.95),
+            .P99 = Histogram.Percentile(0.99),
+            .Max = Histogram.Max()};
+  }
+  static auto Open(const std::string &Path) -> std::ofstream {
+    std::ofstream File(Path);
+    if (!File) {
+      throw std::runtime_error("failed to open " + Path);
+    }
+    return File;
+  }
+};
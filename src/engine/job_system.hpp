@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+
+// Fixed pool of worker threads for background work that must not stall a frame, such as shader
+// compilation, and for splitting a frame's work across cores with ParallelFor. Jobs run in submission
+// order on whichever worker is free. A job that throws does not take its worker down: the exception is
+// handed back through the job's future, or rethrown by ParallelFor on the calling thread.
+class job_system {
+public:
+  explicit job_system(uint32_t ThreadCount = std::max(2U, std::thread::hardware_concurrency()) - 1) {
+    for (uint32_t i = 0; i < ThreadCount; i++) {
+      Workers.emplace_back([this](const std::stop_token &Stop) { Work(Stop); });
+    }
+  }
+  job_system(const job_system &) = delete;
+  job_system(job_system &&) = delete;
+  auto operator=(const job_system &) -> job_system & = delete;
+  auto operator=(job_system &&) -> job_system & = delete;
+  ~job_system() {
+    for (std::jthread &Worker : Workers) {
+      Worker.request_stop();
+    }
+    Wake.notify_all();
+  }
+
+  // The future becomes ready when the job finishes and holds whatever it threw; dropping it is fine.
+  auto Submit(std::function<void()> Job) -> std::future<void> {
+    std::promise<void> Done;
+    std::future<void> Result = Done.get_future();
+    {
+      std::lock_guard Lock(Mutex);
+      Jobs.push_back({.Run = std::move(Job), .Done = std::move(Done)});
+      Unfinished++;
+    }
+    Wake.notify_one();
+    return Result;
+  }
+  // Runs Body(i) for every i in [0, Count) on the workers and the calling thread and returns once all calls
+  // have finished. The caller takes items itself, so a worker busy with a long job never stalls it.
+  // If a call throws, items not yet started are skipped and the first exception is rethrown here.
+  void ParallelFor(uint32_t Count, const std::function<void(uint32_t)> &Body) {
+    struct state {
+      std::atomic<uint32_t> Next{0};
+      std::atomic<uint32_t> Done{0};
+      std::atomic<bool> Failed{false};
+      std::exception_ptr Error; // Written once, by whoever sets Failed first
+      uint32_t Count;
+      const std::function<void(uint32_t)> *Body; // Only used while items remain, so before ParallelFor returns
+    };
+    const auto State = std::make_shared<state>();
+    State->Count = Count;
+    State->Body = &Body;
+    const auto Run = [State] {
+      for (uint32_t i = State->Next.fetch_add(1); i < State->Count; i = State->Next.fetch_add(1)) {
+        if (!State->Failed.load(std::memory_order_relaxed)) {
+          try {
+            (*State->Body)(i);
+          } catch (...) {
+            if (!State->Failed.exchange(true)) {
+              State->Error = std::current_exception();
+            }
+          }
+        }
+        if (State->Done.fetch_add(1, std::memory_order_acq_rel) + 1 == State->Count) {
+          State->Done.notify_all();
+        }
+      }
+    };
+    const uint32_t Helpers = std::min(ThreadCount(), Count > 0 ? Count - 1 : 0);
+    for (uint32_t i = 0; i < Helpers; i++) {
+      Submit(Run);
+    }
+    Run();
+    for (uint32_t Done = State->Done.load(std::memory_order_acquire); Done != Count;
+         Done = State->Done.load(std::memory_order_acquire)) {
+      State->Done.wait(Done);
+    }
+    if (State->Error) {
+      std::rethrow_exception(State->Error);
+    }
+  }
+  // Blocks until every submitted job has finished.
+  void WaitIdle() {
+    std::unique_lock Lock(Mutex);
+    Idle.wait(Lock, [this] { return Unfinished == 0; });
+  }
+  [[nodiscard]] auto ThreadCount() const -> uint32_t { return static_cast<uint32_t>(Workers.size()); }
+
+private:
+  struct job {
+    std::function<void()> Run;
+    std::promise<void> Done;
+  };
+
+  std::mutex Mutex;
+  std::condition_variable_any Wake;
+  std::condition_variable Idle;
+  std::deque<job> Jobs;
+  size_t Unfinished = 0;
+  std::vector<std::jthread> Workers; // Last, so workers stop before the queue goes away
+
+  void Work(const std::stop_token &Stop) {
+    KPROFILE_THREAD("worker");
+    while (true) {
+      job Job;
+      {
+        std::unique_lock Lock(Mutex);
+        if (!Wake.wait(Lock, Stop, [this] { return !Jobs.empty(); })) {
+          return; // Stop requested with nothing left to run
+        }
+        Job = std::move(Jobs.front());
+        Jobs.pop_front();
+      }
+      try {
+        Job.Run();
+        Job.Done.set_value();
+      } catch (...) {
+        Job.Done.set_exception(std::current_exception());
+      }
+      std::lock_guard Lock(Mutex);
+      if (--Unfinished == 0) {
+        Idle.notify_all();
+      }
+    }
+  }
+};
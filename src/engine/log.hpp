@@ -0,0 +1,233 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+enum class log_level : uint8_t { Trace, Debug, Info, Warning, Error, Off };
+enum class log_category : uint8_t { Engine, Vulkan, Validation, Simulation, Render, Shader, Count };
+
+// Messages below this level are compiled out entirely.
+#ifndef KALAN_LOG_MIN_LEVEL
+#define KALAN_LOG_MIN_LEVEL 0
+#endif
+
+// Asynchronous logger. Every producer thread owns a single-producer ring, the writer thread is the only
+// consumer, so together they form an MPSC queue with no locks or syscalls on the logging thread.
+// A full ring drops the message and counts it rather than blocking the frame.
+class logger {
+public:
+  static constexpr size_t MaxMessageSize = 480;
+  static constexpr size_t RingCapacity = 256; // Per thread, must be a power of two
+  static constexpr size_t MaxThreads = 64;
+  using clock = std::chrono::steady_clock;
+
+  struct message {
+    clock::time_point Time;
+    log_level Level;
+    log_category Category;
+    uint16_t Length;
+    std::array<char, MaxMessageSize> Text;
+  };
+
+  static auto Get() -> logger & {
+    static logger Logger;
+    return Logger;
+  }
+
+  [[nodiscard]] auto IsEnabled(log_level Level, log_category Category) const -> bool {
+    return Level >= MinLevel[static_cast<size_t>(Category)].load(std::memory_order_relaxed);
+  }
+  void SetLevel(log_category Category, log_level Level) {
+    MinLevel[static_cast<size_t>(Category)].store(Level, std::memory_order_relaxed);
+  }
+  void SetLevel(log_level Level) {
+    for (auto &Min : MinLevel) {
+      Min.store(Level, std::memory_order_relaxed);
+    }
+  }
+
+  template <class... Args>
+  void Write(log_level Level, log_category Category, std::format_string<Args...> Format, Args &&...Arguments) {
+    ring &Ring = LocalRing();
+    const uint64_t Head = Ring.Head.load(std::memory_order_relaxed);
+    if (Head - Ring.Tail.load(std::memory_order_acquire) >= RingCapacity) {
+      Ring.Dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    message &Message = Ring.Slots[Head & (RingCapacity - 1)];
+    Message.Time = clock::now();
+    Message.Level = Level;
+    Message.Category = Category;
+    const auto Result =
+        std::format_to_n(Message.Text.data(), MaxMessageSize, Format, std::forward<Args>(Arguments)...);
+    Message.Length = static_cast<uint16_t>(std::min<size_t>(Result.size, MaxMessageSize));
+    Ring.Head.store(Head + 1, std::memory_order_release);
+  }
+
+  logger(const logger &) = delete;
+  logger(logger &&) = delete;
+  auto operator=(const logger &) -> logger & = delete;
+  auto operator=(logger &&) -> logger & = delete;
+  ~logger() {
+    Writer.request_stop();
+    Writer.join();
+    Drain(); // Anything logged after the writer saw the stop request
+  }
+
+private:
+  struct ring {
+    std::array<message, RingCapacity> Slots;
+    alignas(64) std::atomic<uint64_t> Head{0};
+    alignas(64) std::atomic<uint64_t> Tail{0};
+    std::atomic<uint64_t> Dropped{0};
+    std::atomic<bool> InUse{true};
+  };
+  // Releases the calling thread's ring for reuse when the thread exits.
+  struct ring_owner {
+    ring *Ring = nullptr;
+    ring_owner() = default;
+    ring_owner(const ring_owner &) = delete;
+    ring_owner(ring_owner &&) = delete;
+    auto operator=(const ring_owner &) -> ring_owner & = delete;
+    auto operator=(ring_owner &&) -> ring_owner & = delete;
+    ~ring_owner() {
+      if (Ring != nullptr) {
+        Ring->InUse.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  std::array<std::atomic<log_level>, static_cast<size_t>(log_category::Count)> MinLevel{};
+  std::array<std::unique_ptr<ring>, MaxThreads> Rings;
+  std::atomic<size_t> RingCount{0};
+  std::mutex RegisterMutex; // Only taken the first time a thread logs
+  clock::time_point Start = clock::now();
+  std::jthread Writer;
+
+  logger() {
+    SetLevel(log_level::Info);
+    Writer = std::jthread{[this](const std::stop_token &Stop) {
+      using namespace std::chrono_literals;
+      while (!Stop.stop_requested()) {
+        if (!Drain()) {
+          std::this_thread::sleep_for(2ms);
+        }
+      }
+    }};
+  }
+
+  auto LocalRing() -> ring & {
+    thread_local ring_owner Owner;
+    if (Owner.Ring == nullptr) {
+      Owner.Ring = Register();
+    }
+    return *Owner.Ring;
+  }
+  auto Register() -> ring * {
+    std::scoped_lock Lock{RegisterMutex};
+    const size_t Count = RingCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < Count; i++) {
+      bool Free = false;
+      if (Rings[i]->InUse.compare_exchange_strong(Free, true, std::memory_order_acquire)) {
+        return Rings[i].get();
+      }
+    }
+    if (Count == MaxThreads) {
+      throw std::runtime_error("logger: too many logging threads");
+    }
+    Rings[Count] = std::make_unique<ring>();
+    RingCount.store(Count + 1, std::memory_order_release);
+    return Rings[Count].get();
+  }
+
+  // Writes everything currently queued. Returns false if there was nothing to do.
+  auto Drain() -> bool {
+    static constexpr std::array<char, 6> LevelTag = {'T', 'D', 'I', 'W', 'E', '-'};
+    static constexpr std::array<std::string_view, static_cast<size_t>(log_category::Count)> CategoryTag = {
+        "engine", "vulkan", "validation", "simulation", "render", "shader"};
+    bool Wrote = false;
+    const size_t Count = RingCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < Count; i++) {
+      ring &Ring = *Rings[i];
+      uint64_t Tail = Ring.Tail.load(std::memory_order_relaxed);
+      const uint64_t Head = Ring.Head.load(std::memory_order_acquire);
+      for (; Tail != Head; Tail++) {
+        const message &Message = Ring.Slots[Tail & (RingCapacity - 1)];
+        const double Seconds = std::chrono::duration<double>(Message.Time - Start).count();
+        std::fprintf(stderr, "[%10.4f] %c %s: %.*s\n", Seconds, LevelTag[static_cast<size_t>(Message.Level)],
+                     CategoryTag[static_cast<size_t>(Message.Category)].data(), static_cast<int>(Message.Length),
+                     Message.Text.data());
+        Wrote = true;
+      }
+      Ring.Tail.store(Tail, std::memory_order_release);
+      if (const uint64_t Dropped = Ring.Dropped.exchange(0, std::memory_order_relaxed); Dropped != 0) {
+        std::fprintf(stderr, "[  logger  ] %llu messages dropped, ring full\n",
+                     static_cast<unsigned long long>(Dropped));
+        Wrote = true;
+      }
+    }
+    if (Wrote) {
+      std::fflush(stderr);
+    }
+    return Wrote;
+  }
+};
+
+// Lets the first few occurrences of a message through per window and counts the rest,
+// so a validation error repeated every frame does not flood the log.
+class rate_limiter {
+public:
+  explicit rate_limiter(uint32_t MaxPerWindow = 5, std::chrono::milliseconds Window = std::chrono::seconds{1})
+      : MaxPerWindow(MaxPerWindow), Window(Window) {}
+
+  struct verdict {
+    bool Allow;
+    uint32_t Suppressed; // Repeats swallowed since the last message that got through
+  };
+  auto Check(uint64_t Key) -> verdict {
+    const auto Now = std::chrono::steady_clock::now();
+    std::scoped_lock Lock{Mutex};
+    entry &Entry = Entries[Key];
+    if (Now - Entry.WindowStart >= Window) {
+      Entry.WindowStart = Now;
+      Entry.Count = 0;
+    }
+    if (Entry.Count++ < MaxPerWindow) {
+      return {.Allow = true, .Suppressed = std::exchange(Entry.Suppressed, 0)};
+    }
+    Entry.Suppressed++;
+    return {.Allow = false, .Suppressed = 0};
+  }
+
+private:
+  struct entry {
+    std::chrono::steady_clock::time_point WindowStart;
+    uint32_t Count = 0;
+    uint32_t Suppressed = 0;
+  };
+  uint32_t MaxPerWindow;
+  std::chrono::milliseconds Window;
+  std::mutex Mutex;
+  std::unordered_map<uint64_t, entry> Entries;
+};
+
+// Filtering happens here, before any argument is formatted.
+#define KLOG(Level, Category, ...)                                                                                     \
+  do {                                                                                                                 \
+    if constexpr (static_cast<int>(log_level::Level) >= KALAN_LOG_MIN_LEVEL) {                                        \
+      if (logger::Get().IsEnabled(log_level::Level, log_category::Category)) {                                        \
+        logger::Get().Write(log_level::Level, log_category::Category, __VA_ARGS__);                                    \
+      }                                                                                                                \
+    }                                                                                                                  \
+  } while (false)
@@ -0,0 +1,349 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <span>
+#include <vector>
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#include "../mth/mth.h"
+#include "assets/mesh_format.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+// Spawns Rate particles per second inside a sphere around Position. Velocities are Velocity plus a random
+// offset up to Spread long; lifetimes vary by up to LifetimeJitter of Lifetime either way.
+struct particle_emitter {
+  mth::vec3<float> Position;
+  float Radius = 0;
+  mth::vec3<float> Velocity;
+  float Spread = 1;
+  std::array<float, 4> Color = {1, 1, 1, 1};
+  float Size = 0.1F;
+  float Lifetime = 2;
+  float LifetimeJitter = 0.25F;
+  float Rate = 1000;
+};
+
+struct particle_settings {
+  uint32_t MaxParticles = 1U << 20;
+  mth::vec3<float> Gravity{0, -9.81F, 0};
+  float Drag = 0.1F;        // Fraction of velocity lost per second
+  float Restitution = 0.4F; // Share of the normal velocity kept when bouncing off the depth buffer
+  float Thickness = 0.5F;   // How far behind the depth buffer a surface is assumed solid, in world units
+};
+
+// A depth buffer to collide with. Each value is clip z / clip w under ViewProjection, rows Pitch values
+// apart with row 0 at NDC y = -1; values of 1 or more are empty. rasterizer::GetDepth has this layout.
+struct particle_depth {
+  std::span<const float> Depth;
+  uint32_t Width, Height, Pitch;
+  mth::matr<float> ViewProjection;
+};
+
+// The random numbers and the per-frame emission counts shared by particle_simulation and the compute
+// shaders in src/shaders/particles, so both spawn the same particles. Random matches ParticleRandom in
+// src/shaders/common/particles.glsl.
+class particle_emission {
+public:
+  struct batch {
+    uint32_t First; // Index of the emitter's first new particle among this step's new particles
+    uint32_t Count;
+    uint32_t Seed;
+  };
+
+  // PCG output hash
+  static auto Hash(uint32_t Value) -> uint32_t {
+    const uint32_t State = Value * 747796405U + 2891336453U;
+    const uint32_t Word = ((State >> ((State >> 28U) + 4U)) ^ State) * 277803737U;
+    return (Word >> 22U) ^ Word;
+  }
+  // Number Index in [0, 1) of the sequence of new particle Particle
+  static auto Random(uint32_t Seed, uint32_t Particle, uint32_t Index) -> float {
+    return static_cast<float>(Hash(Hash(Seed + Particle) + Index) >> 8U) * (1.0F / 16777216.0F);
+  }
+  static auto UnitSphere(float U, float V) -> mth::vec3<float> {
+    const float Z = 2 * U - 1;
+    const float R = std::sqrt(std::max(1 - Z * Z, 0.0F));
+    const float Phi = 2 * std::numbers::pi_v<float> * V;
+    return {R * std::cos(Phi), R * std::sin(Phi), Z};
+  }
+
+  // Splits Dt worth of emission between the emitters; fractions of a particle carry over to the next step.
+  // Emitters are identified by their position in the span.
+  auto Advance(float Dt, std::span<const particle_emitter> Emitters) -> std::span<const batch> {
+    Carry.resize(Emitters.size(), 0.0F);
+    Batches.clear();
+    Step++;
+    uint32_t First = 0;
+    for (size_t i = 0; i < Emitters.size(); i++) {
+      Carry[i] += std::max(Emitters[i].Rate, 0.0F) * Dt;
+      const float Whole = std::floor(Carry[i]);
+      Carry[i] -= Whole;
+      const auto Count = static_cast<uint32_t>(Whole);
+      Batches.push_back({.First = First, .Count = Count, .Seed = Hash(Hash(Step) + static_cast<uint32_t>(i))});
+      First += Count;
+    }
+    Total = First;
+    return Batches;
+  }
+  [[nodiscard]] auto GetTotal() const -> uint32_t { return Total; }
+
+private:
+  std::vector<float> Carry;
+  std::vector<batch> Batches;
+  uint32_t Step = 0;
+  uint32_t Total = 0;
+};
+
+// Simulates particles on the CPU for headless runs and the software renderer, step for step like the
+// compute path in render/particle_system.hpp: emit, integrate with gravity and drag, bounce off a depth
+// buffer, then drop expired particles. Particles live in one array per attribute; integration and expiry
+// run four particles at a time with SSE, and blocks of particles are simulated in parallel and compacted
+// in place, keeping their order.
+class particle_simulation {
+public:
+  particle_simulation(job_system &Jobs, const particle_settings &Settings) : Jobs(Jobs), Settings(Settings) {
+    for (std::vector<float> *Array : Arrays()) {
+      Array->resize(Settings.MaxParticles + 3); // Room for a partial group of four at the end
+    }
+  }
+
+  void Update(float Dt, std::span<const particle_emitter> Emitters, const particle_depth *Depth = nullptr) {
+    KPROFILE_SCOPE("particle_simulation::Update");
+    Emit(Emitters, Emission.Advance(Dt, Emitters));
+    if (Count == 0) {
+      return;
+    }
+    const auto BlockCount = static_cast<uint32_t>((Count + BlockSize - 1) / BlockSize);
+    Survivors.resize(BlockCount);
+    const mth::matr<float> Inverse = Depth != nullptr ? Depth->ViewProjection.Inverse() : mth::matr<float>{};
+    Jobs.ParallelFor(BlockCount, [&](uint32_t Block) {
+      KPROFILE_SCOPE("particle_simulation::Block");
+      const size_t First = size_t{Block} * BlockSize;
+      const size_t Last = std::min(First + BlockSize, Count);
+      Integrate(First, Last, Dt);
+      if (Depth != nullptr) {
+        Collide(First, Last, *Depth, Inverse);
+      }
+      Survivors[Block] = Compact(First, Last, Dt);
+    });
+    // Blocks are compacted in place; close the gaps between them
+    size_t Write = Survivors[0];
+    for (uint32_t Block = 1; Block < BlockCount; Block++) {
+      const size_t First = size_t{Block} * BlockSize;
+      for (std::vector<float> *Array : Arrays()) {
+        std::memmove(Array->data() + Write, Array->data() + First, Survivors[Block] * sizeof(float));
+      }
+      Write += Survivors[Block];
+    }
+    Count = Write;
+  }
+
+  // Camera-facing quads for rasterizer::Draw, two triangles per particle with normals towards the camera.
+  void BuildQuads(const mth::camera<float> &Camera, std::vector<mesh_format::vertex> &Vertices,
+                  std::vector<uint32_t> &Indices) const {
+    Vertices.clear();
+    Indices.clear();
+    const std::array<float, 3> Normal = {-Camera.Dir.X, -Camera.Dir.Y, -Camera.Dir.Z};
+    for (size_t i = 0; i < Count; i++) {
+      const mth::vec3<float> Center(PositionX[i], PositionY[i], PositionZ[i]);
+      const mth::vec3<float> Right = Camera.Right * (Size[i] / 2);
+      const mth::vec3<float> Up = Camera.Up * (Size[i] / 2);
+      const auto Base = static_cast<uint32_t>(Vertices.size());
+      for (const auto &[U, V] : {std::pair{-1.0F, -1.0F}, {1.0F, -1.0F}, {1.0F, 1.0F}, {-1.0F, 1.0F}}) {
+        const mth::vec3<float> Corner = Center + Right * U + Up * V;
+        Vertices.push_back({.Position = {Corner.X, Corner.Y, Corner.Z},
+                            .Normal = Normal,
+                            .UV = {(U + 1) / 2, (V + 1) / 2}});
+      }
+      Indices.insert(Indices.end(), {Base, Base + 1, Base + 2, Base, Base + 2, Base + 3});
+    }
+  }
+
+  [[nodiscard]] auto GetCount() const -> size_t { return Count; }
+  [[nodiscard]] auto GetPositionX() const -> std::span<const float> { return {PositionX.data(), Count}; }
+  [[nodiscard]] auto GetPositionY() const -> std::span<const float> { return {PositionY.data(), Count}; }
+  [[nodiscard]] auto GetPositionZ() const -> std::span<const float> { return {PositionZ.data(), Count}; }
+  [[nodiscard]] auto GetVelocityX() const -> std::span<const float> { return {VelocityX.data(), Count}; }
+  [[nodiscard]] auto GetVelocityY() const -> std::span<const float> { return {VelocityY.data(), Count}; }
+  [[nodiscard]] auto GetVelocityZ() const -> std::span<const float> { return {VelocityZ.data(), Count}; }
+  [[nodiscard]] auto GetAge() const -> std::span<const float> { return {Age.data(), Count}; }
+  [[nodiscard]] auto GetLifetime() const -> std::span<const float> { return {Lifetime.data(), Count}; }
+  [[nodiscard]] auto GetSize() const -> std::span<const float> { return {Size.data(), Count}; }
+  // Red, green, blue and alpha of every particle, in that order
+  [[nodiscard]] auto GetColor(size_t Channel) const -> std::span<const float> { return {Color[Channel].data(), Count}; }
+
+private:
+  static constexpr size_t BlockSize = 16384; // A multiple of four
+
+  job_system &Jobs;
+  particle_settings Settings;
+  particle_emission Emission;
+  size_t Count = 0;
+  std::vector<float> PositionX, PositionY, PositionZ;
+  std::vector<float> VelocityX, VelocityY, VelocityZ;
+  std::vector<float> Age, Lifetime, Size;
+  std::array<std::vector<float>, 4> Color;
+  std::vector<size_t> Survivors; // Per block, after compaction
+
+  auto Arrays() -> std::array<std::vector<float> *, 13> {
+    return {&PositionX, &PositionY, &PositionZ, &VelocityX, &VelocityY, &VelocityZ, &Age,
+            &Lifetime,  &Size,      &Color[0],  &Color[1],  &Color[2],  &Color[3]};
+  }
+
+  // New particles go after the live ones, emitter by emitter, like the atomic append in emit.comp.glsl
+  void Emit(std::span<const particle_emitter> Emitters, std::span<const particle_emission::batch> Batches) {
+    for (size_t e = 0; e < Emitters.size(); e++) {
+      const particle_emitter &Emitter = Emitters[e];
+      const particle_emission::batch &Batch = Batches[e];
+      for (uint32_t k = 0; k < Batch.Count && Count < Settings.MaxParticles; k++) {
+        const auto Random = [&](uint32_t Index) { return particle_emission::Random(Batch.Seed, k, Index); };
+        const mth::vec3<float> Offset =
+            particle_emission::UnitSphere(Random(0), Random(1)) * (Emitter.Radius * std::cbrt(Random(2)));
+        const mth::vec3<float> Spread =
+            particle_emission::UnitSphere(Random(3), Random(4)) * (Emitter.Spread * std::cbrt(Random(5)));
+        const mth::vec3<float> Velocity = Emitter.Velocity + Spread;
+        PositionX[Count] = Emitter.Position.X + Offset.X;
+        PositionY[Count] = Emitter.Position.Y + Offset.Y;
+        PositionZ[Count] = Emitter.Position.Z + Offset.Z;
+        VelocityX[Count] = Velocity.X;
+        VelocityY[Count] = Velocity.Y;
+        VelocityZ[Count] = Velocity.Z;
+        Age[Count] = 0;
+        Lifetime[Count] = Emitter.Lifetime * (1 + Emitter.LifetimeJitter * (2 * Random(6) - 1));
+        Size[Count] = Emitter.Size;
+        for (size_t c = 0; c < 4; c++) {
+          Color[c][Count] = Emitter.Color[c];
+        }
+        Count++;
+      }
+    }
+  }
+
+  // Semi-implicit Euler: gravity and drag change the velocity, which then moves the particle
+  void Integrate(size_t First, size_t Last, float Dt) {
+    const float Damping = std::max(1 - Settings.Drag * Dt, 0.0F);
+    const std::array<float, 3> Gravity = {Settings.Gravity.X * Dt, Settings.Gravity.Y * Dt, Settings.Gravity.Z * Dt};
+    const std::array<std::vector<float> *, 3> Positions = {&PositionX, &PositionY, &PositionZ};
+    const std::array<std::vector<float> *, 3> Velocities = {&VelocityX, &VelocityY, &VelocityZ};
+    for (size_t Axis = 0; Axis < 3; Axis++) {
+      float *P = Positions[Axis]->data();
+      float *V = Velocities[Axis]->data();
+      size_t i = First;
+#if defined(__SSE2__)
+      const __m128 DampingV = _mm_set1_ps(Damping);
+      const __m128 GravityV = _mm_set1_ps(Gravity[Axis]);
+      const __m128 DtV = _mm_set1_ps(Dt);
+      for (; i + 4 <= Last; i += 4) {
+        const __m128 Velocity = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(V + i), GravityV), DampingV);
+        _mm_storeu_ps(V + i, Velocity);
+        _mm_storeu_ps(P + i, _mm_add_ps(_mm_loadu_ps(P + i), _mm_mul_ps(Velocity, DtV)));
+      }
+#endif
+      for (; i < Last; i++) {
+        V[i] = (V[i] + Gravity[Axis]) * Damping;
+        P[i] += V[i] * Dt;
+      }
+    }
+  }
+
+  // A particle less than Thickness behind the depth buffer has gone into a surface. It is pushed back onto the
+  // surface's plane and its velocity is reflected; the normal is rebuilt from neighbouring depths and faces
+  // the camera.
+  void Collide(size_t First, size_t Last, const particle_depth &Depth, const mth::matr<float> &Inverse) {
+    const mth::matr<float> &VP = Depth.ViewProjection;
+    const auto Unproject = [&](uint32_t X, uint32_t Y, float Z) {
+      const mth::vec4<float> Ndc((static_cast<float>(X) + 0.5F) / static_cast<float>(Depth.Width) * 2 - 1,
+                                 (static_cast<float>(Y) + 0.5F) / static_cast<float>(Depth.Height) * 2 - 1, Z, 1);
+      const mth::vec4<float> World = Inverse * Ndc; // mth applies matrices to row vectors either way
+      return mth::vec3<float>(World.X, World.Y, World.Z) / World.W;
+    };
+    const auto Sample = [&](uint32_t X, uint32_t Y) { return Depth.Depth[size_t{Y} * Depth.Pitch + X]; };
+    for (size_t i = First; i < Last; i++) {
+      const mth::vec3<float> Position(PositionX[i], PositionY[i], PositionZ[i]);
+      const mth::vec4<float> Clip = VP * mth::vec4<float>(Position.X, Position.Y, Position.Z, 1);
+      if (Clip.W <= 0) {
+        continue;
+      }
+      const float U = (Clip.X / Clip.W * 0.5F + 0.5F) * static_cast<float>(Depth.Width);
+      const float V = (Clip.Y / Clip.W * 0.5F + 0.5F) * static_cast<float>(Depth.Height);
+      if (!(U >= 0 && V >= 0 && U < static_cast<float>(Depth.Width) && V < static_cast<float>(Depth.Height))) {
+        continue;
+      }
+      const auto X = std::min(static_cast<uint32_t>(U), Depth.Width - 1);
+      const auto Y = std::min(static_cast<uint32_t>(V), Depth.Height - 1);
+      const float Z = Sample(X, Y);
+      if (Z >= 1) {
+        continue;
+      }
+      const mth::vec3<float> Surface = Unproject(X, Y, Z);
+      const float SurfaceW = (VP * mth::vec4<float>(Surface.X, Surface.Y, Surface.Z, 1)).W;
+      if (Clip.W < SurfaceW || Clip.W > SurfaceW + Settings.Thickness) {
+        continue;
+      }
+      const uint32_t X1 = X + 1 < Depth.Width ? X + 1 : X - 1;
+      const uint32_t Y1 = Y + 1 < Depth.Height ? Y + 1 : Y - 1;
+      mth::vec3<float> Normal =
+          ((Unproject(X1, Y, Sample(X1, Y)) - Surface) % (Unproject(X, Y1, Sample(X, Y1)) - Surface)).Normalizing();
+      if (((Unproject(X, Y, -1) - Surface) & Normal) < 0) {
+        Normal = -Normal;
+      }
+      const mth::vec3<float> Resolved = Position + Normal * std::max((Surface - Position) & Normal, 0.0F);
+      mth::vec3<float> Velocity(VelocityX[i], VelocityY[i], VelocityZ[i]);
+      const float Along = Velocity & Normal;
+      if (Along < 0) {
+        Velocity -= Normal * ((1 + Settings.Restitution) * Along);
+      }
+      PositionX[i] = Resolved.X;
+      PositionY[i] = Resolved.Y;
+      PositionZ[i] = Resolved.Z;
+      VelocityX[i] = Velocity.X;
+      VelocityY[i] = Velocity.Y;
+      VelocityZ[i] = Velocity.Z;
+    }
+  }
+
+  // Ages the block's particles and moves the survivors to its front; returns how many survived
+  auto Compact(size_t First, size_t Last, float Dt) -> size_t {
+    size_t Write = First;
+    size_t i = First;
+    const auto Keep = [&](size_t From) {
+      if (From != Write) {
+        for (std::vector<float> *Array : Arrays()) {
+          (*Array)[Write] = (*Array)[From];
+        }
+      }
+      Write++;
+    };
+#if defined(__SSE2__)
+    const __m128 DtV = _mm_set1_ps(Dt);
+    for (; i + 4 <= Last; i += 4) {
+      const __m128 Aged = _mm_add_ps(_mm_loadu_ps(&Age[i]), DtV);
+      _mm_storeu_ps(&Age[i], Aged);
+      const auto Alive = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(Aged, _mm_loadu_ps(&Lifetime[i]))));
+      if (Alive == 0xF && Write == i) { // Nothing to move yet
+        Write += 4;
+        continue;
+      }
+      for (uint32_t Lane = 0; Lane < 4; Lane++) {
+        if ((Alive & (1U << Lane)) != 0) {
+          Keep(i + Lane);
+        }
+      }
+    }
+#endif
+    for (; i < Last; i++) {
+      Age[i] += Dt;
+      if (Age[i] < Lifetime[i]) {
+        Keep(i);
+      }
+    }
+    return Write - First;
+  }
+};
@@ -0,0 +1,345 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../job_system.hpp"
+#include "../profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+enum class broadphase_method : uint8_t { SweepAndPrune, SpatialHash };
+
+// Finds the pairs of boxes that overlap, for the narrowphase to look at. Work is proportional to what moved.
+//
+// Each proxy keeps a fat box, its bounds grown by Margin. Move only counts as a move once the new bounds
+// leave the fat box, so resting and slowly drifting objects cost nothing. Update drops the previous pairs
+// that involve moved proxies, updates the structure, then queries only the moved proxies, in parallel; pairs
+// between two unmoved proxies carry over from the last update. The pair list and all scratch are reused, so
+// nothing allocates once the counts stop growing.
+//
+// The structure is one of:
+//  - sweep and prune: proxies sorted by min x. The order changes little between updates, so an insertion
+//    sort restores it in about linear time, and a query scans the neighbours on x only;
+//  - spatial hash: a grid per power-of-two cell size, each proxy stored once in the level whose cells fit it,
+//    keyed by the cell of its centre. Suits scenes spread out on every axis, where one sorted axis is not
+//    selective.
+class broadphase {
+public:
+  using proxy = uint32_t;
+  using pair = std::pair<proxy, proxy>; // First < second
+  static constexpr proxy NoProxy = UINT32_MAX;
+
+  broadphase(job_system &Jobs, broadphase_method Method, float Margin = 0.1F, float CellSize = 1.0F)
+      : Jobs(Jobs), Method(Method), Margin(Margin), CellSize(CellSize) {}
+
+  // Pairs of two static proxies are never reported.
+  auto Add(const mth::vec3<float> &Min, const mth::vec3<float> &Max, bool Static = false) -> proxy {
+    proxy Proxy = 0;
+    if (!FreeProxies.empty()) {
+      Proxy = FreeProxies.back();
+      FreeProxies.pop_back();
+    } else {
+      Proxy = static_cast<proxy>(Flags.size());
+      for (std::vector<float> *Array : {&MinX, &MinY, &MinZ, &MaxX, &MaxY, &MaxZ}) {
+        Array->push_back(0);
+      }
+      Flags.push_back(0);
+      Cell.push_back(0);
+      Next.push_back(NoProxy);
+      Previous.push_back(NoProxy);
+      Level.push_back(0);
+      Rank.push_back(0);
+    }
+    Flags[Proxy] = Alive | Moved | (Static ? IsStatic : 0);
+    SetBounds(Proxy, Min, Max);
+    return Proxy;
+  }
+  // The id may be handed out again after the next Update.
+  void Remove(proxy Proxy) {
+    Flags[Proxy] = static_cast<uint8_t>((Flags[Proxy] & ~Alive) | Moved);
+    Removed = true;
+  }
+  // Returns whether the bounds left the fat box. Safe to call in parallel for different proxies.
+  auto Move(proxy Proxy, const mth::vec3<float> &Min, const mth::vec3<float> &Max) -> bool {
+    if (Min.X >= MinX[Proxy] && Min.Y >= MinY[Proxy] && Min.Z >= MinZ[Proxy] && Max.X <= MaxX[Proxy] &&
+        Max.Y <= MaxY[Proxy] && Max.Z <= MaxZ[Proxy]) {
+      return false;
+    }
+    SetBounds(Proxy, Min, Max);
+    Flags[Proxy] |= Moved;
+    return true;
+  }
+
+  // Brings the pairs up to date with every Add, Remove and Move since the last call.
+  auto Update() -> std::span<const pair> {
+    KPROFILE_SCOPE("broadphase::Update");
+    MovedProxies.clear();
+    for (proxy Proxy = 0; Proxy < Flags.size(); Proxy++) {
+      if ((Flags[Proxy] & Moved) != 0) {
+        MovedProxies.push_back(Proxy);
+      }
+    }
+    std::erase_if(Pairs, [&](const pair &Pair) { return ((Flags[Pair.first] | Flags[Pair.second]) & Moved) != 0; });
+    if (Method == broadphase_method::SweepAndPrune) {
+      UpdateOrder();
+    } else {
+      UpdateGrid();
+    }
+
+    const auto Chunks = static_cast<uint32_t>((MovedProxies.size() + QueryGrain - 1) / QueryGrain);
+    ChunkPairs.resize(std::max<size_t>(ChunkPairs.size(), Chunks));
+    Jobs.ParallelFor(Chunks, [&](uint32_t Chunk) {
+      std::vector<pair> &Out = ChunkPairs[Chunk];
+      Out.clear();
+      for (size_t i = Chunk * QueryGrain; i < std::min(MovedProxies.size(), (Chunk + 1) * QueryGrain); i++) {
+        if ((Flags[MovedProxies[i]] & Alive) == 0) {
+          continue;
+        }
+        if (Method == broadphase_method::SweepAndPrune) {
+          QueryOrder(MovedProxies[i], Out);
+        } else {
+          QueryGrid(MovedProxies[i], Out);
+        }
+      }
+    });
+    for (uint32_t Chunk = 0; Chunk < Chunks; Chunk++) {
+      Pairs.insert(Pairs.end(), ChunkPairs[Chunk].begin(), ChunkPairs[Chunk].end());
+    }
+    for (const proxy Proxy : MovedProxies) {
+      Flags[Proxy] &= ~Moved;
+      if ((Flags[Proxy] & Alive) == 0) {
+        Flags[Proxy] = 0;
+        FreeProxies.push_back(Proxy);
+      }
+    }
+    Removed = false;
+    return Pairs;
+  }
+
+  [[nodiscard]] auto GetPairs() const -> std::span<const pair> { return Pairs; }
+  [[nodiscard]] auto GetMovedCount() const -> size_t { return MovedProxies.size(); }
+
+private:
+  static constexpr size_t QueryGrain = 128;
+  static constexpr uint32_t Levels = 16;
+  static constexpr uint64_t EmptyCell = UINT64_MAX;
+  static constexpr uint8_t Alive = 1;
+  static constexpr uint8_t Moved = 2;
+  static constexpr uint8_t IsStatic = 4;
+  static constexpr uint8_t InStructure = 8;
+
+  struct grid_cell {
+    uint64_t Key = EmptyCell;
+    proxy Head = NoProxy; // NoProxy with a key is a cell that emptied out, kept so probing still works
+  };
+
+  job_system &Jobs;
+  broadphase_method Method;
+  float Margin;
+  float CellSize;
+  // Fat boxes
+  std::vector<float> MinX, MinY, MinZ, MaxX, MaxY, MaxZ;
+  std::vector<uint8_t> Flags;
+  std::vector<proxy> FreeProxies;
+  std::vector<proxy> MovedProxies;
+  std::vector<pair> Pairs;
+  std::vector<std::vector<pair>> ChunkPairs;
+  bool Removed = false;
+  // Sweep and prune
+  std::vector<proxy> Order; // By MinX
+  std::vector<uint32_t> Rank;
+  float MaxWidth = 0; // Widest box on x ever inserted, which bounds the backwards scan
+  // Spatial hash
+  std::vector<grid_cell> Cells;
+  size_t UsedCells = 0;
+  std::vector<uint64_t> Cell;
+  std::vector<proxy> Next, Previous; // Each cell's proxies, as a doubly linked list
+  std::vector<uint8_t> Level;
+  std::array<float, Levels> MaxHalfSize{};
+  uint32_t LevelMask = 0;
+
+  void SetBounds(proxy Proxy, const mth::vec3<float> &Min, const mth::vec3<float> &Max) {
+    MinX[Proxy] = Min.X - Margin;
+    MinY[Proxy] = Min.Y - Margin;
+    MinZ[Proxy] = Min.Z - Margin;
+    MaxX[Proxy] = Max.X + Margin;
+    MaxY[Proxy] = Max.Y + Margin;
+    MaxZ[Proxy] = Max.Z + Margin;
+  }
+
+  [[nodiscard]] auto Overlap(proxy A, proxy B) const -> bool {
+    return MinX[A] <= MaxX[B] && MinX[B] <= MaxX[A] && MinY[A] <= MaxY[B] && MinY[B] <= MaxY[A] &&
+           MinZ[A] <= MaxZ[B] && MinZ[B] <= MaxZ[A];
+  }
+  // Both moved proxies find each other, so only the smaller id reports the pair
+  void Report(proxy Proxy, proxy Other, std::vector<pair> &Out) const {
+    const uint8_t OtherFlags = Flags[Other];
+    if (Other == Proxy || (OtherFlags & Alive) == 0 || ((OtherFlags & Moved) != 0 && Other < Proxy) ||
+        ((Flags[Proxy] & OtherFlags & IsStatic) != 0) || !Overlap(Proxy, Other)) {
+      return;
+    }
+    Out.emplace_back(std::min(Proxy, Other), std::max(Proxy, Other));
+  }
+
+  void UpdateOrder() {
+    if (Removed) {
+      std::erase_if(Order, [&](proxy Proxy) { return (Flags[Proxy] & Alive) == 0; });
+    }
+    size_t Added = 0;
+    for (const proxy Proxy : MovedProxies) {
+      if ((Flags[Proxy] & Alive) != 0) {
+        MaxWidth = std::max(MaxWidth, MaxX[Proxy] - MinX[Proxy]);
+        if ((Flags[Proxy] & InStructure) == 0) {
+          Flags[Proxy] |= InStructure;
+          Order.push_back(Proxy);
+          Added++;
+        }
+      } else {
+        Flags[Proxy] &= ~InStructure;
+      }
+    }
+    const auto ByMin = [&](proxy A, proxy B) { return MinX[A] < MinX[B]; };
+    if (Added > 64) {
+      std::ranges::sort(Order, ByMin);
+    } else {
+      for (size_t i = 1; i < Order.size(); i++) { // Nearly sorted: few elements move and not far
+        const proxy Proxy = Order[i];
+        size_t j = i;
+        for (; j > 0 && ByMin(Proxy, Order[j - 1]); j--) {
+          Order[j] = Order[j - 1];
+        }
+        Order[j] = Proxy;
+      }
+    }
+    for (uint32_t i = 0; i < Order.size(); i++) {
+      Rank[Order[i]] = i;
+    }
+  }
+
+  void QueryOrder(proxy Proxy, std::vector<pair> &Out) const {
+    const uint32_t Index = Rank[Proxy];
+    for (uint32_t i = Index + 1; i < Order.size() && MinX[Order[i]] <= MaxX[Proxy]; i++) {
+      Report(Proxy, Order[i], Out);
+    }
+    for (uint32_t i = Index; i-- > 0 && MinX[Order[i]] >= MinX[Proxy] - MaxWidth;) {
+      Report(Proxy, Order[i], Out);
+    }
+  }
+
+  [[nodiscard]] auto LevelSize(uint32_t L) const -> float { return CellSize * static_cast<float>(1U << L); }
+  static auto CellKey(uint32_t L, int64_t X, int64_t Y, int64_t Z) -> uint64_t {
+    constexpr int64_t Bias = 1 << 19;
+    constexpr uint64_t Mask = (1U << 20) - 1;
+    return (uint64_t{L} << 60U) | ((static_cast<uint64_t>(X + Bias) & Mask) << 40U) |
+           ((static_cast<uint64_t>(Y + Bias) & Mask) << 20U) | (static_cast<uint64_t>(Z + Bias) & Mask);
+  }
+  [[nodiscard]] auto CellCoordinate(float Value, uint32_t L) const -> int64_t {
+    return static_cast<int64_t>(std::floor(Value / LevelSize(L)));
+  }
+  [[nodiscard]] auto FindCell(uint64_t Key) const -> size_t { // Slot holding Key, or the empty slot it would take
+    const size_t Mask = Cells.size() - 1;
+    for (size_t Slot = (Key * 0x9E3779B97F4A7C15ULL) >> 20U & Mask;; Slot = (Slot + 1) & Mask) {
+      if (Cells[Slot].Key == Key || Cells[Slot].Key == EmptyCell) {
+        return Slot;
+      }
+    }
+  }
+
+  void Link(proxy Proxy) {
+    const float Size = std::max({MaxX[Proxy] - MinX[Proxy], MaxY[Proxy] - MinY[Proxy], MaxZ[Proxy] - MinZ[Proxy]});
+    uint32_t L = 0;
+    while (L + 1 < Levels && LevelSize(L) < Size) {
+      L++;
+    }
+    Level[Proxy] = static_cast<uint8_t>(L);
+    MaxHalfSize[L] = std::max(MaxHalfSize[L], Size / 2);
+    LevelMask |= 1U << L;
+    Cell[Proxy] = CellKey(L, CellCoordinate((MinX[Proxy] + MaxX[Proxy]) / 2, L),
+                          CellCoordinate((MinY[Proxy] + MaxY[Proxy]) / 2, L),
+                          CellCoordinate((MinZ[Proxy] + MaxZ[Proxy]) / 2, L));
+    grid_cell &Target = Cells[FindCell(Cell[Proxy])];
+    if (Target.Key == EmptyCell) {
+      Target.Key = Cell[Proxy];
+      UsedCells++;
+    }
+    Previous[Proxy] = NoProxy;
+    Next[Proxy] = Target.Head;
+    if (Target.Head != NoProxy) {
+      Previous[Target.Head] = Proxy;
+    }
+    Target.Head = Proxy;
+  }
+
+  void Unlink(proxy Proxy) {
+    if (Previous[Proxy] != NoProxy) {
+      Next[Previous[Proxy]] = Next[Proxy];
+    } else {
+      Cells[FindCell(Cell[Proxy])].Head = Next[Proxy];
+    }
+    if (Next[Proxy] != NoProxy) {
+      Previous[Next[Proxy]] = Previous[Proxy];
+    }
+  }
+
+  void UpdateGrid() {
+    const auto Live = static_cast<size_t>(std::ranges::count_if(Flags, [](uint8_t F) { return (F & Alive) != 0; }));
+    // Emptied cells are only reclaimed here: rebuild once live and emptied cells fill half the table
+    if (Cells.empty() || (UsedCells + MovedProxies.size()) * 2 > Cells.size()) {
+      Cells.assign(std::max<size_t>(std::bit_ceil(Live * 4), 64), {});
+      UsedCells = 0;
+      for (proxy Proxy = 0; Proxy < Flags.size(); Proxy++) {
+        Flags[Proxy] &= ~InStructure;
+        if ((Flags[Proxy] & Alive) != 0) {
+          Flags[Proxy] |= InStructure;
+          Link(Proxy);
+        }
+      }
+      return;
+    }
+    for (const proxy Proxy : MovedProxies) {
+      if ((Flags[Proxy] & InStructure) != 0) {
+        Unlink(Proxy);
+        Flags[Proxy] &= ~InStructure;
+      }
+      if ((Flags[Proxy] & Alive) != 0) {
+        Flags[Proxy] |= InStructure;
+        Link(Proxy);
+      }
+    }
+  }
+
+  void QueryGrid(proxy Proxy, std::vector<pair> &Out) const {
+    for (uint32_t Mask = LevelMask; Mask != 0; Mask &= Mask - 1) {
+      const auto L = static_cast<uint32_t>(std::countr_zero(Mask));
+      // Centres of boxes at this level that can reach ours lie within our box grown by their largest half size
+      const float Reach = MaxHalfSize[L];
+      const int64_t X0 = CellCoordinate(MinX[Proxy] - Reach, L), X1 = CellCoordinate(MaxX[Proxy] + Reach, L);
+      const int64_t Y0 = CellCoordinate(MinY[Proxy] - Reach, L), Y1 = CellCoordinate(MaxY[Proxy] + Reach, L);
+      const int64_t Z0 = CellCoordinate(MinZ[Proxy] - Reach, L), Z1 = CellCoordinate(MaxZ[Proxy] + Reach, L);
+      if ((X1 - X0 + 1) * (Y1 - Y0 + 1) * (Z1 - Z0 + 1) > static_cast<int64_t>(Flags.size())) {
+        // A big box against a fine level: checking every proxy is cheaper than visiting every cell
+        for (proxy Other = 0; Other < Flags.size(); Other++) {
+          if ((Flags[Other] & InStructure) != 0 && Level[Other] == L) {
+            Report(Proxy, Other, Out);
+          }
+        }
+        continue;
+      }
+      for (int64_t X = X0; X <= X1; X++) {
+        for (int64_t Y = Y0; Y <= Y1; Y++) {
+          for (int64_t Z = Z0; Z <= Z1; Z++) {
+            const grid_cell &Found = Cells[FindCell(CellKey(L, X, Y, Z))];
+            for (proxy Other = Found.Key != EmptyCell ? Found.Head : NoProxy; Other != NoProxy; Other = Next[Other]) {
+              Report(Proxy, Other, Out);
+            }
+          }
+        }
+      }
+    }
+  }
+};
@@ -0,0 +1,675 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../job_system.hpp"
+#include "../profiler.hpp"
+#include "broadphase.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+enum class body_shape : uint8_t { Sphere, Box };
+
+struct body_desc {
+  body_shape Shape = body_shape::Box;
+  mth::vec3<float> HalfExtents{0.5F}; // Spheres use X as the radius
+  float Mass = 1;                     // 0 makes the body static
+  mth::vec3<float> Position{};
+  mth::quat<float> Orientation{1, 0, 0, 0};
+  mth::vec3<float> Velocity{};
+  mth::vec3<float> AngularVelocity{};
+  float Friction = 0.5F;
+  float Restitution = 0.0F;
+};
+
+// Rigid-body dynamics for spheres and boxes on static planes, stepped at a fixed rate by the simulation.
+//
+// Bodies are stored as structure of arrays. The state is position, orientation and the two momenta;
+// velocities and the world-space inverse inertia tensor are derived from it. A step runs in stages, each
+// parallel over bodies, pairs or islands on the job system:
+//  1. velocities: apply gravity to the momenta and derive the velocities (semi-implicit Euler);
+//  2. contacts: the broadphase updates the bodies that moved out of their fat boxes and returns candidate
+//     pairs, then the narrowphase writes contact points;
+//  3. islands: bodies joined by contacts are grouped with union-find. Static bodies do not join islands, so
+//     everything resting on the same floor still splits into independent groups;
+//  4. solve: each island runs its own sequential-impulse solver, warm-started with the previous step's
+//     impulses, with no locks since no dynamic body is in two islands;
+//  5. positions: write the solved velocities back into the momenta and integrate position and orientation.
+//
+// Positions are corrected with a Baumgarte bias on the normal impulse, so deep overlaps resolve over a few
+// steps rather than in one.
+class rigid_bodies {
+public:
+  using body = uint32_t;
+  static constexpr body NoBody = UINT32_MAX;
+
+  struct settings {
+    mth::vec3<float> Gravity{0, -9.81F, 0};
+    uint32_t Iterations = 8;
+    float Baumgarte = 0.2F;        // Share of the penetration removed per step
+    float Slop = 0.005F;           // Penetration left alone, so resting contacts do not jitter
+    float BounceThreshold = 1.0F;  // Slower impacts do not bounce
+    broadphase_method Broadphase = broadphase_method::SweepAndPrune;
+    float BroadphaseMargin = 0.05F;
+    float CellSize = 1.0F; // Finest spatial hash level, about the size of a typical body
+  };
+  struct stats {
+    uint32_t Pairs = 0;
+    uint32_t Contacts = 0;
+    uint32_t Islands = 0;
+  };
+
+  explicit rigid_bodies(job_system &Jobs) : rigid_bodies(Jobs, settings{}) {}
+  rigid_bodies(job_system &Jobs, const settings &Settings)
+      : Jobs(Jobs), Settings(Settings),
+        Broadphase(Jobs, Settings.Broadphase, Settings.BroadphaseMargin, Settings.CellSize) {}
+
+  auto Add(const body_desc &Desc) -> body {
+    const float InvMass = Desc.Mass > 0 ? 1 / Desc.Mass : 0;
+    const mth::vec3<float> &H = Desc.HalfExtents;
+    mth::vec3<float> InvInertia(0.0F);
+    if (InvMass > 0) {
+      InvInertia = Desc.Shape == body_shape::Sphere
+                       ? mth::vec3<float>(2.5F * InvMass / (H.X * H.X))
+                       : mth::vec3<float>(3 * InvMass / (H.Y * H.Y + H.Z * H.Z), 3 * InvMass / (H.X * H.X + H.Z * H.Z),
+                                          3 * InvMass / (H.X * H.X + H.Y * H.Y));
+    }
+    const mth::quat<float> Orientation = Desc.Orientation.Normalized();
+    Position.push_back(Desc.Position);
+    this->Orientation.push_back(Orientation);
+    InverseMass.push_back(InvMass);
+    InverseInertia.push_back(InvInertia);
+    InverseInertiaWorld.push_back(WorldInertia(Orientation, InvInertia));
+    LinearMomentum.push_back(InvMass > 0 ? Desc.Velocity / InvMass : mth::vec3<float>(0.0F));
+    AngularMomentum.push_back(InvMass > 0 ? WorldInertia(Orientation, Reciprocal(InvInertia)) * Desc.AngularVelocity
+                                          : mth::vec3<float>(0.0F));
+    Shape.push_back(Desc.Shape);
+    HalfExtents.push_back(Desc.Shape == body_shape::Sphere ? mth::vec3<float>(H.X) : H);
+    Friction.push_back(Desc.Friction);
+    Restitution.push_back(Desc.Restitution);
+    Velocity.emplace_back();
+    AngularVelocity.emplace_back();
+    const auto [Min, Max] = Bounds(Position.size() - 1);
+    Broadphase.Add(Min, Max, InvMass == 0); // Bodies are never removed, so proxies and bodies share ids
+    return static_cast<body>(Position.size() - 1);
+  }
+  // Static half-space below Normal . x = Offset.
+  void AddPlane(const mth::vec3<float> &Normal, float Offset) { Planes.push_back({Normal.Normalizing(), Offset}); }
+
+  void Step(float Dt) {
+    KPROFILE_SCOPE("rigid_bodies::Step");
+    IntegrateVelocities(Dt);
+    FindPairs();
+    Collide();
+    BuildIslands();
+    Solve(Dt);
+    IntegratePositions(Dt);
+  }
+
+  [[nodiscard]] auto size() const -> size_t { return Position.size(); }
+  [[nodiscard]] auto GetPosition(body Body) const -> const mth::vec3<float> & { return Position[Body]; }
+  [[nodiscard]] auto GetOrientation(body Body) const -> const mth::quat<float> & { return Orientation[Body]; }
+  [[nodiscard]] auto GetVelocity(body Body) const -> mth::vec3<float> {
+    return LinearMomentum[Body] * InverseMass[Body];
+  }
+  // World matrix for rendering the body, without its scale.
+  [[nodiscard]] auto GetTransform(body Body) const -> mth::matr<float> {
+    return Orientation[Body].RotateMatr() * mth::matr<float>::Translate(Position[Body]);
+  }
+  void ApplyImpulse(body Body, const mth::vec3<float> &Impulse, const mth::vec3<float> &Point) {
+    if (InverseMass[Body] > 0) {
+      LinearMomentum[Body] += Impulse;
+      AngularMomentum[Body] += (Point - Position[Body]) % Impulse;
+    }
+  }
+  [[nodiscard]] auto GetStats() const -> const stats & { return Stats; }
+
+private:
+  static constexpr size_t BodyGrain = 256;
+  static constexpr size_t PairGrain = 128;
+  static constexpr uint32_t MinJobContacts = 64; // Small islands are batched so a job is worth scheduling
+
+  struct plane {
+    mth::vec3<float> Normal;
+    float Offset;
+  };
+  struct contact {
+    body A, B; // B is NoBody for planes
+    uint32_t Feature;
+    mth::vec3<float> Point;
+    mth::vec3<float> Normal; // From A towards B
+    float Depth;
+    // Filled in by the solver
+    mth::vec3<float> RA{}, RB{}, Tangent1{}, Tangent2{};
+    float NormalMass = 0, TangentMass1 = 0, TangentMass2 = 0;
+    float Bias = 0, Friction = 0;
+    float NormalImpulse = 0, TangentImpulse1 = 0, TangentImpulse2 = 0;
+  };
+  struct cached_impulse {
+    uint64_t Key;
+    float Normal, Tangent1, Tangent2;
+  };
+
+  job_system &Jobs;
+  settings Settings;
+  broadphase Broadphase;
+  // Body state
+  std::vector<mth::vec3<float>> Position;
+  std::vector<mth::quat<float>> Orientation;
+  std::vector<mth::vec3<float>> LinearMomentum;
+  std::vector<mth::vec3<float>> AngularMomentum;
+  std::vector<float> InverseMass;
+  std::vector<mth::vec3<float>> InverseInertia; // Diagonal, in body space
+  std::vector<mth::tensor<float>> InverseInertiaWorld;
+  std::vector<body_shape> Shape;
+  std::vector<mth::vec3<float>> HalfExtents;
+  std::vector<float> Friction;
+  std::vector<float> Restitution;
+  // Per-step scratch, kept to avoid reallocating
+  std::vector<mth::vec3<float>> Velocity;
+  std::vector<mth::vec3<float>> AngularVelocity;
+  std::span<const broadphase::pair> Pairs;
+  std::vector<std::vector<contact>> ChunkContacts;
+  std::vector<contact> Contacts;
+  std::vector<uint32_t> Parent;                // Union-find
+  std::vector<uint32_t> IslandOf;              // Root body to island
+  std::vector<uint32_t> IslandStart;           // Island i owns IslandContacts[IslandStart[i], IslandStart[i + 1])
+  std::vector<uint32_t> IslandContacts;
+  std::vector<uint32_t> ContactIsland;
+  std::vector<uint32_t> IslandFill;
+  std::vector<uint32_t> IslandOrder;
+  std::vector<std::pair<uint32_t, uint32_t>> SolveJobs; // Ranges of IslandOrder
+  std::vector<cached_impulse> Cache;                    // Sorted by key
+  std::vector<plane> Planes;
+  stats Stats;
+
+  template <typename function> void ParallelRanges(size_t Count, size_t Grain, const function &Body) {
+    const auto Chunks = static_cast<uint32_t>((Count + Grain - 1) / Grain);
+    Jobs.ParallelFor(Chunks, [&](uint32_t Chunk) { Body(Chunk * Grain, std::min(Count, (Chunk + 1) * Grain)); });
+  }
+
+  static auto Reciprocal(const mth::vec3<float> &V) -> mth::vec3<float> {
+    return {V.X > 0 ? 1 / V.X : 0, V.Y > 0 ? 1 / V.Y : 0, V.Z > 0 ? 1 / V.Z : 0};
+  }
+  // R^T D R, for body axes in the rows of R
+  static auto WorldInertia(const mth::quat<float> &Orientation, const mth::vec3<float> &Diagonal)
+      -> mth::tensor<float> {
+    const mth::tensor<float> R = Orientation.RotateTensor();
+    return R.Transpose() * mth::tensor<float>(Diagonal.X, 0, 0, 0, Diagonal.Y, 0, 0, 0, Diagonal.Z) * R;
+  }
+  static auto Axes(const mth::tensor<float> &R) -> std::array<mth::vec3<float>, 3> {
+    return {mth::vec3<float>(R(0, 0), R(0, 1), R(0, 2)), mth::vec3<float>(R(1, 0), R(1, 1), R(1, 2)),
+            mth::vec3<float>(R(2, 0), R(2, 1), R(2, 2))};
+  }
+  static auto Basis(const mth::vec3<float> &Normal) -> std::pair<mth::vec3<float>, mth::vec3<float>> {
+    const mth::vec3<float> Other = std::abs(Normal.X) > 0.9F ? mth::vec3<float>(0, 1, 0) : mth::vec3<float>(1, 0, 0);
+    const mth::vec3<float> Tangent = (Other % Normal).Normalizing();
+    return {Tangent, Normal % Tangent};
+  }
+
+  void IntegrateVelocities(float Dt) {
+    KPROFILE_SCOPE("rigid_bodies::IntegrateVelocities");
+    ParallelRanges(size(), BodyGrain, [&](size_t Begin, size_t End) {
+      for (size_t i = Begin; i < End; i++) {
+        if (InverseMass[i] == 0) {
+          Velocity[i] = AngularVelocity[i] = mth::vec3<float>(0.0F);
+          continue;
+        }
+        LinearMomentum[i] += Settings.Gravity * (Dt / InverseMass[i]);
+        Velocity[i] = LinearMomentum[i] * InverseMass[i];
+        AngularVelocity[i] = InverseInertiaWorld[i] * AngularMomentum[i];
+      }
+    });
+  }
+
+  [[nodiscard]] auto Bounds(size_t Body) const -> std::pair<mth::vec3<float>, mth::vec3<float>> {
+    mth::vec3<float> Extent = HalfExtents[Body];
+    if (Shape[Body] == body_shape::Box) {
+      const std::array<mth::vec3<float>, 3> Axis = Axes(Orientation[Body].RotateTensor());
+      Extent = mth::vec3<float>(std::abs(Axis[0].X), std::abs(Axis[0].Y), std::abs(Axis[0].Z)) * Extent.X +
+               mth::vec3<float>(std::abs(Axis[1].X), std::abs(Axis[1].Y), std::abs(Axis[1].Z)) * Extent.Y +
+               mth::vec3<float>(std::abs(Axis[2].X), std::abs(Axis[2].Y), std::abs(Axis[2].Z)) * Extent.Z;
+    }
+    return {Position[Body] - Extent, Position[Body] + Extent};
+  }
+
+  void FindPairs() {
+    KPROFILE_SCOPE("rigid_bodies::FindPairs");
+    ParallelRanges(size(), BodyGrain, [&](size_t Begin, size_t End) {
+      for (size_t i = Begin; i < End; i++) {
+        if (InverseMass[i] > 0) {
+          const auto [Min, Max] = Bounds(i);
+          Broadphase.Move(static_cast<broadphase::proxy>(i), Min, Max);
+        }
+      }
+    });
+    Pairs = Broadphase.Update();
+    Stats.Pairs = static_cast<uint32_t>(Pairs.size());
+  }
+
+  void Collide() {
+    KPROFILE_SCOPE("rigid_bodies::Collide");
+    // Pair chunks first, then body chunks for the planes; each chunk writes its own list
+    const size_t PairChunks = (Pairs.size() + PairGrain - 1) / PairGrain;
+    const size_t BodyChunks = (size() + BodyGrain - 1) / BodyGrain;
+    ChunkContacts.resize(std::max(ChunkContacts.size(), PairChunks + BodyChunks));
+    Jobs.ParallelFor(static_cast<uint32_t>(PairChunks + BodyChunks), [&](uint32_t Chunk) {
+      std::vector<contact> &Out = ChunkContacts[Chunk];
+      Out.clear();
+      if (Chunk < PairChunks) {
+        for (size_t i = Chunk * PairGrain; i < std::min(Pairs.size(), (Chunk + 1) * PairGrain); i++) {
+          CollidePair(Pairs[i].first, Pairs[i].second, Out);
+        }
+        return;
+      }
+      const size_t First = (Chunk - PairChunks) * BodyGrain;
+      for (size_t i = First; i < std::min(size(), First + BodyGrain); i++) {
+        if (InverseMass[i] > 0) {
+          CollidePlanes(static_cast<body>(i), Out);
+        }
+      }
+    });
+    Contacts.clear();
+    for (size_t i = 0; i < PairChunks + BodyChunks; i++) {
+      Contacts.insert(Contacts.end(), ChunkContacts[i].begin(), ChunkContacts[i].end());
+    }
+    Stats.Contacts = static_cast<uint32_t>(Contacts.size());
+  }
+
+  void CollidePair(body A, body B, std::vector<contact> &Out) const {
+    if (Shape[A] == body_shape::Sphere && Shape[B] == body_shape::Sphere) {
+      const mth::vec3<float> Offset = Position[B] - Position[A];
+      const float Distance = Offset.Length();
+      const float Radii = HalfExtents[A].X + HalfExtents[B].X;
+      if (Distance < Radii) {
+        const mth::vec3<float> Normal = Distance > 1e-6F ? Offset / Distance : mth::vec3<float>(0, 1, 0);
+        Out.push_back({.A = A, .B = B, .Feature = 0,
+                       .Point = Position[A] + Normal * (HalfExtents[A].X - (Radii - Distance) / 2),
+                       .Normal = Normal, .Depth = Radii - Distance});
+      }
+    } else if (Shape[A] == body_shape::Box && Shape[B] == body_shape::Box) {
+      BoxBox(A, B, Out);
+    } else if (Shape[A] == body_shape::Sphere) {
+      SphereBox(A, B, Out);
+    } else {
+      SphereBox(B, A, Out);
+    }
+  }
+
+  void CollidePlanes(body Body, std::vector<contact> &Out) const {
+    for (uint32_t p = 0; p < Planes.size(); p++) {
+      const plane &Plane = Planes[p];
+      if (Shape[Body] == body_shape::Sphere) {
+        const float Depth = HalfExtents[Body].X - ((Plane.Normal & Position[Body]) - Plane.Offset);
+        if (Depth > 0) {
+          Out.push_back({.A = Body, .B = NoBody, .Feature = p * 8,
+                         .Point = Position[Body] - Plane.Normal * HalfExtents[Body].X, .Normal = -Plane.Normal,
+                         .Depth = Depth});
+        }
+        continue;
+      }
+      const std::array<mth::vec3<float>, 3> Axis = Axes(Orientation[Body].RotateTensor());
+      const mth::vec3<float> &H = HalfExtents[Body];
+      for (uint32_t Corner = 0; Corner < 8; Corner++) {
+        const mth::vec3<float> Point = Position[Body] + Axis[0] * ((Corner & 1U) != 0 ? H.X : -H.X) +
+                                       Axis[1] * ((Corner & 2U) != 0 ? H.Y : -H.Y) +
+                                       Axis[2] * ((Corner & 4U) != 0 ? H.Z : -H.Z);
+        const float Depth = Plane.Offset - (Plane.Normal & Point);
+        if (Depth > 0) {
+          Out.push_back({.A = Body, .B = NoBody, .Feature = p * 8 + Corner, .Point = Point,
+                         .Normal = -Plane.Normal, .Depth = Depth});
+        }
+      }
+    }
+  }
+
+  void SphereBox(body Sphere, body Box, std::vector<contact> &Out) const {
+    const mth::tensor<float> R = Orientation[Box].RotateTensor();
+    const mth::vec3<float> &H = HalfExtents[Box];
+    const float Radius = HalfExtents[Sphere].X;
+    const mth::vec3<float> Local = R.Transpose() * (Position[Sphere] - Position[Box]);
+    const mth::vec3<float> Closest(std::clamp(Local.X, -H.X, H.X), std::clamp(Local.Y, -H.Y, H.Y),
+                                   std::clamp(Local.Z, -H.Z, H.Z));
+    const mth::vec3<float> Offset = Local - Closest;
+    const float Distance2 = Offset.Length2();
+    if (Distance2 >= Radius * Radius) {
+      return;
+    }
+    mth::vec3<float> Normal; // Box space, from the box out towards the sphere
+    float Depth = 0;
+    mth::vec3<float> Surface = Closest;
+    if (Distance2 > 1e-12F) {
+      const float Distance = std::sqrt(Distance2);
+      Normal = Offset / Distance;
+      Depth = Radius - Distance;
+    } else { // Centre inside the box: leave through the nearest face
+      int Axis = 0;
+      float Gap = std::numeric_limits<float>::max();
+      for (int i = 0; i < 3; i++) {
+        if (H[i] - std::abs(Local[i]) < Gap) {
+          Gap = H[i] - std::abs(Local[i]);
+          Axis = i;
+        }
+      }
+      Normal[Axis] = Local[Axis] >= 0 ? 1.0F : -1.0F;
+      Surface[Axis] = Normal[Axis] * H[Axis];
+      Depth = Radius + Gap;
+    }
+    Out.push_back({.A = Sphere, .B = Box, .Feature = 0, .Point = R * Surface + Position[Box],
+                   .Normal = -(R * Normal), .Depth = Depth});
+  }
+
+  // Separating axis test over the 15 axes, then a clipped face manifold or a single edge-edge point
+  void BoxBox(body A, body B, std::vector<contact> &Out) const {
+    const std::array<mth::vec3<float>, 3> AxisA = Axes(Orientation[A].RotateTensor());
+    const std::array<mth::vec3<float>, 3> AxisB = Axes(Orientation[B].RotateTensor());
+    const mth::vec3<float> &HA = HalfExtents[A];
+    const mth::vec3<float> &HB = HalfExtents[B];
+    const mth::vec3<float> Offset = Position[B] - Position[A];
+    const auto Project = [](const std::array<mth::vec3<float>, 3> &Axis, const mth::vec3<float> &H,
+                            const mth::vec3<float> &Direction) {
+      return std::abs(Axis[0] & Direction) * H.X + std::abs(Axis[1] & Direction) * H.Y +
+             std::abs(Axis[2] & Direction) * H.Z;
+    };
+    float Best = std::numeric_limits<float>::max();
+    uint32_t BestAxis = 0;
+    mth::vec3<float> Normal;
+    for (uint32_t Id = 0; Id < 15; Id++) {
+      mth::vec3<float> Direction =
+          Id < 3 ? AxisA[Id] : Id < 6 ? AxisB[Id - 3] : AxisA[(Id - 6) / 3] % AxisB[(Id - 6) % 3];
+      const float Length2 = Direction.Length2();
+      if (Length2 < 1e-6F) {
+        continue; // Parallel edges; the face axes already cover this direction
+      }
+      Direction /= std::sqrt(Length2);
+      const float Distance = Offset & Direction;
+      const float Depth = Project(AxisA, HA, Direction) + Project(AxisB, HB, Direction) - std::abs(Distance);
+      if (Depth < 0) {
+        return;
+      }
+      // Edge axes must win clearly: face manifolds have several points and stack far more stably
+      if (Id < 6 ? Depth < Best : Depth < Best * 0.95F - 1e-3F) {
+        Best = Depth;
+        BestAxis = Id;
+        Normal = Distance < 0 ? -Direction : Direction;
+      }
+    }
+
+    if (BestAxis >= 6) {
+      const uint32_t I = (BestAxis - 6) / 3;
+      const uint32_t J = (BestAxis - 6) % 3;
+      mth::vec3<float> EdgeA = Position[A];
+      mth::vec3<float> EdgeB = Position[B];
+      for (uint32_t k = 0; k < 3; k++) {
+        if (k != I) {
+          EdgeA += AxisA[k] * ((AxisA[k] & Normal) > 0 ? HA[static_cast<int>(k)] : -HA[static_cast<int>(k)]);
+        }
+        if (k != J) {
+          EdgeB += AxisB[k] * ((AxisB[k] & Normal) > 0 ? -HB[static_cast<int>(k)] : HB[static_cast<int>(k)]);
+        }
+      }
+      // Closest points of the two edge lines, clamped to the edges
+      const float Cos = AxisA[I] & AxisB[J];
+      const mth::vec3<float> Between = EdgeA - EdgeB;
+      const float C = AxisA[I] & Between;
+      const float F = AxisB[J] & Between;
+      const float Denominator = std::max(1 - Cos * Cos, 1e-6F);
+      const float S = std::clamp((Cos * F - C) / Denominator, -HA[static_cast<int>(I)], HA[static_cast<int>(I)]);
+      const float T = std::clamp((F - Cos * C) / Denominator, -HB[static_cast<int>(J)], HB[static_cast<int>(J)]);
+      const mth::vec3<float> Point = (EdgeA + AxisA[I] * S + EdgeB + AxisB[J] * T) / 2.0F;
+      Out.push_back({.A = A, .B = B, .Feature = BestAxis * 8, .Point = Point, .Normal = Normal, .Depth = Best});
+      return;
+    }
+
+    // Reference face on the box whose axis won, incident face on the other one's face most against it
+    const bool ReferenceIsA = BestAxis < 3;
+    const std::array<mth::vec3<float>, 3> &RefAxis = ReferenceIsA ? AxisA : AxisB;
+    const std::array<mth::vec3<float>, 3> &IncAxis = ReferenceIsA ? AxisB : AxisA;
+    const mth::vec3<float> &RefH = ReferenceIsA ? HA : HB;
+    const mth::vec3<float> &IncH = ReferenceIsA ? HB : HA;
+    const mth::vec3<float> &RefPosition = Position[ReferenceIsA ? A : B];
+    const mth::vec3<float> &IncPosition = Position[ReferenceIsA ? B : A];
+    const mth::vec3<float> FaceNormal = ReferenceIsA ? Normal : -Normal; // Out of the reference box
+    const auto RefIndex = static_cast<int>(BestAxis % 3);
+
+    int IncIndex = 0;
+    for (int k = 1; k < 3; k++) {
+      if (std::abs(IncAxis[k] & FaceNormal) > std::abs(IncAxis[IncIndex] & FaceNormal)) {
+        IncIndex = k;
+      }
+    }
+    const float Side = (IncAxis[IncIndex] & FaceNormal) > 0 ? -1.0F : 1.0F;
+    const mth::vec3<float> IncCenter = IncPosition + IncAxis[IncIndex] * (Side * IncH[IncIndex]);
+    const int U = (IncIndex + 1) % 3;
+    const int V = (IncIndex + 2) % 3;
+    const mth::vec3<float> EdgeU = IncAxis[U] * IncH[U];
+    const mth::vec3<float> EdgeV = IncAxis[V] * IncH[V];
+    std::array<mth::vec3<float>, 8> Polygon{IncCenter + EdgeU + EdgeV, IncCenter - EdgeU + EdgeV,
+                                            IncCenter - EdgeU - EdgeV, IncCenter + EdgeU - EdgeV};
+    size_t Count = 4;
+    // Sutherland-Hodgman against the four side planes of the reference face
+    for (int k = 1; k < 3; k++) {
+      const int Axis = (RefIndex + k) % 3;
+      for (const float Sign : {1.0F, -1.0F}) {
+        const mth::vec3<float> PlaneNormal = RefAxis[Axis] * Sign;
+        const float Limit = (PlaneNormal & RefPosition) + RefH[Axis];
+        std::array<mth::vec3<float>, 8> Clipped;
+        size_t ClippedCount = 0;
+        for (size_t i = 0; i < Count; i++) {
+          const mth::vec3<float> &P = Polygon[i];
+          const mth::vec3<float> &Q = Polygon[(i + 1) % Count];
+          const float DistanceP = (PlaneNormal & P) - Limit;
+          const float DistanceQ = (PlaneNormal & Q) - Limit;
+          if (DistanceP <= 0 && ClippedCount < Clipped.size()) {
+            Clipped[ClippedCount++] = P;
+          }
+          if ((DistanceP < 0) != (DistanceQ < 0) && ClippedCount < Clipped.size()) {
+            Clipped[ClippedCount++] = P + (Q - P) * (DistanceP / (DistanceP - DistanceQ));
+          }
+        }
+        Polygon = Clipped;
+        Count = ClippedCount;
+      }
+    }
+    const float FaceOffset = (FaceNormal & RefPosition) + RefH[RefIndex];
+    for (size_t i = 0; i < Count; i++) {
+      const float Separation = (FaceNormal & Polygon[i]) - FaceOffset;
+      if (Separation <= 0) {
+        Out.push_back({.A = A, .B = B, .Feature = BestAxis * 8 + static_cast<uint32_t>(i),
+                       .Point = Polygon[i] - FaceNormal * (Separation / 2), .Normal = Normal, .Depth = -Separation});
+      }
+    }
+  }
+
+  void BuildIslands() {
+    KPROFILE_SCOPE("rigid_bodies::BuildIslands");
+    Parent.resize(size());
+    std::iota(Parent.begin(), Parent.end(), 0U);
+    const auto Find = [&](uint32_t Body) {
+      while (Parent[Body] != Body) {
+        Parent[Body] = Parent[Parent[Body]];
+        Body = Parent[Body];
+      }
+      return Body;
+    };
+    for (const contact &Contact : Contacts) {
+      if (Contact.B != NoBody && InverseMass[Contact.A] > 0 && InverseMass[Contact.B] > 0) {
+        const uint32_t RootA = Find(Contact.A);
+        const uint32_t RootB = Find(Contact.B);
+        if (RootA != RootB) {
+          Parent[std::max(RootA, RootB)] = std::min(RootA, RootB);
+        }
+      }
+    }
+
+    // Counting sort of the contacts by island
+    IslandOf.assign(size(), NoBody);
+    IslandStart.clear();
+    ContactIsland.resize(Contacts.size());
+    for (size_t i = 0; i < Contacts.size(); i++) {
+      const body Dynamic = InverseMass[Contacts[i].A] > 0 ? Contacts[i].A : Contacts[i].B;
+      const uint32_t Root = Find(Dynamic);
+      if (IslandOf[Root] == NoBody) {
+        IslandOf[Root] = static_cast<uint32_t>(IslandStart.size());
+        IslandStart.push_back(0);
+      }
+      ContactIsland[i] = IslandOf[Root];
+      IslandStart[ContactIsland[i]]++;
+    }
+    const auto Islands = static_cast<uint32_t>(IslandStart.size());
+    uint32_t Offset = 0;
+    for (uint32_t &Start : IslandStart) {
+      Offset += std::exchange(Start, Offset);
+    }
+    IslandStart.push_back(Offset);
+    IslandFill.assign(IslandStart.begin(), IslandStart.end() - 1);
+    IslandContacts.resize(Contacts.size());
+    for (size_t i = 0; i < Contacts.size(); i++) {
+      IslandContacts[IslandFill[ContactIsland[i]]++] = static_cast<uint32_t>(i);
+    }
+
+    // Largest islands first so they start early, small ones batched together
+    IslandOrder.resize(Islands);
+    std::iota(IslandOrder.begin(), IslandOrder.end(), 0U);
+    std::ranges::sort(IslandOrder, [&](uint32_t L, uint32_t R) {
+      return IslandStart[L + 1] - IslandStart[L] > IslandStart[R + 1] - IslandStart[R];
+    });
+    SolveJobs.clear();
+    for (uint32_t Begin = 0, End = 0, Size = 0; End < Islands; Size = 0, Begin = End) {
+      while (End < Islands && Size < MinJobContacts) {
+        Size += IslandStart[IslandOrder[End] + 1] - IslandStart[IslandOrder[End]];
+        End++;
+      }
+      SolveJobs.emplace_back(Begin, End);
+    }
+    Stats.Islands = Islands;
+  }
+
+  static auto Key(const contact &Contact) -> uint64_t {
+    return (uint64_t{Contact.A} << 40U) | (uint64_t{Contact.B & 0xFFFFFFU} << 16U) | (Contact.Feature & 0xFFFFU);
+  }
+
+  void Solve(float Dt) {
+    KPROFILE_SCOPE("rigid_bodies::Solve");
+    Jobs.ParallelFor(static_cast<uint32_t>(SolveJobs.size()), [&](uint32_t Job) {
+      for (uint32_t i = SolveJobs[Job].first; i < SolveJobs[Job].second; i++) {
+        const uint32_t Island = IslandOrder[i];
+        const std::span<const uint32_t> Indices(IslandContacts.data() + IslandStart[Island],
+                                                IslandStart[Island + 1] - IslandStart[Island]);
+        for (const uint32_t Index : Indices) {
+          Prepare(Contacts[Index], Dt);
+        }
+        for (const uint32_t Index : Indices) {
+          const contact &Contact = Contacts[Index];
+          Apply(Contact, Contact.Normal * Contact.NormalImpulse + Contact.Tangent1 * Contact.TangentImpulse1 +
+                             Contact.Tangent2 * Contact.TangentImpulse2);
+        }
+        for (uint32_t Iteration = 0; Iteration < Settings.Iterations; Iteration++) {
+          for (const uint32_t Index : Indices) {
+            SolveContact(Contacts[Index]);
+          }
+        }
+      }
+    });
+    Cache.resize(Contacts.size());
+    for (size_t i = 0; i < Contacts.size(); i++) {
+      Cache[i] = {Key(Contacts[i]), Contacts[i].NormalImpulse, Contacts[i].TangentImpulse1,
+                  Contacts[i].TangentImpulse2};
+    }
+    std::ranges::sort(Cache, {}, &cached_impulse::Key);
+  }
+
+  [[nodiscard]] auto RelativeVelocity(const contact &Contact) const -> mth::vec3<float> {
+    mth::vec3<float> Relative = -(Velocity[Contact.A] + AngularVelocity[Contact.A] % Contact.RA);
+    if (Contact.B != NoBody) {
+      Relative += Velocity[Contact.B] + AngularVelocity[Contact.B] % Contact.RB;
+    }
+    return Relative;
+  }
+
+  [[nodiscard]] auto EffectiveMass(const contact &Contact, const mth::vec3<float> &Direction) const -> float {
+    const mth::vec3<float> CrossA = Contact.RA % Direction;
+    float Inverse = InverseMass[Contact.A] + (CrossA & (InverseInertiaWorld[Contact.A] * CrossA));
+    if (Contact.B != NoBody) {
+      const mth::vec3<float> CrossB = Contact.RB % Direction;
+      Inverse += InverseMass[Contact.B] + (CrossB & (InverseInertiaWorld[Contact.B] * CrossB));
+    }
+    return Inverse > 0 ? 1 / Inverse : 0;
+  }
+
+  void Prepare(contact &Contact, float Dt) const {
+    Contact.RA = Contact.Point - Position[Contact.A];
+    Contact.RB = Contact.B != NoBody ? Contact.Point - Position[Contact.B] : mth::vec3<float>(0.0F);
+    std::tie(Contact.Tangent1, Contact.Tangent2) = Basis(Contact.Normal);
+    Contact.NormalMass = EffectiveMass(Contact, Contact.Normal);
+    Contact.TangentMass1 = EffectiveMass(Contact, Contact.Tangent1);
+    Contact.TangentMass2 = EffectiveMass(Contact, Contact.Tangent2);
+    const bool Plane = Contact.B == NoBody;
+    Contact.Friction = Plane ? Friction[Contact.A] : std::sqrt(Friction[Contact.A] * Friction[Contact.B]);
+    const float Bounce = Plane ? Restitution[Contact.A] : std::max(Restitution[Contact.A], Restitution[Contact.B]);
+    const float Approach = RelativeVelocity(Contact) & Contact.Normal; // Negative while closing
+    Contact.Bias = std::max(Settings.Baumgarte / Dt * std::max(Contact.Depth - Settings.Slop, 0.0F),
+                            Approach < -Settings.BounceThreshold ? -Bounce * Approach : 0.0F);
+
+    const uint64_t ContactKey = Key(Contact);
+    const auto Cached = std::ranges::lower_bound(Cache, ContactKey, {}, &cached_impulse::Key);
+    if (Cached != Cache.end() && Cached->Key == ContactKey) {
+      Contact.NormalImpulse = Cached->Normal;
+      Contact.TangentImpulse1 = Cached->Tangent1;
+      Contact.TangentImpulse2 = Cached->Tangent2;
+    }
+  }
+
+  // Impulse acts on B and its opposite on A. Static bodies are shared between islands, so they are never
+  // written, not even with zeros.
+  void Apply(const contact &Contact, const mth::vec3<float> &Impulse) {
+    if (InverseMass[Contact.A] > 0) {
+      Velocity[Contact.A] -= Impulse * InverseMass[Contact.A];
+      AngularVelocity[Contact.A] -= InverseInertiaWorld[Contact.A] * (Contact.RA % Impulse);
+    }
+    if (Contact.B != NoBody && InverseMass[Contact.B] > 0) {
+      Velocity[Contact.B] += Impulse * InverseMass[Contact.B];
+      AngularVelocity[Contact.B] += InverseInertiaWorld[Contact.B] * (Contact.RB % Impulse);
+    }
+  }
+
+  void SolveContact(contact &Contact) {
+    // Friction first, bounded by the normal impulse from the previous iteration
+    const float Limit = Contact.Friction * Contact.NormalImpulse;
+    for (const auto &[Tangent, Mass, Accumulated] :
+         {std::tuple{Contact.Tangent1, Contact.TangentMass1, &Contact.TangentImpulse1},
+          std::tuple{Contact.Tangent2, Contact.TangentMass2, &Contact.TangentImpulse2}}) {
+      const float Old = *Accumulated;
+      *Accumulated = std::clamp(Old - Mass * (RelativeVelocity(Contact) & Tangent), -Limit, Limit);
+      Apply(Contact, Tangent * (*Accumulated - Old));
+    }
+    const float Old = Contact.NormalImpulse;
+    Contact.NormalImpulse =
+        std::max(Old + Contact.NormalMass * (Contact.Bias - (RelativeVelocity(Contact) & Contact.Normal)), 0.0F);
+    Apply(Contact, Contact.Normal * (Contact.NormalImpulse - Old));
+  }
+
+  void IntegratePositions(float Dt) {
+    KPROFILE_SCOPE("rigid_bodies::IntegratePositions");
+    ParallelRanges(size(), BodyGrain, [&](size_t Begin, size_t End) {
+      for (size_t i = Begin; i < End; i++) {
+        if (InverseMass[i] == 0) {
+          continue;
+        }
+        LinearMomentum[i] = Velocity[i] / InverseMass[i];
+        AngularMomentum[i] = WorldInertia(Orientation[i], Reciprocal(InverseInertia[i])) * AngularVelocity[i];
+        Position[i] += Velocity[i] * Dt;
+        Orientation[i] += mth::quat<float>(0, AngularVelocity[i]) * Orientation[i] * (Dt / 2);
+        Orientation[i] = Orientation[i].Normalized();
+        InverseInertiaWorld[i] = WorldInertia(Orientation[i], InverseInertia[i]);
+      }
+    });
+  }
+};
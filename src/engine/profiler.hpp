@@ -0,0 +1,184 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// CPU scope profiler. Build with KALAN_PROFILE defined to enable it; otherwise every KPROFILE_* macro
+// expands to nothing. Scopes are recorded into a per-thread ring (oldest events are overwritten) and
+// exported as Chrome Trace Event JSON, which chrome://tracing and ui.perfetto.dev both open. Each ring has
+// its own lock, which only an export ever contends for.
+class profiler {
+public:
+  static constexpr size_t RingCapacity = 1 << 16; // Events per thread, must be a power of two
+  static constexpr size_t FrameCapacity = 1 << 14; // Frame marks kept, must be a power of two
+  using clock = std::chrono::steady_clock;
+
+  struct event {
+    const char *Name; // Must be a string literal, only the pointer is stored
+    int64_t Start;    // Nanoseconds since profiler start
+    int64_t Duration;
+  };
+
+  static auto Get() -> profiler & {
+    static profiler Profiler;
+    return Profiler;
+  }
+
+  [[nodiscard]] auto Now() const -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - Start).count();
+  }
+  void Record(const char *Name, int64_t Begin, int64_t End) {
+    ring &Ring = LocalRing();
+    std::scoped_lock Lock{Ring.Mutex};
+    Ring.Events[Ring.Head & (RingCapacity - 1)] = {.Name = Name, .Start = Begin, .Duration = End - Begin};
+    Ring.Head++;
+  }
+  void SetThreadName(std::string Name) {
+    ring &Ring = LocalRing();
+    std::scoped_lock Lock{Ring.Mutex};
+    Ring.Name = std::move(Name);
+  }
+  void MarkFrame() {
+    const int64_t Time = Now();
+    std::scoped_lock Lock{FrameMutex};
+    Frames[FrameHead & (FrameCapacity - 1)] = Time;
+    FrameHead++;
+  }
+
+  // Writes every event still held in the rings.
+  void Export(const std::string &Path) {
+    std::ofstream File(Path);
+    if (!File) {
+      throw std::runtime_error("failed to open trace file " + Path);
+    }
+    File << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    bool First = true;
+    auto Separator = [&]() -> std::ofstream & {
+      File << (First ? "\n" : ",\n");
+      First = false;
+      return File;
+    };
+
+    std::scoped_lock Lock{RegisterMutex};
+    std::vector<event> Copy;
+    for (size_t Tid = 0; Tid < Rings.size(); Tid++) {
+      ring &Ring = *Rings[Tid];
+      std::string Name;
+      {
+        // The owner blocks in Record only while its ring is copied, not while the file is written
+        std::scoped_lock RingLock{Ring.Mutex};
+        const uint64_t Count = std::min<uint64_t>(Ring.Head, RingCapacity);
+        Copy.resize(Count);
+        for (uint64_t i = 0; i < Count; i++) {
+          Copy[i] = Ring.Events[(Ring.Head - Count + i) & (RingCapacity - 1)];
+        }
+        Name = Ring.Name;
+      }
+      Separator() << R"({"ph":"M","name":"thread_name","pid":1,"tid":)" << Tid << R"(,"args":{"name":")"
+                  << Escape(Name) << "\"}}";
+      for (const event &Event : Copy) {
+        Separator() << R"({"ph":"X","pid":1,"tid":)" << Tid << R"(,"name":")" << Escape(Event.Name)
+                    << R"(","ts":)" << static_cast<double>(Event.Start) / 1000.0
+                    << R"(,"dur":)" << static_cast<double>(Event.Duration) / 1000.0 << '}';
+      }
+    }
+    {
+      std::scoped_lock FrameLock{FrameMutex};
+      for (uint64_t i = FrameHead - std::min<uint64_t>(FrameHead, FrameCapacity); i < FrameHead; i++) {
+        Separator() << R"({"ph":"i","s":"g","pid":1,"tid":0,"name":"frame )" << i << R"(","ts":)"
+                    << static_cast<double>(Frames[i & (FrameCapacity - 1)]) / 1000.0 << '}';
+      }
+    }
+    File << "\n]}\n";
+  }
+
+  profiler(const profiler &) = delete;
+  profiler(profiler &&) = delete;
+  auto operator=(const profiler &) -> profiler & = delete;
+  auto operator=(profiler &&) -> profiler & = delete;
+  ~profiler() = default;
+
+private:
+  struct ring {
+    std::mutex Mutex; // Taken by the owner on every record and by Export while it copies
+    std::array<event, RingCapacity> Events;
+    uint64_t Head = 0;
+    std::string Name;
+  };
+
+  clock::time_point Start = clock::now();
+  std::mutex RegisterMutex; // Only taken the first time a thread records and on export
+  std::vector<std::unique_ptr<ring>> Rings;
+  std::mutex FrameMutex;
+  std::array<int64_t, FrameCapacity> Frames{}; // The latest marks, oldest overwritten like the event rings
+  uint64_t FrameHead = 0; // Marks ever made, which numbers them
+
+  profiler() = default;
+
+  // Scope and thread names are arbitrary strings; JSON wants quotes, backslashes and control characters escaped
+  static auto Escape(std::string_view Text) -> std::string {
+    static constexpr std::string_view Hex = "0123456789abcdef";
+    std::string Escaped;
+    Escaped.reserve(Text.size());
+    for (const char C : Text) {
+      if (C == '"' || C == '\\') {
+        Escaped += '\\';
+        Escaped += C;
+      } else if (static_cast<unsigned char>(C) < 0x20) {
+        Escaped += "\\u00";
+        Escaped += Hex[(static_cast<unsigned char>(C) >> 4) & 0xF];
+        Escaped += Hex[static_cast<unsigned char>(C) & 0xF];
+      } else {
+        Escaped += C;
+      }
+    }
+    return Escaped;
+  }
+
+  auto LocalRing() -> ring & {
+    thread_local ring *Ring = nullptr;
+    if (Ring == nullptr) {
+      std::scoped_lock Lock{RegisterMutex};
+      Rings.push_back(std::make_unique<ring>());
+      Ring = Rings.back().get();
+      Ring->Name = "thread " + std::to_string(Rings.size() - 1);
+    }
+    return *Ring;
+  }
+};
+
+class profile_scope {
+  const char *Name;
+  int64_t Begin;
+
+public:
+  explicit profile_scope(const char *Name) : Name(Name), Begin(profiler::Get().Now()) {}
+  profile_scope(const profile_scope &) = delete;
+  profile_scope(profile_scope &&) = delete;
+  auto operator=(const profile_scope &) -> profile_scope & = delete;
+  auto operator=(profile_scope &&) -> profile_scope & = delete;
+  ~profile_scope() { profiler::Get().Record(Name, Begin, profiler::Get().Now()); }
+};
+
+#define KPROFILE_CONCAT_IMPL(A, B) A##B
+#define KPROFILE_CONCAT(A, B) KPROFILE_CONCAT_IMPL(A, B)
+
+#ifdef KALAN_PROFILE
+#define KPROFILE_SCOPE(Name) const profile_scope KPROFILE_CONCAT(ProfileScope, __LINE__)(Name)
+#define KPROFILE_FRAME() profiler::Get().MarkFrame()
+#define KPROFILE_THREAD(Name) profiler::Get().SetThreadName(Name)
+#define KPROFILE_EXPORT(Path) profiler::Get().Export(Path)
+#else
+#define KPROFILE_SCOPE(Name) ((void)0)
+#define KPROFILE_FRAME() ((void)0)
+#define KPROFILE_THREAD(Name) ((void)0)
+#define KPROFILE_EXPORT(Path) ((void)0)
+#endif
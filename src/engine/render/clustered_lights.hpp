@@ -0,0 +1,363 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../profiler.hpp"
+#include "../shader/shader_library.hpp"
+#include "../vulkan/buffer.hpp"
+#include "../vulkan/pipelines.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <span>
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+// A point light as the shading shaders see it. Layouts match src/shaders/common/clustered.glsl (std430).
+struct gpu_light {
+  std::array<float, 3> Position; // World space
+  float Radius;                  // The light has no effect past this distance
+  std::array<float, 3> Color;    // Premultiplied by intensity
+  float Pad;
+};
+static_assert(sizeof(gpu_light) == 32);
+
+// Precedes the lights in their buffer, so binning and shading agree on the camera the grid was built for.
+struct gpu_cluster_header {
+  std::array<float, 16> View;
+  std::array<float, 4> Projection; // Tangents of the half field of view in x and y, near and far distance
+  std::array<uint32_t, 4> Grid;    // Clusters in x, y and z, then the light count
+  std::array<float, 4> Lookup;     // Depth slice scale and bias for log(depth), then clusters per pixel in x and y
+};
+static_assert(sizeof(gpu_cluster_header) == 112);
+
+// Bins point lights into a grid of view-space clusters (froxels) so a fragment only shades the lights
+// whose spheres touch its cluster. Screen tiles split x and y, and depth is sliced exponentially between
+// the camera's near and far planes so clusters stay roughly cubic. Shaders include
+// src/shaders/common/clustered.glsl and call ClusteredLighting.
+//
+// Binning normally runs as a compute pass. The CPU path bins slice by slice and row by row, then tests
+// four lights at a time against each cluster with SSE; it writes the same buffers into mapped memory.
+class clustered_lights {
+public:
+  static constexpr uint32_t GridX = 16;
+  static constexpr uint32_t GridY = 9;
+  static constexpr uint32_t GridZ = 24;
+  static constexpr uint32_t ClusterCount = GridX * GridY * GridZ;
+  static constexpr uint32_t MaxLightsPerCluster = 256; // CLUSTER_MAX_LIGHTS in clustered.glsl; extra lights are dropped
+
+  clustered_lights(VkPhysicalDevice PhysicalDevice, VkDevice Device, shader_library &Shaders,
+                   pipeline_registry &Pipelines, uint32_t FramesInFlight, uint32_t MaxLights, bool GpuBinning = true)
+      : Device(Device), MaxLights(MaxLights), GpuBinning(GpuBinning) {
+    const VkMemoryPropertyFlags HostVisible =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkMemoryPropertyFlags Output = GpuBinning ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : HostVisible;
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      frame_data &Frame = *Frames.emplace_back(std::make_unique<frame_data>());
+      Frame.Lights =
+          std::make_unique<buffer>(PhysicalDevice, Device, sizeof(gpu_cluster_header) + MaxLights * sizeof(gpu_light),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HostVisible);
+      Frame.Counts = std::make_unique<buffer>(PhysicalDevice, Device, ClusterCount * sizeof(uint32_t),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, Output);
+      Frame.Indices =
+          std::make_unique<buffer>(PhysicalDevice, Device, ClusterCount * MaxLightsPerCluster * sizeof(uint32_t),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, Output);
+    }
+    CreateDescriptors(FramesInFlight);
+    if (!GpuBinning) {
+      Staged.resize(MaxLights);
+      return;
+    }
+    const shader_library::handle BinShader = Shaders.Load("cluster/bin.comp.glsl");
+    BinPipeline = Pipelines.Create({BinShader}, [this](std::span<const VkShaderModule> Modules) {
+      VkComputePipelineCreateInfo CreateInfo{
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = Modules[0],
+                    .pName = "main"},
+          .layout = PipelineLayout,
+      };
+      VkPipeline Pipeline = VK_NULL_HANDLE;
+      vkCreateComputePipelines(this->Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline);
+      return Pipeline;
+    });
+    this->Pipelines = &Pipelines;
+  }
+  clustered_lights(const clustered_lights &) = delete;
+  clustered_lights(clustered_lights &&) = delete;
+  auto operator=(const clustered_lights &) -> clustered_lights & = delete;
+  auto operator=(clustered_lights &&) -> clustered_lights & = delete;
+  // The owner waits for the device to go idle first
+  ~clustered_lights() {
+    if (Pipelines != nullptr) { // GPU binning only
+      Pipelines->Destroy(BinPipeline);
+    }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+  }
+
+  // Where the CPU writes this frame's lights before Bin.
+  [[nodiscard]] auto GetLights(uint32_t Frame) -> std::span<gpu_light> {
+    if (!GpuBinning) {
+      return Staged;
+    }
+    return {reinterpret_cast<gpu_light *>(Frames[Frame]->Lights->Mapped + sizeof(gpu_cluster_header)), MaxLights};
+  }
+  [[nodiscard]] auto IsGpuBinning() const -> bool { return GpuBinning; }
+
+  // Record outside of a render pass, before any draw that shades with the clusters.
+  void Bin(VkCommandBuffer CommandBuffer, uint32_t Frame, const mth::camera<float> &Camera, uint32_t LightCount) {
+    KPROFILE_SCOPE("clustered_lights::Bin");
+    LightCount = std::min(LightCount, MaxLights);
+    frame_data &Data = *Frames[Frame];
+    const gpu_cluster_header Header = MakeHeader(Camera, LightCount);
+    std::memcpy(Data.Lights->Mapped, &Header, sizeof(Header));
+    if (!GpuBinning) {
+      std::memcpy(Data.Lights->Mapped + sizeof(Header), Staged.data(), LightCount * sizeof(gpu_light));
+      CpuBin(Data, Camera, Header, LightCount);
+      return;
+    }
+
+    // The frame's fence has been waited on, so the previous readers of these buffers are done
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines->Get(BinPipeline));
+    vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1, &Data.Set, 0,
+                            nullptr);
+    vkCmdDispatch(CommandBuffer, (ClusterCount + BinGroupSize - 1) / BinGroupSize, 1, 1);
+    VkMemoryBarrier Barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &Barrier,
+                         0, nullptr, 0, nullptr);
+  }
+
+  // Binds the frame's lights and clusters as set SetIndex of a pipeline layout created with GetSetLayout
+  // there; clustered.glsl expects set 1 unless CLUSTER_SET says otherwise.
+  void Bind(VkCommandBuffer CommandBuffer, VkPipelineBindPoint BindPoint, VkPipelineLayout Layout, uint32_t SetIndex,
+            uint32_t Frame) const {
+    vkCmdBindDescriptorSets(CommandBuffer, BindPoint, Layout, SetIndex, 1, &Frames[Frame]->Set, 0, nullptr);
+  }
+  [[nodiscard]] auto GetSetLayout() const -> VkDescriptorSetLayout { return SetLayout; }
+
+private:
+  static constexpr uint32_t BinGroupSize = 128; // local_size_x in bin.comp.glsl
+
+  struct frame_data {
+    std::unique_ptr<buffer> Lights; // gpu_cluster_header, then the lights
+    std::unique_ptr<buffer> Counts;
+    std::unique_ptr<buffer> Indices;
+    VkDescriptorSet Set = VK_NULL_HANDLE;
+  };
+  // A cluster's view-space bounds, with z as the positive distance in front of the camera
+  struct box {
+    float MinX, MaxX, MinY, MaxY, MinZ, MaxZ;
+  };
+  // Lights in view space, one array per component, padded to a multiple of four
+  struct light_soa {
+    std::vector<float> X, Y, Z, RadiusSquared;
+
+    void Clear() {
+      X.clear();
+      Y.clear();
+      Z.clear();
+      RadiusSquared.clear();
+    }
+    void Push(float PositionX, float PositionY, float PositionZ, float RadiusSquared) {
+      X.push_back(PositionX);
+      Y.push_back(PositionY);
+      Z.push_back(PositionZ);
+      this->RadiusSquared.push_back(RadiusSquared);
+    }
+    void Pad() {
+      while (X.size() % 4 != 0) {
+        Push(0, 0, 0, -1); // A negative squared radius never overlaps anything
+      }
+    }
+  };
+
+  VkDevice Device;
+  uint32_t MaxLights;
+  bool GpuBinning;
+  std::vector<std::unique_ptr<frame_data>> Frames;
+  std::vector<gpu_light> Staged; // CPU binning reads lights from cached memory, not the mapped buffer
+  std::vector<mth::vec4<float>> ViewLights; // CPU binning: view-space position and radius
+  std::vector<uint32_t> SliceLights, RowLights;
+  light_soa Batch;
+  VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+  pipeline_registry *Pipelines = nullptr;
+  pipeline_registry::handle BinPipeline = 0;
+
+  static auto MakeHeader(const mth::camera<float> &Camera, uint32_t LightCount) -> gpu_cluster_header {
+    gpu_cluster_header Header{};
+    Header.View = Camera.MatrView.A;
+    const float Near = Camera.ProjDist;
+    const float Far = Camera.FarClip;
+    Header.Projection = {Camera.Wp / 2 / Near, Camera.Hp / 2 / Near, Near, Far};
+    Header.Grid = {GridX, GridY, GridZ, LightCount};
+    const float SliceScale = static_cast<float>(GridZ) / std::log(Far / Near);
+    Header.Lookup = {SliceScale, -SliceScale * std::log(Near), static_cast<float>(GridX) / std::max(Camera.FrameW, 1),
+                     static_cast<float>(GridY) / std::max(Camera.FrameH, 1)};
+    return Header;
+  }
+
+  // View-space extent of a tile between two depths; Ndc0 < Ndc1 are the tile's edges in [-1, 1]
+  static auto Extent(float Ndc0, float Ndc1, float Tangent, float Near, float Far) -> std::pair<float, float> {
+    return {std::min(Ndc0 * Tangent * Near, Ndc0 * Tangent * Far),
+            std::max(Ndc1 * Tangent * Near, Ndc1 * Tangent * Far)};
+  }
+
+  // Bit i is set if light i of the four starting at First overlaps Box
+  static auto Overlap4(const light_soa &Lights, size_t First, const box &Box) -> uint32_t {
+#if defined(__SSE2__)
+    const __m128 Zero = _mm_setzero_ps();
+    const auto AxisDistanceSquared = [&](const float *Position, float Min, float Max) {
+      const __m128 P = _mm_loadu_ps(Position);
+      const __m128 D = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(Min), P), _mm_sub_ps(P, _mm_set1_ps(Max))), Zero);
+      return _mm_mul_ps(D, D);
+    };
+    const __m128 DistanceSquared =
+        _mm_add_ps(_mm_add_ps(AxisDistanceSquared(&Lights.X[First], Box.MinX, Box.MaxX),
+                              AxisDistanceSquared(&Lights.Y[First], Box.MinY, Box.MaxY)),
+                   AxisDistanceSquared(&Lights.Z[First], Box.MinZ, Box.MaxZ));
+    return static_cast<uint32_t>(
+        _mm_movemask_ps(_mm_cmple_ps(DistanceSquared, _mm_loadu_ps(&Lights.RadiusSquared[First]))));
+#else
+    uint32_t Mask = 0;
+    for (size_t i = 0; i < 4; i++) {
+      const float Dx = std::max({Box.MinX - Lights.X[First + i], Lights.X[First + i] - Box.MaxX, 0.0F});
+      const float Dy = std::max({Box.MinY - Lights.Y[First + i], Lights.Y[First + i] - Box.MaxY, 0.0F});
+      const float Dz = std::max({Box.MinZ - Lights.Z[First + i], Lights.Z[First + i] - Box.MaxZ, 0.0F});
+      if (Dx * Dx + Dy * Dy + Dz * Dz <= Lights.RadiusSquared[First + i]) {
+        Mask |= 1U << i;
+      }
+    }
+    return Mask;
+#endif
+  }
+
+  void CpuBin(frame_data &Data, const mth::camera<float> &Camera, const gpu_cluster_header &Header,
+              uint32_t LightCount) {
+    ViewLights.clear();
+    for (uint32_t i = 0; i < LightCount; i++) {
+      const gpu_light &Light = Staged[i];
+      const mth::vec3<float> View =
+          Camera.MatrView.PointTransform({Light.Position[0], Light.Position[1], Light.Position[2]});
+      ViewLights.emplace_back(View.X, View.Y, -View.Z, Light.Radius); // The camera looks down -z
+    }
+    auto *Counts = reinterpret_cast<uint32_t *>(Data.Counts->Mapped);
+    auto *Indices = reinterpret_cast<uint32_t *>(Data.Indices->Mapped);
+    const auto [TangentX, TangentY, Near, Far] = Header.Projection;
+
+    // Narrow the lights down per depth slice, then per row, so each cluster only tests its neighbourhood
+    for (uint32_t Z = 0; Z < GridZ; Z++) {
+      const float Near0 = Near * std::pow(Far / Near, static_cast<float>(Z) / GridZ);
+      const float Far0 = Near * std::pow(Far / Near, static_cast<float>(Z + 1) / GridZ);
+      SliceLights.clear();
+      for (uint32_t i = 0; i < LightCount; i++) {
+        const mth::vec4<float> &Light = ViewLights[i];
+        if (Light.Z + Light.W >= Near0 && Light.Z - Light.W <= Far0) {
+          SliceLights.push_back(i);
+        }
+      }
+      for (uint32_t Y = 0; Y < GridY; Y++) {
+        // Row 0 is the top of the screen, which is +y in view space
+        const auto [MinY, MaxY] =
+            Extent(1 - 2.0F * (Y + 1) / GridY, 1 - 2.0F * Y / GridY, TangentY, Near0, Far0);
+        RowLights.clear();
+        Batch.Clear();
+        for (uint32_t i : SliceLights) {
+          const mth::vec4<float> &Light = ViewLights[i];
+          if (Light.Y + Light.W >= MinY && Light.Y - Light.W <= MaxY) {
+            RowLights.push_back(i);
+            Batch.Push(Light.X, Light.Y, Light.Z, Light.W * Light.W);
+          }
+        }
+        Batch.Pad();
+        for (uint32_t X = 0; X < GridX; X++) {
+          const auto [MinX, MaxX] =
+              Extent(-1 + 2.0F * X / GridX, -1 + 2.0F * (X + 1) / GridX, TangentX, Near0, Far0);
+          const box Box{MinX, MaxX, MinY, MaxY, Near0, Far0};
+          const uint32_t Cluster = X + GridX * (Y + GridY * Z);
+          uint32_t *Out = Indices + size_t{Cluster} * MaxLightsPerCluster;
+          uint32_t Count = 0;
+          for (size_t First = 0; First < Batch.X.size() && Count < MaxLightsPerCluster; First += 4) {
+            for (uint32_t Mask = Overlap4(Batch, First, Box); Mask != 0 && Count < MaxLightsPerCluster;
+                 Mask &= Mask - 1) {
+              Out[Count++] = RowLights[First + std::countr_zero(Mask)];
+            }
+          }
+          Counts[Cluster] = Count;
+        }
+      }
+    }
+  }
+
+  void CreateDescriptors(uint32_t FramesInFlight) {
+    std::array<VkDescriptorSetLayoutBinding, 3> Bindings{};
+    for (uint32_t i = 0; i < Bindings.size(); i++) {
+      Bindings[i] = {.binding = i,
+                     .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                     .descriptorCount = 1,
+                     .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT};
+    }
+    VkDescriptorSetLayoutCreateInfo LayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(Bindings.size()),
+        .pBindings = Bindings.data(),
+    };
+    VkDescriptorPoolSize PoolSize{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                  .descriptorCount = static_cast<uint32_t>(Bindings.size()) * FramesInFlight};
+    VkDescriptorPoolCreateInfo PoolInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = FramesInFlight,
+        .poolSizeCount = 1,
+        .pPoolSizes = &PoolSize,
+    };
+    if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &SetLayout) != VK_SUCCESS ||
+        vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &DescriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cluster descriptors!");
+    }
+    VkPipelineLayoutCreateInfo PipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &SetLayout,
+    };
+    if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cluster pipeline layout!");
+    }
+    for (std::unique_ptr<frame_data> &Frame : Frames) {
+      VkDescriptorSetAllocateInfo AllocateInfo{
+          .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+          .descriptorPool = DescriptorPool,
+          .descriptorSetCount = 1,
+          .pSetLayouts = &SetLayout,
+      };
+      if (vkAllocateDescriptorSets(Device, &AllocateInfo, &Frame->Set) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate cluster descriptor set!");
+      }
+      const std::array<VkDescriptorBufferInfo, 3> Infos = {{
+          {Frame->Lights->Buffer, 0, VK_WHOLE_SIZE},
+          {Frame->Counts->Buffer, 0, VK_WHOLE_SIZE},
+          {Frame->Indices->Buffer, 0, VK_WHOLE_SIZE},
+      }};
+      std::array<VkWriteDescriptorSet, 3> Writes{};
+      for (uint32_t i = 0; i < Writes.size(); i++) {
+        Writes[i] = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                     .dstSet = Frame->Set,
+                     .dstBinding = i,
+                     .descriptorCount = 1,
+                     .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                     .pBufferInfo = &Infos[i]};
+      }
+      vkUpdateDescriptorSets(Device, static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+    }
+  }
+};
@@ -0,0 +1,301 @@
+#pragma once
+#include "../profiler.hpp"
+#include "../shader/shader_library.hpp"
+#include "../vulkan/common.hpp"
+#include "../vulkan/pipelines.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+// A hierarchical-Z pyramid of a depth buffer. Each texel of level L holds the farthest depth of the texels it
+// covers in level L - 1, and level 0 is a copy of the depth buffer, so a bounding box whose nearest depth lies
+// behind the pyramid over its screen rectangle is hidden. indirect_draw::CullLate tests against it.
+//
+// The pyramid is an R32_SFLOAT image with a full mip chain that stays in GENERAL layout. Build records one
+// hiz/build.comp.glsl dispatch per level, which reduces the same way as occlusion_buffer does on the CPU.
+class hiz_pyramid {
+public:
+  hiz_pyramid(VkPhysicalDevice PhysicalDevice, VkDevice Device, shader_library &Shaders, pipeline_registry &Pipelines)
+      : PhysicalDevice(PhysicalDevice), Device(Device), Pipelines(Pipelines) {
+    VkSamplerCreateInfo SamplerInfo{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = VK_LOD_CLAMP_NONE,
+    };
+    if (vkCreateSampler(Device, &SamplerInfo, nullptr, &Sampler) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+    const std::array<VkDescriptorSetLayoutBinding, 2> Bindings = {{
+        {.binding = 0,
+         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT},
+        {.binding = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT},
+    }};
+    VkDescriptorSetLayoutCreateInfo LayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(Bindings.size()),
+        .pBindings = Bindings.data(),
+    };
+    VkPushConstantRange PushConstants{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .size = sizeof(build_constants)};
+    if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &SetLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+    }
+    VkPipelineLayoutCreateInfo PipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &SetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &PushConstants,
+    };
+    if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+    const shader_library::handle BuildShader = Shaders.Load("hiz/build.comp.glsl");
+    BuildPipeline = Pipelines.Create({BuildShader}, [this](std::span<const VkShaderModule> Modules) {
+      VkComputePipelineCreateInfo CreateInfo{
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = Modules[0],
+                    .pName = "main"},
+          .layout = PipelineLayout,
+      };
+      VkPipeline Pipeline = VK_NULL_HANDLE;
+      vkCreateComputePipelines(this->Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline);
+      return Pipeline;
+    });
+  }
+  hiz_pyramid(const hiz_pyramid &) = delete;
+  hiz_pyramid(hiz_pyramid &&) = delete;
+  auto operator=(const hiz_pyramid &) -> hiz_pyramid & = delete;
+  auto operator=(hiz_pyramid &&) -> hiz_pyramid & = delete;
+  // The owner waits for the device to go idle first
+  ~hiz_pyramid() {
+    Pipelines.Destroy(BuildPipeline);
+    DestroyImage();
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+    vkDestroySampler(Device, Sampler, nullptr);
+  }
+
+  // Sets the depth buffer Build reduces and sizes the pyramid after it. DepthView views the depth aspect only,
+  // and the image is in DepthLayout whenever Build runs. Call while no frame is in flight, e.g. after the
+  // swapchain was recreated.
+  void SetDepth(VkImageView DepthView, VkImageLayout DepthLayout, uint32_t DepthWidth, uint32_t DepthHeight) {
+    DestroyImage();
+    Generation++;
+    Width = DepthWidth;
+    Height = DepthHeight;
+    LevelCount = static_cast<uint32_t>(std::bit_width(std::max(Width, Height)));
+    CreateImage();
+
+    const std::array<VkDescriptorPoolSize, 2> PoolSizes = {{
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = LevelCount},
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = LevelCount},
+    }};
+    VkDescriptorPoolCreateInfo PoolInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = LevelCount,
+        .poolSizeCount = static_cast<uint32_t>(PoolSizes.size()),
+        .pPoolSizes = PoolSizes.data(),
+    };
+    if (vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &DescriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+    }
+    const std::vector<VkDescriptorSetLayout> Layouts(LevelCount, SetLayout);
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = DescriptorPool,
+        .descriptorSetCount = LevelCount,
+        .pSetLayouts = Layouts.data(),
+    };
+    Sets.resize(LevelCount);
+    if (vkAllocateDescriptorSets(Device, &AllocateInfo, Sets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate depth pyramid descriptor sets!");
+    }
+    for (uint32_t Level = 0; Level < LevelCount; Level++) {
+      const VkDescriptorImageInfo Source =
+          Level == 0 ? VkDescriptorImageInfo{Sampler, DepthView, DepthLayout}
+                     : VkDescriptorImageInfo{Sampler, LevelViews[Level - 1], VK_IMAGE_LAYOUT_GENERAL};
+      const VkDescriptorImageInfo Target{VK_NULL_HANDLE, LevelViews[Level], VK_IMAGE_LAYOUT_GENERAL};
+      const std::array<VkWriteDescriptorSet, 2> Writes = {{
+          {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+           .dstSet = Sets[Level],
+           .dstBinding = 0,
+           .descriptorCount = 1,
+           .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+           .pImageInfo = &Source},
+          {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+           .dstSet = Sets[Level],
+           .dstBinding = 1,
+           .descriptorCount = 1,
+           .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+           .pImageInfo = &Target},
+      }};
+      vkUpdateDescriptorSets(Device, static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+    }
+    Initialized = false;
+  }
+
+  // Record outside of a render pass once depth has been written, e.g. after the first phase of culling drew
+  // last frame's visible instances. The pyramid is ready for compute shaders to read afterwards.
+  void Build(VkCommandBuffer CommandBuffer) {
+    KPROFILE_SCOPE("hiz_pyramid::Build");
+    if (Image == VK_NULL_HANDLE) {
+      return;
+    }
+    if (!Initialized) {
+      TransitionImage(CommandBuffer, Image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_WRITE_BIT, LevelCount);
+      Initialized = true;
+    }
+    // Depth writes must land before level 0 reads them, and last frame's culling must be done reading the
+    // pyramid before it is overwritten
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines.Get(BuildPipeline));
+    build_constants Constants{.SourceSize = {Width, Height}, .TargetSize = {Width, Height}};
+    for (uint32_t Level = 0; Level < LevelCount; Level++) {
+      if (Level != 0) {
+        Constants.SourceSize = Constants.TargetSize;
+        Constants.TargetSize = {std::max(Constants.SourceSize[0] / 2, 1U), std::max(Constants.SourceSize[1] / 2, 1U)};
+        Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+      }
+      vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1, &Sets[Level], 0,
+                              nullptr);
+      vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants),
+                         &Constants);
+      vkCmdDispatch(CommandBuffer, (Constants.TargetSize[0] + GroupSize - 1) / GroupSize,
+                    (Constants.TargetSize[1] + GroupSize - 1) / GroupSize, 1);
+    }
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  }
+
+  // Views every level, in GENERAL layout. Sample with GetSampler and texelFetch.
+  [[nodiscard]] auto GetView() const -> VkImageView { return View; }
+  // Bumped by every SetDepth. The new view may reuse the old one's handle, so compare this, not the view.
+  [[nodiscard]] auto GetGeneration() const -> uint64_t { return Generation; }
+  [[nodiscard]] auto GetSampler() const -> VkSampler { return Sampler; }
+  [[nodiscard]] auto GetWidth() const -> uint32_t { return Width; }
+  [[nodiscard]] auto GetHeight() const -> uint32_t { return Height; }
+  [[nodiscard]] auto GetLevelCount() const -> uint32_t { return LevelCount; }
+
+private:
+  static constexpr uint32_t GroupSize = 8; // local_size_x and local_size_y in build.comp.glsl
+
+  struct build_constants {
+    std::array<uint32_t, 2> SourceSize;
+    std::array<uint32_t, 2> TargetSize;
+  };
+
+  VkPhysicalDevice PhysicalDevice;
+  VkDevice Device;
+  pipeline_registry &Pipelines;
+  pipeline_registry::handle BuildPipeline = 0;
+  VkSampler Sampler = VK_NULL_HANDLE;
+  VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+  VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> Sets; // Per level
+  VkImage Image = VK_NULL_HANDLE;
+  VkDeviceMemory Memory = VK_NULL_HANDLE;
+  VkImageView View = VK_NULL_HANDLE;
+  std::vector<VkImageView> LevelViews;
+  uint32_t Width = 0, Height = 0, LevelCount = 0;
+  uint64_t Generation = 0;
+  bool Initialized = false; // Whether the image has left UNDEFINED layout
+
+  static void Barrier(VkCommandBuffer CommandBuffer, VkPipelineStageFlags SrcStage, VkAccessFlags SrcAccess,
+                      VkPipelineStageFlags DstStage, VkAccessFlags DstAccess) {
+    VkMemoryBarrier Barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = SrcAccess,
+        .dstAccessMask = DstAccess,
+    };
+    vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+  }
+
+  auto CreateView(uint32_t FirstLevel, uint32_t Count) const -> VkImageView {
+    VkImageViewCreateInfo ViewInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = Image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = VK_FORMAT_R32_SFLOAT,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .baseMipLevel = FirstLevel,
+                             .levelCount = Count,
+                             .layerCount = 1},
+    };
+    VkImageView Result = VK_NULL_HANDLE;
+    if (vkCreateImageView(Device, &ViewInfo, nullptr, &Result) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid view!");
+    }
+    return Result;
+  }
+
+  void CreateImage() {
+    VkImageCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R32_SFLOAT,
+        .extent = {Width, Height, 1},
+        .mipLevels = LevelCount,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    if (vkCreateImage(Device, &CreateInfo, nullptr, &Image) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid image!");
+    }
+    VkMemoryRequirements Requirements;
+    vkGetImageMemoryRequirements(Device, Image, &Requirements);
+    VkMemoryAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = Requirements.size,
+        .memoryTypeIndex =
+            FindMemoryType(PhysicalDevice, Requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+    };
+    if (vkAllocateMemory(Device, &AllocateInfo, nullptr, &Memory) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate depth pyramid memory!");
+    }
+    vkBindImageMemory(Device, Image, Memory, 0);
+    View = CreateView(0, LevelCount);
+    for (uint32_t Level = 0; Level < LevelCount; Level++) {
+      LevelViews.push_back(CreateView(Level, 1));
+    }
+  }
+
+  void DestroyImage() {
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    DescriptorPool = VK_NULL_HANDLE;
+    Sets.clear();
+    for (VkImageView LevelView : LevelViews) {
+      vkDestroyImageView(Device, LevelView, nullptr);
+    }
+    LevelViews.clear();
+    vkDestroyImageView(Device, View, nullptr);
+    vkDestroyImage(Device, Image, nullptr);
+    vkFreeMemory(Device, Memory, nullptr);
+    View = VK_NULL_HANDLE;
+    Image = VK_NULL_HANDLE;
+    Memory = VK_NULL_HANDLE;
+  }
+};
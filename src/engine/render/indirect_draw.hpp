@@ -0,0 +1,485 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../assets/mesh_format.hpp"
+#include "../profiler.hpp"
+#include "../shader/shader_library.hpp"
+#include "../software/occlusion_buffer.hpp"
+#include "../vulkan/buffer.hpp"
+#include "../vulkan/device.hpp"
+#include "../vulkan/pipelines.hpp"
+#include "../vulkan/shader_variants.hpp"
+#include "hiz_pyramid.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// Per-instance data, read by the culling shader and by vertex shaders through gl_InstanceIndex.
+// Layouts match src/shaders/common/cull.glsl (std430).
+struct gpu_instance {
+  std::array<float, 16> World;
+  std::array<float, 3> Center; // World-space bounding sphere
+  float Radius;
+  uint32_t Mesh; // Index into the mesh table
+  std::array<uint32_t, 3> Pad;
+};
+static_assert(sizeof(gpu_instance) == 96);
+
+struct gpu_mesh {
+  uint32_t IndexCount;
+  uint32_t FirstIndex;
+  int32_t VertexOffset;
+  uint32_t Pad;
+};
+
+// Draws every instance with a single indirect call instead of one vkCmdDraw* per object. Culling writes
+// one VkDrawIndexedIndirectCommand per visible instance with firstInstance set to the instance index.
+//
+// With VK_KHR_draw_indirect_count and drawIndirectFirstInstance a compute pass culls against the camera
+// frustum, compacts the commands and the draw count never leaves the GPU. Without them the CPU culls with
+// mth::frustum and writes the commands into a mapped buffer; without drawIndirectFirstInstance, which indirect
+// commands need to name their instance, it issues one vkCmdDrawIndexed per visible instance instead.
+//
+// On the GPU path, CullEarly and CullLate add two-phase occlusion culling against a hiz_pyramid:
+//  1. CullEarly, then Draw: the instances visible last frame are drawn first and lay down depth;
+//  2. hiz_pyramid::Build reduces that depth;
+//  3. CullLate, then DrawLate: every instance is tested against the pyramid, the result is remembered for the
+//     next frame, and the newly visible instances are drawn.
+// An instance must keep its index from frame to frame for this to pay off. On the CPU path Cull can take an
+// occlusion_buffer instead.
+class indirect_draw {
+public:
+  indirect_draw(VkPhysicalDevice PhysicalDevice, VkDevice Device, const device_capabilities &Capabilities,
+                shader_library &Shaders, pipeline_registry &Pipelines, uint32_t FramesInFlight, uint32_t MaxInstances)
+      : PhysicalDevice(PhysicalDevice), Device(Device), MaxInstances(MaxInstances),
+        GpuCulling(Capabilities.DrawIndirectCount && Capabilities.DrawIndirectFirstInstance),
+        MultiDraw(Capabilities.MultiDrawIndirect), IndirectFirstInstance(Capabilities.DrawIndirectFirstInstance) {
+    const VkMemoryPropertyFlags HostVisible =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      frame_data &Frame = *Frames.emplace_back(std::make_unique<frame_data>());
+      Frame.Instances = std::make_unique<buffer>(PhysicalDevice, Device, MaxInstances * sizeof(gpu_instance),
+                                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HostVisible);
+      Frame.Draws = std::make_unique<buffer>(
+          PhysicalDevice, Device, MaxInstances * sizeof(VkDrawIndexedIndirectCommand),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+          GpuCulling ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : HostVisible);
+    }
+    if (!GpuCulling) {
+      Staged.resize(MaxInstances);
+      return;
+    }
+    CmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(Device, "vkCmdDrawIndexedIndirectCountKHR"));
+    const VkBufferUsageFlags CountUsage =
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    for (std::unique_ptr<frame_data> &Frame : Frames) {
+      Frame->Count = std::make_unique<buffer>(PhysicalDevice, Device, sizeof(uint32_t), CountUsage,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      Frame->LateDraws = std::make_unique<buffer>(PhysicalDevice, Device,
+                                                  MaxInstances * sizeof(VkDrawIndexedIndirectCommand),
+                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      Frame->LateCount = std::make_unique<buffer>(PhysicalDevice, Device, sizeof(uint32_t), CountUsage,
+                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    Visibility = std::make_unique<buffer>(PhysicalDevice, Device, MaxInstances * sizeof(uint32_t),
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CreateDescriptors(FramesInFlight);
+    const auto Compute = [this](std::span<const VkShaderModule> Modules, const VkSpecializationInfo *Specialization) {
+      VkComputePipelineCreateInfo CreateInfo{
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = Modules[0],
+                    .pName = "main",
+                    .pSpecializationInfo = Specialization},
+          .layout = PipelineLayout,
+      };
+      VkPipeline Pipeline = VK_NULL_HANDLE;
+      vkCreateComputePipelines(this->Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline);
+      return Pipeline;
+    };
+    CullPipeline = Pipelines.Create({Shaders.Load("cull/cull.comp.glsl")},
+                                    [Compute](std::span<const VkShaderModule> Modules) {
+                                      return Compute(Modules, nullptr);
+                                    });
+    // The late phase binds the pyramid, so it is a define; each phase is compiled when first recorded
+    Occlusion = std::make_unique<shader_variants>(
+        Shaders, Pipelines, std::vector<std::filesystem::path>{"cull/occlusion.comp.glsl"},
+        std::vector<shader_variants::feature>{{.Name = "CULL_LATE"}}, Compute);
+    this->Pipelines = &Pipelines;
+  }
+  indirect_draw(const indirect_draw &) = delete;
+  indirect_draw(indirect_draw &&) = delete;
+  auto operator=(const indirect_draw &) -> indirect_draw & = delete;
+  auto operator=(indirect_draw &&) -> indirect_draw & = delete;
+  // The owner waits for the device to go idle first
+  ~indirect_draw() {
+    if (Pipelines != nullptr) { // GPU culling only
+      Pipelines->Destroy(CullPipeline);
+    }
+    Occlusion.reset(); // Its builders use PipelineLayout
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, PyramidSetLayout, nullptr);
+  }
+
+  // Replaces the mesh table, e.g. with the meshes of a mesh_file. Call while no frame is in flight.
+  void SetMeshes(std::span<const mesh_format::mesh> Source) {
+    Meshes.clear();
+    for (const mesh_format::mesh &Mesh : Source) {
+      Meshes.push_back(
+          {.IndexCount = Mesh.IndexCount, .FirstIndex = Mesh.FirstIndex, .VertexOffset = Mesh.VertexOffset});
+    }
+    if (!GpuCulling || Meshes.empty()) {
+      return;
+    }
+    MeshTable = std::make_unique<buffer>(PhysicalDevice, Device, Meshes.size() * sizeof(gpu_mesh),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    std::memcpy(MeshTable->Mapped, Meshes.data(), Meshes.size() * sizeof(gpu_mesh));
+    for (std::unique_ptr<frame_data> &Frame : Frames) {
+      WriteDescriptors(*Frame);
+    }
+  }
+
+  // Where the CPU writes this frame's instances before Cull.
+  [[nodiscard]] auto GetInstances(uint32_t Frame) -> std::span<gpu_instance> {
+    if (!GpuCulling) {
+      return Staged;
+    }
+    return {reinterpret_cast<gpu_instance *>(Frames[Frame]->Instances->Mapped), MaxInstances};
+  }
+  // Bind as a storage buffer for vertex shaders to fetch instances[gl_InstanceIndex].
+  [[nodiscard]] auto GetInstanceBuffer(uint32_t Frame) const -> VkBuffer { return Frames[Frame]->Instances->Buffer; }
+  [[nodiscard]] auto IsGpuCulling() const -> bool { return GpuCulling; }
+
+  // Record outside of a render pass, before Draw. The CPU path also skips instances hidden behind Occluders,
+  // which must have been rendered from the same camera; the GPU path ignores them.
+  void Cull(VkCommandBuffer CommandBuffer, uint32_t Frame, const mth::camera<float> &Camera, uint32_t InstanceCount,
+            const occlusion_buffer *Occluders = nullptr) {
+    KPROFILE_SCOPE("indirect_draw::Cull");
+    InstanceCount = std::min(InstanceCount, MaxInstances);
+    const mth::frustum<float> Frustum(Camera.MatrVP);
+    frame_data &Data = *Frames[Frame];
+    if (!GpuCulling) {
+      CpuCull(Data, Frustum, InstanceCount, Occluders);
+      return;
+    }
+    if (!BeginCull(CommandBuffer, *Data.Count)) {
+      return;
+    }
+    cull_constants Constants{.InstanceCount = InstanceCount};
+    for (size_t i = 0; i < Constants.Planes.size(); i++) {
+      const mth::vec4<float> &Plane = Frustum.Planes[i];
+      Constants.Planes[i] = {Plane.X, Plane.Y, Plane.Z, Plane.W};
+    }
+    Dispatch(CommandBuffer, CullPipeline, {&Data.Set, 1}, &Constants, sizeof(Constants), InstanceCount);
+  }
+
+  // The first phase of occlusion culling: queues the instances that were visible last frame and are still in
+  // the frustum. Record outside of a render pass, then Draw, then build the pyramid from the depth written.
+  // The CPU path culls against the frustum only, like Cull, and leaves nothing for the second phase.
+  void CullEarly(VkCommandBuffer CommandBuffer, uint32_t Frame, const mth::camera<float> &Camera,
+                 uint32_t InstanceCount) {
+    KPROFILE_SCOPE("indirect_draw::CullEarly");
+    InstanceCount = std::min(InstanceCount, MaxInstances);
+    frame_data &Data = *Frames[Frame];
+    if (!GpuCulling) {
+      CpuCull(Data, mth::frustum<float>(Camera.MatrVP), InstanceCount, nullptr);
+      return;
+    }
+    if (!VisibilityCleared) { // Nothing was visible before the first frame
+      vkCmdFillBuffer(CommandBuffer, Visibility->Buffer, 0, VK_WHOLE_SIZE, 0);
+      VisibilityCleared = true;
+    }
+    if (!BeginCull(CommandBuffer, *Data.Count)) {
+      return;
+    }
+    const occlusion_constants Constants{.ViewProjection = Camera.MatrVP.A, .InstanceCount = InstanceCount};
+    Dispatch(CommandBuffer, Occlusion->Get(0), {&Data.Set, 1}, &Constants, sizeof(Constants), InstanceCount);
+  }
+
+  // The second phase: tests every instance against the frustum and Pyramid, built from the depth of what
+  // CullEarly queued, remembers the result for the next frame's CullEarly and queues the instances CullEarly
+  // did not for DrawLate. Record outside of a render pass with the same camera as CullEarly.
+  void CullLate(VkCommandBuffer CommandBuffer, uint32_t Frame, const mth::camera<float> &Camera,
+                uint32_t InstanceCount, const hiz_pyramid &Pyramid) {
+    KPROFILE_SCOPE("indirect_draw::CullLate");
+    InstanceCount = std::min(InstanceCount, MaxInstances);
+    frame_data &Data = *Frames[Frame];
+    if (!GpuCulling) {
+      return;
+    }
+    if (&Pyramid != Data.Pyramid || Pyramid.GetGeneration() != Data.PyramidGeneration) {
+      WritePyramidDescriptor(Data, Pyramid); // The frame's fence has been waited on, so its set is not in use
+    }
+    if (!BeginCull(CommandBuffer, *Data.LateCount)) {
+      return;
+    }
+    const occlusion_constants Constants{.ViewProjection = Camera.MatrVP.A,
+                                        .InstanceCount = InstanceCount,
+                                        .LevelCount = Pyramid.GetLevelCount(),
+                                        .PyramidSize = {Pyramid.GetWidth(), Pyramid.GetHeight()}};
+    const std::array<VkDescriptorSet, 2> Sets = {Data.LateSet, Data.PyramidSet};
+    Dispatch(CommandBuffer, Occlusion->Get(LatePhase), Sets, &Constants, sizeof(Constants), InstanceCount);
+  }
+
+  // Record inside a render pass, with the graphics pipeline and the vertex and index buffers bound.
+  void Draw(VkCommandBuffer CommandBuffer, uint32_t Frame) const {
+    const frame_data &Data = *Frames[Frame];
+    constexpr uint32_t Stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (GpuCulling) {
+      CmdDrawIndexedIndirectCount(CommandBuffer, Data.Draws->Buffer, 0, Data.Count->Buffer, 0, MaxInstances, Stride);
+    } else if (!IndirectFirstInstance) {
+      for (const VkDrawIndexedIndirectCommand &Command : Data.Direct) {
+        vkCmdDrawIndexed(CommandBuffer, Command.indexCount, Command.instanceCount, Command.firstIndex,
+                         Command.vertexOffset, Command.firstInstance);
+      }
+    } else if (MultiDraw) {
+      vkCmdDrawIndexedIndirect(CommandBuffer, Data.Draws->Buffer, 0, Data.Visible, Stride);
+    } else {
+      for (uint32_t i = 0; i < Data.Visible; i++) {
+        vkCmdDrawIndexedIndirect(CommandBuffer, Data.Draws->Buffer, VkDeviceSize{i} * Stride, 1, Stride);
+      }
+    }
+  }
+
+  // Draws what CullLate queued, like Draw.
+  void DrawLate(VkCommandBuffer CommandBuffer, uint32_t Frame) const {
+    const frame_data &Data = *Frames[Frame];
+    if (GpuCulling) {
+      CmdDrawIndexedIndirectCount(CommandBuffer, Data.LateDraws->Buffer, 0, Data.LateCount->Buffer, 0, MaxInstances,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+    }
+  }
+
+private:
+  static constexpr uint32_t CullGroupSize = 64; // local_size_x in cull.comp.glsl and occlusion.comp.glsl
+
+  struct cull_constants {
+    std::array<std::array<float, 4>, 6> Planes;
+    uint32_t InstanceCount;
+  };
+  // Push constants of occlusion.comp.glsl
+  struct occlusion_constants {
+    std::array<float, 16> ViewProjection;
+    uint32_t InstanceCount;
+    uint32_t LevelCount;
+    std::array<uint32_t, 2> PyramidSize;
+  };
+  struct frame_data {
+    std::unique_ptr<buffer> Instances;
+    std::unique_ptr<buffer> Draws;
+    std::unique_ptr<buffer> Count; // GPU culling only, like everything below but Visible
+    std::unique_ptr<buffer> LateDraws;
+    std::unique_ptr<buffer> LateCount;
+    VkDescriptorSet Set = VK_NULL_HANDLE;
+    VkDescriptorSet LateSet = VK_NULL_HANDLE; // Set with LateDraws and LateCount in place of Draws and Count
+    VkDescriptorSet PyramidSet = VK_NULL_HANDLE;
+    const hiz_pyramid *Pyramid = nullptr; // Whose view PyramidSet holds, as of PyramidGeneration
+    uint64_t PyramidGeneration = 0;
+    uint32_t Visible = 0; // CPU culling only
+    std::vector<VkDrawIndexedIndirectCommand> Direct; // In place of Draws without drawIndirectFirstInstance
+  };
+
+  VkPhysicalDevice PhysicalDevice;
+  VkDevice Device;
+  uint32_t MaxInstances;
+  bool GpuCulling;
+  bool MultiDraw;
+  bool IndirectFirstInstance;
+  PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCount = nullptr;
+  std::vector<std::unique_ptr<frame_data>> Frames;
+  std::vector<gpu_mesh> Meshes;
+  std::unique_ptr<buffer> MeshTable;
+  std::vector<gpu_instance> Staged; // CPU culling reads instances from cached memory, not the mapped buffer
+  std::unique_ptr<buffer> Visibility; // Per instance, whether CullLate found it visible
+  bool VisibilityCleared = false;
+  VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout PyramidSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+  pipeline_registry *Pipelines = nullptr;
+  pipeline_registry::handle CullPipeline = 0;
+  static constexpr shader_variants::mask LatePhase = 1; // CULL_LATE
+  std::unique_ptr<shader_variants> Occlusion;
+
+  static void Barrier(VkCommandBuffer CommandBuffer, VkPipelineStageFlags SrcStage, VkAccessFlags SrcAccess,
+                      VkPipelineStageFlags DstStage, VkAccessFlags DstAccess) {
+    VkMemoryBarrier Barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = SrcAccess,
+        .dstAccessMask = DstAccess,
+    };
+    vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // Clears the draw count a culling pass appends to. False if there is nothing to cull until SetMeshes, since
+  // the descriptor sets are still empty.
+  auto BeginCull(VkCommandBuffer CommandBuffer, const buffer &Count) const -> bool {
+    vkCmdFillBuffer(CommandBuffer, Count.Buffer, 0, sizeof(uint32_t), 0);
+    if (MeshTable == nullptr) {
+      Barrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+              VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+      return false;
+    }
+    // Also orders the visibility writes of the previous pass before this one
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    return true;
+  }
+
+  void Dispatch(VkCommandBuffer CommandBuffer, pipeline_registry::handle Pipeline,
+                std::span<const VkDescriptorSet> Sets, const void *Constants, uint32_t ConstantsSize,
+                uint32_t InstanceCount) const {
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines->Get(Pipeline));
+    vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0,
+                            static_cast<uint32_t>(Sets.size()), Sets.data(), 0, nullptr);
+    vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, ConstantsSize, Constants);
+    vkCmdDispatch(CommandBuffer, (InstanceCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  }
+
+  void CpuCull(frame_data &Data, const mth::frustum<float> &Frustum, uint32_t InstanceCount,
+               const occlusion_buffer *Occluders) {
+    std::memcpy(Data.Instances->Mapped, Staged.data(), InstanceCount * sizeof(gpu_instance));
+    if (!IndirectFirstInstance) {
+      Data.Direct.resize(InstanceCount);
+    }
+    auto *Commands = IndirectFirstInstance ? reinterpret_cast<VkDrawIndexedIndirectCommand *>(Data.Draws->Mapped)
+                                           : Data.Direct.data();
+    Data.Visible = 0;
+    for (uint32_t i = 0; i < InstanceCount; i++) {
+      const gpu_instance &Instance = Staged[i];
+      const mth::vec3<float> Center(Instance.Center[0], Instance.Center[1], Instance.Center[2]);
+      if (Instance.Mesh >= Meshes.size() || !Frustum.IsSphereVisible(Center, Instance.Radius) ||
+          (Occluders != nullptr && !Occluders->IsSphereVisible(Center, Instance.Radius))) {
+        continue;
+      }
+      const gpu_mesh &Mesh = Meshes[Instance.Mesh];
+      Commands[Data.Visible++] = {
+          .indexCount = Mesh.IndexCount,
+          .instanceCount = 1,
+          .firstIndex = Mesh.FirstIndex,
+          .vertexOffset = Mesh.VertexOffset,
+          .firstInstance = i,
+      };
+    }
+    if (!IndirectFirstInstance) {
+      Data.Direct.resize(Data.Visible);
+    }
+  }
+
+  void CreateDescriptors(uint32_t FramesInFlight) {
+    std::array<VkDescriptorSetLayoutBinding, 5> Bindings{};
+    for (uint32_t i = 0; i < Bindings.size(); i++) {
+      Bindings[i] = {.binding = i,
+                     .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                     .descriptorCount = 1,
+                     .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    }
+    VkDescriptorSetLayoutCreateInfo LayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(Bindings.size()),
+        .pBindings = Bindings.data(),
+    };
+    const VkDescriptorSetLayoutBinding PyramidBinding{.binding = 0,
+                                                      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                      .descriptorCount = 1,
+                                                      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    VkDescriptorSetLayoutCreateInfo PyramidLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &PyramidBinding,
+    };
+    const std::array<VkDescriptorPoolSize, 2> PoolSizes = {{
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = static_cast<uint32_t>(Bindings.size()) * 2 * FramesInFlight},
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = FramesInFlight},
+    }};
+    VkDescriptorPoolCreateInfo PoolInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 3 * FramesInFlight,
+        .poolSizeCount = static_cast<uint32_t>(PoolSizes.size()),
+        .pPoolSizes = PoolSizes.data(),
+    };
+    VkPushConstantRange PushConstants{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                                      .size = static_cast<uint32_t>(
+                                          std::max(sizeof(cull_constants), sizeof(occlusion_constants)))};
+    if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &SetLayout) != VK_SUCCESS ||
+        vkCreateDescriptorSetLayout(Device, &PyramidLayoutInfo, nullptr, &PyramidSetLayout) != VK_SUCCESS ||
+        vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &DescriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling descriptors!");
+    }
+    const std::array<VkDescriptorSetLayout, 2> SetLayouts = {SetLayout, PyramidSetLayout};
+    VkPipelineLayoutCreateInfo PipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(SetLayouts.size()),
+        .pSetLayouts = SetLayouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &PushConstants,
+    };
+    if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling pipeline layout!");
+    }
+    for (std::unique_ptr<frame_data> &Frame : Frames) {
+      const std::array<VkDescriptorSetLayout, 3> Layouts = {SetLayout, SetLayout, PyramidSetLayout};
+      std::array<VkDescriptorSet, 3> Sets{};
+      VkDescriptorSetAllocateInfo AllocateInfo{
+          .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+          .descriptorPool = DescriptorPool,
+          .descriptorSetCount = static_cast<uint32_t>(Layouts.size()),
+          .pSetLayouts = Layouts.data(),
+      };
+      if (vkAllocateDescriptorSets(Device, &AllocateInfo, Sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate culling descriptor set!");
+      }
+      Frame->Set = Sets[0];
+      Frame->LateSet = Sets[1];
+      Frame->PyramidSet = Sets[2];
+    }
+  }
+
+  void WriteDescriptors(const frame_data &Frame) const {
+    WriteBuffers(Frame.Set, {Frame.Instances->Buffer, MeshTable->Buffer, Frame.Draws->Buffer, Frame.Count->Buffer,
+                             Visibility->Buffer});
+    WriteBuffers(Frame.LateSet, {Frame.Instances->Buffer, MeshTable->Buffer, Frame.LateDraws->Buffer,
+                                 Frame.LateCount->Buffer, Visibility->Buffer});
+  }
+
+  void WriteBuffers(VkDescriptorSet Set, const std::array<VkBuffer, 5> &Buffers) const {
+    std::array<VkDescriptorBufferInfo, 5> Infos{};
+    std::array<VkWriteDescriptorSet, 5> Writes{};
+    for (uint32_t i = 0; i < Writes.size(); i++) {
+      Infos[i] = {Buffers[i], 0, VK_WHOLE_SIZE};
+      Writes[i] = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                   .dstSet = Set,
+                   .dstBinding = i,
+                   .descriptorCount = 1,
+                   .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                   .pBufferInfo = &Infos[i]};
+    }
+    vkUpdateDescriptorSets(Device, static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+  }
+
+  void WritePyramidDescriptor(frame_data &Data, const hiz_pyramid &Pyramid) const {
+    const VkDescriptorImageInfo Info{
+        .sampler = Pyramid.GetSampler(), .imageView = Pyramid.GetView(), .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    const VkWriteDescriptorSet Write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                     .dstSet = Data.PyramidSet,
+                                     .dstBinding = 0,
+                                     .descriptorCount = 1,
+                                     .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     .pImageInfo = &Info};
+    vkUpdateDescriptorSets(Device, 1, &Write, 0, nullptr);
+    Data.Pyramid = &Pyramid;
+    Data.PyramidGeneration = Pyramid.GetGeneration();
+  }
+};
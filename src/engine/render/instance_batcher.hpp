@@ -0,0 +1,134 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../assets/mesh_format.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "../vulkan/buffer.hpp"
+#include "../vulkan/pipelines.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <optional>
+
+// What a vertex shader sees per instance, through vertex binding InstanceBinding at instance rate.
+struct instance_data {
+  std::array<float, 16> World; // Row vector convention, as in matr
+  std::array<float, 4> Params; // Free for the material: tint, wind phase, animation offset...
+};
+static_assert(sizeof(instance_data) == 80);
+
+// Collects instanced submissions for a frame and draws each pipeline/material/mesh batch with one
+// vkCmdDrawIndexed. Submit copies the caller's data right away, so its spans need not outlive the call.
+// Record sorts the submissions by pipeline, then material, then mesh, writes every batch contiguously
+// into this frame's slice of a persistently mapped instance ring and draws it with firstInstance
+// pointing at that range. Instances past the per-frame capacity are dropped with a warning.
+class instance_batcher {
+public:
+  static constexpr uint32_t InstanceBinding = 1; // Binding 0 is left for the mesh vertices
+  // Called when the material changes between batches, with the batch's pipeline already bound.
+  using material_binder = std::function<void(VkCommandBuffer, uint32_t Material)>;
+
+  instance_batcher(VkPhysicalDevice PhysicalDevice, VkDevice Device, const pipeline_registry &Pipelines,
+                   uint32_t FramesInFlight, uint32_t MaxInstances)
+      : Pipelines(Pipelines), MaxInstances(MaxInstances),
+        Ring(std::make_unique<buffer>(PhysicalDevice, Device,
+                                      VkDeviceSize{FramesInFlight} * MaxInstances * sizeof(instance_data),
+                                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {}
+
+  // Shared vertex and index buffers are bound by the caller; the table says where each mesh lives in them.
+  void SetMeshes(std::span<const mesh_format::mesh> Source) { Meshes.assign(Source.begin(), Source.end()); }
+
+  // Params is either empty or one entry per transform.
+  void Submit(pipeline_registry::handle Pipeline, uint32_t Material, uint32_t Mesh,
+              std::span<const mth::matr<float>> Transforms, std::span<const std::array<float, 4>> Params = {}) {
+    if (Transforms.empty()) {
+      return;
+    }
+    Runs.push_back({.Key = {Pipeline, Material, Mesh},
+                    .First = static_cast<uint32_t>(Staged.size()),
+                    .Count = static_cast<uint32_t>(Transforms.size())});
+    for (size_t i = 0; i < Transforms.size(); i++) {
+      Staged.push_back({.World = Transforms[i].A, .Params = Params.empty() ? std::array<float, 4>{} : Params[i]});
+    }
+  }
+
+  // Draws and clears everything submitted since the last call. Record inside a render pass, with the mesh
+  // vertex and index buffers bound.
+  void Record(VkCommandBuffer CommandBuffer, uint32_t Frame, const material_binder &BindMaterial) {
+    KPROFILE_SCOPE("instance_batcher::Record");
+    std::ranges::stable_sort(Runs, {}, &run::Key);
+    auto *Slice = reinterpret_cast<instance_data *>(Ring->Mapped) + VkDeviceSize{Frame} * MaxInstances;
+    const VkDeviceSize Offset = VkDeviceSize{Frame} * MaxInstances * sizeof(instance_data);
+    vkCmdBindVertexBuffers(CommandBuffer, InstanceBinding, 1, &Ring->Buffer, &Offset);
+
+    uint32_t Written = 0;
+    std::optional<pipeline_registry::handle> BoundPipeline;
+    std::optional<uint32_t> BoundMaterial;
+    for (size_t i = 0; i < Runs.size();) {
+      const key Key = Runs[i].Key;
+      const uint32_t First = Written;
+      // Runs of one batch are adjacent after sorting; copy them back to back so one draw covers them all
+      for (; i < Runs.size() && Runs[i].Key == Key; i++) {
+        const uint32_t Count = std::min(Runs[i].Count, MaxInstances - Written);
+        std::memcpy(Slice + Written, Staged.data() + Runs[i].First, Count * sizeof(instance_data));
+        Written += Count;
+      }
+      if (Written == First || Key.Mesh >= Meshes.size()) {
+        continue;
+      }
+      if (BoundPipeline != Key.Pipeline) {
+        vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipelines.Get(Key.Pipeline));
+        BoundPipeline = Key.Pipeline;
+        BoundMaterial.reset(); // A new pipeline may have an incompatible layout
+      }
+      if (BoundMaterial != Key.Material) {
+        BindMaterial(CommandBuffer, Key.Material);
+        BoundMaterial = Key.Material;
+      }
+      const mesh_format::mesh &Mesh = Meshes[Key.Mesh];
+      vkCmdDrawIndexed(CommandBuffer, Mesh.IndexCount, Written - First, Mesh.FirstIndex, Mesh.VertexOffset, First);
+    }
+    if (Written < Staged.size()) {
+      KLOG(Warning, Render, "instance ring full, dropped {} of {} instances", Staged.size() - Written, Staged.size());
+    }
+    Runs.clear();
+    Staged.clear();
+  }
+
+  // For pipeline builders: the instance binding and its attributes, World as four vec4 rows then Params.
+  static auto BindingDescription() -> VkVertexInputBindingDescription {
+    return {.binding = InstanceBinding, .stride = sizeof(instance_data), .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE};
+  }
+  static auto AttributeDescriptions(uint32_t FirstLocation) -> std::array<VkVertexInputAttributeDescription, 5> {
+    std::array<VkVertexInputAttributeDescription, 5> Attributes{};
+    for (uint32_t i = 0; i < Attributes.size(); i++) {
+      Attributes[i] = {.location = FirstLocation + i,
+                       .binding = InstanceBinding,
+                       .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                       .offset = static_cast<uint32_t>(i * 4 * sizeof(float))};
+    }
+    return Attributes;
+  }
+
+private:
+  struct key {
+    pipeline_registry::handle Pipeline;
+    uint32_t Material;
+    uint32_t Mesh;
+    auto operator<=>(const key &) const = default;
+  };
+  struct run {
+    key Key;
+    uint32_t First; // Into Staged
+    uint32_t Count;
+  };
+
+  const pipeline_registry &Pipelines;
+  uint32_t MaxInstances;
+  std::unique_ptr<buffer> Ring; // FramesInFlight slices of MaxInstances each
+  std::vector<mesh_format::mesh> Meshes;
+  std::vector<run> Runs;
+  std::vector<instance_data> Staged; // Cached memory; the ring is write-combined, so it is only written in order
+};
@@ -0,0 +1,426 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../particles.hpp"
+#include "../profiler.hpp"
+#include "../shader/shader_library.hpp"
+#include "../vulkan/buffer.hpp"
+#include "../vulkan/pipelines.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+
+// Layouts match src/shaders/common/particles.glsl and src/shaders/particles/bindings.glsl (std430).
+struct gpu_particle {
+  std::array<float, 3> Position;
+  float Age;
+  std::array<float, 3> Velocity;
+  float Lifetime;
+  std::array<float, 4> Color;
+  float Size;
+  std::array<float, 3> Pad;
+};
+static_assert(sizeof(gpu_particle) == 64);
+
+struct gpu_particle_emitter {
+  std::array<float, 3> Position;
+  float Radius;
+  std::array<float, 3> Velocity;
+  float Spread;
+  std::array<float, 4> Color;
+  float Size;
+  float Lifetime;
+  float LifetimeJitter;
+  uint32_t Seed;
+  uint32_t First;
+  uint32_t Count;
+  std::array<uint32_t, 2> Pad;
+};
+static_assert(sizeof(gpu_particle_emitter) == 80);
+
+// Precedes the emitters in each frame's buffer.
+struct gpu_particle_header {
+  std::array<float, 16> DepthViewProjection;
+  std::array<float, 16> DepthInverse;
+  std::array<float, 4> GravityDt;   // Gravity, then the time step
+  std::array<float, 4> Response;    // Drag, restitution, thickness
+  std::array<uint32_t, 4> Counts;   // New particles, emitters, parity, capacity
+};
+static_assert(sizeof(gpu_particle_header) == 176);
+
+struct gpu_particle_counters {
+  std::array<uint32_t, 4> Alive;    // Per particle buffer, indexed by parity
+  std::array<uint32_t, 4> Simulate; // VkDispatchIndirectCommand
+  std::array<uint32_t, 4> Draw;     // VkDrawIndirectCommand
+};
+static_assert(sizeof(gpu_particle_counters) == 48);
+
+// Simulates particles entirely on the GPU, so their count is bounded by memory rather than by the CPU.
+// Particles live in two storage buffers that swap roles every frame. Simulate records four compute passes:
+//  1. emit.comp.glsl appends this frame's new particles to the live buffer;
+//  2. args.comp.glsl clamps the live count and writes the dispatch size of the next pass;
+//  3. simulate.comp.glsl integrates every live particle, bounces it off the depth buffer if one is given,
+//     and appends the survivors to the other buffer, which compacts it;
+//  4. args.comp.glsl writes the instance count of Draw's indirect draw.
+// The live count never returns to the CPU. Emission counts and random numbers come from particle_emission
+// like in particle_simulation, the CPU implementation; only the order of particles differs, since
+// appending is atomic.
+class particle_system {
+public:
+  // A sampled depth buffer to collide with, in SHADER_READ_ONLY_OPTIMAL or DEPTH_STENCIL_READ_ONLY_OPTIMAL
+  // layout, and the view-projection it was rendered with. Usually the previous frame's. Bump Generation
+  // whenever the view is recreated: a new view may reuse the handle of the one it replaced.
+  struct depth {
+    VkImageView View;
+    VkImageLayout Layout;
+    mth::matr<float> ViewProjection;
+    uint64_t Generation = 0;
+  };
+  // Push constants of draw.vert.glsl
+  struct draw_constants {
+    std::array<float, 16> ViewProjection;
+    std::array<float, 4> Right;
+    std::array<float, 4> Up;
+  };
+
+  particle_system(VkPhysicalDevice PhysicalDevice, VkDevice Device, shader_library &Shaders,
+                  pipeline_registry &Pipelines, uint32_t FramesInFlight, const particle_settings &Settings,
+                  uint32_t MaxEmitters = 64)
+      : Device(Device), Settings(Settings), MaxEmitters(MaxEmitters), Pipelines(Pipelines) {
+    if (Settings.MaxParticles > 65535 * SimulateGroupSize) {
+      throw std::runtime_error("too many particles for one dispatch!");
+    }
+    for (std::unique_ptr<buffer> &State : States) {
+      State = std::make_unique<buffer>(PhysicalDevice, Device,
+                                       VkDeviceSize{Settings.MaxParticles} * sizeof(gpu_particle),
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    Counters = std::make_unique<buffer>(
+        PhysicalDevice, Device, sizeof(gpu_particle_counters),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      frame_data &Frame = *Frames.emplace_back(std::make_unique<frame_data>());
+      Frame.Data = std::make_unique<buffer>(
+          PhysicalDevice, Device, sizeof(gpu_particle_header) + MaxEmitters * sizeof(gpu_particle_emitter),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    CreateDescriptors(FramesInFlight);
+
+    const auto Compute = [this](shader_library::handle Shader) {
+      return this->Pipelines.Create({Shader}, [this](std::span<const VkShaderModule> Modules) {
+        VkComputePipelineCreateInfo CreateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                      .module = Modules[0],
+                      .pName = "main"},
+            .layout = PipelineLayout,
+        };
+        VkPipeline Pipeline = VK_NULL_HANDLE;
+        vkCreateComputePipelines(this->Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline);
+        return Pipeline;
+      });
+    };
+    EmitPipeline = Compute(Shaders.Load("particles/emit.comp.glsl"));
+    ArgsPipeline = Compute(Shaders.Load("particles/args.comp.glsl"));
+    SimulatePipeline = Compute(Shaders.Load("particles/simulate.comp.glsl"));
+    CollidePipeline = Compute(Shaders.Load("particles/simulate.comp.glsl", {{"PARTICLE_COLLIDE", ""}}));
+  }
+  particle_system(const particle_system &) = delete;
+  particle_system(particle_system &&) = delete;
+  auto operator=(const particle_system &) -> particle_system & = delete;
+  auto operator=(particle_system &&) -> particle_system & = delete;
+  // The owner waits for the device to go idle first
+  ~particle_system() {
+    for (const pipeline_registry::handle Pipeline : {EmitPipeline, ArgsPipeline, SimulatePipeline, CollidePipeline}) {
+      Pipelines.Destroy(Pipeline);
+    }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, ComputeSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DepthSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DrawSetLayout, nullptr);
+    vkDestroySampler(Device, Sampler, nullptr);
+  }
+
+  // Record outside of a render pass, once per frame and before Draw. Emitters past MaxEmitters are ignored.
+  void Simulate(VkCommandBuffer CommandBuffer, uint32_t Frame, float Dt, std::span<const particle_emitter> Emitters,
+                const depth *Depth = nullptr) {
+    KPROFILE_SCOPE("particle_system::Simulate");
+    Emitters = Emitters.first(std::min<size_t>(Emitters.size(), MaxEmitters));
+    frame_data &Data = *Frames[Frame];
+    WriteFrame(Data, Dt, Emitters, Depth);
+    if (Depth != nullptr && (Depth->View != Data.DepthView || Depth->Layout != Data.DepthLayout ||
+                             Depth->Generation != Data.DepthGeneration)) {
+      WriteDepthDescriptor(Data, *Depth); // The frame's fence has been waited on, so its set is not in use
+    }
+
+    if (!Cleared) {
+      vkCmdFillBuffer(CommandBuffer, Counters->Buffer, 0, VK_WHOLE_SIZE, 0);
+      Barrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+      Cleared = true;
+    } else {
+      // Last frame's draw read the buffer this frame emits into, and the counters
+      Barrier(CommandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    const std::array<VkDescriptorSet, 2> Sets = {Data.Sets[Parity], Data.DepthSet};
+    vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0,
+                            Depth != nullptr ? 2 : 1, Sets.data(), 0, nullptr);
+    constexpr VkAccessFlags ReadWrite = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    const uint32_t NewParticles = Emission.GetTotal();
+    if (NewParticles != 0) {
+      vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines.Get(EmitPipeline));
+      vkCmdDispatch(CommandBuffer, (NewParticles + EmitGroupSize - 1) / EmitGroupSize, 1, 1);
+      Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, ReadWrite);
+    }
+    Args(CommandBuffer, 0);
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            ReadWrite | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      Pipelines.Get(Depth != nullptr ? CollidePipeline : SimulatePipeline));
+    vkCmdDispatchIndirect(CommandBuffer, Counters->Buffer, offsetof(gpu_particle_counters, Simulate));
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, ReadWrite);
+    Args(CommandBuffer, 1);
+    Barrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+    Parity = 1 - Parity;
+  }
+
+  // Record inside a render pass with a pipeline built from particles/draw.vert.glsl and draw.frag.glsl bound.
+  // Its layout has GetDrawSetLayout as set SetIndex, which the shader expects unless PARTICLE_SET says
+  // otherwise, and GetDrawConstantsRange as its push constants.
+  void Draw(VkCommandBuffer CommandBuffer, VkPipelineLayout Layout, uint32_t SetIndex,
+            const mth::camera<float> &Camera) const {
+    const draw_constants Constants{.ViewProjection = Camera.MatrVP.A,
+                                   .Right = {Camera.Right.X, Camera.Right.Y, Camera.Right.Z, 0},
+                                   .Up = {Camera.Up.X, Camera.Up.Y, Camera.Up.Z, 0}};
+    vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, SetIndex, 1, &DrawSets[Parity],
+                            0, nullptr);
+    vkCmdPushConstants(CommandBuffer, Layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Constants), &Constants);
+    vkCmdDrawIndirect(CommandBuffer, Counters->Buffer, offsetof(gpu_particle_counters, Draw), 1, 0);
+  }
+  [[nodiscard]] auto GetDrawSetLayout() const -> VkDescriptorSetLayout { return DrawSetLayout; }
+  [[nodiscard]] static auto GetDrawConstantsRange() -> VkPushConstantRange {
+    return {.stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .offset = 0, .size = sizeof(draw_constants)};
+  }
+
+private:
+  static constexpr uint32_t EmitGroupSize = 64;      // local_size_x in emit.comp.glsl
+  static constexpr uint32_t SimulateGroupSize = 256; // local_size_x in simulate.comp.glsl
+
+  struct frame_data {
+    std::unique_ptr<buffer> Data; // gpu_particle_header, then the emitters
+    std::array<VkDescriptorSet, 2> Sets{}; // Per parity
+    VkDescriptorSet DepthSet = VK_NULL_HANDLE;
+    VkImageView DepthView = VK_NULL_HANDLE;
+    VkImageLayout DepthLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    uint64_t DepthGeneration = 0;
+  };
+
+  VkDevice Device;
+  particle_settings Settings;
+  uint32_t MaxEmitters;
+  pipeline_registry &Pipelines;
+  particle_emission Emission;
+  std::array<std::unique_ptr<buffer>, 2> States;
+  std::unique_ptr<buffer> Counters;
+  std::vector<std::unique_ptr<frame_data>> Frames;
+  uint32_t Parity = 0; // States[Parity] holds the live particles
+  bool Cleared = false;
+  VkSampler Sampler = VK_NULL_HANDLE;
+  VkDescriptorSetLayout ComputeSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout DepthSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout DrawSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+  std::array<VkDescriptorSet, 2> DrawSets{}; // Per parity
+  VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+  pipeline_registry::handle EmitPipeline = 0, ArgsPipeline = 0, SimulatePipeline = 0, CollidePipeline = 0;
+
+  static void Barrier(VkCommandBuffer CommandBuffer, VkPipelineStageFlags SrcStage, VkAccessFlags SrcAccess,
+                      VkPipelineStageFlags DstStage, VkAccessFlags DstAccess) {
+    VkMemoryBarrier Barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = SrcAccess,
+        .dstAccessMask = DstAccess,
+    };
+    vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+  }
+
+  void Args(VkCommandBuffer CommandBuffer, uint32_t Stage) {
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines.Get(ArgsPipeline));
+    vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Stage), &Stage);
+    vkCmdDispatch(CommandBuffer, 1, 1, 1);
+  }
+
+  void WriteFrame(frame_data &Data, float Dt, std::span<const particle_emitter> Emitters, const depth *Depth) {
+    const std::span<const particle_emission::batch> Batches = Emission.Advance(Dt, Emitters);
+    gpu_particle_header Header{};
+    if (Depth != nullptr) {
+      Header.DepthViewProjection = Depth->ViewProjection.A;
+      Header.DepthInverse = Depth->ViewProjection.Inverse().A;
+    }
+    Header.GravityDt = {Settings.Gravity.X, Settings.Gravity.Y, Settings.Gravity.Z, Dt};
+    Header.Response = {Settings.Drag, Settings.Restitution, Settings.Thickness, 0};
+    Header.Counts = {Emission.GetTotal(), static_cast<uint32_t>(Emitters.size()), Parity, Settings.MaxParticles};
+    std::memcpy(Data.Data->Mapped, &Header, sizeof(Header));
+    auto *Out = reinterpret_cast<gpu_particle_emitter *>(Data.Data->Mapped + sizeof(Header));
+    for (size_t i = 0; i < Emitters.size(); i++) {
+      const particle_emitter &Emitter = Emitters[i];
+      Out[i] = {.Position = {Emitter.Position.X, Emitter.Position.Y, Emitter.Position.Z},
+                .Radius = Emitter.Radius,
+                .Velocity = {Emitter.Velocity.X, Emitter.Velocity.Y, Emitter.Velocity.Z},
+                .Spread = Emitter.Spread,
+                .Color = Emitter.Color,
+                .Size = Emitter.Size,
+                .Lifetime = Emitter.Lifetime,
+                .LifetimeJitter = Emitter.LifetimeJitter,
+                .Seed = Batches[i].Seed,
+                .First = Batches[i].First,
+                .Count = Batches[i].Count,
+                .Pad = {}};
+    }
+  }
+
+  void WriteDepthDescriptor(frame_data &Data, const depth &Depth) {
+    const VkDescriptorImageInfo Info{.sampler = Sampler, .imageView = Depth.View, .imageLayout = Depth.Layout};
+    const VkWriteDescriptorSet Write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                     .dstSet = Data.DepthSet,
+                                     .dstBinding = 0,
+                                     .descriptorCount = 1,
+                                     .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     .pImageInfo = &Info};
+    vkUpdateDescriptorSets(Device, 1, &Write, 0, nullptr);
+    Data.DepthView = Depth.View;
+    Data.DepthLayout = Depth.Layout;
+    Data.DepthGeneration = Depth.Generation;
+  }
+
+  auto CreateSetLayout(std::span<const VkDescriptorSetLayoutBinding> Bindings) -> VkDescriptorSetLayout {
+    VkDescriptorSetLayoutCreateInfo LayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(Bindings.size()),
+        .pBindings = Bindings.data(),
+    };
+    VkDescriptorSetLayout Layout = VK_NULL_HANDLE;
+    if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &Layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create particle descriptor set layout!");
+    }
+    return Layout;
+  }
+
+  auto AllocateSet(VkDescriptorSetLayout Layout) -> VkDescriptorSet {
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = DescriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &Layout,
+    };
+    VkDescriptorSet Set = VK_NULL_HANDLE;
+    if (vkAllocateDescriptorSets(Device, &AllocateInfo, &Set) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate particle descriptor set!");
+    }
+    return Set;
+  }
+
+  void WriteBuffers(VkDescriptorSet Set, std::span<const VkBuffer> Buffers) const {
+    std::vector<VkDescriptorBufferInfo> Infos;
+    for (VkBuffer Buffer : Buffers) {
+      Infos.push_back({Buffer, 0, VK_WHOLE_SIZE});
+    }
+    std::vector<VkWriteDescriptorSet> Writes(Buffers.size());
+    for (uint32_t i = 0; i < Writes.size(); i++) {
+      Writes[i] = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                   .dstSet = Set,
+                   .dstBinding = i,
+                   .descriptorCount = 1,
+                   .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                   .pBufferInfo = &Infos[i]};
+    }
+    vkUpdateDescriptorSets(Device, static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+  }
+
+  void CreateDescriptors(uint32_t FramesInFlight) {
+    VkSamplerCreateInfo SamplerInfo{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+    if (vkCreateSampler(Device, &SamplerInfo, nullptr, &Sampler) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create particle depth sampler!");
+    }
+    std::array<VkDescriptorSetLayoutBinding, 4> ComputeBindings{};
+    for (uint32_t i = 0; i < ComputeBindings.size(); i++) {
+      ComputeBindings[i] = {.binding = i,
+                            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                            .descriptorCount = 1,
+                            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    }
+    const VkDescriptorSetLayoutBinding DepthBinding{.binding = 0,
+                                                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                    .descriptorCount = 1,
+                                                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    const VkDescriptorSetLayoutBinding DrawBinding{.binding = 0,
+                                                   .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                   .descriptorCount = 1,
+                                                   .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
+    ComputeSetLayout = CreateSetLayout(ComputeBindings);
+    DepthSetLayout = CreateSetLayout({&DepthBinding, 1});
+    DrawSetLayout = CreateSetLayout({&DrawBinding, 1});
+
+    const std::array<VkDescriptorPoolSize, 2> PoolSizes = {{
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = static_cast<uint32_t>(ComputeBindings.size()) * 2 * FramesInFlight + 2},
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = FramesInFlight},
+    }};
+    VkDescriptorPoolCreateInfo PoolInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 3 * FramesInFlight + 2,
+        .poolSizeCount = static_cast<uint32_t>(PoolSizes.size()),
+        .pPoolSizes = PoolSizes.data(),
+    };
+    if (vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &DescriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create particle descriptor pool!");
+    }
+    const std::array<VkDescriptorSetLayout, 2> SetLayouts = {ComputeSetLayout, DepthSetLayout};
+    VkPushConstantRange PushConstants{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .size = sizeof(uint32_t)};
+    VkPipelineLayoutCreateInfo PipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(SetLayouts.size()),
+        .pSetLayouts = SetLayouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &PushConstants,
+    };
+    if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create particle pipeline layout!");
+    }
+
+    for (std::unique_ptr<frame_data> &Frame : Frames) {
+      for (uint32_t Side = 0; Side < 2; Side++) {
+        Frame->Sets[Side] = AllocateSet(ComputeSetLayout);
+        const std::array<VkBuffer, 4> Buffers = {States[Side]->Buffer, States[1 - Side]->Buffer, Counters->Buffer,
+                                                 Frame->Data->Buffer};
+        WriteBuffers(Frame->Sets[Side], Buffers);
+      }
+      Frame->DepthSet = AllocateSet(DepthSetLayout);
+    }
+    for (uint32_t Side = 0; Side < 2; Side++) {
+      DrawSets[Side] = AllocateSet(DrawSetLayout);
+      const std::array<VkBuffer, 1> Buffers = {States[Side]->Buffer};
+      WriteBuffers(DrawSets[Side], Buffers);
+    }
+  }
+};
@@ -0,0 +1,1219 @@
+#pragma once
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "../vulkan/device.hpp"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <map>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+// How a pass touches a resource. Each maps to the pipeline stages, access mask and image layout the
+// graph synchronizes on.
+enum class graph_access : uint8_t {
+  ColorAttachment,
+  DepthAttachment,
+  DepthRead,    // Depth test without writes
+  Sampled,      // Any shader stage
+  StorageRead,  // Any shader stage
+  StorageWrite, // Any shader stage; also covers read-modify-write
+  TransferSrc,
+  TransferDst,
+  IndirectRead,
+  VertexRead, // Vertex and index fetch
+  Present,    // Only as the final access of an imported image
+};
+
+// A frame is described as a list of passes, each declaring what it reads and writes, and then executed
+// in one go. Execute
+//  - culls passes whose results nothing consumes: a pass survives if it writes an imported resource,
+//    is marked SideEffect, or writes something a surviving later pass reads;
+//  - keeps the declaration order, which is always a valid order since a pass can only depend on passes
+//    declared before it;
+//  - emits before each pass one batched vkCmdPipelineBarrier holding exactly the dependencies and layout
+//    transitions it needs, and none between passes that only read;
+//  - places transient images whose lifetimes do not overlap in the same memory;
+//  - begins and ends rendering around passes that declare attachments.
+//
+// Barriers go through synchronization2 where the device has it, with stage masks per resource; otherwise
+// one vkCmdPipelineBarrier per pass carries the union of the stages. Likewise rendering uses dynamic
+// rendering on Vulkan 1.3 and falls back to cached render pass and framebuffer objects on older devices.
+//
+// Transient images are created by the graph and their contents do not survive the frame. Imported
+// resources are owned by the caller, e.g. the swapchain image. Physical images are kept while the
+// frame's transients stay the same and rebuilt, with the old ones retired, when they change.
+// Declarations are consumed by Execute; declare everything again next frame.
+//
+// Passes marked AsyncCompute run on the device's compute queue when it has one and timeline semaphores,
+// overlapping the graphics passes around them. Each queue records into a chain of command buffers
+// (segments), and a segment ends only where the other queue needs its results: the first use of a resource
+// on one queue after the other waits, through the other queue's timeline semaphore, for the segment holding
+// its last use there. Across queue families the resource is released and acquired on the way. The frame
+// ends on the graphics queue after the compute queue, so the caller's fence covers both, and the first
+// compute segment waits for the previous frame's graphics work.
+class render_graph {
+public:
+  using resource = uint32_t;
+  using executor = std::function<void(VkCommandBuffer)>;
+
+  struct image_desc {
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    VkFormat Format = VK_FORMAT_UNDEFINED;
+    uint32_t Levels = 1;
+    auto operator<=>(const image_desc &) const = default;
+  };
+
+  class builder {
+  public:
+    void Read(resource Resource, graph_access Access) { Use(Resource, Access); }
+    void Write(resource Resource, graph_access Access) { Use(Resource, Access); }
+    // Renders into the image: color or depth by its format, stored at the end of the pass. Attachments are
+    // bound in declaration order, depth last whatever its position.
+    void Attachment(resource Resource, VkAttachmentLoadOp Load = VK_ATTACHMENT_LOAD_OP_LOAD, VkClearValue Clear = {}) {
+      const bool Depth = (Graph.Resources[Resource].Aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+      Use(Resource, Depth ? graph_access::DepthAttachment : graph_access::ColorAttachment);
+      Graph.Passes[Pass].Attachments.push_back({.Resource = Resource, .Load = Load, .Clear = Clear});
+    }
+    // Keeps the pass even if nothing reads what it writes, e.g. a readback or a timestamp.
+    void SideEffect() { Graph.Passes[Pass].SideEffect = true; }
+    // Lets the pass run on the async compute queue. It may only dispatch and copy, and must not touch the
+    // resources the semaphores given to Submit guard, such as the swapchain image.
+    void AsyncCompute() { Graph.Passes[Pass].Async = true; }
+
+  private:
+    friend class render_graph;
+    render_graph &Graph;
+    uint32_t Pass;
+    builder(render_graph &Graph, uint32_t Pass) : Graph(Graph), Pass(Pass) {}
+    void Use(resource Resource, graph_access Access) {
+      Graph.Passes[Pass].Uses.push_back({.Resource = Resource, .Access = Access});
+    }
+  };
+
+  render_graph(VkPhysicalDevice PhysicalDevice, const device &Queues, const device_capabilities &Capabilities,
+               uint32_t FramesInFlight)
+      : PhysicalDevice(PhysicalDevice), Device(Queues.Device), FramesInFlight(FramesInFlight),
+        Synchronization2(Capabilities.Synchronization2), DynamicRendering(Capabilities.DynamicRendering),
+        AsyncCompute(Capabilities.TimelineSemaphores && Queues.ComputeQueue != VK_NULL_HANDLE),
+        Queues{Queues.GraphicsQueue, Queues.ComputeQueue},
+        QueueFamilies{Queues.QueueFamilyIndex, Queues.ComputeQueueFamilyIndex} {
+    if (!AsyncCompute) {
+      KLOG(Info, Render, "render graph: no async compute queue, compute passes run on the graphics queue");
+      return;
+    }
+    VkSemaphoreTypeCreateInfo TypeInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                                       .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE};
+    VkSemaphoreCreateInfo SemaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &TypeInfo};
+    for (VkSemaphore &Timeline : Timelines) {
+      if (vkCreateSemaphore(Device, &SemaphoreInfo, nullptr, &Timeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timeline semaphore!");
+      }
+    }
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      std::array<command_list, 2> &Lists = CommandLists.emplace_back();
+      for (uint32_t Queue : {Graphics, Compute}) {
+        VkCommandPoolCreateInfo CreateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = QueueFamilies[Queue],
+        };
+        if (vkCreateCommandPool(Device, &CreateInfo, nullptr, &Lists[Queue].Pool) != VK_SUCCESS) {
+          throw std::runtime_error("failed to create render graph command pool!");
+        }
+      }
+    }
+    KLOG(Info, Render, "render graph: async compute on queue family {}", QueueFamilies[Compute]);
+  }
+  render_graph(const render_graph &) = delete;
+  render_graph(render_graph &&) = delete;
+  auto operator=(const render_graph &) -> render_graph & = delete;
+  auto operator=(render_graph &&) -> render_graph & = delete;
+  // The owner waits for the device to go idle first
+  ~render_graph() {
+    Release(Physical);
+    for (retired &Old : Retired) {
+      Release(Old.Physical);
+    }
+    for (const auto &[Key, Framebuffer] : Framebuffers) {
+      vkDestroyFramebuffer(Device, Framebuffer, nullptr);
+    }
+    for (const auto &[Key, RenderPass] : RenderPasses) {
+      vkDestroyRenderPass(Device, RenderPass, nullptr);
+    }
+    for (const std::array<command_list, 2> &Lists : CommandLists) {
+      for (const command_list &List : Lists) {
+        vkDestroyCommandPool(Device, List.Pool, nullptr);
+      }
+    }
+    for (VkSemaphore Timeline : Timelines) {
+      vkDestroySemaphore(Device, Timeline, nullptr);
+    }
+  }
+
+  auto CreateImage(std::string Name, image_desc Desc) -> resource {
+    Resources.push_back({.Name = std::move(Name), .Desc = Desc, .Aspect = AspectOf(Desc.Format)});
+    return static_cast<resource>(Resources.size() - 1);
+  }
+  // Layout and stage describe the image as the graph finds it; the graph leaves it in the layout of Final.
+  auto ImportImage(std::string Name, VkImage Image, VkImageView View, image_desc Desc, VkImageLayout Layout,
+                   VkPipelineStageFlags LastStage, graph_access Final) -> resource {
+    Resources.push_back({.Name = std::move(Name),
+                         .Imported = true,
+                         .Desc = Desc,
+                         .Image = Image,
+                         .View = View,
+                         .Aspect = AspectOf(Desc.Format),
+                         .Final = Final,
+                         .State = {.Layout = Layout, .WriteStage = LastStage}});
+    return static_cast<resource>(Resources.size() - 1);
+  }
+  // Earlier writes to the buffer must already be visible, e.g. host writes made before the submit.
+  auto ImportBuffer(std::string Name, VkBuffer Buffer) -> resource {
+    Resources.push_back({.Name = std::move(Name), .Imported = true, .IsBuffer = true, .Buffer = Buffer});
+    return static_cast<resource>(Resources.size() - 1);
+  }
+
+  // Setup runs immediately and declares the pass's resources; Execute runs later, inside Execute.
+  void AddPass(std::string Name, const std::function<void(builder &)> &Setup, executor Execute) {
+    Passes.push_back({.Name = std::move(Name), .Execute = std::move(Execute)});
+    builder Builder(*this, static_cast<uint32_t>(Passes.size() - 1));
+    Setup(Builder);
+    const pass &Pass = Passes.back();
+    const auto Graphical = [&](const use &Use) {
+      return (UsageOf(Use.Access).Stage & ComputeStages) == 0 ||
+             Resources[Use.Resource].Final == graph_access::Present;
+    };
+    if (Pass.Async && std::ranges::any_of(Pass.Uses, Graphical)) {
+      throw std::runtime_error("pass " + Pass.Name + " cannot run on the compute queue!");
+    }
+  }
+
+  // For pipelines drawing into attachments of these formats: a compatible render pass, or VK_NULL_HANDLE
+  // with dynamic rendering, in which case chain a VkPipelineRenderingCreateInfo with the same formats.
+  auto GetRenderPass(std::span<const VkFormat> Colors, VkFormat Depth = VK_FORMAT_UNDEFINED) -> VkRenderPass {
+    if (DynamicRendering) {
+      return VK_NULL_HANDLE;
+    }
+    render_pass_key Key;
+    for (VkFormat Format : Colors) {
+      Key.Colors.emplace_back(Format, VK_ATTACHMENT_LOAD_OP_LOAD);
+    }
+    Key.Depth = {Depth, VK_ATTACHMENT_LOAD_OP_LOAD};
+    return GetRenderPass(Key);
+  }
+
+  // Valid inside pass executors.
+  // Call when imported views are destroyed, e.g. with the swapchain, so no cached framebuffer outlives them or
+  // is found again under a recycled handle. Framebuffers of frames in flight are destroyed once those finish.
+  void ForgetFramebuffers() {
+    physical Old;
+    for (const auto &[Key, Framebuffer] : Framebuffers) {
+      Old.Framebuffers.push_back(Framebuffer);
+    }
+    Framebuffers.clear();
+    Retired.push_back({.Physical = std::move(Old), .Frame = FrameNumber});
+  }
+
+  [[nodiscard]] auto GetImage(resource Resource) const -> VkImage { return Resources[Resource].Image; }
+  [[nodiscard]] auto GetView(resource Resource) const -> VkImageView { return Resources[Resource].View; }
+  [[nodiscard]] auto GetBuffer(resource Resource) const -> VkBuffer { return Resources[Resource].Buffer; }
+  [[nodiscard]] auto GetDesc(resource Resource) const -> const image_desc & { return Resources[Resource].Desc; }
+
+  // Records the frame's surviving passes with their barriers, then forgets the declarations. Recording starts
+  // in CommandBuffer, which the caller has begun and may have recorded into; the returned command buffer,
+  // which may be another one, ends the frame: record anything left into it, end it and call Submit.
+  auto Execute(VkCommandBuffer CommandBuffer) -> VkCommandBuffer {
+    KPROFILE_SCOPE("render_graph::Execute");
+    FrameNumber++;
+    while (!Retired.empty() && Retired.front().Frame + FramesInFlight <= FrameNumber) {
+      Release(Retired.front().Physical);
+      Retired.pop_front();
+    }
+    Cull();
+    Allocate();
+    Schedule();
+    BeginFrame(CommandBuffer);
+    for (uint32_t i = 0; i < Passes.size(); i++) {
+      pass &Pass = Passes[i];
+      if (!Pass.Live) {
+        continue;
+      }
+      const VkCommandBuffer Commands = SegmentFor(Pass.Queue, Pass.WaitFor);
+      Synchronize(Commands, i);
+      if (Pass.Attachments.empty()) {
+        Pass.Execute(Commands);
+      } else {
+        BeginRendering(Commands, Pass);
+        Pass.Execute(Commands);
+        if (DynamicRendering) {
+          vkCmdEndRendering(Commands);
+        } else {
+          vkCmdEndRenderPass(Commands);
+        }
+      }
+      ReleaseToOtherQueue(Commands, Pass);
+      if (Pass.EndsSegment) {
+        Pass.Signal = CloseSegment(Pass.Queue);
+      }
+    }
+    if (Open[Compute]) {
+      CloseSegment(Compute);
+    }
+    const VkCommandBuffer Last = SegmentFor(Graphics, FinalWait);
+    Finalize(Last);
+    Passes.clear();
+    Resources.clear();
+    return Last;
+  }
+
+  // Submits what Execute recorded once the caller has ended its last command buffer. Wait is waited on at
+  // WaitStages before any graphics work, and Signal and Fence are signalled once both queues are done.
+  void Submit(std::span<const VkSemaphore> Wait, std::span<const VkPipelineStageFlags> WaitStages,
+              std::span<const VkSemaphore> Signal, VkFence Fence) {
+    segment Tail = *std::exchange(Open[Graphics], std::nullopt);
+    Tail.Signal = AsyncCompute ? ++TimelineValues[Graphics] : 0;
+    Segments.push_back(Tail);
+    bool FirstGraphics = true;
+    for (size_t i = 0; i < Segments.size(); i++) {
+      const segment &Segment = Segments[i];
+      const bool Last = i + 1 == Segments.size();
+      std::vector<VkSemaphore> WaitSemaphores;
+      std::vector<VkPipelineStageFlags> Stages;
+      std::vector<uint64_t> WaitValues; // Ignored for binary semaphores
+      if (Segment.Queue == Graphics && std::exchange(FirstGraphics, false)) {
+        WaitSemaphores.assign(Wait.begin(), Wait.end());
+        Stages.assign(WaitStages.begin(), WaitStages.end());
+        WaitValues.resize(Wait.size());
+      }
+      if (Segment.Wait != 0) {
+        WaitSemaphores.push_back(Timelines[1 - Segment.Queue]);
+        Stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        WaitValues.push_back(Segment.Wait);
+      }
+      std::vector<VkSemaphore> SignalSemaphores;
+      std::vector<uint64_t> SignalValues;
+      if (AsyncCompute) {
+        SignalSemaphores.push_back(Timelines[Segment.Queue]);
+        SignalValues.push_back(Segment.Signal);
+      }
+      if (Last) {
+        SignalSemaphores.insert(SignalSemaphores.end(), Signal.begin(), Signal.end());
+        SignalValues.resize(SignalSemaphores.size());
+      }
+      VkTimelineSemaphoreSubmitInfo TimelineInfo{
+          .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+          .waitSemaphoreValueCount = static_cast<uint32_t>(WaitValues.size()),
+          .pWaitSemaphoreValues = WaitValues.data(),
+          .signalSemaphoreValueCount = static_cast<uint32_t>(SignalValues.size()),
+          .pSignalSemaphoreValues = SignalValues.data(),
+      };
+      VkSubmitInfo SubmitInfo{
+          .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+          .pNext = AsyncCompute ? &TimelineInfo : nullptr,
+          .waitSemaphoreCount = static_cast<uint32_t>(WaitSemaphores.size()),
+          .pWaitSemaphores = WaitSemaphores.data(),
+          .pWaitDstStageMask = Stages.data(),
+          .commandBufferCount = 1,
+          .pCommandBuffers = &Segment.CommandBuffer,
+          .signalSemaphoreCount = static_cast<uint32_t>(SignalSemaphores.size()),
+          .pSignalSemaphores = SignalSemaphores.data(),
+      };
+      if (vkQueueSubmit(Queues[Segment.Queue], 1, &SubmitInfo, Last ? Fence : VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit frame!");
+      }
+    }
+    Segments.clear();
+  }
+
+private:
+  static constexpr uint32_t Graphics = 0;
+  static constexpr uint32_t Compute = 1;
+  // What a compute-only queue supports; compute passes use no other stages
+  static constexpr VkPipelineStageFlags ComputeStages =
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  struct state {
+    VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags WriteStage = 0; // Of the last write, or of whatever the contents came from
+    VkAccessFlags WriteAccess = 0;
+    VkPipelineStageFlags ReadStages = 0;    // Reads since the last write
+    VkPipelineStageFlags VisibleStages = 0; // Where the last write has been made visible
+    VkAccessFlags VisibleAccess = 0;
+    uint32_t Queue = Graphics; // Of the last use; the stages above are on this queue
+    bool Released = false;     // To the other queue family, which acquires it at its next use
+  };
+  struct usage {
+    VkPipelineStageFlags Stage;
+    VkAccessFlags Access;
+    VkImageLayout Layout;
+    bool Write;
+    VkImageUsageFlags ImageUsage;
+  };
+  struct resource_data {
+    std::string Name;
+    bool Imported = false;
+    bool IsBuffer = false;
+    image_desc Desc;
+    VkImage Image = VK_NULL_HANDLE;
+    VkImageView View = VK_NULL_HANDLE;
+    VkBuffer Buffer = VK_NULL_HANDLE;
+    VkImageAspectFlags Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    std::optional<graph_access> Final;
+    state State; // Imported resources only; transients share their memory block's state
+    // Transients: usage and lifetime over the surviving passes
+    VkImageUsageFlags Usage = 0;
+    std::optional<uint32_t> First;
+    uint32_t Last = 0;
+    uint32_t Block = 0;
+  };
+  struct use {
+    resource Resource;
+    graph_access Access;
+  };
+  struct attachment {
+    resource Resource;
+    VkAttachmentLoadOp Load;
+    VkClearValue Clear;
+  };
+  // An ownership transfer to the other queue family after a pass, into the layout the next use wants
+  struct release {
+    resource Resource;
+    std::optional<VkImageLayout> Layout; // Unchanged if empty
+  };
+  struct pass {
+    std::string Name;
+    executor Execute;
+    std::vector<use> Uses;
+    std::vector<attachment> Attachments;
+    bool SideEffect = false;
+    bool Live = false;
+    bool Async = false;
+    // Filled by Schedule
+    uint32_t Queue = Graphics;
+    std::optional<uint32_t> WaitFor; // The pass of the other queue whose segment this one waits for
+    bool EndsSegment = false;        // Another queue waits for this pass
+    std::vector<release> Releases;
+    uint64_t Signal = 0; // Timeline value of the segment it ends
+  };
+  // Passes recorded into one command buffer of one queue, submitted as one batch
+  struct segment {
+    uint32_t Queue = Graphics;
+    VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+    uint64_t Wait = 0;   // Value of the other queue's timeline to wait for, 0 for none
+    uint64_t Signal = 0; // Value of this queue's timeline once done
+  };
+  struct command_list {
+    VkCommandPool Pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> Buffers;
+    size_t Used = 0;
+  };
+  // Transients that can share memory share a block
+  struct block {
+    VkDeviceMemory Memory = VK_NULL_HANDLE;
+    VkDeviceSize Size = 0;
+    uint32_t MemoryTypeBits = ~0U;
+    std::vector<std::pair<uint32_t, uint32_t>> Lifetimes;
+    state State; // Of its most recent occupant
+  };
+  struct transient_key {
+    image_desc Desc;
+    VkImageUsageFlags Usage;
+    uint32_t First;
+    uint32_t Last;
+    auto operator<=>(const transient_key &) const = default;
+  };
+  struct physical {
+    std::vector<transient_key> Keys;
+    std::vector<VkImage> Images;
+    std::vector<VkImageView> Views;
+    std::vector<block> Blocks;
+    std::vector<uint32_t> BlockOf; // Per transient
+    std::vector<VkFramebuffer> Framebuffers; // Fallback path: may reference the views above
+  };
+  struct retired {
+    physical Physical;
+    uint64_t Frame;
+  };
+  struct render_pass_key {
+    std::vector<std::pair<VkFormat, VkAttachmentLoadOp>> Colors;
+    std::pair<VkFormat, VkAttachmentLoadOp> Depth; // VK_FORMAT_UNDEFINED without depth
+    auto operator<=>(const render_pass_key &) const = default;
+  };
+  struct framebuffer_key {
+    VkRenderPass RenderPass;
+    std::vector<VkImageView> Views;
+    uint32_t Width;
+    uint32_t Height;
+    auto operator<=>(const framebuffer_key &) const = default;
+  };
+  // One dependency, recorded with its own stage masks under synchronization2 and merged into the pass's
+  // vkCmdPipelineBarrier otherwise. Image is VK_NULL_HANDLE for buffers.
+  // Buffer is only set for queue family ownership transfers, which need a buffer barrier.
+  struct barrier {
+    VkPipelineStageFlags SrcStage;
+    VkAccessFlags SrcAccess;
+    VkPipelineStageFlags DstStage;
+    VkAccessFlags DstAccess;
+    VkImage Image = VK_NULL_HANDLE;
+    VkImageLayout OldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout NewLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageAspectFlags Aspect = 0;
+    VkBuffer Buffer = VK_NULL_HANDLE;
+    uint32_t SrcFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t DstFamily = VK_QUEUE_FAMILY_IGNORED;
+  };
+
+  VkPhysicalDevice PhysicalDevice;
+  VkDevice Device;
+  uint32_t FramesInFlight;
+  uint64_t FrameNumber = 0;
+  bool Synchronization2;
+  bool DynamicRendering;
+  bool AsyncCompute;
+  std::array<VkQueue, 2> Queues;
+  std::array<uint32_t, 2> QueueFamilies;
+  std::array<VkSemaphore, 2> Timelines{};
+  std::array<uint64_t, 2> TimelineValues{}; // Last value signalled, or to be signalled, per queue
+  uint64_t FrameStart = 0;                  // Graphics timeline value at the end of the previous frame
+  std::vector<std::array<command_list, 2>> CommandLists; // Per frame in flight and queue
+  std::array<std::optional<segment>, 2> Open;
+  std::vector<segment> Segments; // Closed this frame, in submission order
+  bool ComputeStarted = false;
+  std::optional<uint32_t> FinalWait; // The compute pass the end of the frame waits for
+  std::vector<resource_data> Resources;
+  std::vector<pass> Passes;
+  physical Physical;
+  std::deque<retired> Retired;
+  std::map<render_pass_key, VkRenderPass> RenderPasses;
+  std::map<framebuffer_key, VkFramebuffer> Framebuffers;
+  std::vector<barrier> Barriers; // Scratch
+
+  static auto UsageOf(graph_access Access) -> usage {
+    constexpr VkPipelineStageFlags Shaders = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    constexpr VkPipelineStageFlags DepthTests =
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    switch (Access) {
+    case graph_access::ColorAttachment:
+      return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+              VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+    case graph_access::DepthAttachment:
+      return {DepthTests,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+    case graph_access::DepthRead:
+      return {DepthTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+    case graph_access::Sampled:
+      return {Shaders, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false,
+              VK_IMAGE_USAGE_SAMPLED_BIT};
+    case graph_access::StorageRead:
+      return {Shaders, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, VK_IMAGE_USAGE_STORAGE_BIT};
+    case graph_access::StorageWrite:
+      return {Shaders, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true,
+              VK_IMAGE_USAGE_STORAGE_BIT};
+    case graph_access::TransferSrc:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+              false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+    case graph_access::TransferDst:
+      return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+              true, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+    case graph_access::IndirectRead:
+      return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+              false, 0};
+    case graph_access::VertexRead:
+      return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+              VK_IMAGE_LAYOUT_UNDEFINED, false, 0};
+    case graph_access::Present:
+      return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false, 0};
+    }
+    return {};
+  }
+
+  static auto AspectOf(VkFormat Format) -> VkImageAspectFlags {
+    switch (Format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+  }
+
+  auto StateOf(resource_data &Resource) -> state & {
+    return Resource.Imported ? Resource.State : Physical.Blocks[Resource.Block].State;
+  }
+
+  void Cull() {
+    std::vector<bool> Needed(Resources.size());
+    for (resource i = 0; i < Resources.size(); i++) {
+      Needed[i] = Resources[i].Imported;
+    }
+    for (uint32_t i = static_cast<uint32_t>(Passes.size()); i-- > 0;) {
+      pass &Pass = Passes[i];
+      Pass.Live = Pass.SideEffect || std::ranges::any_of(Pass.Uses, [&](const use &Use) {
+                    return UsageOf(Use.Access).Write && Needed[Use.Resource];
+                  });
+      if (!Pass.Live) {
+        continue;
+      }
+      for (const use &Use : Pass.Uses) {
+        Needed[Use.Resource] = true; // Written resources stay needed: earlier writers may have filled them partly
+        resource_data &Resource = Resources[Use.Resource];
+        Resource.Usage |= UsageOf(Use.Access).ImageUsage;
+        Resource.Last = std::max(Resource.Last, i);
+        Resource.First = i;
+      }
+    }
+  }
+
+  // A resource used several ways in one pass is synchronized once for all of them
+  auto Merge(const pass &Pass) const -> std::vector<std::pair<resource, usage>> {
+    std::vector<std::pair<resource, usage>> Merged;
+    for (const use &Use : Pass.Uses) {
+      const usage Usage = UsageOf(Use.Access);
+      auto It = std::ranges::find(Merged, Use.Resource, &std::pair<resource, usage>::first);
+      if (It == Merged.end()) {
+        Merged.emplace_back(Use.Resource, Usage);
+        continue;
+      }
+      It->second.Stage |= Usage.Stage;
+      It->second.Access |= Usage.Access;
+      It->second.Write |= Usage.Write;
+      if (It->second.Layout != Usage.Layout) {
+        It->second.Layout = VK_IMAGE_LAYOUT_GENERAL;
+      }
+    }
+    return Merged;
+  }
+
+  // Puts passes on queues and finds where one queue waits for the other. A resource, or the memory a
+  // transient shares, changes queues only through a semaphore, even between reads, so its first use on one
+  // queue waits for the segment holding its last use on the other, which ends right after that pass. A queue
+  // that already waits for a later pass of the other needs no new wait.
+  void Schedule() {
+    struct slot {
+      uint32_t Queue = Graphics;
+      std::optional<uint32_t> LastUse; // This frame
+    };
+    std::map<const state *, slot> Slots;
+    std::array<std::optional<uint32_t>, 2> Known; // Per queue, the last pass of the other it waits for
+    std::array<std::optional<uint32_t>, 2> Last;
+    const bool Transfer = QueueFamilies[Graphics] != QueueFamilies[Compute];
+    const auto Depend = [&](uint32_t Queue, uint32_t Producer) {
+      if (Known[Queue] && *Known[Queue] >= Producer) {
+        return false;
+      }
+      Passes[Producer].EndsSegment = true;
+      Known[Queue] = Producer;
+      return true;
+    };
+    FinalWait.reset();
+    for (uint32_t i = 0; i < Passes.size(); i++) {
+      pass &Pass = Passes[i];
+      if (!Pass.Live) {
+        continue;
+      }
+      Pass.Queue = Pass.Async && AsyncCompute ? Compute : Graphics;
+      for (const auto &[Index, Usage] : Merge(Pass)) {
+        const resource_data &Resource = Resources[Index];
+        slot &Slot = Slots[&StateOf(Resources[Index])];
+        if (Slot.LastUse && Slot.Queue != Pass.Queue) {
+          if (Depend(Pass.Queue, *Slot.LastUse)) {
+            Pass.WaitFor = Known[Pass.Queue];
+          }
+          const bool Fresh = !Resource.Imported && Resource.First == i;
+          if (Transfer && !Fresh) {
+            Passes[*Slot.LastUse].Releases.push_back({.Resource = Index, .Layout = Usage.Layout});
+          }
+        }
+        Slot = {.Queue = Pass.Queue, .LastUse = i};
+      }
+      Last[Pass.Queue] = i;
+    }
+    // The frame ends on the graphics queue, after the compute queue, which hands imported resources back
+    if (Last[Compute] && Depend(Graphics, *Last[Compute])) {
+      FinalWait = Last[Compute];
+    }
+    for (resource i = 0; i < Resources.size(); i++) {
+      const resource_data &Resource = Resources[i];
+      if (!Resource.Imported || !Transfer) {
+        continue;
+      }
+      const auto It = Slots.find(&Resource.State);
+      if (It != Slots.end() && It->second.Queue == Compute) {
+        Passes[*It->second.LastUse].Releases.push_back(
+            {.Resource = i,
+             .Layout = Resource.Final ? std::optional(UsageOf(*Resource.Final).Layout) : std::nullopt});
+      }
+    }
+  }
+
+  void BeginFrame(VkCommandBuffer CommandBuffer) {
+    Open = {segment{.Queue = Graphics, .CommandBuffer = CommandBuffer}, std::nullopt};
+    Segments.clear();
+    ComputeStarted = false;
+    FrameStart = TimelineValues[Graphics];
+    if (AsyncCompute) {
+      for (command_list &List : CommandLists[FrameNumber % FramesInFlight]) {
+        vkResetCommandPool(Device, List.Pool, 0);
+        List.Used = 0;
+      }
+    }
+  }
+
+  // The command buffer a pass on Queue records into, starting a segment if the pass waits for another
+  // queue, since a batch waits as a whole.
+  auto SegmentFor(uint32_t Queue, std::optional<uint32_t> WaitFor) -> VkCommandBuffer {
+    if (Open[Queue] && WaitFor) {
+      CloseSegment(Queue);
+    }
+    if (!Open[Queue]) {
+      segment Segment{.Queue = Queue, .CommandBuffer = NextCommandBuffer(Queue)};
+      if (WaitFor) {
+        Segment.Wait = Passes[*WaitFor].Signal;
+      }
+      if (Queue == Compute && !std::exchange(ComputeStarted, true)) {
+        Segment.Wait = std::max(Segment.Wait, FrameStart); // Last frame's graphics work may use the same memory
+      }
+      Open[Queue] = Segment;
+    }
+    return Open[Queue]->CommandBuffer;
+  }
+
+  auto CloseSegment(uint32_t Queue) -> uint64_t {
+    segment Segment = *std::exchange(Open[Queue], std::nullopt);
+    vkEndCommandBuffer(Segment.CommandBuffer);
+    Segment.Signal = ++TimelineValues[Queue];
+    Segments.push_back(Segment);
+    return Segment.Signal;
+  }
+
+  auto NextCommandBuffer(uint32_t Queue) -> VkCommandBuffer {
+    command_list &List = CommandLists[FrameNumber % FramesInFlight][Queue];
+    if (List.Used == List.Buffers.size()) {
+      VkCommandBufferAllocateInfo AllocateInfo{
+          .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+          .commandPool = List.Pool,
+          .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+          .commandBufferCount = 1,
+      };
+      if (vkAllocateCommandBuffers(Device, &AllocateInfo, &List.Buffers.emplace_back()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate render graph command buffer!");
+      }
+    }
+    const VkCommandBuffer CommandBuffer = List.Buffers[List.Used++];
+    VkCommandBufferBeginInfo BeginInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+    return CommandBuffer;
+  }
+
+  // Creates physical images for this frame's transients, reusing last frame's if nothing changed.
+  void Allocate() {
+    std::vector<resource> Transients;
+    std::vector<transient_key> Keys;
+    for (resource i = 0; i < Resources.size(); i++) {
+      const resource_data &Resource = Resources[i];
+      if (!Resource.Imported && Resource.First) {
+        Transients.push_back(i);
+        Keys.push_back(
+            {.Desc = Resource.Desc, .Usage = Resource.Usage, .First = *Resource.First, .Last = Resource.Last});
+      }
+    }
+    if (Keys != Physical.Keys) {
+      KPROFILE_SCOPE("render_graph::Allocate");
+      ForgetFramebuffers(); // They may reference the old views
+      Retired.push_back({.Physical = std::move(Physical), .Frame = FrameNumber});
+      Physical = {.Keys = std::move(Keys)};
+      Build(Transients);
+    }
+    for (size_t i = 0; i < Transients.size(); i++) {
+      resource_data &Resource = Resources[Transients[i]];
+      Resource.Image = Physical.Images[i];
+      Resource.View = Physical.Views[i];
+      Resource.Block = Physical.BlockOf[i];
+    }
+  }
+
+  void Build(std::span<const resource> Transients) {
+    std::vector<VkMemoryRequirements> Requirements(Transients.size());
+    for (size_t i = 0; i < Transients.size(); i++) {
+      const resource_data &Resource = Resources[Transients[i]];
+      VkImageCreateInfo CreateInfo{
+          .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+          .imageType = VK_IMAGE_TYPE_2D,
+          .format = Resource.Desc.Format,
+          .extent = {Resource.Desc.Width, Resource.Desc.Height, 1},
+          .mipLevels = Resource.Desc.Levels,
+          .arrayLayers = 1,
+          .samples = VK_SAMPLE_COUNT_1_BIT,
+          .tiling = VK_IMAGE_TILING_OPTIMAL,
+          .usage = Resource.Usage,
+          .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+          .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      };
+      VkImage Image = VK_NULL_HANDLE;
+      if (vkCreateImage(Device, &CreateInfo, nullptr, &Image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transient image " + Resource.Name + "!");
+      }
+      Physical.Images.push_back(Image);
+      vkGetImageMemoryRequirements(Device, Image, &Requirements[i]);
+    }
+
+    // Largest first, each into the first block it fits in without overlapping the lifetime of an occupant
+    std::vector<size_t> Order(Transients.size());
+    std::iota(Order.begin(), Order.end(), 0);
+    std::ranges::stable_sort(Order, std::greater{}, [&](size_t i) { return Requirements[i].size; });
+    Physical.BlockOf.assign(Transients.size(), 0);
+    VkDeviceSize Total = 0;
+    for (size_t i : Order) {
+      const std::pair<uint32_t, uint32_t> Lifetime = {Physical.Keys[i].First, Physical.Keys[i].Last};
+      auto Fits = [&](const block &Block) {
+        return (Block.MemoryTypeBits & Requirements[i].memoryTypeBits) != 0 &&
+               std::ranges::none_of(Block.Lifetimes, [&](const std::pair<uint32_t, uint32_t> &Other) {
+                 return Other.first <= Lifetime.second && Lifetime.first <= Other.second;
+               });
+      };
+      auto It = std::ranges::find_if(Physical.Blocks, Fits);
+      if (It == Physical.Blocks.end()) {
+        It = Physical.Blocks.emplace(Physical.Blocks.end());
+      }
+      It->Size = std::max(It->Size, Requirements[i].size);
+      It->MemoryTypeBits &= Requirements[i].memoryTypeBits;
+      It->Lifetimes.push_back(Lifetime);
+      Physical.BlockOf[i] = static_cast<uint32_t>(It - Physical.Blocks.begin());
+      Total += Requirements[i].size;
+    }
+
+    VkDeviceSize Allocated = 0;
+    for (block &Block : Physical.Blocks) {
+      VkMemoryAllocateInfo AllocateInfo{
+          .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+          .allocationSize = Block.Size,
+          .memoryTypeIndex =
+              FindMemoryType(PhysicalDevice, Block.MemoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+      };
+      if (vkAllocateMemory(Device, &AllocateInfo, nullptr, &Block.Memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate transient memory!");
+      }
+      Allocated += Block.Size;
+    }
+    for (size_t i = 0; i < Transients.size(); i++) {
+      const resource_data &Resource = Resources[Transients[i]];
+      vkBindImageMemory(Device, Physical.Images[i], Physical.Blocks[Physical.BlockOf[i]].Memory, 0);
+      VkImageViewCreateInfo ViewInfo{
+          .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+          .image = Physical.Images[i],
+          .viewType = VK_IMAGE_VIEW_TYPE_2D,
+          .format = Resource.Desc.Format,
+          .subresourceRange = {.aspectMask = Resource.Aspect, .levelCount = Resource.Desc.Levels, .layerCount = 1},
+      };
+      VkImageView View = VK_NULL_HANDLE;
+      if (vkCreateImageView(Device, &ViewInfo, nullptr, &View) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transient image view " + Resource.Name + "!");
+      }
+      Physical.Views.push_back(View);
+    }
+    KLOG(Debug, Render, "render graph: {} transient images in {} blocks, {} MiB ({} MiB saved by aliasing)",
+         Transients.size(), Physical.Blocks.size(), Allocated >> 20, (Total - Allocated) >> 20);
+  }
+
+  void Release(physical &Old) const {
+    for (VkFramebuffer Framebuffer : Old.Framebuffers) {
+      vkDestroyFramebuffer(Device, Framebuffer, nullptr);
+    }
+    for (VkImageView View : Old.Views) {
+      vkDestroyImageView(Device, View, nullptr);
+    }
+    for (VkImage Image : Old.Images) {
+      vkDestroyImage(Device, Image, nullptr);
+    }
+    for (const block &Block : Old.Blocks) {
+      vkFreeMemory(Device, Block.Memory, nullptr);
+    }
+    Old = {};
+  }
+
+  // One barrier before the pass covering every hazard on every resource it uses.
+  void Synchronize(VkCommandBuffer CommandBuffer, uint32_t PassIndex) {
+    const uint32_t Queue = Passes[PassIndex].Queue;
+    for (auto [Index, Usage] : Merge(Passes[PassIndex])) {
+      resource_data &Resource = Resources[Index];
+      state &State = StateOf(Resource);
+      if (Queue == Compute) {
+        Usage.Stage &= ComputeStages;
+      }
+      const bool Acquire = State.Queue != Queue && State.Released;
+      if (State.Queue != Queue) {
+        // The segment waits for the one that last used the resource on the other queue, which orders execution
+        // and makes its writes visible; only the layout may still change
+        State = {.Layout = State.Layout, .Queue = Queue};
+      }
+      const bool Fresh = !Resource.Imported && Resource.First == PassIndex; // Previous contents are discarded
+      const VkImageLayout OldLayout = Fresh ? VK_IMAGE_LAYOUT_UNDEFINED : State.Layout;
+      const bool Transition = !Resource.IsBuffer && OldLayout != Usage.Layout;
+      const bool Visible = (State.VisibleStages & Usage.Stage) == Usage.Stage &&
+                           (State.VisibleAccess & Usage.Access) == Usage.Access;
+
+      VkPipelineStageFlags Src = 0;
+      VkAccessFlags SrcAccess = 0;
+      if (Usage.Write || Transition) { // Write-after-read and write-after-write; a transition is a write too
+        Src = State.ReadStages | State.WriteStage;
+        SrcAccess = State.WriteAccess;
+      } else if (State.WriteAccess != 0 && !Visible) { // Read-after-write
+        Src = State.WriteStage;
+        SrcAccess = State.WriteAccess;
+      }
+      if (Src != 0 || Transition || Acquire) {
+        Barriers.push_back({.SrcStage = Src,
+                            .SrcAccess = SrcAccess,
+                            .DstStage = Usage.Stage,
+                            .DstAccess = Usage.Access,
+                            .Image = Resource.IsBuffer ? VK_NULL_HANDLE : Resource.Image,
+                            .OldLayout = OldLayout,
+                            .NewLayout = Usage.Layout,
+                            .Aspect = Resource.Aspect,
+                            .Buffer = Acquire && Resource.IsBuffer ? Resource.Buffer : VK_NULL_HANDLE,
+                            .SrcFamily = Acquire ? QueueFamilies[1 - Queue] : VK_QUEUE_FAMILY_IGNORED,
+                            .DstFamily = Acquire ? QueueFamilies[Queue] : VK_QUEUE_FAMILY_IGNORED});
+      }
+
+      if (Usage.Write) {
+        State = {.Layout = Usage.Layout, .WriteStage = Usage.Stage, .WriteAccess = Usage.Access};
+      } else if (Transition) {
+        State = {.Layout = Usage.Layout,
+                 .WriteStage = State.WriteStage,
+                 .WriteAccess = State.WriteAccess,
+                 .ReadStages = Usage.Stage,
+                 .VisibleStages = Usage.Stage,
+                 .VisibleAccess = Usage.Access};
+      } else {
+        State.ReadStages |= Usage.Stage;
+        if (Src != 0) {
+          State.VisibleStages |= Usage.Stage;
+          State.VisibleAccess |= Usage.Access;
+        }
+      }
+      State.Queue = Queue;
+    }
+
+    FlushBarriers(CommandBuffer);
+  }
+
+  // Hands the resources the other queue uses next over to its family, in the layout it wants them in.
+  void ReleaseToOtherQueue(VkCommandBuffer CommandBuffer, const pass &Pass) {
+    for (const release &Release : Pass.Releases) {
+      resource_data &Resource = Resources[Release.Resource];
+      state &State = StateOf(Resource);
+      Barriers.push_back({.SrcStage = State.ReadStages | State.WriteStage,
+                          .SrcAccess = State.WriteAccess,
+                          .DstStage = 0,
+                          .DstAccess = 0,
+                          .Image = Resource.IsBuffer ? VK_NULL_HANDLE : Resource.Image,
+                          .OldLayout = State.Layout,
+                          .NewLayout = Release.Layout.value_or(State.Layout),
+                          .Aspect = Resource.Aspect,
+                          .Buffer = Resource.IsBuffer ? Resource.Buffer : VK_NULL_HANDLE,
+                          .SrcFamily = QueueFamilies[Pass.Queue],
+                          .DstFamily = QueueFamilies[1 - Pass.Queue]});
+      State.Layout = Release.Layout.value_or(State.Layout);
+      State.Released = true;
+    }
+    FlushBarriers(CommandBuffer);
+  }
+
+  // Leaves imported images in the layout their owner asked for, and takes back what the compute queue used last.
+  void Finalize(VkCommandBuffer CommandBuffer) {
+    for (resource_data &Resource : Resources) {
+      if (!Resource.Imported) {
+        continue;
+      }
+      state &State = Resource.State;
+      const bool Acquire = State.Queue != Graphics && State.Released;
+      if (State.Queue != Graphics) {
+        State = {.Layout = State.Layout}; // The last segment waits for the compute queue
+      }
+      if (!Resource.Final && !Acquire) {
+        continue;
+      }
+      const usage Usage = Resource.Final ? UsageOf(*Resource.Final) : usage{.Layout = State.Layout};
+      if (!Acquire && State.Layout == Usage.Layout && State.WriteAccess == 0) {
+        continue;
+      }
+      Barriers.push_back({.SrcStage = State.ReadStages | State.WriteStage,
+                          .SrcAccess = State.WriteAccess,
+                          .DstStage = Usage.Stage,
+                          .DstAccess = Usage.Access,
+                          .Image = Resource.Image,
+                          .OldLayout = State.Layout,
+                          .NewLayout = Usage.Layout,
+                          .Aspect = Resource.Aspect,
+                          .Buffer = Acquire && Resource.IsBuffer ? Resource.Buffer : VK_NULL_HANDLE,
+                          .SrcFamily = Acquire ? QueueFamilies[Compute] : VK_QUEUE_FAMILY_IGNORED,
+                          .DstFamily = Acquire ? QueueFamilies[Graphics] : VK_QUEUE_FAMILY_IGNORED});
+    }
+    FlushBarriers(CommandBuffer);
+  }
+
+  void FlushBarriers(VkCommandBuffer CommandBuffer) {
+    if (Barriers.empty()) {
+      return;
+    }
+    if (Synchronization2) {
+      std::vector<VkMemoryBarrier2> MemoryBarriers;
+      std::vector<VkBufferMemoryBarrier2> BufferBarriers;
+      std::vector<VkImageMemoryBarrier2> ImageBarriers;
+      for (const barrier &Barrier : Barriers) {
+        // The 1.0 stage and access bits keep their values in the 64-bit synchronization2 masks
+        const VkPipelineStageFlags2 Src = Barrier.SrcStage != 0 ? Barrier.SrcStage : VK_PIPELINE_STAGE_2_NONE;
+        if (Barrier.Buffer != VK_NULL_HANDLE) {
+          BufferBarriers.push_back({.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                                    .srcStageMask = Src,
+                                    .srcAccessMask = Barrier.SrcAccess,
+                                    .dstStageMask = Barrier.DstStage,
+                                    .dstAccessMask = Barrier.DstAccess,
+                                    .srcQueueFamilyIndex = Barrier.SrcFamily,
+                                    .dstQueueFamilyIndex = Barrier.DstFamily,
+                                    .buffer = Barrier.Buffer,
+                                    .size = VK_WHOLE_SIZE});
+          continue;
+        }
+        if (Barrier.Image == VK_NULL_HANDLE) {
+          MemoryBarriers.push_back({.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                    .srcStageMask = Src,
+                                    .srcAccessMask = Barrier.SrcAccess,
+                                    .dstStageMask = Barrier.DstStage,
+                                    .dstAccessMask = Barrier.DstAccess});
+          continue;
+        }
+        ImageBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                                 .srcStageMask = Src,
+                                 .srcAccessMask = Barrier.SrcAccess,
+                                 .dstStageMask = Barrier.DstStage,
+                                 .dstAccessMask = Barrier.DstAccess,
+                                 .oldLayout = Barrier.OldLayout,
+                                 .newLayout = Barrier.NewLayout,
+                                 .srcQueueFamilyIndex = Barrier.SrcFamily,
+                                 .dstQueueFamilyIndex = Barrier.DstFamily,
+                                 .image = Barrier.Image,
+                                 .subresourceRange = Range(Barrier.Aspect)});
+      }
+      VkDependencyInfo Dependency{
+          .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+          .memoryBarrierCount = static_cast<uint32_t>(MemoryBarriers.size()),
+          .pMemoryBarriers = MemoryBarriers.data(),
+          .bufferMemoryBarrierCount = static_cast<uint32_t>(BufferBarriers.size()),
+          .pBufferMemoryBarriers = BufferBarriers.data(),
+          .imageMemoryBarrierCount = static_cast<uint32_t>(ImageBarriers.size()),
+          .pImageMemoryBarriers = ImageBarriers.data(),
+      };
+      vkCmdPipelineBarrier2(CommandBuffer, &Dependency);
+    } else {
+      VkPipelineStageFlags SrcStages = 0;
+      VkPipelineStageFlags DstStages = 0;
+      VkMemoryBarrier MemoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+      std::vector<VkBufferMemoryBarrier> BufferBarriers;
+      std::vector<VkImageMemoryBarrier> ImageBarriers;
+      for (const barrier &Barrier : Barriers) {
+        SrcStages |= Barrier.SrcStage;
+        DstStages |= Barrier.DstStage;
+        if (Barrier.Buffer != VK_NULL_HANDLE) {
+          BufferBarriers.push_back({.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                    .srcAccessMask = Barrier.SrcAccess,
+                                    .dstAccessMask = Barrier.DstAccess,
+                                    .srcQueueFamilyIndex = Barrier.SrcFamily,
+                                    .dstQueueFamilyIndex = Barrier.DstFamily,
+                                    .buffer = Barrier.Buffer,
+                                    .size = VK_WHOLE_SIZE});
+          continue;
+        }
+        if (Barrier.Image == VK_NULL_HANDLE) {
+          MemoryBarrier.srcAccessMask |= Barrier.SrcAccess;
+          MemoryBarrier.dstAccessMask |= Barrier.DstAccess;
+          continue;
+        }
+        ImageBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                 .srcAccessMask = Barrier.SrcAccess,
+                                 .dstAccessMask = Barrier.DstAccess,
+                                 .oldLayout = Barrier.OldLayout,
+                                 .newLayout = Barrier.NewLayout,
+                                 .srcQueueFamilyIndex = Barrier.SrcFamily,
+                                 .dstQueueFamilyIndex = Barrier.DstFamily,
+                                 .image = Barrier.Image,
+                                 .subresourceRange = Range(Barrier.Aspect)});
+      }
+      const bool HasMemoryBarrier = MemoryBarrier.srcAccessMask != 0 || MemoryBarrier.dstAccessMask != 0;
+      // A release has no destination stage and an acquire no source stage
+      vkCmdPipelineBarrier(CommandBuffer, SrcStages != 0 ? SrcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           DstStages != 0 ? DstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                           HasMemoryBarrier ? 1 : 0, &MemoryBarrier, static_cast<uint32_t>(BufferBarriers.size()),
+                           BufferBarriers.data(), static_cast<uint32_t>(ImageBarriers.size()), ImageBarriers.data());
+    }
+    Barriers.clear();
+  }
+
+  static auto Range(VkImageAspectFlags Aspect) -> VkImageSubresourceRange {
+    return {.aspectMask = Aspect, .levelCount = VK_REMAINING_MIP_LEVELS, .layerCount = VK_REMAINING_ARRAY_LAYERS};
+  }
+
+  void BeginRendering(VkCommandBuffer CommandBuffer, const pass &Pass) {
+    std::vector<const attachment *> Colors;
+    const attachment *Depth = nullptr;
+    for (const attachment &Attachment : Pass.Attachments) {
+      if ((Resources[Attachment.Resource].Aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0) {
+        Depth = &Attachment;
+      } else {
+        Colors.push_back(&Attachment);
+      }
+    }
+    const image_desc &Size = Resources[Pass.Attachments.front().Resource].Desc;
+    const VkRect2D Area = {.extent = {Size.Width, Size.Height}};
+
+    if (DynamicRendering) {
+      auto Info = [&](const attachment &Attachment, VkImageLayout Layout) -> VkRenderingAttachmentInfo {
+        return {.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                .imageView = Resources[Attachment.Resource].View,
+                .imageLayout = Layout,
+                .loadOp = Attachment.Load,
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .clearValue = Attachment.Clear};
+      };
+      std::vector<VkRenderingAttachmentInfo> ColorInfos;
+      for (const attachment *Color : Colors) {
+        ColorInfos.push_back(Info(*Color, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+      }
+      VkRenderingAttachmentInfo DepthInfo{};
+      if (Depth != nullptr) {
+        DepthInfo = Info(*Depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+      }
+      const bool Stencil = Depth != nullptr && (Resources[Depth->Resource].Aspect & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+      VkRenderingInfo RenderingInfo{
+          .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+          .renderArea = Area,
+          .layerCount = 1,
+          .colorAttachmentCount = static_cast<uint32_t>(ColorInfos.size()),
+          .pColorAttachments = ColorInfos.data(),
+          .pDepthAttachment = Depth != nullptr ? &DepthInfo : nullptr,
+          .pStencilAttachment = Stencil ? &DepthInfo : nullptr,
+      };
+      vkCmdBeginRendering(CommandBuffer, &RenderingInfo);
+      return;
+    }
+
+    render_pass_key Key{.Depth = {VK_FORMAT_UNDEFINED, VK_ATTACHMENT_LOAD_OP_DONT_CARE}};
+    std::vector<VkImageView> Views;
+    std::vector<VkClearValue> Clears;
+    for (const attachment *Color : Colors) {
+      Key.Colors.emplace_back(Resources[Color->Resource].Desc.Format, Color->Load);
+      Views.push_back(Resources[Color->Resource].View);
+      Clears.push_back(Color->Clear);
+    }
+    if (Depth != nullptr) {
+      Key.Depth = {Resources[Depth->Resource].Desc.Format, Depth->Load};
+      Views.push_back(Resources[Depth->Resource].View);
+      Clears.push_back(Depth->Clear);
+    }
+    const VkRenderPass RenderPass = GetRenderPass(Key);
+    framebuffer_key FramebufferKey{
+        .RenderPass = RenderPass, .Views = std::move(Views), .Width = Size.Width, .Height = Size.Height};
+    auto [It, Inserted] = Framebuffers.try_emplace(FramebufferKey, VK_NULL_HANDLE);
+    if (Inserted) {
+      VkFramebufferCreateInfo CreateInfo{
+          .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+          .renderPass = RenderPass,
+          .attachmentCount = static_cast<uint32_t>(FramebufferKey.Views.size()),
+          .pAttachments = FramebufferKey.Views.data(),
+          .width = Size.Width,
+          .height = Size.Height,
+          .layers = 1,
+      };
+      if (vkCreateFramebuffer(Device, &CreateInfo, nullptr, &It->second) != VK_SUCCESS) {
+        Framebuffers.erase(It);
+        throw std::runtime_error("failed to create framebuffer for pass " + Pass.Name + "!");
+      }
+    }
+    VkRenderPassBeginInfo BeginInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = RenderPass,
+        .framebuffer = It->second,
+        .renderArea = Area,
+        .clearValueCount = static_cast<uint32_t>(Clears.size()),
+        .pClearValues = Clears.data(),
+    };
+    vkCmdBeginRenderPass(CommandBuffer, &BeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  }
+
+  // Fallback path. Layouts do not change inside the render pass; the graph's barriers already put every
+  // attachment in its attachment layout.
+  auto GetRenderPass(const render_pass_key &Key) -> VkRenderPass {
+    auto [It, Inserted] = RenderPasses.try_emplace(Key, VK_NULL_HANDLE);
+    if (!Inserted) {
+      return It->second;
+    }
+    std::vector<VkAttachmentDescription> Attachments;
+    std::vector<VkAttachmentReference> ColorReferences;
+    for (const auto &[Format, Load] : Key.Colors) {
+      ColorReferences.push_back({.attachment = static_cast<uint32_t>(Attachments.size()),
+                                 .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+      Attachments.push_back({.format = Format,
+                             .samples = VK_SAMPLE_COUNT_1_BIT,
+                             .loadOp = Load,
+                             .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                             .initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                             .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    }
+    const VkAttachmentReference DepthReference{.attachment = static_cast<uint32_t>(Attachments.size()),
+                                               .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    const bool HasDepth = Key.Depth.first != VK_FORMAT_UNDEFINED;
+    if (HasDepth) {
+      const bool Stencil = (AspectOf(Key.Depth.first) & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+      Attachments.push_back({.format = Key.Depth.first,
+                             .samples = VK_SAMPLE_COUNT_1_BIT,
+                             .loadOp = Key.Depth.second,
+                             .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                             .stencilLoadOp = Stencil ? Key.Depth.second : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                             .stencilStoreOp = Stencil ? VK_ATTACHMENT_STORE_OP_STORE
+                                                       : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                             .initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                             .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL});
+    }
+    VkSubpassDescription Subpass{
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = static_cast<uint32_t>(ColorReferences.size()),
+        .pColorAttachments = ColorReferences.data(),
+        .pDepthStencilAttachment = HasDepth ? &DepthReference : nullptr,
+    };
+    VkRenderPassCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = static_cast<uint32_t>(Attachments.size()),
+        .pAttachments = Attachments.data(),
+        .subpassCount = 1,
+        .pSubpasses = &Subpass,
+    };
+    if (vkCreateRenderPass(Device, &CreateInfo, nullptr, &It->second) != VK_SUCCESS) {
+      RenderPasses.erase(It);
+      throw std::runtime_error("failed to create render pass!");
+    }
+    return It->second;
+  }
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../profiler.hpp"
+
+struct shader_define {
+  std::string Name;
+  std::string Value;
+};
+
+// Compiles GLSL to SPIR-V with glslc. Output is cached on disk under a hash of everything that affects
+// it: the stage, the defines, the compiler flags and the text of the shader and every file it includes.
+// A shader whose inputs have not changed is read back from the cache and never recompiled.
+//
+// Shader stages come from the file name, e.g. main.vert.glsl or cull.comp.glsl. Includes are resolved
+// relative to the including file, then to the shader root.
+class shader_compiler {
+public:
+  struct result {
+    bool Ok = false;
+    bool Cached = false;
+    std::vector<uint32_t> Spirv;
+    std::vector<std::filesystem::path> Dependencies; // The shader itself and everything it includes
+    std::string Log;                                 // Compiler output
+  };
+
+  shader_compiler(std::filesystem::path Root, std::filesystem::path CacheDirectory)
+      : Root(std::move(Root)), CacheDirectory(std::move(CacheDirectory)) {
+    std::filesystem::create_directories(this->CacheDirectory);
+  }
+
+  // Safe to call from several threads at once.
+  [[nodiscard]] auto Compile(const std::filesystem::path &Path, std::span<const shader_define> Defines) const -> result {
+    KPROFILE_SCOPE("shader_compiler::Compile");
+    result Result;
+    const std::string_view Stage = StageOf(Path);
+    if (Stage.empty()) {
+      Result.Log = Path.string() + ": unknown shader stage";
+      return Result;
+    }
+    uint64_t Hash = Fnv1a(Flags);
+    Hash = Fnv1a(Stage, Hash);
+    for (const shader_define &Define : Defines) {
+      Hash = Fnv1a(Define.Name + '=' + Define.Value + ';', Hash);
+    }
+    if (!HashSources(Path, Result.Dependencies, Hash, Result.Log)) {
+      return Result;
+    }
+
+    std::array<char, 17> Hex{};
+    std::snprintf(Hex.data(), Hex.size(), "%016llx", static_cast<unsigned long long>(Hash));
+    const std::filesystem::path Cached = CacheDirectory / (std::string(Hex.data()) + ".spv");
+    if (ReadSpirv(Cached, Result.Spirv)) {
+      Result.Ok = Result.Cached = true;
+      return Result;
+    }
+
+    // Compile next to the cache entry and rename, so concurrent compiles never see a partial file
+    std::ostringstream Temporary;
+    Temporary << Cached.string() << '.' << std::this_thread::get_id() << ".tmp";
+    std::string Command = "glslc " + std::string(Flags) + " -fshader-stage=" + std::string(Stage) + " -I" +
+                          Quote(Root.string());
+    for (const shader_define &Define : Defines) {
+      Command += " " + Quote("-D" + Define.Name + (Define.Value.empty() ? "" : "=" + Define.Value));
+    }
+    Command += " -o " + Quote(Temporary.str()) + " " + Quote(Path.string()) + " 2>&1";
+    FILE *Pipe = popen(Command.c_str(), "r");
+    if (Pipe == nullptr) {
+      Result.Log = "failed to run glslc";
+      return Result;
+    }
+    std::array<char, 512> Buffer{};
+    while (std::fgets(Buffer.data(), Buffer.size(), Pipe) != nullptr) {
+      Result.Log += Buffer.data();
+    }
+    const int Status = pclose(Pipe);
+    std::error_code Error;
+    if (Status == 0 && ReadSpirv(Temporary.str(), Result.Spirv)) {
+      std::filesystem::rename(Temporary.str(), Cached, Error);
+      Result.Ok = true;
+    } else {
+      std::filesystem::remove(Temporary.str(), Error);
+    }
+    return Result;
+  }
+
+  [[nodiscard]] auto GetRoot() const -> const std::filesystem::path & { return Root; }
+
+  // "vert" for main.vert.glsl; empty if the name carries no known stage.
+  static auto StageOf(const std::filesystem::path &Path) -> std::string_view {
+    static constexpr std::array<std::string_view, 6> Stages = {"vert", "frag", "comp", "geom", "tesc", "tese"};
+    const std::string Inner = Path.stem().extension().string();
+    for (std::string_view Stage : Stages) {
+      if (Inner.size() == Stage.size() + 1 && Inner.substr(1) == Stage) {
+        return Stage;
+      }
+    }
+    return {};
+  }
+
+private:
+  // Part of the cache key, so changing them invalidates every entry
+  static constexpr std::string_view Flags = "--target-env=vulkan1.0 -O";
+
+  std::filesystem::path Root;
+  std::filesystem::path CacheDirectory;
+
+  static auto Fnv1a(std::string_view Data, uint64_t Hash = 0xcbf29ce484222325ULL) -> uint64_t {
+    for (char C : Data) {
+      Hash = (Hash ^ static_cast<uint8_t>(C)) * 0x100000001b3ULL;
+    }
+    return Hash;
+  }
+  static auto Quote(const std::string &Text) -> std::string {
+    std::string Out = "'";
+    for (char C : Text) {
+      Out += C == '\'' ? std::string("'\\''") : std::string(1, C);
+    }
+    return Out + "'";
+  }
+  static auto ReadSpirv(const std::filesystem::path &Path, std::vector<uint32_t> &Spirv) -> bool {
+    std::ifstream File(Path, std::ios::binary | std::ios::ate);
+    if (!File) {
+      return false;
+    }
+    const auto Size = static_cast<size_t>(File.tellg());
+    if (Size == 0 || Size % sizeof(uint32_t) != 0) {
+      return false;
+    }
+    Spirv.resize(Size / sizeof(uint32_t));
+    File.seekg(0);
+    return static_cast<bool>(File.read(reinterpret_cast<char *>(Spirv.data()), static_cast<std::streamsize>(Size)));
+  }
+
+  // Hashes the shader and, depth first, every file it includes.
+  auto HashSources(const std::filesystem::path &Path, std::vector<std::filesystem::path> &Visited, uint64_t &Hash,
+                   std::string &Log) const -> bool {
+    if (std::ranges::find(Visited, Path) != Visited.end()) {
+      return true; // Include guards make repeats harmless
+    }
+    std::ifstream File(Path);
+    if (!File) {
+      Log = "failed to open " + Path.string();
+      return false;
+    }
+    Visited.push_back(Path);
+    const std::string Text{std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>()};
+    Hash = Fnv1a(Text, Hash);
+    std::istringstream Lines(Text);
+    for (std::string Line; std::getline(Lines, Line);) {
+      const size_t Directive = Line.find("#include");
+      const size_t Open = Line.find('"', Directive);
+      const size_t Close = Open == std::string::npos ? Open : Line.find('"', Open + 1);
+      if (Directive == std::string::npos || Close == std::string::npos) {
+        continue;
+      }
+      const std::string Name = Line.substr(Open + 1, Close - Open - 1);
+      std::filesystem::path Included = Path.parent_path() / Name;
+      if (!std::filesystem::exists(Included)) {
+        Included = Root / Name;
+      }
+      if (!HashSources(Included.lexically_normal(), Visited, Hash, Log)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,168 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include "../job_system.hpp"
+#include "../log.hpp"
+#include "shader_compiler.hpp"
+
+#ifndef KALAN_SHADER_DIR
+#define KALAN_SHADER_DIR "src/shaders"
+#endif
+
+// Every shader the renderer uses, addressed by its path under the shader root plus its defines. With
+// watching enabled a background thread polls each shader and its includes for changes, recompiles the
+// affected shaders on the job system and queues the results. The render thread applies them with Poll at
+// a frame boundary. A failed recompile is logged and the previous SPIR-V stays in use.
+class shader_library {
+public:
+  using handle = uint32_t;
+
+  shader_library(job_system &Jobs, const std::filesystem::path &Root, const std::filesystem::path &CacheDirectory,
+                 bool Watch)
+      : Jobs(Jobs), Compiler(Root, CacheDirectory) {
+    if (Watch) {
+      Watcher = std::jthread([this](const std::stop_token &Stop) { WatchSources(Stop); });
+    }
+  }
+  shader_library(const shader_library &) = delete;
+  shader_library(shader_library &&) = delete;
+  auto operator=(const shader_library &) -> shader_library & = delete;
+  auto operator=(shader_library &&) -> shader_library & = delete;
+  ~shader_library() {
+    if (Watcher.joinable()) {
+      Watcher.request_stop();
+      Watcher.join();
+    }
+    // Compile jobs refer to this object; the last thing one touches is Mutex, released after the notify
+    std::unique_lock Lock(Mutex);
+    CompileFinished.wait(Lock, [this] { return Compiling == 0; });
+  }
+
+  // Compiles, or reads from the cache, on the calling thread. Loading the same shader twice returns the same
+  // handle. Throws with the compiler output if the shader does not compile.
+  auto Load(const std::filesystem::path &Name, std::vector<shader_define> Defines = {}) -> handle {
+    std::string Key = Name.generic_string();
+    for (const shader_define &Define : Defines) {
+      Key += ' ' + Define.Name + '=' + Define.Value;
+    }
+    std::lock_guard Lock(Mutex);
+    if (const auto It = Handles.find(Key); It != Handles.end()) {
+      return It->second;
+    }
+    const std::filesystem::path Path = Compiler.GetRoot() / Name;
+    shader_compiler::result Result = Compiler.Compile(Path, Defines);
+    if (!Result.Ok) {
+      throw std::runtime_error("failed to compile " + Key + ":\n" + Result.Log);
+    }
+    KLOG(Debug, Shader, "{} {}", Result.Cached ? "cached" : "compiled", Key);
+    for (const std::filesystem::path &Dependency : Result.Dependencies) {
+      Stamps.try_emplace(Dependency, Stamp(Dependency));
+    }
+    const auto Handle = static_cast<handle>(Shaders.size());
+    Shaders.push_back({.Path = Path,
+                       .Defines = std::move(Defines),
+                       .Spirv = std::move(Result.Spirv),
+                       .Dependencies = std::move(Result.Dependencies)});
+    Handles.emplace(std::move(Key), Handle);
+    return Handle;
+  }
+
+  // Render thread only. The reference is valid until the next Load or Poll.
+  [[nodiscard]] auto GetSpirv(handle Shader) const -> const std::vector<uint32_t> & { return Shaders[Shader].Spirv; }
+
+  // Applies finished recompiles and returns the shaders they replaced. Call at a frame boundary.
+  auto Poll() -> std::vector<handle> {
+    std::lock_guard Lock(Mutex);
+    std::vector<handle> Updated;
+    for (auto &[Shader, Spirv] : Ready) {
+      Shaders[Shader].Spirv = std::move(Spirv);
+      Updated.push_back(Shader);
+    }
+    Ready.clear();
+    return Updated;
+  }
+
+private:
+  struct shader {
+    std::filesystem::path Path;
+    std::vector<shader_define> Defines;
+    std::vector<uint32_t> Spirv;
+    std::vector<std::filesystem::path> Dependencies;
+    uint64_t Generation = 0; // Bumped per recompile so a slow, stale result never wins
+  };
+
+  job_system &Jobs;
+  shader_compiler Compiler;
+  std::mutex Mutex;
+  std::vector<shader> Shaders;
+  std::unordered_map<std::string, handle> Handles;
+  std::map<std::filesystem::path, std::filesystem::file_time_type> Stamps;
+  std::map<handle, std::vector<uint32_t>> Ready;
+  uint32_t Compiling = 0; // Jobs in flight, guarded by Mutex
+  std::condition_variable CompileFinished;
+  std::jthread Watcher;
+
+  static auto Stamp(const std::filesystem::path &Path) -> std::filesystem::file_time_type {
+    std::error_code Error; // Editors that save by rename briefly leave no file behind
+    return std::filesystem::last_write_time(Path, Error);
+  }
+
+  void WatchSources(const std::stop_token &Stop) {
+    constexpr auto Interval = std::chrono::milliseconds(250);
+    while (!Stop.stop_requested()) {
+      std::this_thread::sleep_for(Interval);
+      std::lock_guard Lock(Mutex);
+      std::vector<std::filesystem::path> Changed;
+      for (auto &[Path, Time] : Stamps) {
+        const std::filesystem::file_time_type Now = Stamp(Path);
+        if (Now != Time && Now != std::filesystem::file_time_type{}) {
+          Time = Now;
+          Changed.push_back(Path);
+        }
+      }
+      for (handle Shader = 0; Shader < Shaders.size() && !Changed.empty(); Shader++) {
+        if (std::ranges::find_first_of(Shaders[Shader].Dependencies, Changed) != Shaders[Shader].Dependencies.end()) {
+          Recompile(Shader);
+        }
+      }
+    }
+  }
+
+  // Called with Mutex held.
+  void Recompile(handle Shader) {
+    const shader &Source = Shaders[Shader];
+    const uint64_t Generation = ++Shaders[Shader].Generation;
+    KLOG(Info, Shader, "recompiling {}", Source.Path.string());
+    Compiling++;
+    // Nothing may escape the job: the destructor waits for Compiling to drop, and the future is not kept
+    Jobs.Submit([this, Shader, Generation, Path = Source.Path, Defines = Source.Defines] {
+      std::unique_lock Lock(Mutex, std::defer_lock);
+      try {
+        shader_compiler::result Result = Compiler.Compile(Path, Defines);
+        Lock.lock();
+        if (!Result.Ok) {
+          KLOG(Error, Shader, "{} failed, keeping the previous version:\n{}", Path.string(), Result.Log);
+        } else if (Shaders[Shader].Generation == Generation) {
+          for (const std::filesystem::path &Dependency : Result.Dependencies) {
+            Stamps.try_emplace(Dependency, Stamp(Dependency)); // Includes added by the edit
+          }
+          Shaders[Shader].Dependencies = std::move(Result.Dependencies);
+          Ready[Shader] = std::move(Result.Spirv);
+        }
+      } catch (const std::exception &Error) {
+        KLOG(Error, Shader, "{} failed, keeping the previous version: {}", Path.string(), Error.what());
+      }
+      if (!Lock.owns_lock()) {
+        Lock.lock();
+      }
+      Compiling--;
+      CompileFinished.notify_all();
+    });
+  }
+};
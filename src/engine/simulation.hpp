@@ -0,0 +1,166 @@
+#pragma once
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "job_system.hpp"
+#include "physics/rigid_bodies.hpp"
+#include "profiler.hpp"
+
+using sim_clock = std::chrono::steady_clock;
+
+// Events sampled by the input thread; the simulation drains them at the start of every tick.
+class input_queue {
+  std::mutex Mutex;
+  std::vector<SDL_Event> Pending;
+
+public:
+  void Push(const SDL_Event &Event) {
+    std::scoped_lock Lock{Mutex};
+    Pending.push_back(Event);
+  }
+  // Swaps the pending events into Out so neither side reallocates in steady state.
+  void Drain(std::vector<SDL_Event> &Out) {
+    Out.clear();
+    std::scoped_lock Lock{Mutex};
+    std::swap(Out, Pending);
+  }
+};
+
+// Input as of the current tick, rebuilt from the drained events. Mouse motion accumulates over the tick.
+struct input_state {
+  std::bitset<SDL_NUM_SCANCODES> Keys;
+  uint32_t MouseButtons = 0; // SDL_BUTTON(n) bits
+  int32_t MouseX = 0, MouseY = 0;
+  int32_t MouseDeltaX = 0, MouseDeltaY = 0;
+  bool Focused = true; // Held keys are released when the window loses focus, as no key up arrives then
+
+  [[nodiscard]] auto IsKeyDown(SDL_Scancode Key) const -> bool { return Keys.test(Key); }
+};
+
+// Everything the renderer needs from the simulation. Keep it small: it is copied on every publish.
+struct world_state {
+  uint64_t Tick = 0;
+  double Time = 0;
+
+  static auto Interpolate(const world_state &Prev, const world_state &Cur, double Alpha) -> world_state {
+    return {.Tick = Cur.Tick, .Time = Prev.Time + (Cur.Time - Prev.Time) * Alpha};
+  }
+};
+
+// Fixed-timestep simulation. Runs on its own thread, publishes the last two states so the renderer
+// can interpolate between them without ever touching the simulation directly.
+class simulation {
+public:
+  using duration = std::chrono::nanoseconds;
+
+  simulation(input_queue &Input, job_system &Jobs, uint32_t TickRate = 120)
+      : Input(Input), Step(duration{std::chrono::seconds{1}} / TickRate), Bodies(Jobs) {}
+
+  void Run(const std::stop_token &Stop) {
+    std::vector<SDL_Event> Events;
+    world_state State;
+    auto Next = sim_clock::now();
+    KPROFILE_THREAD("simulation");
+    while (!Stop.stop_requested()) {
+      {
+        KPROFILE_SCOPE("simulation::tick");
+        Input.Drain(Events);
+        for (const SDL_Event &Event : Events) {
+          HandleEvent(Event);
+        }
+        world_state NextState = State;
+        Update(NextState);
+        Publish(State, NextState);
+        State = NextState;
+      }
+
+      Next += Step;
+      // Do not try to catch up forever after a long stall (debugger, suspend): drop the lost ticks instead.
+      const auto Now = sim_clock::now();
+      if (Now - Next > Step * MaxCatchUpTicks) {
+        Next = Now;
+      }
+      std::this_thread::sleep_until(Next);
+    }
+  }
+
+  // Returns the state interpolated to Now. Safe to call from any thread.
+  [[nodiscard]] auto Sample(sim_clock::time_point Now) const -> world_state {
+    std::scoped_lock Lock{SnapshotMutex};
+    const double Alpha =
+        std::clamp(std::chrono::duration<double>(Now - PublishTime) / std::chrono::duration<double>(Step), 0.0, 1.0);
+    return world_state::Interpolate(Previous, Current, Alpha);
+  }
+
+  [[nodiscard]] auto GetStep() const -> duration { return Step; }
+  // Simulation thread only, e.g. from systems stepped by Update.
+  [[nodiscard]] auto GetInput() const -> const input_state & { return InputState; }
+  // Populate before Run; once the simulation thread is running, only it may touch the bodies.
+  [[nodiscard]] auto GetBodies() -> rigid_bodies & { return Bodies; }
+
+private:
+  static constexpr int MaxCatchUpTicks = 5;
+
+  input_queue &Input;
+  duration Step;
+  rigid_bodies Bodies;
+  input_state InputState;
+
+  mutable std::mutex SnapshotMutex;
+  world_state Previous, Current;
+  sim_clock::time_point PublishTime = sim_clock::now();
+
+  void HandleEvent(const SDL_Event &Event) {
+    switch (Event.type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      if (Event.key.keysym.scancode < SDL_NUM_SCANCODES) {
+        InputState.Keys.set(Event.key.keysym.scancode, Event.type == SDL_KEYDOWN);
+      }
+      break;
+    case SDL_MOUSEMOTION:
+      InputState.MouseX = Event.motion.x;
+      InputState.MouseY = Event.motion.y;
+      InputState.MouseDeltaX += Event.motion.xrel;
+      InputState.MouseDeltaY += Event.motion.yrel;
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      InputState.MouseButtons |= SDL_BUTTON(Event.button.button);
+      break;
+    case SDL_MOUSEBUTTONUP:
+      InputState.MouseButtons &= ~SDL_BUTTON(Event.button.button);
+      break;
+    case SDL_WINDOWEVENT:
+      if (Event.window.event == SDL_WINDOWEVENT_FOCUS_LOST) {
+        InputState = {.Focused = false};
+      } else if (Event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED) {
+        InputState.Focused = true;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  void Update(world_state &State) {
+    const double Seconds = std::chrono::duration<double>(Step).count();
+    Bodies.Step(static_cast<float>(Seconds));
+    State.Tick++;
+    State.Time += Seconds;
+    InputState.MouseDeltaX = InputState.MouseDeltaY = 0;
+  }
+  void Publish(const world_state &Prev, const world_state &Cur) {
+    std::scoped_lock Lock{SnapshotMutex};
+    Previous = Prev;
+    Current = Cur;
+    PublishTime = sim_clock::now();
+  }
+};
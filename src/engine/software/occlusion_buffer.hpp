@@ -0,0 +1,141 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../profiler.hpp"
+#include "rasterizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <vector>
+
+// Hierarchical-Z occlusion on the CPU. Occluders are rasterized into a low-resolution depth buffer, which
+// is reduced into a pyramid whose every texel holds the farthest depth of the texels below it. A bounding
+// box is hidden if even its nearest point lies behind the farthest occluder depth over the screen rectangle
+// it covers, read from the finest level where that rectangle touches at most three texels each way.
+//
+// The test matches src/shaders/cull/occlusion.comp.glsl, which does the same against a pyramid built from
+// the GPU depth buffer. Depths are clip z / w under camera::MatrVP.
+//
+// Pixels are sampled at their centres, so an occluder can cover up to half a pixel more than it should;
+// draw occluders that sit inside the real geometry, such as simplified walls and boxes.
+class occlusion_buffer {
+public:
+  occlusion_buffer(job_system &Jobs, uint32_t Width = 256, uint32_t Height = 128)
+      : Rasterizer(Jobs, Width, Height), Width(Width), Height(Height) {}
+
+  // Queues an occluder for the next Render. The spans must stay valid until then.
+  void Draw(std::span<const mesh_format::vertex> Vertices, std::span<const uint32_t> Indices,
+            const mth::matr<float> &World) {
+    Rasterizer.Draw(Vertices, Indices, World);
+  }
+
+  // Rasterizes the queued occluders from Camera and rebuilds the pyramid. Tests use the same camera.
+  void Render(const mth::camera<float> &Camera) {
+    KPROFILE_SCOPE("occlusion_buffer::Render");
+    ViewProjection = Camera.MatrVP;
+    Rasterizer.Render(Camera);
+    const std::span<const float> Depth = Rasterizer.GetDepth();
+    Levels.resize(std::bit_width(std::max(Width, Height)));
+    Levels[0].Width = Width;
+    Levels[0].Height = Height;
+    Levels[0].Depth.resize(size_t{Width} * Height);
+    for (uint32_t Y = 0; Y < Height; Y++) {
+      std::copy_n(Depth.begin() + static_cast<ptrdiff_t>(size_t{Y} * Rasterizer.GetPitch()), Width,
+                  Levels[0].Depth.begin() + static_cast<ptrdiff_t>(size_t{Y} * Width));
+    }
+    for (size_t L = 1; L < Levels.size(); L++) {
+      Reduce(Levels[L - 1], Levels[L]);
+    }
+  }
+
+  [[nodiscard]] auto IsSphereVisible(const mth::vec3<float> &Center, float Radius) const -> bool {
+    return IsBoxVisible(Center - mth::vec3<float>(Radius), Center + mth::vec3<float>(Radius));
+  }
+  // False if the box is outside the frustum or hidden behind the occluders.
+  [[nodiscard]] auto IsBoxVisible(const mth::vec3<float> &Min, const mth::vec3<float> &Max) const -> bool {
+    float MinX = std::numeric_limits<float>::max(), MinY = MinX, Nearest = MinX;
+    float MaxX = std::numeric_limits<float>::lowest(), MaxY = MaxX;
+    uint32_t Behind = 0;
+    for (uint32_t Corner = 0; Corner < 8; Corner++) {
+      const mth::vec4<float> Clip = ViewProjection * mth::vec4<float>((Corner & 1U) != 0 ? Max.X : Min.X,
+                                                                      (Corner & 2U) != 0 ? Max.Y : Min.Y,
+                                                                      (Corner & 4U) != 0 ? Max.Z : Min.Z, 1);
+      if (Clip.W <= NearW) {
+        Behind++;
+        continue;
+      }
+      MinX = std::min(MinX, Clip.X / Clip.W);
+      MaxX = std::max(MaxX, Clip.X / Clip.W);
+      MinY = std::min(MinY, Clip.Y / Clip.W);
+      MaxY = std::max(MaxY, Clip.Y / Clip.W);
+      Nearest = std::min(Nearest, Clip.Z / Clip.W);
+    }
+    if (Behind != 0) {
+      return Behind != 8; // A box around the camera covers the whole screen
+    }
+    if (MaxX < -1 || MinX > 1 || MaxY < -1 || MinY > 1 || Nearest > 1) {
+      return false;
+    }
+    return Levels.empty() || Nearest <= FarthestOccluder(MinX, MaxX, MinY, MaxY);
+  }
+
+  [[nodiscard]] auto GetWidth() const -> uint32_t { return Width; }
+  [[nodiscard]] auto GetHeight() const -> uint32_t { return Height; }
+
+private:
+  static constexpr float NearW = 1e-5F;
+
+  struct level {
+    uint32_t Width = 0, Height = 0;
+    std::vector<float> Depth;
+  };
+
+  rasterizer Rasterizer;
+  uint32_t Width, Height;
+  mth::matr<float> ViewProjection = mth::matr<float>::Identity();
+  std::vector<level> Levels;
+
+  // Each texel takes the farthest of the 2x2 texels below it; on odd sizes the last row and column also
+  // take the leftover one, so texel min(p >> L, width - 1) of level L covers pixel p
+  static void Reduce(const level &Source, level &Target) {
+    Target.Width = std::max(Source.Width / 2, 1U);
+    Target.Height = std::max(Source.Height / 2, 1U);
+    Target.Depth.resize(size_t{Target.Width} * Target.Height);
+    for (uint32_t Y = 0; Y < Target.Height; Y++) {
+      const uint32_t Y1 = Y + 1 == Target.Height ? Source.Height : std::min(2 * Y + 2, Source.Height);
+      for (uint32_t X = 0; X < Target.Width; X++) {
+        const uint32_t X1 = X + 1 == Target.Width ? Source.Width : std::min(2 * X + 2, Source.Width);
+        float Farthest = std::numeric_limits<float>::lowest();
+        for (uint32_t SY = 2 * Y; SY < Y1; SY++) {
+          for (uint32_t SX = 2 * X; SX < X1; SX++) {
+            Farthest = std::max(Farthest, Source.Depth[size_t{SY} * Source.Width + SX]);
+          }
+        }
+        Target.Depth[size_t{Y} * Target.Width + X] = Farthest;
+      }
+    }
+  }
+
+  // Farthest occluder depth over an NDC rectangle
+  [[nodiscard]] auto FarthestOccluder(float MinX, float MaxX, float MinY, float MaxY) const -> float {
+    const auto Pixel = [](float Ndc, uint32_t Size) {
+      return static_cast<uint32_t>(std::clamp((Ndc * 0.5F + 0.5F) * static_cast<float>(Size), 0.0F,
+                                              static_cast<float>(Size - 1)));
+    };
+    const uint32_t X0 = Pixel(MinX, Width), X1 = Pixel(MaxX, Width);
+    const uint32_t Y0 = Pixel(MinY, Height), Y1 = Pixel(MaxY, Height);
+    // The finest level where the rectangle spans at most two texels, so it touches at most three each way
+    const uint32_t Span = std::max(X1 - X0, Y1 - Y0);
+    const auto L = std::min<size_t>(Span <= 2 ? 0 : std::bit_width((Span - 1) / 2), Levels.size() - 1);
+    const level &Level = Levels[L];
+    float Farthest = std::numeric_limits<float>::lowest();
+    for (uint32_t Y = std::min(Y0 >> L, Level.Height - 1); Y <= std::min(Y1 >> L, Level.Height - 1); Y++) {
+      for (uint32_t X = std::min(X0 >> L, Level.Width - 1); X <= std::min(X1 >> L, Level.Width - 1); X++) {
+        Farthest = std::max(Farthest, Level.Depth[size_t{Y} * Level.Width + X]);
+      }
+    }
+    return Farthest;
+  }
+};
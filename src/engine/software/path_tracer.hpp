@@ -0,0 +1,531 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../assets/mesh_format.hpp"
+#include "../job_system.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <numeric>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Lambertian surfaces only: reference lighting is about light transport, not material models.
+struct path_material {
+  mth::vec3<float> Albedo{0.8F};
+  mth::vec3<float> Emission{0.0F}; // Radiance leaving the surface on its own
+};
+
+// Reference renderer for ground-truth lighting. Primary rays come from a mth::camera and each pixel
+// accumulates path-traced samples until its tile is quiet enough or the time runs out.
+//
+// Rendering is progressive. Each pass gives every unconverged tile a few more samples per pixel. The tiles
+// are dealt round-robin to one deque per worker; a worker takes from the back of its own deque and steals
+// from the front of the others' when it runs dry, so a worker that drew expensive tiles gets help instead
+// of holding up the pass. A tile stops once it has MinSamples and its noise metric is under NoiseThreshold:
+// the standard error of each pixel's mean luminance divided by the square root of that luminance, which
+// weighs noise the way the eye does, averaged over the tile.
+//
+// Triangles sit in a BVH; spheres are tested one by one, so keep them few. Emissive spheres are sampled
+// directly at every bounce (next event estimation), which is what makes small bright lights converge.
+class path_tracer {
+public:
+  struct settings {
+    uint32_t TileSize = 32;
+    uint32_t SamplesPerPass = 4;
+    uint32_t MinSamples = 32;
+    uint32_t MaxSamples = 8192;
+    float NoiseThreshold = 0.01F;
+    std::chrono::seconds TimeLimit{300};
+    uint32_t MaxBounces = 8;
+    mth::vec3<float> Sky{0.0F}; // Radiance of rays that leave the scene
+    uint64_t Seed = 0;
+  };
+  struct stats {
+    uint32_t Passes = 0;
+    uint64_t Samples = 0;
+    uint32_t ConvergedTiles = 0;
+    uint32_t Tiles = 0;
+    double Seconds = 0;
+  };
+  using material = uint32_t;
+
+  path_tracer(job_system &Jobs, const settings &Settings) : Jobs(Jobs), Settings(Settings) {}
+
+  auto AddMaterial(const path_material &Material) -> material {
+    Materials.push_back(Material);
+    return static_cast<material>(Materials.size() - 1);
+  }
+  // Copies the mesh into the scene in world space.
+  void AddMesh(std::span<const mesh_format::vertex> Vertices, std::span<const uint32_t> Indices,
+               const mth::matr<float> &World, material Material) {
+    for (size_t i = 0; i + 2 < Indices.size(); i += 3) {
+      if (std::max({Indices[i], Indices[i + 1], Indices[i + 2]}) >= Vertices.size()) {
+        continue;
+      }
+      std::array<mth::vec3<float>, 3> P;
+      for (size_t k = 0; k < 3; k++) {
+        const std::array<float, 3> &Position = Vertices[Indices[i + k]].Position;
+        P[k] = World.PointTransform({Position[0], Position[1], Position[2]});
+      }
+      const mth::vec3<float> Normal = ((P[1] - P[0]) % (P[2] - P[0])).Normalizing();
+      Triangles.push_back({.V0 = P[0], .Edge1 = P[1] - P[0], .Edge2 = P[2] - P[0], .Normal = Normal,
+                           .Material = Material});
+    }
+    Dirty = true;
+  }
+  void AddSphere(const mth::vec3<float> &Center, float Radius, material Material) {
+    Spheres.push_back({.Center = Center, .Radius = Radius, .Material = Material});
+    Dirty = true;
+  }
+
+  // Renders from scratch until every tile has converged or the time limit passes. OnPass runs on the
+  // calling thread after every pass, e.g. to show the image so far.
+  auto Render(const mth::camera<float> &Camera, const std::function<void(const path_tracer &)> &OnPass = {})
+      -> stats {
+    KPROFILE_SCOPE("path_tracer::Render");
+    const auto Start = std::chrono::steady_clock::now();
+    if (Dirty) {
+      Build();
+    }
+    this->Camera = Camera;
+    Width = static_cast<uint32_t>(std::max(Camera.FrameW, 1));
+    Height = static_cast<uint32_t>(std::max(Camera.FrameH, 1));
+    Pixels.assign(size_t{Width} * Height, {});
+    TilesX = (Width + Settings.TileSize - 1) / Settings.TileSize;
+    TilesY = (Height + Settings.TileSize - 1) / Settings.TileSize;
+    Tiles.assign(size_t{TilesX} * TilesY, {});
+    const uint32_t WorkerCount = Jobs.ThreadCount() + 1;
+    Queues.clear();
+    for (uint32_t i = 0; i < WorkerCount; i++) {
+      Queues.push_back(std::make_unique<worker_queue>());
+    }
+
+    stats Stats{.Tiles = static_cast<uint32_t>(Tiles.size())};
+    std::vector<uint32_t> Active(Tiles.size());
+    std::iota(Active.begin(), Active.end(), 0U);
+    while (!Active.empty() && std::chrono::steady_clock::now() - Start < Settings.TimeLimit) {
+      // Noisiest tiles first, so they are started early and the cheap ones fill in the gaps at the end
+      std::ranges::sort(Active, [&](uint32_t A, uint32_t B) { return Tiles[A].Error > Tiles[B].Error; });
+      for (size_t i = 0; i < Active.size(); i++) {
+        Queues[i % WorkerCount]->Tiles.push_back(Active[i]);
+      }
+      Jobs.ParallelFor(WorkerCount, [&](uint32_t Worker) {
+        KPROFILE_SCOPE("path_tracer::Worker");
+        for (uint32_t Tile = 0; NextTile(Worker, Tile);) {
+          TraceTile(Tile);
+        }
+      });
+      Stats.Passes++;
+      Stats.Samples += uint64_t{Settings.SamplesPerPass} * TilePixels(Active);
+      std::erase_if(Active, [&](uint32_t Tile) {
+        const tile &State = Tiles[Tile];
+        return State.Samples >= Settings.MaxSamples ||
+               (State.Samples >= Settings.MinSamples && State.Error < Settings.NoiseThreshold);
+      });
+      if (OnPass) {
+        OnPass(*this);
+      }
+    }
+    Stats.ConvergedTiles = Stats.Tiles - static_cast<uint32_t>(Active.size());
+    Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    KLOG(Info, Render, "path traced {}x{} in {:.1f} s: {} passes, {} samples, {}/{} tiles converged", Width, Height,
+         Stats.Seconds, Stats.Passes, Stats.Samples, Stats.ConvergedTiles, Stats.Tiles);
+    return Stats;
+  }
+
+  [[nodiscard]] auto GetWidth() const -> uint32_t { return Width; }
+  [[nodiscard]] auto GetHeight() const -> uint32_t { return Height; }
+  // The current estimate of a pixel's radiance.
+  [[nodiscard]] auto GetPixel(uint32_t X, uint32_t Y) const -> mth::vec3<float> {
+    const uint32_t Samples = Tiles[(Y / Settings.TileSize) * TilesX + X / Settings.TileSize].Samples;
+    const pixel &Pixel = Pixels[size_t{Y} * Width + X];
+    const double Scale = Samples == 0 ? 0.0 : 1.0 / Samples;
+    return {static_cast<float>(Pixel.Sum[0] * Scale), static_cast<float>(Pixel.Sum[1] * Scale),
+            static_cast<float>(Pixel.Sum[2] * Scale)};
+  }
+  // Linear radiance as PFM, so references can be compared without tone mapping in the way.
+  [[nodiscard]] auto WriteImage(const std::string &Path) const -> bool {
+    std::ofstream File(Path, std::ios::binary);
+    File << "PF\n" << Width << ' ' << Height << "\n-1.0\n"; // Negative scale: little-endian floats
+    std::vector<float> Row(size_t{Width} * 3);
+    for (uint32_t Y = Height; Y-- > 0;) { // PFM stores the bottom row first
+      for (uint32_t X = 0; X < Width; X++) {
+        const mth::vec3<float> Radiance = GetPixel(X, Y);
+        Row[X * 3 + 0] = Radiance.X;
+        Row[X * 3 + 1] = Radiance.Y;
+        Row[X * 3 + 2] = Radiance.Z;
+      }
+      File.write(reinterpret_cast<const char *>(Row.data()), static_cast<std::streamsize>(Row.size() * sizeof(float)));
+    }
+    return File.good();
+  }
+
+private:
+  static constexpr uint32_t NoHit = UINT32_MAX;
+  static constexpr uint32_t LeafSize = 4;
+  static constexpr float Epsilon = 1e-4F;
+
+  struct triangle {
+    mth::vec3<float> V0, Edge1, Edge2;
+    mth::vec3<float> Normal;
+    material Material;
+  };
+  struct sphere {
+    mth::vec3<float> Center;
+    float Radius;
+    material Material;
+  };
+  struct bvh_node {
+    mth::vec3<float> Min{}, Max{};
+    uint32_t First; // First triangle if Count > 0, else the left child; the right child follows it
+    uint32_t Count;
+  };
+  struct hit {
+    float T = std::numeric_limits<float>::max();
+    mth::vec3<float> Normal;
+    material Material = 0;
+    uint32_t Sphere = NoHit;
+  };
+  struct pixel {
+    std::array<double, 3> Sum{};
+    double Luminance = 0;
+    double LuminanceSquares = 0;
+  };
+  struct tile {
+    uint32_t Samples = 0;
+    float Error = std::numeric_limits<float>::max();
+  };
+  struct worker_queue {
+    std::mutex Mutex;
+    std::deque<uint32_t> Tiles;
+  };
+  // PCG32, seeded per pixel and sample so a render does not depend on which worker ran which tile. The seed
+  // goes through a SplitMix64 finalizer first; neighbouring seeds would otherwise give correlated streams.
+  struct random {
+    uint64_t State;
+    explicit random(uint64_t Seed) {
+      Seed = (Seed ^ (Seed >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+      Seed = (Seed ^ (Seed >> 27U)) * 0x94D049BB133111EBULL;
+      State = Seed ^ (Seed >> 31U);
+      Next();
+    }
+    auto Next() -> uint32_t {
+      const uint64_t Old = State;
+      State = Old * 6364136223846793005ULL + 1442695040888963407ULL;
+      const auto Shifted = static_cast<uint32_t>(((Old >> 18U) ^ Old) >> 27U);
+      const auto Rotation = static_cast<uint32_t>(Old >> 59U);
+      return (Shifted >> Rotation) | (Shifted << ((32 - Rotation) & 31));
+    }
+    auto Uniform() -> float { return static_cast<float>(Next() >> 8) * 0x1p-24F; } // [0, 1)
+  };
+
+  job_system &Jobs;
+  settings Settings;
+  std::vector<path_material> Materials;
+  std::vector<triangle> Triangles;
+  std::vector<sphere> Spheres;
+  std::vector<uint32_t> Lights; // Emissive spheres
+  std::vector<bvh_node> Nodes;
+  bool Dirty = true;
+  mth::camera<float> Camera;
+  uint32_t Width = 0, Height = 0;
+  uint32_t TilesX = 0, TilesY = 0;
+  std::vector<pixel> Pixels;
+  std::vector<tile> Tiles;
+  std::vector<std::unique_ptr<worker_queue>> Queues;
+
+  auto NextTile(uint32_t Worker, uint32_t &Tile) -> bool {
+    for (size_t i = 0; i < Queues.size(); i++) {
+      worker_queue &Queue = *Queues[(Worker + i) % Queues.size()];
+      std::lock_guard Lock(Queue.Mutex);
+      if (Queue.Tiles.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        Tile = Queue.Tiles.back();
+        Queue.Tiles.pop_back();
+      } else {
+        Tile = Queue.Tiles.front();
+        Queue.Tiles.pop_front();
+      }
+      return true;
+    }
+    return false; // No tiles are added during a pass, so everything is taken
+  }
+
+  auto TilePixels(std::span<const uint32_t> Active) const -> uint64_t {
+    uint64_t Count = 0;
+    for (uint32_t Tile : Active) {
+      const uint32_t X = Tile % TilesX * Settings.TileSize;
+      const uint32_t Y = Tile / TilesX * Settings.TileSize;
+      Count += uint64_t{std::min(Settings.TileSize, Width - X)} * std::min(Settings.TileSize, Height - Y);
+    }
+    return Count;
+  }
+
+  void TraceTile(uint32_t Tile) {
+    tile &State = Tiles[Tile];
+    const uint32_t X0 = Tile % TilesX * Settings.TileSize;
+    const uint32_t Y0 = Tile / TilesX * Settings.TileSize;
+    const uint32_t X1 = std::min(X0 + Settings.TileSize, Width);
+    const uint32_t Y1 = std::min(Y0 + Settings.TileSize, Height);
+    const uint32_t Samples = State.Samples + Settings.SamplesPerPass;
+    double Error = 0;
+    for (uint32_t Y = Y0; Y < Y1; Y++) {
+      for (uint32_t X = X0; X < X1; X++) {
+        const uint64_t Index = uint64_t{Y} * Width + X;
+        pixel &Pixel = Pixels[Index];
+        for (uint32_t Sample = State.Samples; Sample < Samples; Sample++) {
+          random Random((Index * Settings.MaxSamples + Sample) + Settings.Seed * 0x9E3779B97F4A7C15ULL);
+          const mth::vec3<float> Radiance = Trace(PrimaryRay(X, Y, Random), Random);
+          const double Luminance = 0.2126 * Radiance.X + 0.7152 * Radiance.Y + 0.0722 * Radiance.Z;
+          Pixel.Sum[0] += Radiance.X;
+          Pixel.Sum[1] += Radiance.Y;
+          Pixel.Sum[2] += Radiance.Z;
+          Pixel.Luminance += Luminance;
+          Pixel.LuminanceSquares += Luminance * Luminance;
+        }
+        const double Mean = Pixel.Luminance / Samples;
+        const double Variance = std::max(Pixel.LuminanceSquares / Samples - Mean * Mean, 0.0);
+        Error += std::sqrt(Variance / Samples) / std::sqrt(Mean + 1e-3);
+      }
+    }
+    State.Samples = Samples;
+    State.Error = static_cast<float>(Error / ((X1 - X0) * (Y1 - Y0)));
+  }
+
+  auto PrimaryRay(uint32_t X, uint32_t Y, random &Random) const -> mth::ray<float> {
+    const float ScreenX = (static_cast<float>(X) + Random.Uniform()) / static_cast<float>(Width) * 2 - 1;
+    const float ScreenY = 1 - (static_cast<float>(Y) + Random.Uniform()) / static_cast<float>(Height) * 2;
+    return {Camera.Loc, Camera.Dir * Camera.ProjDist + Camera.Right * (ScreenX * Camera.Wp / 2) +
+                            Camera.Up * (ScreenY * Camera.Hp / 2)};
+  }
+
+  auto Trace(mth::ray<float> Ray, random &Random) const -> mth::vec3<float> {
+    mth::vec3<float> Radiance(0.0F);
+    mth::vec3<float> Throughput(1.0F);
+    for (uint32_t Bounce = 0; Bounce <= Settings.MaxBounces; Bounce++) {
+      hit Hit;
+      if (!Intersect(Ray, Hit)) {
+        Radiance += Throughput * Settings.Sky;
+        break;
+      }
+      const path_material &Material = Materials[Hit.Material];
+      // Light from emissive spheres is gathered by the direct sampling below; counting hits too would
+      // add it twice
+      if (Bounce == 0 || Hit.Sphere == NoHit || !IsLight(Hit.Sphere)) {
+        Radiance += Throughput * Material.Emission;
+      }
+      const mth::vec3<float> Normal = (Hit.Normal & Ray.Dir) < 0 ? Hit.Normal : -Hit.Normal;
+      const mth::vec3<float> Position = Ray(Hit.T) + Normal * Epsilon * std::max(1.0F, Hit.T);
+      if (!Lights.empty()) {
+        Radiance += Throughput * Material.Albedo * SampleLight(Position, Normal, Random);
+      }
+
+      // Cosine-weighted bounce: the Lambert BRDF, cosine and pdf cancel down to the albedo
+      Throughput = Throughput * Material.Albedo;
+      if (Bounce >= 3) { // Russian roulette keeps long paths unbiased without tracing all of them
+        const float Survival = std::min(Throughput.MaxC(), 0.95F);
+        if (Random.Uniform() >= Survival) {
+          break;
+        }
+        Throughput = Throughput / Survival;
+      }
+      Ray = mth::ray<float>(Position, CosineSample(Normal, Random));
+    }
+    return Radiance;
+  }
+
+  [[nodiscard]] auto IsLight(uint32_t Sphere) const -> bool {
+    return std::ranges::find(Lights, Sphere) != Lights.end();
+  }
+
+  // Picks one emissive sphere and samples the cone it subtends, returning the reflected radiance over albedo.
+  auto SampleLight(const mth::vec3<float> &Position, const mth::vec3<float> &Normal, random &Random) const
+      -> mth::vec3<float> {
+    const auto Pick = std::min(static_cast<uint32_t>(Random.Uniform() * static_cast<float>(Lights.size())),
+                               static_cast<uint32_t>(Lights.size() - 1));
+    const sphere &Light = Spheres[Lights[Pick]];
+    const mth::vec3<float> ToCenter = Light.Center - Position;
+    const float Distance2 = ToCenter.Length2();
+    if (Distance2 <= Light.Radius * Light.Radius) {
+      return mth::vec3<float>(0.0F);
+    }
+    const float CosMax = std::sqrt(1 - Light.Radius * Light.Radius / Distance2);
+    const float Cos = 1 - Random.Uniform() * (1 - CosMax);
+    const float Sin = std::sqrt(std::max(0.0F, 1 - Cos * Cos));
+    const float Phi = 2 * std::numbers::pi_v<float> * Random.Uniform();
+    const mth::vec3<float> Axis = ToCenter / std::sqrt(Distance2);
+    const auto [Tangent, Bitangent] = Basis(Axis);
+    const mth::vec3<float> Direction =
+        Tangent * (Sin * std::cos(Phi)) + Bitangent * (Sin * std::sin(Phi)) + Axis * Cos;
+    const float Facing = Direction & Normal;
+    if (Facing <= 0) {
+      return mth::vec3<float>(0.0F);
+    }
+    hit Hit;
+    if (!Intersect(mth::ray<float>(Position, Direction), Hit) || Hit.Sphere != Lights[Pick]) {
+      return mth::vec3<float>(0.0F); // Shadowed
+    }
+    // BRDF 1/pi times the cosine, over the pdf 1 / (2 pi (1 - CosMax)) times the chance of this light
+    const float Weight = Facing * 2 * (1 - CosMax) * static_cast<float>(Lights.size());
+    return Materials[Light.Material].Emission * Weight;
+  }
+
+  static auto Basis(const mth::vec3<float> &Axis) -> std::pair<mth::vec3<float>, mth::vec3<float>> {
+    const mth::vec3<float> Other = std::abs(Axis.X) > 0.9F ? mth::vec3<float>(0, 1, 0) : mth::vec3<float>(1, 0, 0);
+    const mth::vec3<float> Tangent = (Other % Axis).Normalizing();
+    return {Tangent, Axis % Tangent};
+  }
+
+  static auto CosineSample(const mth::vec3<float> &Normal, random &Random) -> mth::vec3<float> {
+    const float Radius = std::sqrt(Random.Uniform());
+    const float Phi = 2 * std::numbers::pi_v<float> * Random.Uniform();
+    const auto [Tangent, Bitangent] = Basis(Normal);
+    return Tangent * (Radius * std::cos(Phi)) + Bitangent * (Radius * std::sin(Phi)) +
+           Normal * std::sqrt(std::max(0.0F, 1 - Radius * Radius));
+  }
+
+  auto Intersect(const mth::ray<float> &Ray, hit &Hit) const -> bool {
+    for (uint32_t i = 0; i < Spheres.size(); i++) {
+      const float T = Ray.Intersect(Spheres[i].Center, Spheres[i].Radius);
+      if (T > Epsilon && T < Hit.T) {
+        Hit.T = T;
+        Hit.Normal = (Ray(T) - Spheres[i].Center) / Spheres[i].Radius;
+        Hit.Material = Spheres[i].Material;
+        Hit.Sphere = i;
+      }
+    }
+    if (Nodes.empty()) {
+      return Hit.T != std::numeric_limits<float>::max();
+    }
+    const mth::vec3<float> InverseDir(1 / Ray.Dir.X, 1 / Ray.Dir.Y, 1 / Ray.Dir.Z);
+    std::array<uint32_t, 64> Stack;
+    uint32_t Depth = 0;
+    Stack[Depth++] = 0;
+    while (Depth > 0) {
+      const bvh_node &Node = Nodes[Stack[--Depth]];
+      if (!HitsBox(Ray, InverseDir, Node, Hit.T)) {
+        continue;
+      }
+      if (Node.Count == 0) {
+        Stack[Depth++] = Node.First;
+        Stack[Depth++] = Node.First + 1;
+        continue;
+      }
+      for (uint32_t i = Node.First; i < Node.First + Node.Count; i++) {
+        IntersectTriangle(Ray, Triangles[i], Hit);
+      }
+    }
+    return Hit.T != std::numeric_limits<float>::max();
+  }
+
+  static auto HitsBox(const mth::ray<float> &Ray, const mth::vec3<float> &InverseDir, const bvh_node &Node,
+                      float Closest) -> bool {
+    const mth::vec3<float> Near = (Node.Min - Ray.Org) * InverseDir;
+    const mth::vec3<float> Far = (Node.Max - Ray.Org) * InverseDir;
+    const float Enter = Near.Min(Far).MaxC();
+    const float Exit = Near.Max(Far).MinC();
+    return Enter <= Exit && Exit > 0 && Enter < Closest;
+  }
+
+  // Moller-Trumbore
+  static void IntersectTriangle(const mth::ray<float> &Ray, const triangle &Triangle, hit &Hit) {
+    const mth::vec3<float> P = Ray.Dir % Triangle.Edge2;
+    const float Determinant = Triangle.Edge1 & P;
+    if (std::abs(Determinant) < 1e-12F) {
+      return;
+    }
+    const float Inverse = 1 / Determinant;
+    const mth::vec3<float> S = Ray.Org - Triangle.V0;
+    const float U = (S & P) * Inverse;
+    if (U < 0 || U > 1) {
+      return;
+    }
+    const mth::vec3<float> Q = S % Triangle.Edge1;
+    const float V = (Ray.Dir & Q) * Inverse;
+    if (V < 0 || U + V > 1) {
+      return;
+    }
+    const float T = (Triangle.Edge2 & Q) * Inverse;
+    if (T > Epsilon && T < Hit.T) {
+      Hit.T = T;
+      Hit.Normal = Triangle.Normal;
+      Hit.Material = Triangle.Material;
+      Hit.Sphere = NoHit;
+    }
+  }
+
+  void Build() {
+    KPROFILE_SCOPE("path_tracer::Build");
+    Lights.clear();
+    for (uint32_t i = 0; i < Spheres.size(); i++) {
+      if (Materials[Spheres[i].Material].Emission.MaxC() > 0) {
+        Lights.push_back(i);
+      }
+    }
+    Nodes.clear();
+    if (!Triangles.empty()) {
+      Nodes.push_back({.First = 0, .Count = static_cast<uint32_t>(Triangles.size())});
+      Split(0, 0);
+    }
+    Dirty = false;
+  }
+
+  // Median split along the longest axis of the centroids. Depth stays below the traversal stack size
+  // because every split halves the triangle count.
+  void Split(uint32_t Index, uint32_t Level) {
+    bvh_node &Node = Nodes[Index];
+    Node.Min = mth::vec3<float>(std::numeric_limits<float>::max());
+    Node.Max = mth::vec3<float>(std::numeric_limits<float>::lowest());
+    mth::vec3<float> CentroidMin = Node.Min;
+    mth::vec3<float> CentroidMax = Node.Max;
+    for (uint32_t i = Node.First; i < Node.First + Node.Count; i++) {
+      const triangle &Triangle = Triangles[i];
+      for (const mth::vec3<float> &Corner :
+           {Triangle.V0, Triangle.V0 + Triangle.Edge1, Triangle.V0 + Triangle.Edge2}) {
+        Node.Min = Node.Min.Min(Corner);
+        Node.Max = Node.Max.Max(Corner);
+      }
+      const mth::vec3<float> Centroid = Centroid3(Triangle);
+      CentroidMin = CentroidMin.Min(Centroid);
+      CentroidMax = CentroidMax.Max(Centroid);
+    }
+    if (Node.Count <= LeafSize || Level >= 48) {
+      return;
+    }
+    const mth::vec3<float> Extent = CentroidMax - CentroidMin;
+    const int Axis = Extent.X >= Extent.Y && Extent.X >= Extent.Z ? 0 : (Extent.Y >= Extent.Z ? 1 : 2);
+    const uint32_t First = Node.First;
+    const uint32_t Count = Node.Count;
+    const auto Begin = Triangles.begin() + First;
+    std::nth_element(Begin, Begin + Count / 2, Begin + Count, [Axis](const triangle &A, const triangle &B) {
+      return Centroid3(A)[Axis] < Centroid3(B)[Axis];
+    });
+    const auto Left = static_cast<uint32_t>(Nodes.size());
+    Nodes.push_back({.First = First, .Count = Count / 2});
+    Nodes.push_back({.First = First + Count / 2, .Count = Count - Count / 2});
+    Nodes[Index].First = Left; // Node may dangle after the push_backs
+    Nodes[Index].Count = 0;
+    Split(Left, Level + 1);
+    Split(Left + 1, Level + 1);
+  }
+
+  static auto Centroid3(const triangle &Triangle) -> mth::vec3<float> {
+    return Triangle.V0 + (Triangle.Edge1 + Triangle.Edge2) / 3.0F;
+  }
+};
@@ -0,0 +1,397 @@
+#pragma once
+#include "../../mth/mth.h"
+#include "../assets/mesh_format.hpp"
+#include "../job_system.hpp"
+#include "../profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Renders meshes on the CPU, for hosts without a GPU. A frame runs in two parallel stages:
+//  1. geometry: the triangles are split into one contiguous range per thread. Each range is transformed,
+//     lit per vertex, clipped against the near plane and binned into the screen tiles its bounds touch;
+//  2. raster: each tile goes to one job, which clears it and walks every range's bin in order, so
+//     triangles land in submission order and no two jobs ever write the same pixel.
+// Edge functions, depth and the perspective-correct colour are evaluated four pixels at a time.
+//
+// The image is ARGB8888 with rows GetPitch() pixels apart. software_renderer presents it through SDL;
+// WriteImage saves it for headless runs.
+class rasterizer {
+public:
+  static constexpr uint32_t TileSize = 64;
+
+  rasterizer(job_system &Jobs, uint32_t Width, uint32_t Height) : Jobs(Jobs) { Resize(Width, Height); }
+
+  void Resize(uint32_t Width, uint32_t Height) {
+    this->Width = Width;
+    this->Height = Height;
+    TilesX = (Width + TileSize - 1) / TileSize;
+    TilesY = (Height + TileSize - 1) / TileSize;
+    Pitch = TilesX * TileSize; // Padded to whole tiles, so four-pixel blocks never leave the image
+    Color.assign(size_t{Pitch} * TilesY * TileSize, 0);
+    Depth.assign(Color.size(), 1.0F);
+  }
+
+  // Queues a mesh for the next Render. The spans must stay valid until then; indices are relative to Vertices.
+  void Draw(std::span<const mesh_format::vertex> Vertices, std::span<const uint32_t> Indices,
+            const mth::matr<float> &World, uint32_t Color = 0xFFFFFFFF) {
+    Draws.push_back(
+        {.Vertices = Vertices, .Indices = Indices, .World = World, .Color = Color, .FirstTriangle = TriangleCount});
+    TriangleCount += Indices.size() / 3;
+  }
+  // Direction towards a white directional light, and the light every surface gets regardless of facing.
+  void SetLight(const mth::vec3<float> &Direction, float Ambient) {
+    const mth::vec3<float> Normalized = Direction.Normalizing();
+    LightDirection = {Normalized.X, Normalized.Y, Normalized.Z};
+    this->Ambient = Ambient;
+  }
+
+  // Draws everything queued since the last Render over a cleared image.
+  void Render(const mth::camera<float> &Camera, uint32_t ClearColor = 0xFF1A1A1A) {
+    KPROFILE_SCOPE("rasterizer::Render");
+    for (draw &Draw : Draws) {
+      Draw.WorldViewProjection = Draw.World * Camera.MatrVP;
+    }
+    const uint32_t TileCount = TilesX * TilesY;
+    Ranges.resize(Jobs.ThreadCount() + 1);
+    for (range &Range : Ranges) {
+      Range.Bins.resize(TileCount);
+    }
+    const uint64_t PerRange = (TriangleCount + Ranges.size() - 1) / Ranges.size();
+    Jobs.ParallelFor(static_cast<uint32_t>(Ranges.size()), [&](uint32_t i) {
+      KPROFILE_SCOPE("rasterizer::Geometry");
+      Geometry(Ranges[i], std::min(TriangleCount, i * PerRange), std::min(TriangleCount, (i + 1) * PerRange));
+    });
+    Jobs.ParallelFor(TileCount, [&](uint32_t Tile) {
+      KPROFILE_SCOPE("rasterizer::Tile");
+      RasterTile(Tile, ClearColor);
+    });
+    Draws.clear();
+    TriangleCount = 0;
+  }
+
+  [[nodiscard]] auto GetPixels() const -> std::span<const uint32_t> { return Color; }
+  [[nodiscard]] auto GetWidth() const -> uint32_t { return Width; }
+  [[nodiscard]] auto GetHeight() const -> uint32_t { return Height; }
+  [[nodiscard]] auto GetPitch() const -> uint32_t { return Pitch; }
+  // Clip z / w of the nearest surface per pixel, 1 where nothing was drawn; rows GetPitch() values apart.
+  [[nodiscard]] auto GetDepth() const -> std::span<const float> { return Depth; }
+
+  // Binary PPM, which every image tool reads and which needs no encoder.
+  [[nodiscard]] auto WriteImage(const std::string &Path) const -> bool {
+    std::ofstream File(Path, std::ios::binary);
+    File << "P6\n" << Width << ' ' << Height << "\n255\n";
+    std::vector<char> Row(size_t{Width} * 3);
+    for (uint32_t Y = 0; Y < Height; Y++) {
+      for (uint32_t X = 0; X < Width; X++) {
+        const uint32_t Pixel = Color[size_t{Y} * Pitch + X];
+        Row[X * 3 + 0] = static_cast<char>(Pixel >> 16);
+        Row[X * 3 + 1] = static_cast<char>(Pixel >> 8);
+        Row[X * 3 + 2] = static_cast<char>(Pixel);
+      }
+      File.write(Row.data(), static_cast<std::streamsize>(Row.size()));
+    }
+    return File.good();
+  }
+
+private:
+  struct draw {
+    std::span<const mesh_format::vertex> Vertices;
+    std::span<const uint32_t> Indices;
+    mth::matr<float> World;
+    uint32_t Color;
+    uint64_t FirstTriangle;
+    mth::matr<float> WorldViewProjection{};
+  };
+  struct clip_vertex {
+    std::array<float, 4> Clip;
+    std::array<float, 3> Color;
+  };
+  // A screen-space triangle ready to rasterize. The edge functions are divided by the area, so at a pixel
+  // centre they are the barycentric weights of the opposite vertices.
+  struct triangle {
+    std::array<float, 3> EdgeX, EdgeY, EdgeC;
+    std::array<float, 3> Z;            // NDC depth, affine in screen space
+    std::array<float, 3> InverseW;     // For perspective-correct colour
+    std::array<float, 3> R, G, B;      // Colour divided by w
+    int32_t MinX, MinY, MaxX, MaxY;    // Inclusive pixel bounds, inside the image
+  };
+  // One geometry job's output
+  struct range {
+    std::vector<triangle> Triangles;
+    std::vector<std::vector<uint32_t>> Bins; // Per tile, indices into Triangles
+  };
+
+  // Four lanes of float math, on SSE registers where available
+  struct float4 {
+#if defined(__SSE2__)
+    __m128 V;
+    explicit float4(__m128 V) : V(V) {}
+    explicit float4(float Scalar) : V(_mm_set1_ps(Scalar)) {}
+    static auto Load(const float *Pointer) -> float4 { return float4(_mm_loadu_ps(Pointer)); }
+    void Store(float *Pointer) const { _mm_storeu_ps(Pointer, V); }
+    auto operator+(float4 Other) const -> float4 { return float4(_mm_add_ps(V, Other.V)); }
+    auto operator*(float4 Other) const -> float4 { return float4(_mm_mul_ps(V, Other.V)); }
+    auto operator/(float4 Other) const -> float4 { return float4(_mm_div_ps(V, Other.V)); }
+    // Bit i is set where lane i compares true
+    [[nodiscard]] auto GreaterEqual(float4 Other) const -> uint32_t {
+      return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(V, Other.V)));
+    }
+    [[nodiscard]] auto Less(float4 Other) const -> uint32_t {
+      return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(V, Other.V)));
+    }
+#else
+    std::array<float, 4> V;
+    explicit float4(float Scalar) : V{Scalar, Scalar, Scalar, Scalar} {}
+    static auto Load(const float *Pointer) -> float4 {
+      float4 Result(0.0F);
+      std::copy_n(Pointer, 4, Result.V.begin());
+      return Result;
+    }
+    void Store(float *Pointer) const { std::copy_n(V.begin(), 4, Pointer); }
+    template <typename Operation> [[nodiscard]] auto Map(float4 Other, Operation Apply) const -> float4 {
+      float4 Result(0.0F);
+      for (size_t i = 0; i < 4; i++) {
+        Result.V[i] = Apply(V[i], Other.V[i]);
+      }
+      return Result;
+    }
+    template <typename Operation> [[nodiscard]] auto Mask(float4 Other, Operation Compare) const -> uint32_t {
+      uint32_t Bits = 0;
+      for (size_t i = 0; i < 4; i++) {
+        Bits |= Compare(V[i], Other.V[i]) ? 1U << i : 0U;
+      }
+      return Bits;
+    }
+    auto operator+(float4 Other) const -> float4 { return Map(Other, [](float A, float B) { return A + B; }); }
+    auto operator*(float4 Other) const -> float4 { return Map(Other, [](float A, float B) { return A * B; }); }
+    auto operator/(float4 Other) const -> float4 { return Map(Other, [](float A, float B) { return A / B; }); }
+    [[nodiscard]] auto GreaterEqual(float4 Other) const -> uint32_t {
+      return Mask(Other, [](float A, float B) { return A >= B; });
+    }
+    [[nodiscard]] auto Less(float4 Other) const -> uint32_t {
+      return Mask(Other, [](float A, float B) { return A < B; });
+    }
+#endif
+  };
+
+  job_system &Jobs;
+  uint32_t Width = 0, Height = 0;
+  uint32_t TilesX = 0, TilesY = 0;
+  uint32_t Pitch = 0;
+  std::vector<uint32_t> Color;
+  std::vector<float> Depth;
+  std::vector<draw> Draws;
+  uint64_t TriangleCount = 0;
+  std::vector<range> Ranges;
+  std::array<float, 3> LightDirection = {0.32F, 0.84F, 0.43F};
+  float Ambient = 0.2F;
+
+  void Geometry(range &Range, uint64_t First, uint64_t Last) {
+    Range.Triangles.clear();
+    for (std::vector<uint32_t> &Bin : Range.Bins) {
+      Bin.clear();
+    }
+    if (First >= Last) {
+      return;
+    }
+    auto Draw = std::ranges::upper_bound(Draws, First, {}, &draw::FirstTriangle) - 1;
+    for (uint64_t Triangle = First; Triangle < Last; Triangle++) {
+      while (Triangle >= Draw->FirstTriangle + Draw->Indices.size() / 3) {
+        ++Draw;
+      }
+      const uint64_t Local = Triangle - Draw->FirstTriangle;
+      std::array<clip_vertex, 3> Corners;
+      bool Valid = true;
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t Index = Draw->Indices[Local * 3 + k];
+        if (Index >= Draw->Vertices.size()) {
+          Valid = false;
+          break;
+        }
+        Corners[k] = Shade(*Draw, Draw->Vertices[Index]);
+      }
+      if (Valid) {
+        ClipNear(Range, Corners);
+      }
+    }
+  }
+
+  auto Shade(const draw &Draw, const mesh_format::vertex &Vertex) const -> clip_vertex {
+    const mth::vec4<float> Clip =
+        Draw.WorldViewProjection * mth::vec4<float>(Vertex.Position[0], Vertex.Position[1], Vertex.Position[2], 1);
+    const mth::vec3<float> Normal =
+        Draw.World.VectorTransform({Vertex.Normal[0], Vertex.Normal[1], Vertex.Normal[2]}).Normalizing();
+    const float Diffuse =
+        std::max(Normal.X * LightDirection[0] + Normal.Y * LightDirection[1] + Normal.Z * LightDirection[2], 0.0F);
+    const float Light = Ambient + (1 - Ambient) * Diffuse;
+    const auto Channel = [&](uint32_t Shift) { return static_cast<float>((Draw.Color >> Shift) & 0xFF) / 255 * Light; };
+    return {.Clip = {Clip.X, Clip.Y, Clip.Z, Clip.W}, .Color = {Channel(16), Channel(8), Channel(0)}};
+  }
+
+  // The projection maps the near plane to z = -w; cut away what lies in front of it, which also keeps w
+  // positive for the perspective divide. Triangles crossing the other planes are bounded by the tiles.
+  void ClipNear(range &Range, const std::array<clip_vertex, 3> &Corners) {
+    std::array<clip_vertex, 4> Polygon;
+    size_t Count = 0;
+    for (size_t k = 0; k < 3; k++) {
+      const clip_vertex &A = Corners[k];
+      const clip_vertex &B = Corners[(k + 1) % 3];
+      const float DistanceA = A.Clip[2] + A.Clip[3];
+      const float DistanceB = B.Clip[2] + B.Clip[3];
+      if (DistanceA >= 0) {
+        Polygon[Count++] = A;
+      }
+      if ((DistanceA >= 0) != (DistanceB >= 0)) {
+        const float T = DistanceA / (DistanceA - DistanceB);
+        clip_vertex &Cut = Polygon[Count++];
+        for (size_t i = 0; i < 4; i++) {
+          Cut.Clip[i] = A.Clip[i] + (B.Clip[i] - A.Clip[i]) * T;
+        }
+        for (size_t i = 0; i < 3; i++) {
+          Cut.Color[i] = A.Color[i] + (B.Color[i] - A.Color[i]) * T;
+        }
+      }
+    }
+    for (size_t k = 2; k < Count; k++) {
+      Setup(Range, Polygon[0], Polygon[k - 1], Polygon[k]);
+    }
+  }
+
+  void Setup(range &Range, const clip_vertex &V0, const clip_vertex &V1, const clip_vertex &V2) {
+    std::array<const clip_vertex *, 3> Vertices = {&V0, &V1, &V2};
+    std::array<float, 3> X, Y;
+    for (size_t k = 0; k < 3; k++) {
+      const float InverseW = 1 / Vertices[k]->Clip[3];
+      X[k] = (Vertices[k]->Clip[0] * InverseW * 0.5F + 0.5F) * static_cast<float>(Width);
+      Y[k] = (Vertices[k]->Clip[1] * InverseW * 0.5F + 0.5F) * static_cast<float>(Height);
+    }
+    float Area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+    if (std::abs(Area) < 1e-8F) {
+      return;
+    }
+    if (Area < 0) { // Both faces are drawn; flip to one winding so inside is where every edge is positive
+      std::swap(Vertices[1], Vertices[2]);
+      std::swap(X[1], X[2]);
+      std::swap(Y[1], Y[2]);
+      Area = -Area;
+    }
+    // Clamped while still floats: converting a coordinate outside int32_t (or a NaN) is undefined. The
+    // bounds stay one past the viewport, so a triangle entirely outside it still comes out empty.
+    auto Bound = [](float Value, float Low, float High) {
+      return static_cast<int32_t>(std::min(High, std::max(Low, Value))); // Picks Low for a NaN
+    };
+    const auto W = static_cast<float>(Width), H = static_cast<float>(Height);
+    triangle Triangle;
+    Triangle.MinX = Bound(std::floor(std::min({X[0], X[1], X[2]})), 0, W);
+    Triangle.MinY = Bound(std::floor(std::min({Y[0], Y[1], Y[2]})), 0, H);
+    Triangle.MaxX = Bound(std::ceil(std::max({X[0], X[1], X[2]})), -1, W - 1);
+    Triangle.MaxY = Bound(std::ceil(std::max({Y[0], Y[1], Y[2]})), -1, H - 1);
+    if (Triangle.MinX > Triangle.MaxX || Triangle.MinY > Triangle.MaxY) {
+      return;
+    }
+    for (size_t k = 0; k < 3; k++) {
+      // The edge from A to B, opposite vertex k
+      const size_t A = (k + 1) % 3;
+      const size_t B = (k + 2) % 3;
+      Triangle.EdgeX[k] = (Y[A] - Y[B]) / Area;
+      Triangle.EdgeY[k] = (X[B] - X[A]) / Area;
+      Triangle.EdgeC[k] = ((Y[B] - Y[A]) * X[A] - (X[B] - X[A]) * Y[A]) / Area;
+      const clip_vertex &Vertex = *Vertices[k];
+      const float InverseW = 1 / Vertex.Clip[3];
+      Triangle.Z[k] = Vertex.Clip[2] * InverseW;
+      Triangle.InverseW[k] = InverseW;
+      Triangle.R[k] = Vertex.Color[0] * InverseW;
+      Triangle.G[k] = Vertex.Color[1] * InverseW;
+      Triangle.B[k] = Vertex.Color[2] * InverseW;
+    }
+
+    const auto Index = static_cast<uint32_t>(Range.Triangles.size());
+    Range.Triangles.push_back(Triangle);
+    for (uint32_t TileY = Triangle.MinY / TileSize; TileY <= Triangle.MaxY / TileSize; TileY++) {
+      for (uint32_t TileX = Triangle.MinX / TileSize; TileX <= Triangle.MaxX / TileSize; TileX++) {
+        Range.Bins[TileY * TilesX + TileX].push_back(Index);
+      }
+    }
+  }
+
+  void RasterTile(uint32_t Tile, uint32_t ClearColor) {
+    const int32_t X0 = static_cast<int32_t>(Tile % TilesX * TileSize);
+    const int32_t Y0 = static_cast<int32_t>(Tile / TilesX * TileSize);
+    for (int32_t Y = Y0; Y < Y0 + static_cast<int32_t>(TileSize); Y++) {
+      const size_t Row = static_cast<size_t>(Y) * Pitch + X0;
+      std::fill_n(Color.begin() + static_cast<ptrdiff_t>(Row), TileSize, ClearColor);
+      std::fill_n(Depth.begin() + static_cast<ptrdiff_t>(Row), TileSize, 1.0F);
+    }
+    for (const range &Range : Ranges) {
+      for (uint32_t Index : Range.Bins[Tile]) {
+        RasterTriangle(Range.Triangles[Index], X0, Y0);
+      }
+    }
+  }
+
+  void RasterTriangle(const triangle &Triangle, int32_t X0, int32_t Y0) {
+    const int32_t MinX = std::max(Triangle.MinX, X0) & ~3; // Blocks start on a multiple of four
+    const int32_t MaxX = std::min(Triangle.MaxX, X0 + static_cast<int32_t>(TileSize) - 1);
+    const int32_t MinY = std::max(Triangle.MinY, Y0);
+    const int32_t MaxY = std::min(Triangle.MaxY, Y0 + static_cast<int32_t>(TileSize) - 1);
+    constexpr std::array<float, 4> LaneOffsets = {0.5F, 1.5F, 2.5F, 3.5F}; // Pixel centres
+    const float4 Lanes = float4::Load(LaneOffsets.data());
+    const float4 Zero(0.0F);
+    const auto Interpolate = [](const std::array<float4, 3> &Weights, const std::array<float, 3> &Values) {
+      return Weights[0] * float4(Values[0]) + Weights[1] * float4(Values[1]) + Weights[2] * float4(Values[2]);
+    };
+
+    for (int32_t Y = MinY; Y <= MaxY; Y++) {
+      const float CentreY = static_cast<float>(Y) + 0.5F;
+      std::array<float, 3> RowStart;
+      for (size_t k = 0; k < 3; k++) {
+        RowStart[k] = Triangle.EdgeY[k] * CentreY + Triangle.EdgeC[k];
+      }
+      const size_t Row = static_cast<size_t>(Y) * Pitch;
+      for (int32_t X = MinX; X <= MaxX; X += 4) {
+        const float4 CentreX = float4(static_cast<float>(X)) + Lanes;
+        std::array<float4, 3> Weights = {Zero, Zero, Zero};
+        uint32_t Covered = 0xF;
+        for (size_t k = 0; k < 3; k++) {
+          Weights[k] = float4(Triangle.EdgeX[k]) * CentreX + float4(RowStart[k]);
+          Covered &= Weights[k].GreaterEqual(Zero);
+        }
+        if (Covered == 0) {
+          continue;
+        }
+        float *DepthRow = &Depth[Row + X];
+        const float4 Z = Interpolate(Weights, Triangle.Z);
+        Covered &= Z.Less(float4::Load(DepthRow));
+        if (Covered == 0) {
+          continue;
+        }
+        const float4 W = float4(1.0F) / Interpolate(Weights, Triangle.InverseW);
+        std::array<float, 4> Depths, R, G, B;
+        Z.Store(Depths.data());
+        (Interpolate(Weights, Triangle.R) * W).Store(R.data());
+        (Interpolate(Weights, Triangle.G) * W).Store(G.data());
+        (Interpolate(Weights, Triangle.B) * W).Store(B.data());
+        for (; Covered != 0; Covered &= Covered - 1) {
+          const auto Lane = static_cast<size_t>(std::countr_zero(Covered));
+          DepthRow[Lane] = Depths[Lane];
+          Color[Row + X + Lane] = 0xFF000000 | ToByte(R[Lane]) << 16 | ToByte(G[Lane]) << 8 | ToByte(B[Lane]);
+        }
+      }
+    }
+  }
+
+  static auto ToByte(float Channel) -> uint32_t {
+    return static_cast<uint32_t>(std::clamp(Channel, 0.0F, 1.0F) * 255.0F + 0.5F);
+  }
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "../log.hpp"
+#include "rasterizer.hpp"
+
+#include <SDL2/SDL.h>
+
+// The CPU backend: rasterizes into memory and copies the image into the window's SDL surface. Stands in
+// for the vulkan class when the config selects renderer = software.
+class software_renderer {
+public:
+  software_renderer(SDL_Window *Window, job_system &Jobs) : Window(Window), Rasterizer(Jobs, 1, 1) {
+    int Width = 0;
+    int Height = 0;
+    SDL_GetWindowSize(Window, &Width, &Height);
+    Resize(Width, Height);
+    Camera.Set(Camera.Loc, Camera.At, Camera.Up);
+    KLOG(Info, Render, "software renderer, {} threads", Jobs.ThreadCount() + 1);
+  }
+
+  void Render() {
+    SDL_Surface *Surface = SDL_GetWindowSurface(Window); // Recreated by SDL when the window is resized
+    if (Surface == nullptr) {
+      KLOG(Error, Render, "no window surface: {}", SDL_GetError());
+      return;
+    }
+    if (static_cast<uint32_t>(Surface->w) != Rasterizer.GetWidth() ||
+        static_cast<uint32_t>(Surface->h) != Rasterizer.GetHeight()) {
+      Resize(Surface->w, Surface->h);
+    }
+    Rasterizer.Render(Camera);
+    KPROFILE_SCOPE("software_renderer::Present");
+    // SDL converts from ARGB8888 if the window surface uses another format
+    SDL_Surface *Image = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<uint32_t *>(Rasterizer.GetPixels().data()), static_cast<int>(Rasterizer.GetWidth()),
+        static_cast<int>(Rasterizer.GetHeight()), 32, static_cast<int>(Rasterizer.GetPitch() * sizeof(uint32_t)),
+        SDL_PIXELFORMAT_ARGB8888);
+    SDL_BlitSurface(Image, nullptr, Surface, nullptr);
+    SDL_FreeSurface(Image);
+    SDL_UpdateWindowSurface(Window);
+  }
+
+  // Scene code queues draws here between frames.
+  [[nodiscard]] auto GetRasterizer() -> rasterizer & { return Rasterizer; }
+  [[nodiscard]] auto GetCamera() -> mth::camera<float> & { return Camera; }
+
+private:
+  SDL_Window *Window;
+  rasterizer Rasterizer;
+  mth::camera<float> Camera;
+
+  void Resize(int Width, int Height) {
+    Rasterizer.Resize(static_cast<uint32_t>(std::max(Width, 1)), static_cast<uint32_t>(std::max(Height, 1)));
+    Camera.Resize(std::max(Width, 1), std::max(Height, 1));
+  }
+};
@@ -0,0 +1,339 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../mth/mth.h"
+#include "assets/mesh_format.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+// Streams a heightfield world in square chunks around the viewer. It knows nothing about Vulkan: Update
+// decides which chunks are wanted at which level of detail, generation runs on the job system, and finished
+// meshes wait in GetReady until the renderer uploads them.
+//
+// Heights are mth::noise turbulence. A chunk's level of detail halves its resolution per level and is picked
+// from its distance to the viewer. A chunk next to a coarser one collapses every edge vertex that the
+// coarser chunk lacks onto the previous one it shares, which closes the seam without extra geometry; its mesh
+// therefore also depends on the neighbours' levels and is rebuilt when they change. The previous mesh stays
+// in use until the new one is uploaded, so a change never leaves a hole.
+//
+// Update never waits: it only reads finished jobs and submits new ones, nearest chunks first, up to MaxJobs
+// at a time. Call it and take the results on one thread, normally the render thread.
+class terrain {
+public:
+  using chunk_id = uint64_t;
+  struct settings {
+    float ChunkSize = 64;
+    uint32_t Resolution = 64; // Quads along a chunk side at level 0, a power of two
+    uint32_t LodCount = 5;
+    float LodDistance = 96;   // Chunks nearer than this use level 0; the range doubles with every level
+    int32_t ViewRadius = 12;  // In chunks
+    float HeightScale = 160;
+    float NoiseScale = 1.0F / 128; // Noise cells per world unit
+    int32_t Octaves = 6;
+    uint32_t MaxJobs = 8; // Generation jobs in flight
+  };
+  struct chunk_mesh {
+    chunk_id Chunk;
+    uint32_t Lod;
+    std::vector<mesh_format::vertex> Vertices; // World space
+    std::vector<uint32_t> Indices;
+    mth::vec3<float> Min, Max;
+  };
+
+  terrain(job_system &Jobs, const settings &Settings)
+      : Jobs(Jobs), Settings(Settings), Noise(std::make_unique<mth::noise<float>>()) {}
+  terrain(const terrain &) = delete;
+  terrain(terrain &&) = delete;
+  auto operator=(const terrain &) -> terrain & = delete;
+  auto operator=(terrain &&) -> terrain & = delete;
+  // Jobs hold a pointer to the terrain; the last thing one touches is FinishedMutex, released after the notify
+  ~terrain() {
+    std::unique_lock Lock(FinishedMutex);
+    JobFinished.wait(Lock, [this] { return InFlight.load() == 0; });
+  }
+
+  static auto Id(int32_t X, int32_t Z) -> chunk_id {
+    return (uint64_t{static_cast<uint32_t>(X)} << 32U) | static_cast<uint32_t>(Z);
+  }
+  static auto ChunkX(chunk_id Chunk) -> int32_t { return static_cast<int32_t>(Chunk >> 32U); }
+  static auto ChunkZ(chunk_id Chunk) -> int32_t { return static_cast<int32_t>(Chunk & 0xFFFFFFFFU); }
+
+  // Same heights the meshes use, for placing things on the ground.
+  [[nodiscard]] auto GetHeight(float X, float Z) const -> float {
+    const float Noise01 = Noise->NoiseTurb2D(X * Settings.NoiseScale, Z * Settings.NoiseScale, Settings.Octaves);
+    return Settings.HeightScale * Noise01;
+  }
+
+  // Call every frame with camera::Loc.
+  void Update(const mth::vec3<float> &Viewer) {
+    KPROFILE_SCOPE("terrain::Update");
+    CollectFinished();
+
+    const int32_t Radius = Settings.ViewRadius;
+    const int32_t Side = 2 * Radius + 1;
+    const auto CenterX = static_cast<int32_t>(std::floor(Viewer.X / Settings.ChunkSize));
+    const auto CenterZ = static_cast<int32_t>(std::floor(Viewer.Z / Settings.ChunkSize));
+    // Level of every chunk in the square around the viewer, outside the view circle marked NoLod
+    Lods.assign(static_cast<size_t>(Side * Side), NoLod);
+    for (int32_t Z = -Radius; Z <= Radius; Z++) {
+      for (int32_t X = -Radius; X <= Radius; X++) {
+        if (X * X + Z * Z <= Radius * Radius) {
+          Lods[static_cast<size_t>((Z + Radius) * Side + X + Radius)] = PickLod(CenterX + X, CenterZ + Z, Viewer);
+        }
+      }
+    }
+    const auto LodAt = [&](int32_t X, int32_t Z) {
+      if (X < -Radius || X > Radius || Z < -Radius || Z > Radius) {
+        return NoLod;
+      }
+      return Lods[static_cast<size_t>((Z + Radius) * Side + X + Radius)];
+    };
+
+    UpdateFrame++;
+    for (int32_t Z = -Radius; Z <= Radius; Z++) {
+      for (int32_t X = -Radius; X <= Radius; X++) {
+        const uint32_t Lod = LodAt(X, Z);
+        if (Lod == NoLod) {
+          continue;
+        }
+        // Seams: how many levels coarser each neighbour is, 4 bits per side in -x, +x, -z, +z order
+        uint32_t Key = Lod;
+        const std::array<uint32_t, 4> Neighbours{LodAt(X - 1, Z), LodAt(X + 1, Z), LodAt(X, Z - 1), LodAt(X, Z + 1)};
+        for (uint32_t s = 0; s < 4; s++) {
+          if (Neighbours[s] != NoLod && Neighbours[s] > Lod) {
+            Key |= (Neighbours[s] - Lod) << (8 + 4 * s);
+          }
+        }
+        chunk &Chunk = Chunks[Id(CenterX + X, CenterZ + Z)];
+        if (!Chunk.InView) { // New, or back while the job it left with still runs; its mesh was evicted
+          Chunk.InView = true;
+          Chunk.Built = NoKey;
+        }
+        Chunk.Wanted = Key;
+        Chunk.Seen = UpdateFrame;
+        Chunk.Distance = static_cast<float>(X * X + Z * Z);
+      }
+    }
+    for (auto It = Chunks.begin(); It != Chunks.end();) {
+      chunk &Chunk = It->second;
+      if (Chunk.Seen != UpdateFrame && Chunk.InView) {
+        Evicted.push_back(It->first);
+        Chunk.InView = false;
+      }
+      // A chunk stays until its job reports back, so coming back into view meanwhile does not start another
+      It = Chunk.InView || Chunk.Generating ? std::next(It) : Chunks.erase(It);
+    }
+    std::erase_if(Ready, [&](const std::unique_ptr<chunk_mesh> &Mesh) {
+      const auto Found = Chunks.find(Mesh->Chunk);
+      return Found == Chunks.end() || !Found->second.InView || Found->second.Built != Found->second.Wanted;
+    });
+    Submit();
+  }
+
+  // Finished meshes, nearest chunks first. Each replaces the chunk's previous mesh; the renderer pops what
+  // its upload budget allows and leaves the rest for later frames.
+  [[nodiscard]] auto GetReady() -> std::deque<std::unique_ptr<chunk_mesh>> & { return Ready; }
+  // Chunks that left the view radius since the last call. Their meshes can be freed.
+  auto TakeEvicted() -> std::vector<chunk_id> { return std::exchange(Evicted, {}); }
+  [[nodiscard]] auto GetJobsInFlight() const -> uint32_t { return InFlight.load(std::memory_order_relaxed); }
+  [[nodiscard]] auto GetSettings() const -> const settings & { return Settings; }
+
+  // Builds a chunk in view again, e.g. after the renderer dropped its mesh, unless a mesh is already on the way.
+  void Rebuild(chunk_id Chunk) {
+    const auto Found = Chunks.find(Chunk);
+    if (Found == Chunks.end() || !Found->second.InView || Found->second.Generating ||
+        std::ranges::any_of(Ready, [&](const std::unique_ptr<chunk_mesh> &Mesh) { return Mesh->Chunk == Chunk; })) {
+      return;
+    }
+    Found->second.Built = NoKey;
+  }
+  // Takes effect on the next Update, which rebuilds the chunks whose level changed. Generation jobs do not
+  // read it, so it can change while they run.
+  void SetLodDistance(float Distance) { Settings.LodDistance = Distance; }
+
+  // Builds one chunk. Key holds the level in its low byte and the seam levels above it, see Update.
+  [[nodiscard]] auto Generate(chunk_id Chunk, uint32_t Key) const -> std::unique_ptr<chunk_mesh> {
+    KPROFILE_SCOPE("terrain::Generate");
+    const uint32_t Lod = Key & 0xFFU;
+    const uint32_t N = std::max(Settings.Resolution >> Lod, 1U); // Quads per side
+    const auto OriginX = static_cast<float>(ChunkX(Chunk));
+    const auto OriginZ = static_cast<float>(ChunkZ(Chunk));
+    // Fractions of a chunk are exact for power-of-two N, so chunks at every level and their neighbours
+    // place shared vertices at bit-identical positions and heights
+    const auto WorldX = [&](int32_t i) {
+      return (OriginX + static_cast<float>(i) / static_cast<float>(N)) * Settings.ChunkSize;
+    };
+    const auto WorldZ = [&](int32_t j) {
+      return (OriginZ + static_cast<float>(j) / static_cast<float>(N)) * Settings.ChunkSize;
+    };
+
+    // Heights with a one-sample border, so normals are continuous across chunks
+    const uint32_t Stride = N + 3;
+    std::vector<float> Heights(size_t{Stride} * Stride);
+    for (uint32_t j = 0; j < Stride; j++) {
+      for (uint32_t i = 0; i < Stride; i++) {
+        Heights[j * Stride + i] = GetHeight(WorldX(static_cast<int32_t>(i) - 1), WorldZ(static_cast<int32_t>(j) - 1));
+      }
+    }
+    const auto Height = [&](uint32_t i, uint32_t j) { return Heights[(j + 1) * Stride + i + 1]; };
+
+    auto Mesh = std::make_unique<chunk_mesh>();
+    Mesh->Chunk = Chunk;
+    Mesh->Lod = Lod;
+    Mesh->Min = mth::vec3<float>(std::numeric_limits<float>::max());
+    Mesh->Max = mth::vec3<float>(std::numeric_limits<float>::lowest());
+    Mesh->Vertices.reserve(size_t{N + 1} * (N + 1));
+    const float Spacing = Settings.ChunkSize / static_cast<float>(N);
+    for (uint32_t j = 0; j <= N; j++) {
+      for (uint32_t i = 0; i <= N; i++) {
+        const mth::vec3<float> Position(WorldX(static_cast<int32_t>(i)), Height(i, j),
+                                        WorldZ(static_cast<int32_t>(j)));
+        // Central differences over the bordered grid
+        const float DX = Heights[(j + 1) * Stride + i] - Heights[(j + 1) * Stride + i + 2];
+        const float DZ = Heights[j * Stride + i + 1] - Heights[(j + 2) * Stride + i + 1];
+        const mth::vec3<float> Normal = mth::vec3<float>(DX, 2 * Spacing, DZ).Normalizing();
+        Mesh->Vertices.push_back({.Position = {Position.X, Position.Y, Position.Z},
+                                  .Normal = {Normal.X, Normal.Y, Normal.Z},
+                                  .UV = {Position.X / Settings.ChunkSize, Position.Z / Settings.ChunkSize}});
+        Mesh->Min = Mesh->Min.Min(Position);
+        Mesh->Max = Mesh->Max.Max(Position);
+      }
+    }
+
+    // Edge vertices the coarser neighbour lacks are collapsed onto the previous one it has
+    const auto Step = [&](uint32_t Side) { return std::min(1U << ((Key >> (8 + 4 * Side)) & 0xFU), N); };
+    const std::array<uint32_t, 4> Steps{Step(0), Step(1), Step(2), Step(3)};
+    const auto Index = [&](uint32_t i, uint32_t j) {
+      if (i == 0) {
+        j -= j % Steps[0];
+      } else if (i == N) {
+        j -= j % Steps[1];
+      }
+      if (j == 0) {
+        i -= i % Steps[2];
+      } else if (j == N) {
+        i -= i % Steps[3];
+      }
+      return j * (N + 1) + i;
+    };
+    Mesh->Indices.reserve(size_t{N} * N * 6);
+    const auto Triangle = [&](uint32_t A, uint32_t B, uint32_t C) {
+      if (A != B && B != C && A != C) {
+        Mesh->Indices.insert(Mesh->Indices.end(), {A, B, C});
+      }
+    };
+    for (uint32_t j = 0; j < N; j++) {
+      for (uint32_t i = 0; i < N; i++) { // Counter-clockwise seen from above
+        Triangle(Index(i, j), Index(i, j + 1), Index(i + 1, j));
+        Triangle(Index(i + 1, j), Index(i, j + 1), Index(i + 1, j + 1));
+      }
+    }
+    return Mesh;
+  }
+
+private:
+  static constexpr uint32_t NoLod = UINT32_MAX;
+  static constexpr uint32_t NoKey = UINT32_MAX;
+
+  struct chunk {
+    uint32_t Wanted = NoKey;
+    uint32_t Built = NoKey; // Key of the newest finished mesh
+    bool Generating = false; // A job for the chunk is running, at most one at a time
+    bool InView = false;     // Cleared when it leaves the view radius while a job is still running
+    uint64_t Seen = 0;
+    float Distance = 0; // Squared, in chunks
+  };
+  struct finished {
+    uint32_t Key;
+    std::unique_ptr<chunk_mesh> Mesh;
+  };
+
+  job_system &Jobs;
+  settings Settings;
+  std::unique_ptr<mth::noise<float>> Noise; // 256 KiB of tables, read-only once built
+  std::unordered_map<chunk_id, chunk> Chunks;
+  std::vector<uint32_t> Lods;
+  std::vector<chunk_id> Candidates;
+  uint64_t UpdateFrame = 0;
+  std::deque<std::unique_ptr<chunk_mesh>> Ready;
+  std::vector<chunk_id> Evicted;
+  std::atomic<uint32_t> InFlight{0}; // Decremented with FinishedMutex held
+  std::mutex FinishedMutex;
+  std::condition_variable JobFinished;
+  std::vector<finished> Finished; // Written by jobs, drained by Update
+
+  [[nodiscard]] auto PickLod(int32_t X, int32_t Z, const mth::vec3<float> &Viewer) const -> uint32_t {
+    const float DX = (static_cast<float>(X) + 0.5F) * Settings.ChunkSize - Viewer.X;
+    const float DZ = (static_cast<float>(Z) + 0.5F) * Settings.ChunkSize - Viewer.Z;
+    const float Distance = std::sqrt(DX * DX + DZ * DZ);
+    uint32_t Lod = 0;
+    for (float Range = Settings.LodDistance; Distance > Range && Lod + 1 < Settings.LodCount; Range *= 2) {
+      Lod++;
+    }
+    return Lod;
+  }
+
+  void CollectFinished() {
+    std::vector<finished> Done;
+    {
+      std::lock_guard Lock(FinishedMutex);
+      std::swap(Done, Finished);
+    }
+    for (finished &Result : Done) {
+      const auto Found = Chunks.find(Result.Mesh->Chunk);
+      Found->second.Generating = false;
+      if (!Found->second.InView) {
+        Chunks.erase(Found); // Evicted while generating
+        continue;
+      }
+      if (Result.Key != Found->second.Wanted) {
+        continue; // Superseded; Submit starts the wanted one
+      }
+      Found->second.Built = Result.Key;
+      std::erase_if(Ready, [&](const std::unique_ptr<chunk_mesh> &Mesh) { return Mesh->Chunk == Result.Mesh->Chunk; });
+      const float Distance = Found->second.Distance;
+      const auto Position = std::ranges::find_if(Ready, [&](const std::unique_ptr<chunk_mesh> &Mesh) {
+        return Chunks.at(Mesh->Chunk).Distance > Distance;
+      });
+      Ready.insert(Position, std::move(Result.Mesh));
+    }
+  }
+
+  void Submit() {
+    Candidates.clear();
+    for (const auto &[Id, Chunk] : Chunks) {
+      if (Chunk.InView && !Chunk.Generating && Chunk.Built != Chunk.Wanted) {
+        Candidates.push_back(Id);
+      }
+    }
+    const uint32_t Free = Settings.MaxJobs - std::min(Settings.MaxJobs, InFlight.load());
+    const auto Count = std::min<size_t>(Free, Candidates.size());
+    std::ranges::partial_sort(Candidates, Candidates.begin() + static_cast<ptrdiff_t>(Count), {},
+                              [&](chunk_id Chunk) { return Chunks.at(Chunk).Distance; });
+    for (size_t i = 0; i < Count; i++) {
+      chunk &Chunk = Chunks.at(Candidates[i]);
+      Chunk.Generating = true;
+      InFlight.fetch_add(1);
+      Jobs.Submit([this, Id = Candidates[i], Key = Chunk.Wanted] {
+        finished Result{.Key = Key, .Mesh = Generate(Id, Key)};
+        std::lock_guard Lock(FinishedMutex);
+        Finished.push_back(std::move(Result));
+        InFlight.fetch_sub(1);
+        JobFinished.notify_all();
+      });
+    }
+  }
+};
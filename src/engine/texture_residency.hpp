@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "../mth/mth.h"
+
+// Decides which mip levels of every streamed texture should be resident in VRAM. It knows nothing
+// about Vulkan: each frame the renderer reports how large each texture appears on screen, and Update
+// returns the textures whose first resident level has to change.
+//
+// A texture always keeps its mip tail. Finer levels are granted one at a time, coarsest first, to the
+// textures that are blurriest on screen, within a per-frame upload limit. When the budget is exceeded,
+// levels are dropped from the textures that were used least recently, finest first. The budget may shrink
+// under memory pressure; the next Update then drops whatever detail is not on screen until it holds again.
+class texture_residency {
+public:
+  using handle = uint32_t;
+  struct change {
+    handle Texture;
+    uint32_t FirstLevel; // New first resident level; uploads or drops everything up to the old one
+  };
+
+  texture_residency(uint64_t BudgetBytes, uint64_t UploadBytesPerFrame)
+      : Budget(BudgetBytes), UploadLimit(UploadBytesPerFrame) {}
+
+  // LevelBytes is indexed by mip level, Size is the larger side of level 0. The tail is resident at once and
+  // the first change reported for the texture uploads it.
+  auto Add(std::span<const uint64_t> LevelBytes, uint32_t Size, uint32_t MipTailStart) -> handle {
+    entry Entry{.LevelBytes = {LevelBytes.begin(), LevelBytes.end()}, .Size = Size, .Tail = MipTailStart};
+    // Levels that do not fit in one frame's upload are never streamed
+    while (Entry.Finest < Entry.Tail && Entry.LevelBytes[Entry.Finest] > UploadLimit) {
+      Entry.Finest++;
+    }
+    Entry.Resident = Entry.Wanted = Entry.Tail;
+    Entry.Committed = static_cast<uint32_t>(Entry.LevelBytes.size());
+    Entry.LastUsed = Frame;
+    Entry.Alive = true;
+    for (uint32_t i = Entry.Tail; i < Entry.LevelBytes.size(); i++) {
+      Used += Entry.LevelBytes[i];
+    }
+    handle Handle;
+    if (FreeHandles.empty()) {
+      Handle = static_cast<handle>(Entries.size());
+      Entries.push_back(std::move(Entry));
+    } else {
+      Handle = FreeHandles.back();
+      FreeHandles.pop_back();
+      Entries[Handle] = std::move(Entry);
+    }
+    return Handle;
+  }
+  void Remove(handle Texture) {
+    entry &Entry = Entries[Texture];
+    for (uint32_t i = Entry.Resident; i < Entry.LevelBytes.size(); i++) {
+      Used -= Entry.LevelBytes[i];
+    }
+    Entry = {};
+    FreeHandles.push_back(Texture);
+  }
+
+  // Height in pixels of a surface WorldSize across centered at Center, as seen through Camera.
+  static auto ScreenSize(const mth::camera<float> &Camera, const mth::vec3<float> &Center, float WorldSize) -> float {
+    const float Depth = (Center - Camera.Loc) & Camera.Dir;
+    if (Depth <= Camera.ProjDist) {
+      return Depth + WorldSize < 0 ? 0 : static_cast<float>(Camera.FrameH); // Behind the camera or touching it
+    }
+    return WorldSize * Camera.ProjDist / Depth / Camera.Hp * static_cast<float>(Camera.FrameH);
+  }
+  // Reports that the texture covers ScreenPixels this frame. The largest request of the frame wins.
+  void Request(handle Texture, float ScreenPixels) {
+    entry &Entry = Entries[Texture];
+    uint32_t Level = Entry.Tail;
+    if (ScreenPixels >= 1) {
+      const float Lod = std::floor(std::log2(static_cast<float>(Entry.Size) / ScreenPixels));
+      Level = static_cast<uint32_t>(std::clamp(Lod, static_cast<float>(Entry.Finest), static_cast<float>(Entry.Tail)));
+    }
+    Entry.Wanted = Entry.LastUsed == Frame ? std::min(Entry.Wanted, Level) : Level;
+    Entry.LastUsed = Frame;
+  }
+
+  // Call once per frame after all requests. The returned span is valid until the next call.
+  auto Update() -> std::span<const change> {
+    Grant();
+    Changes.clear();
+    for (handle Texture = 0; Texture < Entries.size(); Texture++) {
+      entry &Entry = Entries[Texture];
+      if (Entry.Alive && Entry.Resident != Entry.Committed) {
+        Changes.push_back({.Texture = Texture, .FirstLevel = Entry.Resident});
+        Entry.Committed = Entry.Resident;
+      }
+    }
+    Frame++;
+    return Changes;
+  }
+
+  [[nodiscard]] auto FirstResidentLevel(handle Texture) const -> uint32_t { return Entries[Texture].Resident; }
+  [[nodiscard]] auto UsedBytes() const -> uint64_t { return Used; }
+  [[nodiscard]] auto BudgetBytes() const -> uint64_t { return Budget; }
+  void SetBudget(uint64_t BudgetBytes) { Budget = BudgetBytes; }
+
+private:
+  struct entry {
+    std::vector<uint64_t> LevelBytes;
+    uint32_t Size = 0;
+    uint32_t Tail = 0;
+    uint32_t Finest = 0;    // Finest level that may ever be streamed in
+    uint32_t Resident = 0;  // First resident level
+    uint32_t Committed = 0; // First resident level the renderer last heard about
+    uint32_t Wanted = 0;
+    uint64_t LastUsed = 0;
+    bool Alive = false;
+  };
+
+  uint64_t Budget, UploadLimit;
+  uint64_t Used = 0;
+  uint64_t Frame = 0;
+  std::vector<entry> Entries;
+  std::vector<handle> FreeHandles;
+  std::vector<change> Changes;
+  std::vector<handle> Candidates, Victims;
+  bool VictimsReady = false;
+  size_t NextVictim = 0;
+  uint64_t Reclaimable = 0; // Bytes the remaining victims could still give up
+
+  void Grant() {
+    Candidates.clear();
+    for (handle Texture = 0; Texture < Entries.size(); Texture++) {
+      const entry &Entry = Entries[Texture];
+      if (Entry.Alive && Entry.LastUsed == Frame && Entry.Wanted < Entry.Resident) {
+        Candidates.push_back(Texture);
+      }
+    }
+    // Blurriest on screen first
+    std::ranges::sort(Candidates, std::greater{},
+                      [&](handle Texture) { return Entries[Texture].Resident - Entries[Texture].Wanted; });
+    VictimsReady = false;
+    if (Used > Budget) { // The budget shrank
+      CollectVictims();
+      Evict(Budget);
+    }
+
+    uint64_t Uploaded = 0;
+    for (bool Progress = true; Progress;) {
+      Progress = false;
+      for (handle Texture : Candidates) {
+        entry &Entry = Entries[Texture];
+        if (Entry.Wanted >= Entry.Resident) {
+          continue;
+        }
+        const uint64_t Bytes = Entry.LevelBytes[Entry.Resident - 1];
+        if (Uploaded + Bytes > UploadLimit || !MakeRoom(Bytes)) {
+          continue;
+        }
+        Entry.Resident--;
+        Used += Bytes;
+        Uploaded += Bytes;
+        Progress = true;
+      }
+    }
+  }
+
+  // Textures on screen this frame only give up the detail they no longer need.
+  [[nodiscard]] auto EvictionFloor(const entry &Entry) const -> uint32_t {
+    return Entry.LastUsed < Frame ? Entry.Tail : std::max(Entry.Wanted, Entry.Resident);
+  }
+
+  // Drops levels from the least recently used textures until Bytes more fit in the budget.
+  auto MakeRoom(uint64_t Bytes) -> bool {
+    if (!VictimsReady && Used + Bytes > Budget) {
+      CollectVictims();
+    }
+    if (Used + Bytes > Budget + Reclaimable) {
+      return false; // Would not fit even after evicting everything, keep what is there
+    }
+    Evict(Budget - Bytes);
+    return Used + Bytes <= Budget;
+  }
+
+  void CollectVictims() {
+    Victims.clear();
+    NextVictim = 0;
+    Reclaimable = 0;
+    VictimsReady = true;
+    for (handle Texture = 0; Texture < Entries.size(); Texture++) {
+      const entry &Entry = Entries[Texture];
+      for (uint32_t i = Entry.Resident; Entry.Alive && i < EvictionFloor(Entry); i++) {
+        Reclaimable += Entry.LevelBytes[i];
+      }
+      if (Entry.Alive && Entry.Resident < EvictionFloor(Entry)) {
+        Victims.push_back(Texture);
+      }
+    }
+    std::ranges::sort(Victims, std::less{}, [&](handle Texture) { return Entries[Texture].LastUsed; });
+  }
+
+  // Drops levels from the victims, least recently used first, until at most Limit bytes are resident
+  void Evict(uint64_t Limit) {
+    while (Used > Limit && NextVictim < Victims.size()) {
+      entry &Entry = Entries[Victims[NextVictim]];
+      if (Entry.Resident >= EvictionFloor(Entry)) {
+        NextVictim++;
+        continue;
+      }
+      Used -= Entry.LevelBytes[Entry.Resident];
+      Reclaimable -= Entry.LevelBytes[Entry.Resident];
+      Entry.Resident++;
+    }
+  }
+};
@@ -0,0 +1,195 @@
+#pragma once
+#include "../log.hpp"
+#include "common.hpp"
+
+#include <deque>
+
+// Every texture and storage buffer in one descriptor set, bound once per command buffer. Shaders index
+// the arrays declared in src/shaders/common/bindless.glsl with slots passed in push constants, so
+// switching materials costs a push constant instead of a descriptor set bind.
+//
+// The arrays are update-after-bind and partially bound: slots are written while the set is bound and even
+// while earlier frames are in flight, as long as those frames do not use them. A removed slot is therefore
+// only handed out again once every frame that could have used it has completed.
+// Everything here runs on the render thread.
+class bindless_heap {
+public:
+  using slot = uint32_t;
+  static constexpr uint32_t TextureBinding = 0;
+  static constexpr uint32_t BufferBinding = 1;
+  static constexpr uint32_t ReservedResources = 256; // Per stage, for descriptors outside the heap
+
+  bindless_heap(VkPhysicalDevice PhysicalDevice, VkDevice Device, uint32_t FramesInFlight,
+                uint32_t MaxTextures = 16384, uint32_t MaxBuffers = 16384)
+      : Device(Device), FramesInFlight(FramesInFlight) {
+    VkPhysicalDeviceVulkan12Properties Limits{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+    VkPhysicalDeviceProperties2 Properties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &Limits};
+    vkGetPhysicalDeviceProperties2(PhysicalDevice, &Properties);
+    // A combined image sampler counts as both a sampler and a sampled image. The bindings are visible to every
+    // stage, so the per-stage limits apply to each stage, and both arrays share its resource limit with the
+    // other sets in a pipeline layout, which get ReservedResources of it.
+    Textures.Capacity = std::min({MaxTextures, Limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                  Limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                  Limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                  Limits.maxDescriptorSetUpdateAfterBindSamplers});
+    Buffers.Capacity = std::min({MaxBuffers, Limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                 Limits.maxDescriptorSetUpdateAfterBindStorageBuffers});
+    const uint32_t Resources = Limits.maxPerStageUpdateAfterBindResources -
+                               std::min(ReservedResources, Limits.maxPerStageUpdateAfterBindResources / 2);
+    if (const uint64_t Total = static_cast<uint64_t>(Textures.Capacity) + Buffers.Capacity; Total > Resources) {
+      Textures.Capacity = static_cast<uint32_t>(Textures.Capacity * uint64_t{Resources} / Total);
+      Buffers.Capacity = Resources - Textures.Capacity;
+    }
+
+    const std::array<VkDescriptorSetLayoutBinding, 2> Bindings = {{
+        {.binding = TextureBinding,
+         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = Textures.Capacity,
+         .stageFlags = VK_SHADER_STAGE_ALL},
+        {.binding = BufferBinding,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = Buffers.Capacity,
+         .stageFlags = VK_SHADER_STAGE_ALL},
+    }};
+    const VkDescriptorBindingFlags Flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    const std::array<VkDescriptorBindingFlags, 2> BindingFlags = {Flags, Flags};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo FlagsInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(BindingFlags.size()),
+        .pBindingFlags = BindingFlags.data(),
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &FlagsInfo,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+        .bindingCount = static_cast<uint32_t>(Bindings.size()),
+        .pBindings = Bindings.data(),
+    };
+    if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &SetLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+    const std::array<VkDescriptorPoolSize, 2> PoolSizes = {{
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = Textures.Capacity},
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = Buffers.Capacity},
+    }};
+    VkDescriptorPoolCreateInfo PoolInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(PoolSizes.size()),
+        .pPoolSizes = PoolSizes.data(),
+    };
+    if (vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &Pool) != VK_SUCCESS) {
+      vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+      throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = Pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &SetLayout,
+    };
+    if (vkAllocateDescriptorSets(Device, &AllocateInfo, &Set) != VK_SUCCESS) {
+      vkDestroyDescriptorPool(Device, Pool, nullptr);
+      vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+      throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+    KLOG(Info, Vulkan, "bindless heap: {} textures, {} buffers", Textures.Capacity, Buffers.Capacity);
+  }
+  bindless_heap(const bindless_heap &) = delete;
+  bindless_heap(bindless_heap &&) = delete;
+  auto operator=(const bindless_heap &) -> bindless_heap & = delete;
+  auto operator=(bindless_heap &&) -> bindless_heap & = delete;
+  // The owner waits for the device to go idle first
+  ~bindless_heap() {
+    vkDestroyDescriptorPool(Device, Pool, nullptr); // Frees the set
+    vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+  }
+
+  // Throws when every slot is taken.
+  auto AddTexture(VkImageView View, VkSampler Sampler,
+                  VkImageLayout Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) -> slot {
+    const slot Slot = Textures.Allocate("texture");
+    VkDescriptorImageInfo Info{.sampler = Sampler, .imageView = View, .imageLayout = Layout};
+    Write(TextureBinding, Slot, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &Info, nullptr);
+    return Slot;
+  }
+  auto AddBuffer(VkBuffer Buffer, VkDeviceSize Offset = 0, VkDeviceSize Range = VK_WHOLE_SIZE) -> slot {
+    const slot Slot = Buffers.Allocate("buffer");
+    VkDescriptorBufferInfo Info{.buffer = Buffer, .offset = Offset, .range = Range};
+    Write(BufferBinding, Slot, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &Info);
+    return Slot;
+  }
+  // The slot stays valid for frames already recorded; it is reused once they have completed.
+  void RemoveTexture(slot Slot) { Textures.Retired.push_back({.Slot = Slot, .Frame = FrameNumber}); }
+  void RemoveBuffer(slot Slot) { Buffers.Retired.push_back({.Slot = Slot, .Frame = FrameNumber}); }
+
+  // Call once per frame, after the frame's fence has been waited on.
+  void Update() {
+    FrameNumber++;
+    Textures.Reclaim(FrameNumber, FramesInFlight);
+    Buffers.Reclaim(FrameNumber, FramesInFlight);
+  }
+
+  // Binds the heap as set 0 of a pipeline layout created with GetSetLayout first.
+  void Bind(VkCommandBuffer CommandBuffer, VkPipelineBindPoint BindPoint, VkPipelineLayout Layout) const {
+    vkCmdBindDescriptorSets(CommandBuffer, BindPoint, Layout, 0, 1, &Set, 0, nullptr);
+  }
+  [[nodiscard]] auto GetSetLayout() const -> VkDescriptorSetLayout { return SetLayout; }
+
+private:
+  struct retired {
+    slot Slot;
+    uint64_t Frame;
+  };
+  struct slots {
+    uint32_t Capacity = 0;
+    uint32_t Next = 0; // Slots below this have been handed out at least once
+    std::vector<slot> Free;
+    std::deque<retired> Retired;
+
+    auto Allocate(const char *Kind) -> slot {
+      if (!Free.empty()) {
+        const slot Slot = Free.back();
+        Free.pop_back();
+        return Slot;
+      }
+      if (Next == Capacity) {
+        throw std::runtime_error(std::string("bindless heap is out of ") + Kind + " slots!");
+      }
+      return Next++;
+    }
+    void Reclaim(uint64_t FrameNumber, uint32_t FramesInFlight) {
+      while (!Retired.empty() && Retired.front().Frame + FramesInFlight <= FrameNumber) {
+        Free.push_back(Retired.front().Slot);
+        Retired.pop_front();
+      }
+    }
+  };
+
+  VkDevice Device;
+  uint32_t FramesInFlight;
+  uint64_t FrameNumber = 0;
+  VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool Pool = VK_NULL_HANDLE;
+  VkDescriptorSet Set = VK_NULL_HANDLE;
+  slots Textures;
+  slots Buffers;
+
+  void Write(uint32_t Binding, slot Slot, VkDescriptorType Type, const VkDescriptorImageInfo *Image,
+             const VkDescriptorBufferInfo *Buffer) const {
+    VkWriteDescriptorSet Write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = Set,
+        .dstBinding = Binding,
+        .dstArrayElement = Slot,
+        .descriptorCount = 1,
+        .descriptorType = Type,
+        .pImageInfo = Image,
+        .pBufferInfo = Buffer,
+    };
+    vkUpdateDescriptorSets(Device, 1, &Write, 0, nullptr);
+  }
+};
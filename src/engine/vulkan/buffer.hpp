@@ -0,0 +1,53 @@
+#pragma once
+#include "common.hpp"
+#include <cstddef>
+
+// A buffer with its own dedicated allocation. Host-visible buffers stay mapped for their whole lifetime.
+struct buffer {
+  VkBuffer Buffer = VK_NULL_HANDLE;
+  VkDeviceMemory Memory = VK_NULL_HANDLE;
+  VkDeviceSize Size = 0;
+  std::byte *Mapped = nullptr;
+
+  buffer(VkPhysicalDevice PhysicalDevice, VkDevice Device, VkDeviceSize Size, VkBufferUsageFlags Usage,
+         VkMemoryPropertyFlags Properties)
+      : Size(Size), Device(Device) {
+    VkBufferCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = Size,
+        .usage = Usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    if (vkCreateBuffer(Device, &CreateInfo, nullptr, &Buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create buffer!");
+    }
+    VkMemoryRequirements Requirements;
+    vkGetBufferMemoryRequirements(Device, Buffer, &Requirements);
+    VkMemoryAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = Requirements.size,
+        .memoryTypeIndex = FindMemoryType(PhysicalDevice, Requirements.memoryTypeBits, Properties),
+    };
+    if (vkAllocateMemory(Device, &AllocateInfo, nullptr, &Memory) != VK_SUCCESS) {
+      vkDestroyBuffer(Device, Buffer, nullptr);
+      throw std::runtime_error("failed to allocate buffer memory!");
+    }
+    vkBindBufferMemory(Device, Buffer, Memory, 0);
+    if ((Properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0) {
+      void *Pointer = nullptr;
+      vkMapMemory(Device, Memory, 0, VK_WHOLE_SIZE, 0, &Pointer);
+      Mapped = static_cast<std::byte *>(Pointer);
+    }
+  }
+  buffer(const buffer &) = delete;
+  buffer(buffer &&) = delete;
+  auto operator=(const buffer &) -> buffer & = delete;
+  auto operator=(buffer &&) -> buffer & = delete;
+  ~buffer() {
+    vkDestroyBuffer(Device, Buffer, nullptr);
+    vkFreeMemory(Device, Memory, nullptr); // Implicitly unmaps
+  }
+
+private:
+  VkDevice Device;
+};
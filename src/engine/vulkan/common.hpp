@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <iostream>
 #include <ostream>
@@ -19,3 +20,34 @@ constexpr auto find_if_or(R &&r, Pred pred,
   }
   return *f;
 }
+
+// Index of a memory type allowed by TypeBits that has all of Properties.
+inline auto FindMemoryType(VkPhysicalDevice PhysicalDevice, uint32_t TypeBits, VkMemoryPropertyFlags Properties)
+    -> uint32_t {
+  VkPhysicalDeviceMemoryProperties Memory;
+  vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &Memory);
+  for (uint32_t i = 0; i < Memory.memoryTypeCount; i++) {
+    if ((TypeBits & (1U << i)) != 0 && (Memory.memoryTypes[i].propertyFlags & Properties) == Properties) {
+      return i;
+    }
+  }
+  throw std::runtime_error("failed to find a suitable memory type!");
+}
+
+// Single image layout transition covering the first LevelCount mips of the color subresource.
+inline void TransitionImage(VkCommandBuffer CommandBuffer, VkImage Image, VkImageLayout OldLayout,
+                            VkImageLayout NewLayout, VkPipelineStageFlags SrcStage, VkAccessFlags SrcAccess,
+                            VkPipelineStageFlags DstStage, VkAccessFlags DstAccess, uint32_t LevelCount = 1) {
+  VkImageMemoryBarrier Barrier{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = SrcAccess,
+      .dstAccessMask = DstAccess,
+      .oldLayout = OldLayout,
+      .newLayout = NewLayout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = Image,
+      .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = LevelCount, .layerCount = 1},
+  };
+  vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+}
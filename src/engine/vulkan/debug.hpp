@@ -1,30 +1,86 @@
+#pragma once
+#include "../log.hpp"
 #include "common.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
 struct debug {
   VkDebugUtilsMessengerEXT debugMessenger = nullptr;
 
-  explicit debug(VkInstance Instance, const VkDebugUtilsMessageTypeFlagsEXT ImportanceThreshold =
-                                          VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
-    static auto Threshold = ImportanceThreshold;
-
+  // Messages below Threshold and those whose ID is in Muted are dropped before they reach the log.
+  explicit debug(VkInstance Instance,
+                 VkDebugUtilsMessageSeverityFlagBitsEXT Threshold = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT,
+                 std::vector<int32_t> Muted = {})
+      : Instance(Instance), Threshold(Threshold), Muted(std::move(Muted)) {
+    // Only ask the layers for what passes the threshold; the bits are ordered by severity
+    const VkDebugUtilsMessageSeverityFlagsEXT Severities =
+        ~(static_cast<VkDebugUtilsMessageSeverityFlagsEXT>(Threshold) - 1) &
+        (VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+         VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT);
     VkDebugUtilsMessengerCreateInfoEXT createInfo{
         .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-        .messageSeverity =
-            VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+        .messageSeverity = Severities,
         .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
         .pfnUserCallback = [](VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                               VkDebugUtilsMessageTypeFlagsEXT /*messageType*/,
-                              const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void * /*pUserData*/) {
-          if (messageSeverity >= Threshold) {
-            std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl; // Print all
+                              const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData) {
+          const auto &Self = *static_cast<const debug *>(pUserData);
+          if (messageSeverity < Self.Threshold ||
+              std::ranges::find(Self.Muted, pCallbackData->messageIdNumber) != Self.Muted.end()) {
+            return VK_FALSE;
+          }
+          // The same message tends to fire every frame, only let a few of each through
+          static rate_limiter Limiter;
+          const auto Verdict = Limiter.Check(MessageKey(*pCallbackData));
+          if (!Verdict.Allow) {
+            return VK_FALSE;
+          }
+          if (Verdict.Suppressed != 0) {
+            KLOG(Info, Validation, "{} repeats of {} suppressed", Verdict.Suppressed,
+                 pCallbackData->pMessageIdName != nullptr ? pCallbackData->pMessageIdName : "message");
+          }
+          if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+            KLOG(Error, Validation, "{}", pCallbackData->pMessage);
+          } else if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+            KLOG(Warning, Validation, "{}", pCallbackData->pMessage);
+          } else if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+            KLOG(Info, Validation, "{}", pCallbackData->pMessage);
+          } else {
+            KLOG(Debug, Validation, "{}", pCallbackData->pMessage);
           }
           return VK_FALSE;
-        }};
+        },
+        .pUserData = this};
     auto func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
         vkGetInstanceProcAddr(Instance, "vkCreateDebugUtilsMessengerEXT"));
     if ((func == nullptr) || func(Instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
       throw std::runtime_error("failed to set up debug messenger!");
     }
   }
+  // The callback holds a pointer to this object
+  debug(const debug &) = delete;
+  debug(debug &&) = delete;
+  auto operator=(const debug &) -> debug & = delete;
+  auto operator=(debug &&) -> debug & = delete;
+  ~debug() {
+    auto func = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
+        vkGetInstanceProcAddr(Instance, "vkDestroyDebugUtilsMessengerEXT"));
+    if (func != nullptr) {
+      func(Instance, debugMessenger, nullptr);
+    }
+  }
+
+private:
+  // Many layers report 0 as the ID, so the name, or the text when there is none, tells messages apart
+  static auto MessageKey(const VkDebugUtilsMessengerCallbackDataEXT &Data) -> uint64_t {
+    const char *Name = Data.pMessageIdName != nullptr ? Data.pMessageIdName : Data.pMessage;
+    const uint64_t Hash = std::hash<std::string_view>{}(Name != nullptr ? Name : "");
+    return Hash ^ (static_cast<uint64_t>(static_cast<uint32_t>(Data.messageIdNumber)) * 0x9E3779B97F4A7C15ULL);
+  }
+
+  VkInstance Instance;
+  VkDebugUtilsMessageSeverityFlagBitsEXT Threshold;
+  std::vector<int32_t> Muted;
 };
@@ -1,37 +1,175 @@
 #pragma once
 #include "physical_device.hpp"
 
-// TODO(lyka): Add support for multiple queue families
+#include <array>
+#include <optional>
+
+// Negotiated API version and optional device features. Each feature has a fallback path, so a 1.0-only
+// device still runs.
+struct device_capabilities {
+  uint32_t ApiVersion = VK_API_VERSION_1_0; // The highest version both the instance and the device support
+  bool DrawIndirectCount = false;           // VK_KHR_draw_indirect_count, for GPU-culled draws
+  bool MultiDrawIndirect = false;           // More than one draw per vkCmdDrawIndexedIndirect
+  bool DrawIndirectFirstInstance = false;   // Indirect draws with a firstInstance other than 0
+  bool DescriptorIndexing = false; // Vulkan 1.2 update-after-bind descriptor arrays, for bindless resources
+  bool TimelineSemaphores = false; // Vulkan 1.2
+  bool DynamicRendering = false;   // Vulkan 1.3, rendering without render pass and framebuffer objects
+  bool Synchronization2 = false;   // Vulkan 1.3, barriers with per-resource stage masks
+  bool MemoryBudget = false;       // VK_EXT_memory_budget with Vulkan 1.1, for per-heap usage and budget
+
+  device_capabilities(const physical_device &PhysicalDevice, uint32_t InstanceVersion) {
+    VkPhysicalDeviceFeatures Supported;
+    vkGetPhysicalDeviceFeatures(PhysicalDevice.PhysicalDevice, &Supported);
+    DrawIndirectCount = PhysicalDevice.HasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    MultiDrawIndirect = Supported.multiDrawIndirect == VK_TRUE;
+    DrawIndirectFirstInstance = Supported.drawIndirectFirstInstance == VK_TRUE;
+
+    VkPhysicalDeviceProperties Properties;
+    vkGetPhysicalDeviceProperties(PhysicalDevice.PhysicalDevice, &Properties);
+    ApiVersion = std::min(InstanceVersion, Properties.apiVersion);
+    // The budget is read through vkGetPhysicalDeviceMemoryProperties2
+    MemoryBudget = ApiVersion >= VK_API_VERSION_1_1 && PhysicalDevice.HasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (ApiVersion < VK_API_VERSION_1_2) {
+      return; // Everything below is reported through the 1.2 and 1.3 feature structs
+    }
+    VkPhysicalDeviceVulkan13Features Supported13{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceVulkan12Features Supported12{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan11Features Supported11{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+                                                 .pNext = &Supported12};
+    if (ApiVersion >= VK_API_VERSION_1_3) {
+      Supported12.pNext = &Supported13;
+    }
+    VkPhysicalDeviceFeatures2 Features2{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &Supported11};
+    vkGetPhysicalDeviceFeatures2(PhysicalDevice.PhysicalDevice, &Features2);
+
+    DescriptorIndexing = Supported12.runtimeDescriptorArray == VK_TRUE &&
+                         Supported12.descriptorBindingPartiallyBound == VK_TRUE &&
+                         Supported12.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+                         Supported12.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+                         Supported12.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+                         Supported12.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
+                         Supported12.shaderStorageBufferArrayNonUniformIndexing == VK_TRUE;
+    TimelineSemaphores = Supported12.timelineSemaphore == VK_TRUE;
+    DynamicRendering = Supported13.dynamicRendering == VK_TRUE;
+    Synchronization2 = Supported13.synchronization2 == VK_TRUE;
+
+    Enabled11 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+                 .pNext = &Enabled12,
+                 .shaderDrawParameters = Supported11.shaderDrawParameters};
+    Enabled12 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = ApiVersion >= VK_API_VERSION_1_3 ? &Enabled13 : nullptr,
+        .shaderSampledImageArrayNonUniformIndexing = Enable(DescriptorIndexing),
+        .shaderStorageBufferArrayNonUniformIndexing = Enable(DescriptorIndexing),
+        .descriptorBindingSampledImageUpdateAfterBind = Enable(DescriptorIndexing),
+        .descriptorBindingStorageBufferUpdateAfterBind = Enable(DescriptorIndexing),
+        .descriptorBindingUpdateUnusedWhilePending = Enable(DescriptorIndexing),
+        .descriptorBindingPartiallyBound = Enable(DescriptorIndexing),
+        .runtimeDescriptorArray = Enable(DescriptorIndexing),
+        .hostQueryReset = Supported12.hostQueryReset,
+        .timelineSemaphore = Enable(TimelineSemaphores),
+    };
+    Enabled13 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+                 .synchronization2 = Enable(Synchronization2),
+                 .dynamicRendering = Enable(DynamicRendering),
+                 .maintenance4 = Supported13.maintenance4};
+  }
+  // FeatureChain points into this object
+  device_capabilities(const device_capabilities &) = delete;
+  device_capabilities(device_capabilities &&) = delete;
+  auto operator=(const device_capabilities &) -> device_capabilities & = delete;
+  auto operator=(device_capabilities &&) -> device_capabilities & = delete;
+  ~device_capabilities() = default;
+
+  [[nodiscard]] auto Extensions() const -> std::vector<const char *> {
+    std::vector<const char *> Extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    if (DrawIndirectCount) {
+      Extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    if (MemoryBudget) {
+      Extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    return Extensions;
+  }
+  [[nodiscard]] auto Features() const -> VkPhysicalDeviceFeatures {
+    return {.multiDrawIndirect = Enable(MultiDrawIndirect),
+            .drawIndirectFirstInstance = Enable(DrawIndirectFirstInstance)};
+  }
+  // The pNext chain of VkDeviceCreateInfo: the 1.1, 1.2 and 1.3 feature structs the device supports
+  [[nodiscard]] auto FeatureChain() const -> const void * {
+    return ApiVersion >= VK_API_VERSION_1_2 ? &Enabled11 : nullptr;
+  }
+
+private:
+  VkPhysicalDeviceVulkan11Features Enabled11{};
+  VkPhysicalDeviceVulkan12Features Enabled12{};
+  VkPhysicalDeviceVulkan13Features Enabled13{};
+
+  static auto Enable(bool Feature) -> VkBool32 { return Feature ? VK_TRUE : VK_FALSE; }
+};
+
 struct device {
   VkDevice Device = VK_NULL_HANDLE;
   VkQueue GraphicsQueue = VK_NULL_HANDLE;
+  uint32_t QueueFamilyIndex = 0;
+  // A second queue for async compute, VK_NULL_HANDLE if there is none. It comes from a compute-only family
+  // when the device has one, since that usually maps to separate hardware, and is otherwise the graphics
+  // family's second queue.
+  VkQueue ComputeQueue = VK_NULL_HANDLE;
+  uint32_t ComputeQueueFamilyIndex = 0;
   device(const device &) = delete;
   device(device &&) = delete;
   auto operator=(const device &) -> device & = delete;
   auto operator=(device &&) -> device & = delete;
-  explicit device(physical_device PhysicalDevice, VkSurfaceKHR Surface, std::vector<const char *> deviceExtensions) {
-    float queuePriority = 1.0F;
-    uint32_t QueueFamilyIndex = PhysicalDevice.GetQueueIndex(Surface);
-    VkPhysicalDeviceFeatures deviceFeatures{};
-    VkDeviceQueueCreateInfo queueCreateInfo{
+  explicit device(physical_device PhysicalDevice, VkSurfaceKHR Surface, std::vector<const char *> deviceExtensions,
+                  VkPhysicalDeviceFeatures deviceFeatures = {}, const void *FeatureChain = nullptr) {
+    const std::array<float, 2> queuePriorities = {1.0F, 1.0F};
+    QueueFamilyIndex = PhysicalDevice.GetQueueIndex(Surface);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice.PhysicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice.PhysicalDevice, &familyCount, families.data());
+    const auto computeOnly = std::ranges::find_if(families, [](const VkQueueFamilyProperties &Family) {
+      return (Family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0U && (Family.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0U;
+    });
+    std::optional<uint32_t> computeFamily;
+    if (computeOnly != families.end()) {
+      computeFamily = static_cast<uint32_t>(computeOnly - families.begin());
+    } else if (families[QueueFamilyIndex].queueCount > 1) {
+      computeFamily = QueueFamilyIndex;
+    }
+
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos = {{
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
         .queueFamilyIndex = QueueFamilyIndex, // TODO(lyka): Choose the best on,
-        .queueCount = 1,
-        .pQueuePriorities = &queuePriority,
-    };
+        .queueCount = computeFamily == QueueFamilyIndex ? 2U : 1U,
+        .pQueuePriorities = queuePriorities.data(),
+    }};
+    if (computeFamily && *computeFamily != QueueFamilyIndex) {
+      queueCreateInfos.push_back({.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                                  .queueFamilyIndex = *computeFamily,
+                                  .queueCount = 1,
+                                  .pQueuePriorities = queuePriorities.data()});
+    }
 
     VkDeviceCreateInfo createInfo{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queueCreateInfo,
-        .ppEnabledLayerNames = deviceExtensions.data(),
+        .pNext = FeatureChain,
+        .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+        .pQueueCreateInfos = queueCreateInfos.data(),
         .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
+        .ppEnabledExtensionNames = deviceExtensions.data(),
         .pEnabledFeatures = &deviceFeatures,
     };
     if (vkCreateDevice(PhysicalDevice.PhysicalDevice, &createInfo, nullptr, &Device) != VK_SUCCESS) {
       throw std::runtime_error("failed to create logical device!");
     }
     vkGetDeviceQueue(Device, QueueFamilyIndex, 0, &GraphicsQueue);
+    if (computeFamily) {
+      ComputeQueueFamilyIndex = *computeFamily;
+      vkGetDeviceQueue(Device, ComputeQueueFamilyIndex, ComputeQueueFamilyIndex == QueueFamilyIndex ? 1 : 0,
+                       &ComputeQueue);
+    }
   };
   ~device() { vkDestroyDevice(Device, nullptr); };
 };
@@ -0,0 +1,58 @@
+#pragma once
+#include "common.hpp"
+
+struct command_pool {
+  VkCommandPool CommandPool = VK_NULL_HANDLE;
+  command_pool(VkDevice Device, uint32_t QueueFamilyIndex) : Device(Device) {
+    VkCommandPoolCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = QueueFamilyIndex,
+    };
+    if (vkCreateCommandPool(Device, &CreateInfo, nullptr, &CommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create command pool!");
+    }
+  }
+  command_pool(const command_pool &) = delete;
+  command_pool(command_pool &&) = delete;
+  auto operator=(const command_pool &) -> command_pool & = delete;
+  auto operator=(command_pool &&) -> command_pool & = delete;
+  ~command_pool() { vkDestroyCommandPool(Device, CommandPool, nullptr); }
+
+private:
+  VkDevice Device;
+};
+
+// Everything one frame in flight owns. The CPU may record frame N+1 while the GPU still runs frame N.
+struct frame {
+  VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+  VkSemaphore ImageAvailable = VK_NULL_HANDLE;
+  VkFence InFlight = VK_NULL_HANDLE; // Created signalled so the first wait returns immediately
+
+  frame(VkDevice Device, VkCommandPool CommandPool) : Device(Device) {
+    VkCommandBufferAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = CommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VkSemaphoreCreateInfo SemaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VkFenceCreateInfo FenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT};
+    if (vkAllocateCommandBuffers(Device, &AllocateInfo, &CommandBuffer) != VK_SUCCESS ||
+        vkCreateSemaphore(Device, &SemaphoreInfo, nullptr, &ImageAvailable) != VK_SUCCESS ||
+        vkCreateFence(Device, &FenceInfo, nullptr, &InFlight) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create frame resources!");
+    }
+  }
+  frame(const frame &) = delete;
+  frame(frame &&) = delete;
+  auto operator=(const frame &) -> frame & = delete;
+  auto operator=(frame &&) -> frame & = delete;
+  ~frame() {
+    vkDestroyFence(Device, InFlight, nullptr);
+    vkDestroySemaphore(Device, ImageAvailable, nullptr);
+  }
+
+private:
+  VkDevice Device;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include "common.hpp"
+#include <array>
+#include <optional>
+
+// GPU frame time from a pair of timestamp queries per frame in flight. Results are read back without
+// waiting once the frame's fence has signalled, so they lag the CPU by FramesInFlight frames.
+struct gpu_timer {
+  VkQueryPool QueryPool = VK_NULL_HANDLE;
+  bool Available = false;
+
+  gpu_timer(VkPhysicalDevice PhysicalDevice, VkDevice Device, uint32_t QueueFamilyIndex, uint32_t FramesInFlight)
+      : Device(Device), Written(FramesInFlight, false) {
+    VkPhysicalDeviceProperties Properties;
+    vkGetPhysicalDeviceProperties(PhysicalDevice, &Properties);
+    uint32_t FamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &FamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> Families(FamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &FamilyCount, Families.data());
+
+    ValidBits = Families[QueueFamilyIndex].timestampValidBits;
+    Period = Properties.limits.timestampPeriod;
+    if (ValidBits == 0 || Period == 0) {
+      return; // No timestamps on this queue, frame times will be CPU only
+    }
+    VkQueryPoolCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * FramesInFlight,
+    };
+    if (vkCreateQueryPool(Device, &CreateInfo, nullptr, &QueryPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timestamp query pool!");
+    }
+    Available = true;
+  }
+  gpu_timer(const gpu_timer &) = delete;
+  gpu_timer(gpu_timer &&) = delete;
+  auto operator=(const gpu_timer &) -> gpu_timer & = delete;
+  auto operator=(gpu_timer &&) -> gpu_timer & = delete;
+  ~gpu_timer() { vkDestroyQueryPool(Device, QueryPool, nullptr); }
+
+  // Call after the frame's fence has been waited on, before its command buffer is re-recorded.
+  auto Collect(uint32_t Frame) -> std::optional<double> {
+    if (!Available || !Written[Frame]) {
+      return std::nullopt;
+    }
+    std::array<uint64_t, 2> Timestamps{};
+    if (vkGetQueryPoolResults(Device, QueryPool, 2 * Frame, 2, sizeof(Timestamps), Timestamps.data(),
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+      return std::nullopt;
+    }
+    const uint64_t Mask = ValidBits == 64 ? ~uint64_t{0} : (uint64_t{1} << ValidBits) - 1;
+    const uint64_t Ticks = (Timestamps[1] - Timestamps[0]) & Mask;
+    return static_cast<double>(Ticks) * Period / 1e6;
+  }
+  void Begin(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if (Available) {
+      vkCmdResetQueryPool(CommandBuffer, QueryPool, 2 * Frame, 2);
+      vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, QueryPool, 2 * Frame);
+    }
+  }
+  void End(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if (Available) {
+      vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool, 2 * Frame + 1);
+      Written[Frame] = true;
+    }
+  }
+
+private:
+  VkDevice Device;
+  uint32_t ValidBits = 0;
+  float Period = 0; // Nanoseconds per tick
+  std::vector<bool> Written;
+};
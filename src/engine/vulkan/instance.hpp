@@ -1,4 +1,5 @@
 #pragma once
+#include "../config.hpp"
 #include "common.hpp"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
@@ -7,19 +8,30 @@ struct instance {
 
 public:
   VkInstance Instance{VK_NULL_HANDLE};
-  instance(SDL_Window *Window, const std::vector<const char *> &ValidationLayers) {
+  uint32_t ApiVersion = VK_API_VERSION_1_0; // What the instance was created with; devices may support less
+  // Validation enables the Khronos layer and the debug utils extension; neither exists without KALAN_VALIDATION.
+  instance(SDL_Window *Window, bool Validation) {
+    std::vector<const char *> ValidationLayers;
+#if KALAN_VALIDATION
+    if (Validation) {
+      ValidationLayers.push_back("VK_LAYER_KHRONOS_validation");
+    }
     if (!CheckValidationLayerSupport(ValidationLayers)) {
       throw std::runtime_error("Validation layers requested but not available!");
     }
-    std::vector<const char *> ExtensionNames = GetRequiredExtensions(Window);
+#else
+    Validation = false;
+#endif
+    std::vector<const char *> ExtensionNames = GetRequiredExtensions(Window, Validation);
     // TODO(lyka): Maybe I should use vkEnumerateInstanceExtensionProperties
+    ApiVersion = GetApiVersion();
     VkApplicationInfo AppInfo = {
         .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
         .pApplicationName = "Kalan Engine",
         .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
         .pEngineName = "No Engine",
         .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion = VK_API_VERSION_1_0,
+        .apiVersion = ApiVersion,
     };
     VkInstanceCreateInfo InstanceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -35,6 +47,16 @@ public:
   }
 
 private:
+  // The newest version up to 1.3 the loader has. A 1.0 loader rejects any version above 1.0, so ask first.
+  static auto GetApiVersion() -> uint32_t {
+    auto EnumerateVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+    uint32_t Version = VK_API_VERSION_1_0;
+    if (EnumerateVersion == nullptr || EnumerateVersion(&Version) != VK_SUCCESS) {
+      return VK_API_VERSION_1_0;
+    }
+    return std::min(Version, VK_API_VERSION_1_3);
+  }
   static auto CheckValidationLayerSupport(const std::vector<const char *> &ValidationLayers) -> bool {
     uint32_t LayerCount = 0;
     vkEnumerateInstanceLayerProperties(&LayerCount, nullptr);
@@ -0,0 +1,213 @@
+#pragma once
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "common.hpp"
+#include "device.hpp"
+
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum class memory_pressure : uint8_t {
+  None,
+  Elevated, // Close to the budget: stop growing caches
+  Critical, // Over the budget: the driver may start paging
+};
+
+// Keeps device-local memory under the budget the driver gives the process. With VK_EXT_memory_budget the
+// driver reports usage and budget per heap, including what other processes leave us; without it the budget
+// is a fixed share of the heap sizes and usage is what the engine reports.
+//
+// Resources that can be dropped and recreated register with a priority and an evict callback and are touched
+// on every frame that uses them. When usage exceeds the budget, the lowest priority resources unused for the
+// longest are evicted first; nothing touched since the last Update is. Memory returns to the driver only once
+// no frame in flight reads it, so evicted bytes count as free until then and one overshoot is not paid twice.
+// Pressure listeners hear about every change of pressure level, e.g. to lower texture or shadow resolution.
+// Everything here runs on the render thread.
+class memory_budget {
+public:
+  using handle = uint32_t;
+  using evictor = std::function<void()>; // Releases the resource; its handle is invalid afterwards
+  struct report {
+    memory_pressure Pressure;
+    uint64_t UsedBytes;
+    uint64_t BudgetBytes;
+  };
+  using listener = std::function<void(const report &)>;
+  using listener_handle = uint32_t;
+
+  memory_budget(VkPhysicalDevice PhysicalDevice, const device_capabilities &Capabilities, uint32_t FramesInFlight)
+      : PhysicalDevice(PhysicalDevice), Extension(Capabilities.MemoryBudget), FramesInFlight(FramesInFlight) {
+    vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &Properties);
+    if (!Extension) {
+      KLOG(Info, Vulkan, "VK_EXT_memory_budget unsupported, budgeting {}% of device-local heaps",
+           FallbackPercent);
+    }
+    Measure(0, 0);
+  }
+
+  auto Add(uint64_t Bytes, uint32_t Priority, evictor Evict) -> handle {
+    entry Entry{.Bytes = Bytes, .Priority = Priority, .LastUsed = Frame, .Evict = std::move(Evict)};
+    Tracked += Bytes;
+    if (FreeHandles.empty()) {
+      Entries.push_back(std::move(Entry));
+      return static_cast<handle>(Entries.size() - 1);
+    }
+    const handle Handle = FreeHandles.back();
+    FreeHandles.pop_back();
+    Entries[Handle] = std::move(Entry);
+    return Handle;
+  }
+  // For resources the owner destroys itself; evicted ones are already gone.
+  void Remove(handle Resource) {
+    Tracked -= Entries[Resource].Bytes;
+    Entries[Resource] = {};
+    FreeHandles.push_back(Resource);
+  }
+  void Touch(handle Resource) { Entries[Resource].LastUsed = Frame; }
+  // Called with the current report whenever the pressure level changes. Listeners that capture their owner
+  // are removed by it before it goes away.
+  auto OnPressure(listener Listener) -> listener_handle {
+    Listeners.push_back(std::move(Listener));
+    return static_cast<listener_handle>(Listeners.size() - 1);
+  }
+  void RemoveListener(listener_handle Listener) { Listeners[Listener] = {}; }
+
+  // Call once per frame, after the frame's fence has been waited on. OtherBytes is device-local memory the
+  // engine holds outside registered resources; only the fallback needs it, the extension measures everything.
+  // FreeingBytes is memory the engine has already released but frames in flight still hold, e.g. textures
+  // that dropped levels; the extension counts it as used, so it is subtracted like evicted resources.
+  void Update(uint64_t OtherBytes, uint64_t FreeingBytes = 0) {
+    KPROFILE_SCOPE("memory_budget::Update");
+    while (!Freeing.empty() && Freeing.front().Frame + FramesInFlight <= Frame) {
+      Freeing.pop_front();
+    }
+    Measure(OtherBytes, FreeingBytes);
+    if (Used > Budget) {
+      Evict();
+    }
+
+    memory_pressure Pressure = memory_pressure::None;
+    if (Used > Budget) {
+      Pressure = memory_pressure::Critical;
+    } else if (Used * 100 > Budget * ElevatedPercent) {
+      Pressure = memory_pressure::Elevated;
+    }
+    if (Pressure != Current) {
+      if (Pressure > Current) {
+        KLOG(Warning, Vulkan, "memory pressure rose to {}, {} of {} MiB used", static_cast<int>(Pressure),
+             Used >> 20, Budget >> 20);
+      } else {
+        KLOG(Info, Vulkan, "memory pressure fell to {}, {} of {} MiB used", static_cast<int>(Pressure), Used >> 20,
+             Budget >> 20);
+      }
+      Current = Pressure;
+      for (const listener &Listener : Listeners) {
+        if (Listener) {
+          Listener(GetReport());
+        }
+      }
+    }
+    Frame++;
+  }
+
+  [[nodiscard]] auto GetReport() const -> report {
+    return {.Pressure = Current, .UsedBytes = Used, .BudgetBytes = Budget};
+  }
+  // How much a cache holding HeldBytes of the used memory may hold to keep the pressure down: what it holds
+  // plus what is left before the pressure rises, or less whatever is used beyond that.
+  [[nodiscard]] auto Share(uint64_t HeldBytes) const -> uint64_t {
+    const uint64_t Comfortable = Budget * ElevatedPercent / 100;
+    return Comfortable >= Used ? HeldBytes + (Comfortable - Used) : HeldBytes - std::min(HeldBytes, Used - Comfortable);
+  }
+  [[nodiscard]] auto HasExtension() const -> bool { return Extension; }
+
+private:
+  // Drivers, the compositor and other processes share the heap when the extension cannot tell us how much
+  static constexpr uint64_t FallbackPercent = 80;
+  static constexpr uint64_t ElevatedPercent = 90;
+
+  struct entry {
+    uint64_t Bytes = 0;
+    uint32_t Priority = 0;
+    uint64_t LastUsed = 0;
+    evictor Evict; // Empty for free handles
+  };
+  struct freeing {
+    uint64_t Bytes;
+    uint64_t Frame;
+  };
+
+  VkPhysicalDevice PhysicalDevice;
+  VkPhysicalDeviceMemoryProperties Properties;
+  bool Extension;
+  uint32_t FramesInFlight;
+  uint64_t Frame = 0;
+  uint64_t Used = 0, Budget = 0;
+  uint64_t Tracked = 0; // Registered bytes, for the fallback
+  memory_pressure Current = memory_pressure::None;
+  std::vector<entry> Entries;
+  std::vector<handle> FreeHandles;
+  std::vector<listener> Listeners; // Empty where removed
+  std::deque<freeing> Freeing; // Evicted, but still held by frames in flight; extension only
+
+  // Sums usage and budget over the device-local heaps
+  void Measure(uint64_t OtherBytes, uint64_t FreeingBytes) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT HeapBudget{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+    if (Extension) {
+      VkPhysicalDeviceMemoryProperties2 Properties2{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+                                                    .pNext = &HeapBudget};
+      vkGetPhysicalDeviceMemoryProperties2(PhysicalDevice, &Properties2);
+    }
+    Used = Budget = 0;
+    for (uint32_t i = 0; i < Properties.memoryHeapCount; i++) {
+      if ((Properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0) {
+        continue;
+      }
+      Used += Extension ? HeapBudget.heapUsage[i] : 0;
+      Budget += Extension ? HeapBudget.heapBudget[i] : Properties.memoryHeaps[i].size * FallbackPercent / 100;
+    }
+    if (!Extension) {
+      Used = Tracked + OtherBytes; // Evicted resources are no longer tracked
+      return;
+    }
+    uint64_t Pending = FreeingBytes;
+    for (const freeing &Evicted : Freeing) {
+      Pending += Evicted.Bytes;
+    }
+    Used -= std::min(Used, Pending);
+  }
+
+  // Lowest priority first, then least recently used
+  void Evict() {
+    std::vector<handle> Victims;
+    for (handle Resource = 0; Resource < Entries.size(); Resource++) {
+      if (Entries[Resource].Evict && Entries[Resource].LastUsed < Frame) {
+        Victims.push_back(Resource);
+      }
+    }
+    std::ranges::sort(Victims, [&](handle A, handle B) {
+      return std::pair(Entries[A].Priority, Entries[A].LastUsed) < std::pair(Entries[B].Priority, Entries[B].LastUsed);
+    });
+    uint32_t Count = 0;
+    for (const handle Resource : Victims) {
+      if (Used <= Budget) {
+        break;
+      }
+      const uint64_t Bytes = Entries[Resource].Bytes;
+      const evictor Evict = std::move(Entries[Resource].Evict);
+      Remove(Resource);
+      Evict();
+      Used -= std::min(Used, Bytes);
+      if (Extension) {
+        Freeing.push_back({.Bytes = Bytes, .Frame = Frame});
+      }
+      Count++;
+    }
+    if (Count != 0) {
+      KLOG(Info, Vulkan, "evicted {} resources, {} of {} MiB used", Count, Used >> 20, Budget >> 20);
+    }
+  }
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "../profiler.hpp"
 #include "common.hpp"
 #include <algorithm>
 #include <cstring>
@@ -8,6 +9,7 @@ struct physical_device {
   VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
 
   explicit physical_device(VkInstance instance, VkSurfaceKHR Surface) {
+    KPROFILE_SCOPE("physical_device::select");
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
     if (deviceCount == 0) {
@@ -58,6 +60,16 @@ struct physical_device {
     return -1;
   }
 
+  [[nodiscard]] auto HasExtension(const char *Name) const -> bool {
+    uint32_t Count = 0;
+    vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &Count, nullptr);
+    std::vector<VkExtensionProperties> Available(Count);
+    vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &Count, Available.data());
+    return std::ranges::any_of(Available, [&](const VkExtensionProperties &Extension) {
+      return strcmp(Extension.extensionName, Name) == 0;
+    });
+  }
+
   struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities{};
     std::vector<VkSurfaceFormatKHR> formats;
@@ -0,0 +1,138 @@
+#pragma once
+#include "../log.hpp"
+#include "../shader/shader_library.hpp"
+#include "common.hpp"
+
+#include <deque>
+#include <span>
+#include <unordered_map>
+
+// Shader modules and the pipelines built from them. Update, called at a frame boundary, rebuilds every
+// pipeline whose shaders the library has recompiled. Replaced pipelines are destroyed once no frame in
+// flight can still be using them; a pipeline that fails to rebuild keeps its previous version.
+// Builders usually refer to their owner, which must Destroy its pipelines before it goes away.
+class pipeline_registry {
+public:
+  using handle = uint32_t;
+  // Builds a pipeline from one module per shader, in the order the shaders were registered.
+  using builder = std::function<VkPipeline(std::span<const VkShaderModule>)>;
+
+  pipeline_registry(VkDevice Device, shader_library &Shaders, uint32_t FramesInFlight)
+      : Device(Device), Shaders(Shaders), FramesInFlight(FramesInFlight) {}
+  pipeline_registry(const pipeline_registry &) = delete;
+  pipeline_registry(pipeline_registry &&) = delete;
+  auto operator=(const pipeline_registry &) -> pipeline_registry & = delete;
+  auto operator=(pipeline_registry &&) -> pipeline_registry & = delete;
+  // The owner waits for the device to go idle first
+  ~pipeline_registry() {
+    for (const pipeline &Pipeline : Pipelines) {
+      vkDestroyPipeline(Device, Pipeline.Pipeline, nullptr);
+    }
+    for (const retired &Old : Retired) {
+      vkDestroyPipeline(Device, Old.Pipeline, nullptr);
+    }
+    for (const auto &[Shader, Module] : Modules) {
+      vkDestroyShaderModule(Device, Module, nullptr);
+    }
+  }
+
+  auto Create(std::vector<shader_library::handle> Stages, builder Build) -> handle {
+    pipeline Pipeline{.Stages = std::move(Stages), .Build = std::move(Build)};
+    Pipeline.Pipeline = Pipeline.Build(GetModules(Pipeline.Stages));
+    if (Pipeline.Pipeline == VK_NULL_HANDLE) {
+      throw std::runtime_error("failed to create pipeline!");
+    }
+    if (FreeHandles.empty()) {
+      Pipelines.push_back(std::move(Pipeline));
+      return static_cast<handle>(Pipelines.size() - 1);
+    }
+    const handle Handle = FreeHandles.back();
+    FreeHandles.pop_back();
+    Pipelines[Handle] = std::move(Pipeline);
+    return Handle;
+  }
+  // Retires the pipeline and drops its builder, so hot reload never calls into a destroyed owner.
+  void Destroy(handle Pipeline) {
+    Retired.push_back({.Pipeline = Pipelines[Pipeline].Pipeline, .Frame = FrameNumber});
+    Pipelines[Pipeline] = {};
+    FreeHandles.push_back(Pipeline);
+  }
+  [[nodiscard]] auto Get(handle Pipeline) const -> VkPipeline { return Pipelines[Pipeline].Pipeline; }
+
+  // Call once per frame, after the frame's fence has been waited on and before any recording.
+  void Update() {
+    FrameNumber++;
+    while (!Retired.empty() && Retired.front().Frame + FramesInFlight <= FrameNumber) {
+      vkDestroyPipeline(Device, Retired.front().Pipeline, nullptr);
+      Retired.pop_front();
+    }
+    const std::vector<shader_library::handle> Updated = Shaders.Poll();
+    if (Updated.empty()) {
+      return;
+    }
+    KPROFILE_SCOPE("pipeline_registry::Reload");
+    for (shader_library::handle Shader : Updated) {
+      if (const auto It = Modules.find(Shader); It != Modules.end()) {
+        vkDestroyShaderModule(Device, It->second, nullptr); // Modules are not referenced after pipeline creation
+        Modules.erase(It);
+      }
+    }
+    for (pipeline &Pipeline : Pipelines) {
+      if (std::ranges::find_first_of(Pipeline.Stages, Updated) == Pipeline.Stages.end()) {
+        continue;
+      }
+      VkPipeline Rebuilt = VK_NULL_HANDLE;
+      try {
+        Rebuilt = Pipeline.Build(GetModules(Pipeline.Stages));
+      } catch (const std::exception &Error) {
+        KLOG(Error, Shader, "pipeline rebuild failed: {}", Error.what());
+      }
+      if (Rebuilt != VK_NULL_HANDLE) {
+        Retired.push_back({.Pipeline = Pipeline.Pipeline, .Frame = FrameNumber});
+        Pipeline.Pipeline = Rebuilt;
+      }
+    }
+  }
+
+private:
+  struct pipeline {
+    std::vector<shader_library::handle> Stages;
+    builder Build; // Empty, like Stages, for destroyed handles
+    VkPipeline Pipeline = VK_NULL_HANDLE;
+  };
+  struct retired {
+    VkPipeline Pipeline;
+    uint64_t Frame;
+  };
+
+  VkDevice Device;
+  shader_library &Shaders;
+  uint32_t FramesInFlight;
+  uint64_t FrameNumber = 0;
+  std::unordered_map<shader_library::handle, VkShaderModule> Modules;
+  std::vector<pipeline> Pipelines;
+  std::vector<handle> FreeHandles;
+  std::deque<retired> Retired;
+  std::vector<VkShaderModule> Scratch;
+
+  auto GetModules(std::span<const shader_library::handle> Stages) -> std::span<const VkShaderModule> {
+    Scratch.clear();
+    for (shader_library::handle Shader : Stages) {
+      auto [It, Inserted] = Modules.try_emplace(Shader, VK_NULL_HANDLE);
+      if (Inserted) {
+        const std::vector<uint32_t> &Spirv = Shaders.GetSpirv(Shader);
+        VkShaderModuleCreateInfo CreateInfo{
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = Spirv.size() * sizeof(uint32_t),
+            .pCode = Spirv.data(),
+        };
+        if (vkCreateShaderModule(Device, &CreateInfo, nullptr, &It->second) != VK_SUCCESS) {
+          Modules.erase(It);
+          throw std::runtime_error("failed to create shader module!");
+        }
+      }
+      Scratch.push_back(It->second);
+    }
+    return Scratch;
+  }
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include "../log.hpp"
+#include "../shader/shader_library.hpp"
+#include "pipelines.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+
+// One pipeline per combination of optional shader features, built the first time a combination is asked for.
+// A variant is named by a bitmask whose bit i enables Features[i]; bits past the declared features are ignored.
+//
+// A Define feature is compiled in: the shader sees #define NAME, so it can change resources and interfaces, but
+// every combination of defines is a separate compile. A Specialization feature is a VkBool32 specialization
+// constant, declared in GLSL as layout(constant_id = ID) const bool NAME = false; the SPIR-V is shared and the
+// driver folds the branches away when it builds the pipeline. Variants that differ only in specialization
+// constants share their shader modules, and the library shares the SPIR-V of equal defines across owners.
+// Pipelines live in the registry, so hot reload rebuilds every variant built so far.
+// Render thread only.
+class shader_variants {
+public:
+  using mask = uint32_t;
+  struct feature {
+    enum kind : uint8_t { Define, Specialization };
+    std::string Name;
+    kind Kind = Define;
+    uint32_t ConstantId = 0; // Specialization only
+  };
+  // As pipeline_registry::builder; Specialization belongs in every stage's create info and may be null.
+  using builder = std::function<VkPipeline(std::span<const VkShaderModule>, const VkSpecializationInfo *)>;
+
+  shader_variants(shader_library &Shaders, pipeline_registry &Pipelines, std::vector<std::filesystem::path> Stages,
+                  std::vector<feature> Features, builder Build)
+      : Shaders(Shaders), Pipelines(Pipelines), Stages(std::move(Stages)), Features(std::move(Features)),
+        Build(std::move(Build)) {
+    if (this->Features.size() > std::numeric_limits<mask>::digits) {
+      throw std::runtime_error("too many shader features!");
+    }
+  }
+  // The registry's builders refer to this object, so the variants leave the registry with it
+  shader_variants(const shader_variants &) = delete;
+  shader_variants(shader_variants &&) = delete;
+  auto operator=(const shader_variants &) -> shader_variants & = delete;
+  auto operator=(shader_variants &&) -> shader_variants & = delete;
+  ~shader_variants() {
+    for (const auto &[Enabled, Pipeline] : Variants) {
+      Pipelines.Destroy(Pipeline);
+    }
+  }
+
+  // Compiles the variant on first use, which throws like shader_library::Load if it does not compile.
+  auto Get(mask Enabled) -> pipeline_registry::handle {
+    Enabled &= AllFeatures();
+    if (const auto It = Variants.find(Enabled); It != Variants.end()) {
+      return It->second;
+    }
+    std::vector<shader_define> Defines;
+    std::vector<VkSpecializationMapEntry> Entries;
+    std::vector<VkBool32> Values;
+    for (uint32_t i = 0; i < Features.size(); i++) {
+      const bool On = ((Enabled >> i) & 1U) != 0;
+      if (Features[i].Kind == feature::Define && On) {
+        Defines.push_back({.Name = Features[i].Name, .Value = ""});
+      } else if (Features[i].Kind == feature::Specialization) {
+        Entries.push_back({.constantID = Features[i].ConstantId,
+                           .offset = static_cast<uint32_t>(Values.size() * sizeof(VkBool32)),
+                           .size = sizeof(VkBool32)});
+        Values.push_back(On ? VK_TRUE : VK_FALSE);
+      }
+    }
+    std::vector<shader_library::handle> Handles;
+    for (const std::filesystem::path &Stage : Stages) {
+      Handles.push_back(Shaders.Load(Stage, Defines));
+    }
+    // The registry runs the builder again on hot reload, so it owns its copy of the constants
+    const pipeline_registry::handle Pipeline = Pipelines.Create(
+        std::move(Handles), [this, Entries = std::move(Entries),
+                             Values = std::move(Values)](std::span<const VkShaderModule> Modules) {
+          const VkSpecializationInfo Specialization{.mapEntryCount = static_cast<uint32_t>(Entries.size()),
+                                                    .pMapEntries = Entries.data(),
+                                                    .dataSize = Values.size() * sizeof(VkBool32),
+                                                    .pData = Values.data()};
+          return Build(Modules, Entries.empty() ? nullptr : &Specialization);
+        });
+    KLOG(Debug, Shader, "built variant {:#x} of {}, {} so far", Enabled, Stages.front().generic_string(),
+         Variants.size() + 1);
+    Variants.emplace(Enabled, Pipeline);
+    return Pipeline;
+  }
+
+  // Bit of the named feature, for building masks.
+  [[nodiscard]] auto Bit(std::string_view Name) const -> mask {
+    for (uint32_t i = 0; i < Features.size(); i++) {
+      if (Features[i].Name == Name) {
+        return mask{1} << i;
+      }
+    }
+    throw std::runtime_error("unknown shader feature " + std::string(Name) + "!");
+  }
+
+private:
+  shader_library &Shaders;
+  pipeline_registry &Pipelines;
+  std::vector<std::filesystem::path> Stages;
+  std::vector<feature> Features;
+  builder Build;
+  std::unordered_map<mask, pipeline_registry::handle> Variants;
+
+  [[nodiscard]] auto AllFeatures() const -> mask {
+    return Features.size() == std::numeric_limits<mask>::digits ? ~mask{0} : (mask{1} << Features.size()) - 1;
+  }
+};
@@ -1,34 +1,82 @@
+#include "../log.hpp"
+#include "../profiler.hpp"
 #include "common.hpp"
 #include "physical_device.hpp"
 
+#include <algorithm>
+#include <limits>
+
 struct swapchain {
   VkSwapchainKHR Swapchain{};
   std::vector<VkImage> SwapchainImages;
   std::vector<VkImageView> SwapchainImageViews; // TODO(lyka): Combine image and view
+  std::vector<VkSemaphore> RenderFinished;      // One per image, presentation waits on it
   VkSurfaceFormatKHR SurfaceFormat{};
-  swapchain(physical_device PhysicalDevice, VkDevice Device, VkSurfaceKHR surface, VkExtent2D extent) : Device(Device) {
-    physical_device::SwapChainSupportDetails SwapchainDetails = PhysicalDevice.GetSwapchainSupport(surface);
+  VkExtent2D Extent{};
+  // PresentMode falls back to FIFO, the only mode every device supports, when the surface lacks it.
+  // Extent is only a hint: surfaces that report their size get a swapchain of exactly that size.
+  swapchain(physical_device PhysicalDevice, VkDevice Device, VkSurfaceKHR surface, VkExtent2D extent,
+            VkPresentModeKHR PresentMode = VK_PRESENT_MODE_FIFO_KHR)
+      : Device(Device), PhysicalDevice(PhysicalDevice), Surface(surface), PresentMode(PresentMode) {
+    Create(extent, VK_NULL_HANDLE);
+  }
+  ~swapchain() {
+    DestroyImages();
+    vkDestroySwapchainKHR(Device, Swapchain, nullptr);
+  }
+
+  // For a resized window or an out of date surface. The owner waits for the device to go idle first;
+  // the old swapchain is handed to the driver so it can reuse its images.
+  void Recreate(VkExtent2D extent) {
+    KLOG(Info, Vulkan, "recreating swapchain, window is {}x{}", extent.width, extent.height);
+    DestroyImages();
+    VkSwapchainKHR Old = Swapchain;
+    Create(extent, Old);
+    vkDestroySwapchainKHR(Device, Old, nullptr);
+  }
+
+private:
+  VkDevice Device;
+  physical_device PhysicalDevice;
+  VkSurfaceKHR Surface;
+  VkPresentModeKHR PresentMode;
+
+  void Create(VkExtent2D extent, VkSwapchainKHR OldSwapchain) {
+    KPROFILE_SCOPE("swapchain::create");
+    physical_device::SwapChainSupportDetails SwapchainDetails = PhysicalDevice.GetSwapchainSupport(Surface);
+    const VkSurfaceCapabilitiesKHR &Capabilities = SwapchainDetails.capabilities;
+    // A current width of UINT32_MAX means the surface takes its size from the swapchain
+    Extent = Capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()
+                 ? Capabilities.currentExtent
+                 : VkExtent2D{
+                       std::clamp(extent.width, Capabilities.minImageExtent.width, Capabilities.maxImageExtent.width),
+                       std::clamp(extent.height, Capabilities.minImageExtent.height,
+                                  Capabilities.maxImageExtent.height)};
     SurfaceFormat = find_if_or(
         SwapchainDetails.formats,
         [](const auto &format) {
           return format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
         },
         SwapchainDetails.formats[0]);
+    if (std::ranges::find(SwapchainDetails.presentModes, PresentMode) == SwapchainDetails.presentModes.end()) {
+      KLOG(Warning, Vulkan, "present mode {} unsupported, using FIFO", static_cast<int>(PresentMode));
+      PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    }
     VkSwapchainCreateInfoKHR createInfo{
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-        .surface = surface,
+        .surface = Surface,
         .minImageCount = SwapchainDetails.capabilities.minImageCount + 1,
         .imageFormat = SurfaceFormat.format,
         .imageColorSpace = SurfaceFormat.colorSpace,
-        .imageExtent = extent,
+        .imageExtent = Extent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .preTransform = SwapchainDetails.capabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-        .presentMode = VK_PRESENT_MODE_FIFO_KHR, // TODO(lyka): Maybe use mailbox?
+        .presentMode = PresentMode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE,
+        .oldSwapchain = OldSwapchain,
     };
     if (vkCreateSwapchainKHR(Device, &createInfo, nullptr, &Swapchain) != VK_SUCCESS) {
       throw std::runtime_error("failed to create swap chain!");
@@ -37,18 +85,29 @@ struct swapchain {
     vkGetSwapchainImagesKHR(Device, Swapchain, &ImageCount, nullptr);
     SwapchainImages.resize(ImageCount);
     vkGetSwapchainImagesKHR(Device, Swapchain, &ImageCount, SwapchainImages.data());
+    SwapchainImageViews = createImageViews();
+
+    VkSemaphoreCreateInfo SemaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    RenderFinished.resize(ImageCount);
+    for (VkSemaphore &Semaphore : RenderFinished) {
+      if (vkCreateSemaphore(Device, &SemaphoreInfo, nullptr, &Semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create semaphore!");
+      }
+    }
   }
-  ~swapchain() {
+  void DestroyImages() {
+    for (VkSemaphore Semaphore : RenderFinished) {
+      vkDestroySemaphore(Device, Semaphore, nullptr);
+    }
     for (auto *imageView : SwapchainImageViews) {
       vkDestroyImageView(Device, imageView, nullptr);
     }
-    vkDestroySwapchainKHR(Device, Swapchain, nullptr);
+    RenderFinished.clear();
+    SwapchainImageViews.clear();
+    SwapchainImages.clear();
   }
-
-private:
-  VkDevice Device;
   auto createImageViews() -> std::vector<VkImageView> {
-    std::vector<VkImageView> SwapchainImageViews;
+    std::vector<VkImageView> SwapchainImageViews(SwapchainImages.size());
     for (int i = 0; i < SwapchainImages.size(); i++) {
       VkImageViewCreateInfo createInfo{
           .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
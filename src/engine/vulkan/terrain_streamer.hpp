@@ -0,0 +1,186 @@
+#pragma once
+#include "../profiler.hpp"
+#include "../terrain.hpp"
+#include "buffer.hpp"
+#include "common.hpp"
+#include "memory_budget.hpp"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+// Uploads the meshes terrain generates and draws the resident chunks. Every chunk owns one device-local
+// buffer holding its vertices followed by its indices. A rebuilt chunk keeps drawing its previous buffer
+// until the new one has been copied, and replaced buffers are destroyed once no frame in flight reads them.
+// Uploads go through this frame's staging buffer; meshes that do not fit wait for the next frame, so a
+// burst of finished chunks spreads over several frames instead of stalling one.
+//
+// Chunk buffers count against the memory budget. Over budget, the budget may drop the buffers of chunks that
+// have not been drawn lately; such a chunk stays resident without a mesh and is rebuilt once it enters the frustum
+// again. Under critical pressure the terrain switches to coarser levels of detail until the pressure is gone.
+// Everything here runs on the render thread.
+class terrain_streamer {
+public:
+  static constexpr uint32_t BudgetPriority = 1; // Chunks are rebuilt in the background, so cheap to drop
+
+  terrain_streamer(VkPhysicalDevice PhysicalDevice, VkDevice Device, uint32_t FramesInFlight, terrain &Terrain,
+                   memory_budget &Memory, VkDeviceSize StagingBytes = VkDeviceSize{8} << 20)
+      : Terrain(Terrain), Memory(Memory), PhysicalDevice(PhysicalDevice), Device(Device),
+        FramesInFlight(FramesInFlight), LodDistance(Terrain.GetSettings().LodDistance) {
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      Staging.push_back(std::make_unique<buffer>(PhysicalDevice, Device, StagingBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+    }
+    Listener = Memory.OnPressure([this](const memory_budget::report &Report) {
+      if (Report.Pressure == memory_pressure::Critical) {
+        this->Terrain.SetLodDistance(LodDistance / 2);
+      } else if (Report.Pressure == memory_pressure::None) {
+        this->Terrain.SetLodDistance(LodDistance);
+      }
+    });
+  }
+  terrain_streamer(const terrain_streamer &) = delete;
+  terrain_streamer(terrain_streamer &&) = delete;
+  auto operator=(const terrain_streamer &) -> terrain_streamer & = delete;
+  auto operator=(terrain_streamer &&) -> terrain_streamer & = delete;
+  // The owner waits for the device to go idle first
+  ~terrain_streamer() {
+    Memory.RemoveListener(Listener);
+    for (const auto &[Id, Chunk] : Chunks) {
+      if (Chunk.Buffer != nullptr) {
+        Memory.Remove(Chunk.Budget);
+      }
+    }
+  }
+
+  // Records this frame's uploads. Call once per frame after terrain::Update, once the frame's fence has been
+  // waited on and before Draw.
+  void Record(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    KPROFILE_SCOPE("terrain_streamer::Record");
+    FrameNumber++;
+    while (!Retired.empty() && Retired.front().Frame + FramesInFlight <= FrameNumber) {
+      Retired.pop_front();
+    }
+    for (const terrain::chunk_id Chunk : Terrain.TakeEvicted()) {
+      if (const auto Found = Chunks.find(Chunk); Found != Chunks.end()) {
+        Release(Found->second);
+        Chunks.erase(Found);
+      }
+    }
+
+    buffer &Upload = *Staging[Frame];
+    VkDeviceSize UploadOffset = 0;
+    std::deque<std::unique_ptr<terrain::chunk_mesh>> &Ready = Terrain.GetReady();
+    while (!Ready.empty()) {
+      const terrain::chunk_mesh &Mesh = *Ready.front();
+      const VkDeviceSize VertexBytes = Mesh.Vertices.size() * sizeof(mesh_format::vertex);
+      const VkDeviceSize IndexBytes = Mesh.Indices.size() * sizeof(uint32_t);
+      if (UploadOffset + VertexBytes + IndexBytes > Upload.Size) {
+        if (UploadOffset == 0) {
+          throw std::runtime_error("terrain chunk does not fit in the staging buffer!");
+        }
+        break; // The rest waits for the next frame
+      }
+      std::memcpy(Upload.Mapped + UploadOffset, Mesh.Vertices.data(), VertexBytes);
+      std::memcpy(Upload.Mapped + UploadOffset + VertexBytes, Mesh.Indices.data(), IndexBytes);
+      auto Buffer = std::make_unique<buffer>(PhysicalDevice, Device, VertexBytes + IndexBytes,
+                                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      const VkBufferCopy Copy{.srcOffset = UploadOffset, .dstOffset = 0, .size = VertexBytes + IndexBytes};
+      vkCmdCopyBuffer(CommandBuffer, Upload.Buffer, Buffer->Buffer, 1, &Copy);
+      // Indices start right after the vertices, which keeps them 4-byte aligned
+      UploadOffset += VertexBytes + IndexBytes;
+
+      chunk &Chunk = Chunks[Mesh.Chunk];
+      Release(Chunk);
+      const terrain::chunk_id Id = Mesh.Chunk;
+      Chunk = {.Buffer = std::move(Buffer),
+               .Budget = Memory.Add(VertexBytes + IndexBytes, BudgetPriority, [this, Id] { Drop(Id); }),
+               .IndexOffset = VertexBytes,
+               .IndexCount = static_cast<uint32_t>(Mesh.Indices.size()),
+               .Min = Mesh.Min,
+               .Max = Mesh.Max};
+      Ready.pop_front();
+    }
+    if (UploadOffset != 0) {
+      VkMemoryBarrier Barrier{
+          .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+      };
+      vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1,
+                           &Barrier, 0, nullptr, 0, nullptr);
+    }
+  }
+
+  // Draws every resident chunk in the camera frustum with whatever pipeline the owner has bound, and asks
+  // for the meshes of dropped chunks that came into view. Vertices are mesh_format::vertex in world space.
+  void Draw(VkCommandBuffer CommandBuffer, const mth::camera<float> &Camera) {
+    KPROFILE_SCOPE("terrain_streamer::Draw");
+    const mth::frustum<float> Frustum(Camera.MatrVP);
+    DrawnCount = 0;
+    for (const auto &[Id, Chunk] : Chunks) {
+      if (!Frustum.IsBoxVisible(Chunk.Min, Chunk.Max)) {
+        continue;
+      }
+      if (Chunk.Buffer == nullptr) {
+        Terrain.Rebuild(Id); // Its mesh replaces the empty chunk once uploaded
+        continue;
+      }
+      Memory.Touch(Chunk.Budget);
+      const VkDeviceSize Offset = 0;
+      vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &Chunk.Buffer->Buffer, &Offset);
+      vkCmdBindIndexBuffer(CommandBuffer, Chunk.Buffer->Buffer, Chunk.IndexOffset, VK_INDEX_TYPE_UINT32);
+      vkCmdDrawIndexed(CommandBuffer, Chunk.IndexCount, 1, 0, 0, 0);
+      DrawnCount++;
+    }
+  }
+
+  [[nodiscard]] auto GetResidentCount() const -> size_t { return Chunks.size(); }
+  [[nodiscard]] auto GetDrawnCount() const -> size_t { return DrawnCount; }
+
+private:
+  struct chunk {
+    std::unique_ptr<buffer> Buffer; // Null once the memory budget dropped it
+    memory_budget::handle Budget = 0;
+    VkDeviceSize IndexOffset = 0;
+    uint32_t IndexCount = 0;
+    mth::vec3<float> Min, Max;
+  };
+  struct retired {
+    std::unique_ptr<buffer> Buffer;
+    uint64_t Frame;
+  };
+
+  terrain &Terrain;
+  memory_budget &Memory;
+  memory_budget::listener_handle Listener = 0;
+  VkPhysicalDevice PhysicalDevice;
+  VkDevice Device;
+  uint32_t FramesInFlight;
+  float LodDistance; // The terrain's own, restored when the pressure falls
+  uint64_t FrameNumber = 0;
+  size_t DrawnCount = 0;
+  std::unordered_map<terrain::chunk_id, chunk> Chunks;
+  std::deque<retired> Retired;
+  std::vector<std::unique_ptr<buffer>> Staging;
+
+  // Retires the chunk's buffer, if it still has one, and stops counting it
+  void Release(chunk &Chunk) {
+    if (Chunk.Buffer != nullptr) {
+      Memory.Remove(Chunk.Budget);
+      Retire(std::move(Chunk.Buffer));
+    }
+  }
+  // Evictor: the budget has already forgotten the buffer
+  void Drop(terrain::chunk_id Id) { Retire(std::move(Chunks.at(Id).Buffer)); }
+
+  void Retire(std::unique_ptr<buffer> Buffer) {
+    if (Buffer != nullptr) {
+      Retired.push_back({.Buffer = std::move(Buffer), .Frame = FrameNumber});
+    }
+  }
+};
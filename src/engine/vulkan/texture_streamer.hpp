@@ -0,0 +1,328 @@
+#pragma once
+#include "../assets/texture_file.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "../texture_residency.hpp"
+#include "buffer.hpp"
+#include "common.hpp"
+
+#include <deque>
+#include <memory>
+
+// Streams block-compressed textures from mapped files into VRAM under a budget. Each texture owns
+// an image that holds exactly its resident levels. When residency changes the image is reallocated at
+// the new size: shared levels are copied on the GPU, new ones come from the mapped file through this
+// frame's staging buffer, and the old image is destroyed once no frame in flight can sample it.
+//
+// Each frame's staging buffer holds two of the largest levels the streamer accepts: one streamed level and
+// room for mip tails. Textures with a larger level are rejected at Load. A texture that asks for more levels
+// than fit at once gets them coarsest first over several frames.
+//
+// Image views change whenever a texture is reallocated, so fetch them with GetView every frame; a texture
+// has no view until its mip tail has been uploaded.
+// Everything here runs on the render thread.
+class texture_streamer {
+public:
+  using handle = texture_residency::handle;
+
+  // The default MaxLevelBytes fits a 4096x4096 level at one byte per texel, e.g. BC7.
+  texture_streamer(VkPhysicalDevice PhysicalDevice, VkDevice Device, uint32_t FramesInFlight, uint64_t BudgetBytes,
+                   VkDeviceSize MaxLevelBytes = VkDeviceSize{16} << 20)
+      // Half of the staging space is left for mip tails and uploads deferred from earlier frames
+      : Residency(ClampBudget(PhysicalDevice, BudgetBytes), AlignUp(MaxLevelBytes)),
+        MaxBudget(Residency.BudgetBytes()), MaxLevelBytes(AlignUp(MaxLevelBytes)), PhysicalDevice(PhysicalDevice),
+        Device(Device), FramesInFlight(FramesInFlight) {
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      Staging.push_back(std::make_unique<buffer>(PhysicalDevice, Device, 2 * this->MaxLevelBytes,
+                                                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+    }
+  }
+  texture_streamer(const texture_streamer &) = delete;
+  texture_streamer(texture_streamer &&) = delete;
+  auto operator=(const texture_streamer &) -> texture_streamer & = delete;
+  auto operator=(texture_streamer &&) -> texture_streamer & = delete;
+  // The owner waits for the device to go idle first
+  ~texture_streamer() {
+    for (texture &Texture : Textures) {
+      Destroy(Texture.Image);
+    }
+    for (retired &Old : Retired) {
+      Destroy(Old.Image);
+    }
+  }
+
+  // Only the mip tail is uploaded at first; finer levels follow as Request asks for them.
+  // Throws if a level or the mip tail is too large to ever pass through staging.
+  auto Load(const std::string &Path) -> handle {
+    auto File = std::make_unique<texture_file>(Path);
+    std::vector<uint64_t> LevelBytes;
+    VkDeviceSize TailBytes = 0;
+    for (uint32_t Level = 0; Level < File->LevelCount(); Level++) {
+      const uint64_t Bytes = File->GetLevels()[Level].Data.size();
+      LevelBytes.push_back(Bytes);
+      if (Level >= File->MipTailStart()) {
+        TailBytes += AlignUp(Bytes);
+      } else if (AlignUp(Bytes) > MaxLevelBytes) {
+        throw std::runtime_error(std::format("{}: level {} is {} MiB, the streamer takes at most {} MiB per level!",
+                                             Path, Level, Bytes >> 20, MaxLevelBytes >> 20));
+      }
+    }
+    if (TailBytes > MaxLevelBytes) {
+      throw std::runtime_error(std::format("{}: mip tail is {} MiB, the streamer takes at most {} MiB!", Path,
+                                           TailBytes >> 20, MaxLevelBytes >> 20));
+    }
+    const texture_file::level &Top = File->GetLevels()[0];
+    const handle Handle = Residency.Add(LevelBytes, std::max(Top.Width, Top.Height), File->MipTailStart());
+    if (Handle >= Textures.size()) {
+      Textures.resize(Handle + 1);
+    }
+    Textures[Handle] = {.File = std::move(File)};
+    return Handle;
+  }
+  void Unload(handle Texture) {
+    Residency.Remove(Texture);
+    Retire(Textures[Texture].Image);
+    Textures[Texture] = {};
+    std::erase(Pending, Texture);
+  }
+
+  // Reports a surface WorldSize across at Center that samples the texture this frame.
+  void Request(handle Texture, const mth::camera<float> &Camera, const mth::vec3<float> &Center, float WorldSize) {
+    Residency.Request(Texture, texture_residency::ScreenSize(Camera, Center, WorldSize));
+  }
+
+  // Records this frame's reallocations and uploads. Call once per frame, after the frame's fence has been
+  // waited on and before anything that samples the textures.
+  void Record(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    KPROFILE_SCOPE("texture_streamer::Record");
+    FrameNumber++;
+    while (!Retired.empty() && Retired.front().Frame + FramesInFlight <= FrameNumber) {
+      RetiredBytes -= Retired.front().Image.Bytes;
+      Destroy(Retired.front().Image);
+      Retired.pop_front();
+    }
+
+    for (const texture_residency::change &Change : Residency.Update()) {
+      texture &Texture = Textures[Change.Texture];
+      Texture.Target = Change.FirstLevel;
+      // Levels to upload are read next frame, give the kernel a frame to page them in
+      for (uint32_t Level = Texture.Target; Level < MissingEnd(Texture); Level++) {
+        Texture.File->Prefetch(Level);
+      }
+      Texture.ReadyFrame = FrameNumber + 1;
+      if (std::ranges::find(Pending, Change.Texture) == Pending.end()) {
+        Pending.push_back(Change.Texture);
+      }
+    }
+
+    buffer &Upload = *Staging[Frame];
+    VkDeviceSize UploadOffset = 0;
+    std::erase_if(Pending, [&](handle Handle) {
+      texture &Texture = Textures[Handle];
+      if (Texture.Target == Texture.Image.FirstLevel) {
+        return true;
+      }
+      // Dropping levels needs no file data and is not delayed
+      if (Texture.Target < Texture.Image.FirstLevel && Texture.ReadyFrame > FrameNumber) {
+        return false;
+      }
+      // Coarsest first, as many missing levels as this frame's staging space has room for
+      uint32_t FirstLevel = MissingEnd(Texture);
+      VkDeviceSize Needed = 0;
+      while (FirstLevel > Texture.Target) {
+        const VkDeviceSize Bytes = AlignUp(Texture.File->GetLevels()[FirstLevel - 1].Data.size());
+        if (UploadOffset + Needed + Bytes > Upload.Size) {
+          break;
+        }
+        Needed += Bytes;
+        FirstLevel--;
+      }
+      if (Texture.Target >= Texture.Image.FirstLevel) {
+        FirstLevel = Texture.Target;
+      } else if (FirstLevel == MissingEnd(Texture)) {
+        return false; // Retried next frame
+      }
+      Reallocate(CommandBuffer, Texture, FirstLevel, Upload, UploadOffset);
+      return Texture.Image.FirstLevel == Texture.Target;
+    });
+  }
+
+  // Lowers the budget under memory pressure, or raises it back, though never above the one it was created with.
+  // Textures drop unneeded levels to fit at the next Record.
+  void SetBudget(uint64_t BudgetBytes) { Residency.SetBudget(std::min(BudgetBytes, MaxBudget)); }
+
+  [[nodiscard]] auto GetView(handle Texture) const -> VkImageView { return Textures[Texture].Image.View; }
+  [[nodiscard]] auto GetResidency() const -> const texture_residency & { return Residency; }
+  // Memory of images replaced or unloaded but still held for frames in flight. The driver counts it as used,
+  // the residency does not.
+  [[nodiscard]] auto GetRetiredBytes() const -> uint64_t { return RetiredBytes; }
+
+private:
+  struct image {
+    VkImage Image = VK_NULL_HANDLE;
+    VkDeviceMemory Memory = VK_NULL_HANDLE;
+    VkImageView View = VK_NULL_HANDLE;
+    VkDeviceSize Bytes = 0;
+    uint32_t FirstLevel = UINT32_MAX; // Texture level stored in image level 0; past the end while nothing is resident
+  };
+  struct texture {
+    std::unique_ptr<texture_file> File;
+    image Image;
+    uint32_t Target = 0;
+    uint64_t ReadyFrame = 0;
+  };
+  struct retired {
+    image Image;
+    uint64_t Frame;
+  };
+
+  texture_residency Residency;
+  uint64_t MaxBudget;
+  VkDeviceSize MaxLevelBytes;
+  VkPhysicalDevice PhysicalDevice;
+  VkDevice Device;
+  uint32_t FramesInFlight;
+  uint64_t FrameNumber = 0;
+  std::vector<texture> Textures;
+  std::vector<handle> Pending;
+  std::deque<retired> Retired;
+  uint64_t RetiredBytes = 0;
+  std::vector<std::unique_ptr<buffer>> Staging;
+
+  // End of the levels that Target asks for but the current image lacks.
+  static auto MissingEnd(const texture &Texture) -> uint32_t {
+    return std::min(Texture.Image.FirstLevel, Texture.File->LevelCount());
+  }
+  // Compressed uploads must start on a block boundary
+  static auto AlignUp(VkDeviceSize Size) -> VkDeviceSize { return (Size + 15) & ~VkDeviceSize{15}; }
+
+  static auto ClampBudget(VkPhysicalDevice PhysicalDevice, uint64_t BudgetBytes) -> uint64_t {
+    VkPhysicalDeviceMemoryProperties Memory;
+    vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &Memory);
+    VkDeviceSize LargestHeap = 0;
+    for (uint32_t i = 0; i < Memory.memoryHeapCount; i++) {
+      if ((Memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0) {
+        LargestHeap = std::max(LargestHeap, Memory.memoryHeaps[i].size);
+      }
+    }
+    // Leave the rest of VRAM to render targets and geometry
+    const uint64_t Budget = std::min<uint64_t>(BudgetBytes, LargestHeap / 2);
+    KLOG(Info, Render, "Texture budget {} MiB", Budget >> 20);
+    return Budget;
+  }
+
+  auto CreateImage(const texture_file &File, uint32_t FirstLevel) -> image {
+    const texture_file::level &Top = File.GetLevels()[FirstLevel];
+    image Result{.FirstLevel = FirstLevel};
+    VkImageCreateInfo CreateInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = File.GetFormat(),
+        .extent = {Top.Width, Top.Height, 1},
+        .mipLevels = File.LevelCount() - FirstLevel,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    if (vkCreateImage(Device, &CreateInfo, nullptr, &Result.Image) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create texture image!");
+    }
+    VkMemoryRequirements Requirements;
+    vkGetImageMemoryRequirements(Device, Result.Image, &Requirements);
+    VkMemoryAllocateInfo AllocateInfo{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = Requirements.size,
+        .memoryTypeIndex =
+            FindMemoryType(PhysicalDevice, Requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+    };
+    if (vkAllocateMemory(Device, &AllocateInfo, nullptr, &Result.Memory) != VK_SUCCESS) {
+      Destroy(Result);
+      throw std::runtime_error("failed to allocate texture memory!");
+    }
+    vkBindImageMemory(Device, Result.Image, Result.Memory, 0);
+    Result.Bytes = Requirements.size;
+    VkImageViewCreateInfo ViewInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = Result.Image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = File.GetFormat(),
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .levelCount = CreateInfo.mipLevels,
+                             .layerCount = 1},
+    };
+    if (vkCreateImageView(Device, &ViewInfo, nullptr, &Result.View) != VK_SUCCESS) {
+      Destroy(Result);
+      throw std::runtime_error("failed to create texture view!");
+    }
+    return Result;
+  }
+
+  void Reallocate(VkCommandBuffer CommandBuffer, texture &Texture, uint32_t FirstLevel, buffer &Upload,
+                  VkDeviceSize &UploadOffset) {
+    const texture_file &File = *Texture.File;
+    const image Old = Texture.Image;
+    const image New = CreateImage(File, FirstLevel);
+    const uint32_t LevelCount = File.LevelCount();
+    static constexpr VkPipelineStageFlags ShaderStages =
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    TransitionImage(CommandBuffer, New.Image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT, LevelCount - New.FirstLevel);
+    // Levels both images hold move on the GPU
+    if (Old.Image != VK_NULL_HANDLE) {
+      TransitionImage(CommandBuffer, Old.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, ShaderStages, VK_ACCESS_SHADER_READ_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, LevelCount - Old.FirstLevel);
+      std::vector<VkImageCopy> Copies;
+      for (uint32_t Level = std::max(Old.FirstLevel, New.FirstLevel); Level < LevelCount; Level++) {
+        const texture_file::level &Source = File.GetLevels()[Level];
+        Copies.push_back({
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, Level - Old.FirstLevel, 0, 1},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, Level - New.FirstLevel, 0, 1},
+            .extent = {Source.Width, Source.Height, 1},
+        });
+      }
+      vkCmdCopyImage(CommandBuffer, Old.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, New.Image,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(Copies.size()), Copies.data());
+    }
+    // New levels come from the file
+    std::vector<VkBufferImageCopy> Uploads;
+    for (uint32_t Level = New.FirstLevel; Level < std::min(Old.FirstLevel, LevelCount); Level++) {
+      const texture_file::level &Source = File.GetLevels()[Level];
+      std::memcpy(Upload.Mapped + UploadOffset, Source.Data.data(), Source.Data.size());
+      Uploads.push_back({
+          .bufferOffset = UploadOffset,
+          .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, Level - New.FirstLevel, 0, 1},
+          .imageExtent = {Source.Width, Source.Height, 1},
+      });
+      UploadOffset += AlignUp(Source.Data.size());
+    }
+    if (!Uploads.empty()) {
+      vkCmdCopyBufferToImage(CommandBuffer, Upload.Buffer, New.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             static_cast<uint32_t>(Uploads.size()), Uploads.data());
+    }
+    TransitionImage(CommandBuffer, New.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT, ShaderStages, VK_ACCESS_SHADER_READ_BIT, LevelCount - New.FirstLevel);
+    Retire(Old);
+    Texture.Image = New;
+  }
+
+  void Retire(const image &Image) {
+    if (Image.Image != VK_NULL_HANDLE) {
+      Retired.push_back({.Image = Image, .Frame = FrameNumber});
+      RetiredBytes += Image.Bytes;
+    }
+  }
+  void Destroy(const image &Image) {
+    vkDestroyImageView(Device, Image.View, nullptr);
+    vkDestroyImage(Device, Image.Image, nullptr);
+    vkFreeMemory(Device, Image.Memory, nullptr);
+  }
+};
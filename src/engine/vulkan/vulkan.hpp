@@ -1,29 +1,188 @@
 #pragma once
+#include "../config.hpp"
+#include "../render/render_graph.hpp"
+#include "bindless.hpp"
 #include "debug.hpp"
 #include "device.hpp"
+#include "frame.hpp"
+#include "gpu_timer.hpp"
 #include "instance.hpp"
+#include "memory_budget.hpp"
 #include "physical_device.hpp"
+#include "pipelines.hpp"
 #include "surface.hpp"
 #include "swapchain.hpp"
+#include "texture_streamer.hpp"
+
+#include <memory>
+#include <optional>
 
 // The only thing that this class is doing is giving the context
 class vulkan {
+public:
+  static constexpr uint64_t TextureBudgetBytes = uint64_t{1} << 30;
+
+private:
+  const uint32_t FramesInFlight;
+  SDL_Window *Window;
   instance Instance;
-  debug DebugMessenger;
+#if KALAN_VALIDATION
+  std::unique_ptr<debug> DebugMessenger; // Null unless the config asks for it
+#endif
   surface Surface;
   physical_device PhysicalDevice;
+  device_capabilities Capabilities;
   device Device;
   swapchain Swapchain;
-  VkCommandPool CommandPool{};
+  command_pool CommandPool;
+  std::vector<std::unique_ptr<frame>> Frames;
+  gpu_timer GpuTimer;
+  memory_budget Memory;
+  texture_streamer Textures;
+  pipeline_registry Pipelines;
+  render_graph Graph;
+  std::unique_ptr<bindless_heap> Bindless; // Null without descriptor indexing
+  uint32_t FrameIndex = 0;
+  bool SwapchainStale = false; // Out of date or suboptimal, recreated before the next acquire
+  std::optional<double> GpuTime;
 
 public:
-  explicit vulkan(SDL_Window *Window)
-      : Instance(Window, {"VK_LAYER_KHRONOS_validation"}), DebugMessenger{Instance.Instance},
+  vulkan(SDL_Window *Window, shader_library &Shaders, const engine_config &Config)
+      : FramesInFlight(Config.FramesInFlight), Window(Window), Instance(Window, Config.Validation),
         Surface{Window, Instance.Instance}, PhysicalDevice{Instance.Instance, Surface.Surface},
-        Device{PhysicalDevice, Surface.Surface, {VK_KHR_SWAPCHAIN_EXTENSION_NAME}},
-        Swapchain{PhysicalDevice, Device.Device, Surface.Surface, {1920, 1080}} {
+        Capabilities{PhysicalDevice, Instance.ApiVersion},
+        Device{PhysicalDevice, Surface.Surface, Capabilities.Extensions(), Capabilities.Features(),
+               Capabilities.FeatureChain()},
+        Swapchain{PhysicalDevice, Device.Device, Surface.Surface, {Config.Width, Config.Height}, Config.PresentMode},
+        CommandPool{Device.Device, Device.QueueFamilyIndex},
+        GpuTimer{PhysicalDevice.PhysicalDevice, Device.Device, Device.QueueFamilyIndex, FramesInFlight},
+        Memory{PhysicalDevice.PhysicalDevice, Capabilities, FramesInFlight},
+        Textures{PhysicalDevice.PhysicalDevice, Device.Device, FramesInFlight, TextureBudgetBytes},
+        Pipelines{Device.Device, Shaders, FramesInFlight},
+        Graph{PhysicalDevice.PhysicalDevice, Device, Capabilities, FramesInFlight} {
+#if KALAN_VALIDATION
+    if (Config.DebugMessenger && Config.Validation) {
+      DebugMessenger = std::make_unique<debug>(Instance.Instance, Config.DebugSeverity, Config.MutedMessages);
+    }
+#endif
+    for (uint32_t i = 0; i < FramesInFlight; i++) {
+      Frames.push_back(std::make_unique<frame>(Device.Device, CommandPool.CommandPool));
+    }
+    if (Capabilities.DescriptorIndexing) {
+      Bindless = std::make_unique<bindless_heap>(PhysicalDevice.PhysicalDevice, Device.Device, FramesInFlight);
+    } else {
+      KLOG(Warning, Vulkan, "descriptor indexing unsupported, bindless resources disabled");
+    }
+  };
+  vulkan(const vulkan &) = delete;
+  vulkan(vulkan &&) = delete;
+  auto operator=(const vulkan &) -> vulkan & = delete;
+  auto operator=(vulkan &&) -> vulkan & = delete;
+  ~vulkan() { vkDeviceWaitIdle(Device.Device); }
 
-        };
   inline void WithCommandBuffer(const std::function<void(VkCommandBuffer)> &Code) {};
-  void Render() {}
+
+  // GPU time of the most recently completed frame, if the device supports timestamps.
+  [[nodiscard]] auto GetGpuTime() const -> std::optional<double> { return GpuTime; }
+  [[nodiscard]] auto GetFramesInFlight() const -> uint32_t { return FramesInFlight; }
+  [[nodiscard]] auto GetTextures() -> texture_streamer & { return Textures; }
+  [[nodiscard]] auto GetMemory() -> memory_budget & { return Memory; }
+  [[nodiscard]] auto GetPipelines() -> pipeline_registry & { return Pipelines; }
+  [[nodiscard]] auto GetPhysicalDevice() const -> VkPhysicalDevice { return PhysicalDevice.PhysicalDevice; }
+  [[nodiscard]] auto GetDevice() const -> VkDevice { return Device.Device; }
+  // Null if the device lacks descriptor indexing; such devices need per-draw descriptor sets.
+  [[nodiscard]] auto GetBindless() -> bindless_heap * { return Bindless.get(); }
+  [[nodiscard]] auto GetCapabilities() const -> const device_capabilities & { return Capabilities; }
+
+  void Render() {
+    frame &Frame = *Frames[FrameIndex];
+    vkWaitForFences(Device.Device, 1, &Frame.InFlight, VK_TRUE, UINT64_MAX);
+    GpuTime = GpuTimer.Collect(FrameIndex);
+    if (SwapchainStale && !RecreateSwapchain()) {
+      return;
+    }
+
+    uint32_t ImageIndex = 0;
+    VkResult Result = vkAcquireNextImageKHR(Device.Device, Swapchain.Swapchain, UINT64_MAX, Frame.ImageAvailable,
+                                            VK_NULL_HANDLE, &ImageIndex);
+    if (Result == VK_ERROR_OUT_OF_DATE_KHR) {
+      // Nothing was acquired, so the semaphore stays unsignaled and the frame can simply be skipped
+      SwapchainStale = true;
+      return;
+    }
+    if (Result != VK_SUCCESS && Result != VK_SUBOPTIMAL_KHR) {
+      throw std::runtime_error("failed to acquire swapchain image!");
+    }
+    // A suboptimal image still presents, so draw this frame and recreate before the next one
+    SwapchainStale = Result == VK_SUBOPTIMAL_KHR;
+    vkResetFences(Device.Device, 1, &Frame.InFlight);
+    // Textures drop detail as soon as the pressure rises, before registered resources are evicted over budget
+    const uint64_t TextureBytes = Textures.GetResidency().UsedBytes();
+    Memory.Update(TextureBytes, Textures.GetRetiredBytes());
+    Textures.SetBudget(Memory.Share(TextureBytes));
+    Pipelines.Update(); // Shader hot reload swaps pipelines here, between frames
+    if (Bindless) {
+      Bindless->Update();
+    }
+
+    VkCommandBuffer CommandBuffer = Frame.CommandBuffer;
+    vkResetCommandBuffer(CommandBuffer, 0);
+    VkCommandBufferBeginInfo BeginInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+    GpuTimer.Begin(CommandBuffer, FrameIndex);
+    Textures.Record(CommandBuffer, FrameIndex);
+    // The acquire semaphore is waited on at the color attachment stage
+    const render_graph::resource Backbuffer = Graph.ImportImage(
+        "backbuffer", Swapchain.SwapchainImages[ImageIndex], Swapchain.SwapchainImageViews[ImageIndex],
+        {.Width = Swapchain.Extent.width, .Height = Swapchain.Extent.height, .Format = Swapchain.SurfaceFormat.format},
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, graph_access::Present);
+    Graph.AddPass(
+        "clear",
+        [&](render_graph::builder &Builder) {
+          Builder.Attachment(Backbuffer, VK_ATTACHMENT_LOAD_OP_CLEAR, {.color = {.float32 = {0.1F, 0.1F, 0.1F, 1.0F}}});
+        },
+        [](VkCommandBuffer) {});
+    // Async compute passes split the frame into several command buffers; the last one is handed back
+    CommandBuffer = Graph.Execute(CommandBuffer);
+    GpuTimer.End(CommandBuffer, FrameIndex);
+    vkEndCommandBuffer(CommandBuffer);
+
+    const VkPipelineStageFlags WaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    Graph.Submit({&Frame.ImageAvailable, 1}, {&WaitStage, 1}, {&Swapchain.RenderFinished[ImageIndex], 1},
+                 Frame.InFlight);
+    VkPresentInfoKHR PresentInfo{
+        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &Swapchain.RenderFinished[ImageIndex],
+        .swapchainCount = 1,
+        .pSwapchains = &Swapchain.Swapchain,
+        .pImageIndices = &ImageIndex,
+    };
+    Result = vkQueuePresentKHR(Device.GraphicsQueue, &PresentInfo);
+    if (Result == VK_ERROR_OUT_OF_DATE_KHR || Result == VK_SUBOPTIMAL_KHR) {
+      SwapchainStale = true;
+    } else if (Result != VK_SUCCESS) {
+      throw std::runtime_error("failed to present swapchain image!");
+    }
+    FrameIndex = (FrameIndex + 1) % FramesInFlight;
+  }
+
+private:
+  // Sizes the new swapchain from the window; false while the window has no area, e.g. minimized.
+  auto RecreateSwapchain() -> bool {
+    int Width = 0;
+    int Height = 0;
+    SDL_Vulkan_GetDrawableSize(Window, &Width, &Height);
+    if (Width == 0 || Height == 0) {
+      return false;
+    }
+    vkDeviceWaitIdle(Device.Device);
+    Swapchain.Recreate({static_cast<uint32_t>(Width), static_cast<uint32_t>(Height)});
+    Graph.ForgetFramebuffers(); // The render pass fallback caches framebuffers over the old views
+    SwapchainStale = false;
+    return true;
+  }
 };
@@ -1,9 +1,9 @@
 #include <iostream>
 
 #include "engine/engine.hpp"
-auto main(int /*argc*/, char * /*argv*/[]) -> int {
+auto main(int argc, char *argv[]) -> int {
   std::cout << "hello!\n";
-  engine Engine;
+  engine Engine{argc, argv};
   Engine.Run();
   return 0;
 }
@@ -18,6 +18,7 @@
 #define __mth_h_
 
 #include "mth_camera.h"
+#include "mth_frustum.h"
 #include "mth_matr.h"
 #include "mth_noise.h"
 #include "mth_quat.h"
@@ -33,6 +34,7 @@ using vec4 = mth::vec4<FLT>;
 using matr = mth::matr<FLT>;
 using tensor = mth::tensor<FLT>;
 using camera = mth::camera<FLT>;
+using frustum = mth::frustum<FLT>;
 using ray = mth::ray<FLT>;
 using noise = mth::noise<FLT>;
 using quat = mth::quat<FLT>;
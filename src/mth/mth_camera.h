@@ -48,7 +48,7 @@ public:
     }
 
     MatrProj = matr<Type>::Frustum(-Wp / 2, Wp / 2, -Hp / 2, Hp / 2, ProjDist, FarClip);
-    MatrProj.A[1][1] *= -1;
+    MatrProj.A[5] *= -1;
     MatrVP = MatrView * MatrProj;
   }
 
@@ -62,9 +62,9 @@ public:
   auto Set(const vec3<Type> &Loc1, const vec3<Type> &At1, const vec3<Type> &Up1) -> camera & {
     MatrView = mth::matr<Type>::View(Loc1, At1, Up1);
 
-    Dir = mth::vec3<Type>(-MatrView.A[0][2], -MatrView.A[1][2], -MatrView.A[2][2]);
-    Up = mth::vec3<Type>(MatrView.A[0][1], MatrView.A[1][1], MatrView.A[2][1]);
-    Right = mth::vec3<Type>(MatrView.A[0][0], MatrView.A[1][0], MatrView.A[2][0]);
+    Dir = mth::vec3<Type>(-MatrView.A[2], -MatrView.A[6], -MatrView.A[10]);
+    Up = mth::vec3<Type>(MatrView.A[1], MatrView.A[5], MatrView.A[9]);
+    Right = mth::vec3<Type>(MatrView.A[0], MatrView.A[4], MatrView.A[8]);
 
     Loc = Loc1;
     At = At1;
@@ -0,0 +1,69 @@
+#ifndef __mth_frustum_h_
+#define __mth_frustum_h_
+
+#include <array>
+
+#include "mth_def.h"
+
+/* Math namespace */
+namespace mth {
+/* Forward declaration */
+template <typename Type> class matr;
+template <typename Type> class vec3;
+template <typename Type> class vec4;
+
+/* View frustum class */
+template <typename Type> class frustum {
+  static_assert(std::is_arithmetic_v<Type>, "Number type is needed in frustum");
+
+public:
+  /* Left, right, bottom, top, near and far planes as (Normal, Distance) with unit inward normals */
+  std::array<vec4<Type>, 6> Planes;
+
+  frustum() noexcept = default;
+
+  /* Planes of a view-projection matrix in the row vector convention used by 'matr' */
+  explicit frustum(const matr<Type> &VP) noexcept {
+    auto Column = [&](const INT J) { return vec4<Type>(VP.A[J], VP.A[4 + J], VP.A[8 + J], VP.A[12 + J]); };
+    const vec4<Type> X = Column(0), Y = Column(1), Z = Column(2), W = Column(3);
+
+    Planes = {W + X, W - X, W + Y, W - Y, W + Z, W - Z};
+    for (vec4<Type> &Plane : Planes) {
+      const Type Length = std::sqrt(Plane.X * Plane.X + Plane.Y * Plane.Y + Plane.Z * Plane.Z);
+      if (Length > 0) {
+        Plane = Plane / Length;
+      }
+    }
+  } /* End of 'frustum' function */
+
+  /* Signed distance from a point to a plane, positive inside */
+  auto Distance(const INT Plane, const vec3<Type> &P) const noexcept -> Type {
+    return Planes[Plane].X * P.X + Planes[Plane].Y * P.Y + Planes[Plane].Z * P.Z + Planes[Plane].W;
+  } /* End of 'Distance' function */
+
+  auto IsSphereVisible(const vec3<Type> &Center, const Type Radius) const noexcept -> bool {
+    for (INT i = 0; i < 6; i++) {
+      if (Distance(i, Center) < -Radius) {
+        return false;
+      }
+    }
+    return true;
+  } /* End of 'IsSphereVisible' function */
+
+  auto IsBoxVisible(const vec3<Type> &Min, const vec3<Type> &Max) const noexcept -> bool {
+    for (INT i = 0; i < 6; i++) {
+      /* Corner furthest along the plane normal */
+      const vec3<Type> P(Planes[i].X >= 0 ? Max.X : Min.X, Planes[i].Y >= 0 ? Max.Y : Min.Y,
+                         Planes[i].Z >= 0 ? Max.Z : Min.Z);
+      if (Distance(i, P) < 0) {
+        return false;
+      }
+    }
+    return true;
+  } /* End of 'IsBoxVisible' function */
+}; /* End of 'frustum' class */
+} // namespace mth
+
+#endif /* __mth_frustum_h_ */
+
+/* END OF 'mth_frustum.h' FILE */
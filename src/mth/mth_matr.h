@@ -3,6 +3,7 @@
 
 #include "mth_def.h"
 
+#include <array>
 #include <format>
 
 /* Math namespace */
@@ -24,10 +25,10 @@ public:
   } /* End of 'Determ3x3' function */
 
   auto Determ4x4() const noexcept -> Type {
-    return +A[0][0] * Determ3x3(A[5], A[6], A[7], A[9], A[10], A[11], A[13], A[14], A[15]) +
-           -A[0][1] * Determ3x3(A[4], A[6], A[7], A[8], A[10], A[11], A[12], A[14], A[15]) +
-           +A[0][2] * Determ3x3(A[4], A[5], A[7], A[8], A[9], A[11], A[12], A[13], A[15]) +
-           -A[0][3] * Determ3x3(A[4], A[5], A[6], A[8], A[9], A[10], A[12], A[13], A[14]);
+    return +A[0] * Determ3x3(A[5], A[6], A[7], A[9], A[10], A[11], A[13], A[14], A[15]) +
+           -A[1] * Determ3x3(A[4], A[6], A[7], A[8], A[10], A[11], A[12], A[14], A[15]) +
+           +A[2] * Determ3x3(A[4], A[5], A[7], A[8], A[9], A[11], A[12], A[13], A[15]) +
+           -A[3] * Determ3x3(A[4], A[5], A[6], A[8], A[9], A[10], A[12], A[13], A[14]);
   } /* End of 'Determ4x4' function */
 
   matr() = default;
@@ -105,9 +106,9 @@ public:
                 A[0] * Matr2.A[3] + A[1] * Matr2.A[7] + A[2] * Matr2.A[11] + A[3] * Matr2.A[15],
                 // 1
                 A[4] * Matr2.A[0] + A[5] * Matr2.A[4] + A[6] * Matr2.A[8] + A[7] * Matr2.A[12],
-                A[4] * Matr2.A[1] + A[5] * Matr2.A[5] + A[7] * Matr2.A[9] + A[7] * Matr2.A[13],
-                A[4] * Matr2.A[2] + A[5] * Matr2.A[6] + A[8] * Matr2.A[10] + A[7] * Matr2.A[14],
-                A[4] * Matr2.A[3] + A[5] * Matr2.A[7] + A[9] * Matr2.A[11] + A[7] * Matr2.A[15],
+                A[4] * Matr2.A[1] + A[5] * Matr2.A[5] + A[6] * Matr2.A[9] + A[7] * Matr2.A[13],
+                A[4] * Matr2.A[2] + A[5] * Matr2.A[6] + A[6] * Matr2.A[10] + A[7] * Matr2.A[14],
+                A[4] * Matr2.A[3] + A[5] * Matr2.A[7] + A[6] * Matr2.A[11] + A[7] * Matr2.A[15],
                 // 2
                 A[8] * Matr2.A[0] + A[9] * Matr2.A[4] + A[10] * Matr2.A[8] + A[11] * Matr2.A[12],
                 A[8] * Matr2.A[1] + A[9] * Matr2.A[5] + A[10] * Matr2.A[9] + A[11] * Matr2.A[13],
@@ -121,7 +122,7 @@ public:
   }
 
   auto operator*=(const matr<Type> &Matr2) noexcept -> matr<Type> & {
-    A = (*this * Matr2);
+    *this = *this * Matr2;
     return *this;
   } /* End of 'operator*=' function */
 
@@ -136,7 +137,7 @@ public:
     /* Build adjoint matrix */
     res.A[0] = +Determ3x3(A[5], A[6], A[7], A[9], A[10], A[11], A[13], A[14], A[15]) / det;
 
-    res.A[4] = -Determ3x3(A[4], A[6], A[4], A[8], A[10], A[11], A[12], A[14], A[15]) / det;
+    res.A[4] = -Determ3x3(A[4], A[6], A[7], A[8], A[10], A[11], A[12], A[14], A[15]) / det;
 
     res.A[8] = +Determ3x3(A[4], A[5], A[7], A[8], A[9], A[11], A[12], A[13], A[15]) / det;
 
@@ -37,7 +37,7 @@ public:
     ix1 = (ix + 1) & TAB_MASK;
     return TabNoise[0][ix] * (1 - fx) + TabNoise[0][ix1] * fx;
   } /* End of 'Noise1D' function */
-  auto NoiseTurb1D(const Type X, const INT Octaves) const noexcept -> Type {
+  auto NoiseTurb1D(Type X, const INT Octaves) const noexcept -> Type {
     INT frac = 1;
     Type val = 0;
 
@@ -68,14 +68,14 @@ public:
            TabNoise[ix][iy1] * (1 - fx) * fy + TabNoise[ix1][iy1] * fx * fy;
   }
 
-  [[nodiscard]] auto NoiseTurb2D(const FLT X, const FLT Y, const INT Octaves) const noexcept -> FLT {
+  [[nodiscard]] auto NoiseTurb2D(FLT X, FLT Y, const INT Octaves) const noexcept -> FLT {
     INT frac = 1;
     FLT val = 0;
 
     for (int i = 0; i < Octaves; i++) {
       val += Noise2D(X, Y) / frac;
-      this->X = (X + 29.47) * 2;
-      this->Y = (Y + 18.102) * 2;
+      X = (X + 29.47F) * 2;
+      Y = (Y + 18.102F) * 2;
       frac *= 2;
     }
     return val * static_cast<FLT>(1 << (Octaves - 1)) / static_cast<FLT>((1 << Octaves) - 1);
@@ -35,6 +35,7 @@ inline void CubicSolver(const DBL a, const DBL b, const DBL c, const DBL d, DBL
   if (a == 0) {
     SquareSolver(b, c, d, S);
     S[2] = S[1];
+    return;
   }
 
   const DBL p = (3 * a * c - b * b) / (3 * a * a);
@@ -43,13 +43,11 @@ public:
   auto operator()(const INT N1, const INT N2) const -> Type { return A[N1 * 3 + N2]; }
   auto operator()(const INT N1, const INT N2) -> Type & { return A[N1 * 3 + N2]; } /* End of 'operator()' function */
   auto operator+(const tensor &T) const noexcept -> tensor {
-    return tensor(A[0][0] + T.A[0][0], A[0][1] + T.A[0][1], A[0][2] + T.A[0][2], A[1][0] + T.A[1][0],
-                  A[1][1] + T.A[1][1], A[1][2] + T.A[1][2], A[2][0] + T.A[2][0], A[2][1] + T.A[2][1],
-                  A[2][2] + T.A[2][2]);
+    return tensor(A[0] + T.A[0], A[1] + T.A[1], A[2] + T.A[2], A[3] + T.A[3], A[4] + T.A[4], A[5] + T.A[5],
+                  A[6] + T.A[6], A[7] + T.A[7], A[8] + T.A[8]);
   }
   auto operator*(const Type T) const noexcept -> tensor<Type> {
-    return tensor<Type>(A[0][0] * T, A[0][1] * T, A[0][2] * T, A[1][0] * T, A[1][1] * T, A[1][2] * T, A[2][0] * T,
-                        A[2][1] * T, A[2][2] * T);
+    return tensor<Type>(A[0] * T, A[1] * T, A[2] * T, A[3] * T, A[4] * T, A[5] * T, A[6] * T, A[7] * T, A[8] * T);
   }
   auto operator*(const tensor &m) const noexcept -> tensor {
     return tensor{A[0] * m.A[0] + A[1] * m.A[3] + A[2] * m.A[6], A[0] * m.A[1] + A[1] * m.A[4] + A[2] * m.A[7],
@@ -90,7 +88,7 @@ public:
     }
 
     const Type RevDet = 1 / det;
-    return tensor{(A[4] * A[8] - A[5] * A[7]) * RevDet, (A[2] * A[7] - A[1] * A[7]) * RevDet,
+    return tensor{(A[4] * A[8] - A[5] * A[7]) * RevDet, (A[2] * A[7] - A[1] * A[8]) * RevDet,
                   (A[1] * A[5] - A[2] * A[4]) * RevDet, (A[5] * A[6] - A[3] * A[8]) * RevDet,
                   (A[0] * A[8] - A[2] * A[6]) * RevDet, (A[2] * A[3] - A[0] * A[5]) * RevDet,
                   (A[3] * A[7] - A[4] * A[6]) * RevDet, (A[1] * A[6] - A[0] * A[7]) * RevDet,
@@ -4,6 +4,7 @@
 
 #include "mth_def.h"
 
+#include <algorithm>
 #include <format>
 
 /* Math namespace */
@@ -20,13 +21,11 @@ public:
   Type X, Y, Z;
 
   vec3() noexcept : X(0), Y(0), Z(0) {} /* End of 'vec3' constructor */
-  vec3(vec3 &&) = delete;
-  auto operator=(const vec3 &) -> vec3 & = delete;
-  auto operator=(vec3 &&) -> vec3 & = delete;
   explicit vec3(const Type A) noexcept : X(A), Y(A), Z(A) {}                    /* End of 'vec3' constructor */
   vec3(const Type A, const Type B, const Type C) noexcept : X(A), Y(B), Z(C) {} /* End of 'vec3' constructor */
   explicit vec3(const vec2<Type> &V, const Type C = 0) noexcept : X(V.X), Y(V.Y), Z(C) {}
-  vec3(const vec3<Type> &V) noexcept : X(V.X), Y(V.Y), Z(V.Z) {}          /* End of 'vec3' constructor */
+  vec3(const vec3<Type> &V) noexcept = default;                          /* End of 'vec3' constructor */
+  auto operator=(const vec3<Type> &V) noexcept -> vec3 & = default;
   explicit vec3(const vec4<Type> &V) noexcept : X(V.X), Y(V.Y), Z(V.Z) {} /* End of 'vec3' constructor */
   explicit operator Type *() const noexcept { return &X; }
   auto operator[](const INT Ind) const -> Type { return *(&X + Ind); } /* End of 'operator[]' function */
@@ -104,14 +103,14 @@ public:
     }
     return *this / Length();
   }
-  auto MaxC() const noexcept -> Type { return max(max(X, Y), Z); }             /* End of 'MaxC' function */
-  auto MinC() const noexcept -> Type { return min(min(X, Y), Z); }             /* End of 'MinC' function */
+  auto MaxC() const noexcept -> Type { return std::max({X, Y, Z}); }           /* End of 'MaxC' function */
+  auto MinC() const noexcept -> Type { return std::min({X, Y, Z}); }           /* End of 'MinC' function */
   auto Distance(const vec3 &V) const noexcept -> Type { return !(*this - V); } /* End of 'Distance' function */
   auto Lerp(const vec3 &V, const Type T) const noexcept -> vec3 {
     return vec3(std::lerp(X, V.X, T), std::lerp(Y, V.Y, T), std::lerp(Z, V.Z, T));
   }
-  auto Max(const vec3 &V) const noexcept -> vec3 { return vec3(max(V.X, X), max(V.Y, Y), max(V.Z, Z)); }
-  auto Min(const vec3 &V) const noexcept -> vec3 { return vec3(min(V.X, X), min(V.Y, Y), min(V.Z, Z)); }
+  auto Max(const vec3 &V) const noexcept -> vec3 { return vec3(std::max(V.X, X), std::max(V.Y, Y), std::max(V.Z, Z)); }
+  auto Min(const vec3 &V) const noexcept -> vec3 { return vec3(std::min(V.X, X), std::min(V.Y, Y), std::min(V.Z, Z)); }
   auto Ceil() const noexcept -> vec3 { return vec3(std::ceil(X), std::ceil(Y), std::ceil(Z)); }
   auto Floor() const noexcept -> vec3 { return vec3(std::floor(X), std::floor(Y), std::floor(Z)); }
   auto Angle(const vec3 &V) const noexcept -> Type {
@@ -0,0 +1,60 @@
+#version 450
+
+// One thread per cluster: build the cluster's view-space box and list every light whose sphere touches it.
+// The workgroup moves lights into shared memory a batch at a time, transformed to view space once per batch
+// rather than once per cluster. Layouts match src/engine/render/clustered_lights.hpp.
+layout(local_size_x = 128) in;
+
+#define CLUSTER_SET 0
+#define CLUSTER_ACCESS writeonly
+#include "common/clustered.glsl"
+
+shared vec4 batch[128]; // View-space position with positive depth, and radius
+
+// View-space extent of a tile between two depths; ndc0 < ndc1 are the tile's edges in [-1, 1]
+vec2 Extent(float ndc0, float ndc1, float tangent, float near, float far) {
+    return vec2(min(ndc0 * tangent * near, ndc0 * tangent * far), max(ndc1 * tangent * near, ndc1 * tangent * far));
+}
+
+void main() {
+    uint cluster = gl_GlobalInvocationID.x;
+    uvec3 grid = clusterGrid.xyz;
+    bool active = cluster < grid.x * grid.y * grid.z;
+    uvec3 cell = uvec3(cluster % grid.x, cluster / grid.x % grid.y, cluster / (grid.x * grid.y));
+
+    float near = clusterProjection.z;
+    float ratio = clusterProjection.w / near;
+    float sliceNear = near * pow(ratio, float(cell.z) / float(grid.z));
+    float sliceFar = near * pow(ratio, float(cell.z + 1) / float(grid.z));
+    vec2 extentX = Extent(-1.0 + 2.0 * float(cell.x) / float(grid.x), -1.0 + 2.0 * float(cell.x + 1) / float(grid.x),
+                          clusterProjection.x, sliceNear, sliceFar);
+    // Row 0 is the top of the screen, which is +y in view space
+    vec2 extentY = Extent(1.0 - 2.0 * float(cell.y + 1) / float(grid.y), 1.0 - 2.0 * float(cell.y) / float(grid.y),
+                          clusterProjection.y, sliceNear, sliceFar);
+    vec3 boxMin = vec3(extentX.x, extentY.x, sliceNear);
+    vec3 boxMax = vec3(extentX.y, extentY.y, sliceFar);
+
+    uint lightCount = clusterGrid.w;
+    uint count = 0;
+    for (uint first = 0; first < lightCount; first += gl_WorkGroupSize.x) {
+        uint index = first + gl_LocalInvocationIndex;
+        if (index < lightCount) {
+            vec3 view = (clusterView * vec4(lights[index].Position, 1.0)).xyz;
+            batch[gl_LocalInvocationIndex] = vec4(view.xy, -view.z, lights[index].Radius);
+        }
+        barrier();
+        uint batchSize = min(gl_WorkGroupSize.x, lightCount - first);
+        for (uint i = 0; active && i < batchSize && count < CLUSTER_MAX_LIGHTS; i++) {
+            vec4 light = batch[i];
+            vec3 offset = max(max(boxMin - light.xyz, light.xyz - boxMax), 0.0);
+            if (dot(offset, offset) <= light.w * light.w) {
+                clusterIndices[cluster * CLUSTER_MAX_LIGHTS + count] = first + i;
+                count++;
+            }
+        }
+        barrier();
+    }
+    if (active) {
+        clusterCounts[cluster] = count;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef BINDLESS_GLSL
+#define BINDLESS_GLSL
+
+// The bindless heap, set 0 of every pipeline that uses it. Layout matches src/engine/vulkan/bindless.hpp.
+// Slots come from push constants; wrap any slot that can differ within a draw or dispatch in nonuniformEXT.
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform sampler2D Textures[];
+
+// Declare a typed view of the buffer array, e.g. BINDLESS_BUFFER(materials, material Materials[]);
+#define BINDLESS_BUFFER(Name, Contents) \
+    layout(set = 0, binding = 1, std430) readonly buffer Name { Contents; } Name##s[]
+
+#endif // BINDLESS_GLSL
@@ -0,0 +1,67 @@
+#ifndef CLUSTERED_GLSL
+#define CLUSTERED_GLSL
+
+// Lights binned into view-space clusters. Layouts match src/engine/render/clustered_lights.hpp.
+// Bound as set 1 by default so set 0 stays free for the bindless heap; define CLUSTER_SET before
+// including to move it.
+#ifndef CLUSTER_SET
+#define CLUSTER_SET 1
+#endif
+// Only the binning pass writes the clusters; fragment shaders may not write storage buffers by default
+#ifndef CLUSTER_ACCESS
+#define CLUSTER_ACCESS readonly
+#endif
+#define CLUSTER_MAX_LIGHTS 256
+
+struct cluster_light {
+    vec3 Position;
+    float Radius;
+    vec3 Color;
+    float Pad;
+};
+
+layout(set = CLUSTER_SET, binding = 0, std430) readonly buffer ClusterLights {
+    mat4 clusterView;
+    vec4 clusterProjection; // tan(fov / 2) in x and y, near, far
+    uvec4 clusterGrid;      // Clusters in x, y and z, light count
+    vec4 clusterLookup;     // Slice scale and bias for log(depth), clusters per pixel in x and y
+    cluster_light lights[];
+};
+layout(set = CLUSTER_SET, binding = 1, std430) CLUSTER_ACCESS buffer ClusterCounts {
+    uint clusterCounts[];
+};
+layout(set = CLUSTER_SET, binding = 2, std430) CLUSTER_ACCESS buffer ClusterIndices {
+    uint clusterIndices[];
+};
+
+// viewDepth is the positive distance along the camera direction, i.e. -z in view space
+uint ClusterIndex(vec2 fragCoord, float viewDepth) {
+    uvec3 cell = uvec3(fragCoord * clusterLookup.zw, log(max(viewDepth, clusterProjection.z)) * clusterLookup.x +
+                                                       clusterLookup.y);
+    cell = min(cell, clusterGrid.xyz - 1);
+    return cell.x + clusterGrid.x * (cell.y + clusterGrid.y * cell.z);
+}
+
+// Smooth falloff that reaches zero at the light's radius, so skipping lights outside the cluster is exact
+float LightAttenuation(float distance, float radius) {
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (distance * distance + 1.0);
+}
+
+// Diffuse light reaching a surface point from the lights in its cluster; multiply by albedo
+vec3 ClusteredLighting(vec3 position, vec3 normal, vec2 fragCoord, float viewDepth) {
+    uint cluster = ClusterIndex(fragCoord, viewDepth);
+    uint count = clusterCounts[cluster];
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < count; i++) {
+        cluster_light light = lights[clusterIndices[cluster * CLUSTER_MAX_LIGHTS + i]];
+        vec3 toLight = light.Position - position;
+        float distance = length(toLight);
+        float lambert = max(dot(normal, toLight / max(distance, 1e-4)), 0.0);
+        result += light.Color * lambert * LightAttenuation(distance, light.Radius);
+    }
+    return result;
+}
+
+#endif // CLUSTERED_GLSL
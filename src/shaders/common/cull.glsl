@@ -0,0 +1,53 @@
+#ifndef CULL_GLSL
+#define CULL_GLSL
+
+// Instances, meshes and the draws culling writes. Layouts match src/engine/render/indirect_draw.hpp.
+
+struct instance {
+    mat4 World;
+    vec3 Center;
+    float Radius;
+    uint Mesh;
+};
+
+struct mesh {
+    uint IndexCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint Pad;
+};
+
+struct draw_command {
+    uint IndexCount;
+    uint InstanceCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint FirstInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+    instance instances[];
+};
+layout(std430, binding = 1) readonly buffer Meshes {
+    mesh meshes[];
+};
+layout(std430, binding = 2) writeonly buffer Draws {
+    draw_command draws[];
+};
+layout(std430, binding = 3) buffer DrawCount {
+    uint drawCount;
+};
+
+// Skips instances whose mesh is not in the table, as the CPU path does. The table is bound whole and sized to
+// the meshes, so its length is their count.
+void AppendDraw(uint index) {
+    uint meshIndex = instances[index].Mesh;
+    if (meshIndex >= uint(meshes.length())) {
+        return;
+    }
+    mesh m = meshes[meshIndex];
+    uint slot = atomicAdd(drawCount, 1);
+    draws[slot] = draw_command(m.IndexCount, 1, m.FirstIndex, m.VertexOffset, index);
+}
+
+#endif // CULL_GLSL
@@ -0,0 +1,52 @@
+#ifndef PARTICLES_GLSL
+#define PARTICLES_GLSL
+
+// Particle layouts and the random numbers the emitters use. Layouts match src/engine/render/particle_system.hpp
+// and ParticleRandom matches particle_emission::Random in src/engine/particles.hpp, so the CPU simulation
+// spawns the same particles.
+
+struct particle {
+    vec3 Position;
+    float Age;
+    vec3 Velocity;
+    float Lifetime;
+    vec4 Color;
+    float Size;
+    float Pad0, Pad1, Pad2;
+};
+
+struct particle_emitter {
+    vec3 Position;
+    float Radius;
+    vec3 Velocity;
+    float Spread;
+    vec4 Color;
+    float Size;
+    float Lifetime;
+    float LifetimeJitter;
+    uint Seed;
+    uint First; // Index of the emitter's first new particle among this frame's new particles
+    uint Count;
+    uint Pad0, Pad1;
+};
+
+// PCG output hash
+uint ParticleHash(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Number index in [0, 1) of the sequence of new particle k
+float ParticleRandom(uint seed, uint k, uint index) {
+    return float(ParticleHash(ParticleHash(seed + k) + index) >> 8u) * (1.0 / 16777216.0);
+}
+
+vec3 ParticleUnitSphere(float u, float v) {
+    float z = 2.0 * u - 1.0;
+    float r = sqrt(max(1.0 - z * z, 0.0));
+    float phi = 6.28318530718 * v;
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+#endif // PARTICLES_GLSL
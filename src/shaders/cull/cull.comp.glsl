@@ -0,0 +1,26 @@
+#version 450
+
+// One thread per instance: frustum-test its bounding sphere and append a draw for it if visible.
+// Struct layouts match src/engine/render/indirect_draw.hpp.
+layout(local_size_x = 64) in;
+
+#include "common/cull.glsl"
+
+layout(push_constant) uniform Cull {
+    vec4 planes[6];
+    uint instanceCount;
+};
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount) {
+        return;
+    }
+    instance inst = instances[index];
+    for (int i = 0; i < 6; i++) {
+        if (dot(planes[i].xyz, inst.Center) + planes[i].w < -inst.Radius) {
+            return;
+        }
+    }
+    AppendDraw(index);
+}
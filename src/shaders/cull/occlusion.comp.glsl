@@ -0,0 +1,98 @@
+#version 450
+
+// Two-phase occlusion culling, one thread per instance. visibility[] remembers which instances were
+// visible last frame.
+//  - Without CULL_LATE (the first phase), instances visible last frame that pass the frustum test are drawn
+//    straight away; their depth becomes the occluders of the pyramid.
+//  - With CULL_LATE (the second phase), every instance is tested against the frustum and the pyramid built
+//    from that depth. The result goes to visibility[], and instances the first phase did not draw are drawn.
+// The box test matches occlusion_buffer::IsBoxVisible in src/engine/software/occlusion_buffer.hpp.
+// Struct layouts match src/engine/render/indirect_draw.hpp.
+layout(local_size_x = 64) in;
+
+#include "common/cull.glsl"
+
+layout(std430, binding = 4) buffer Visibility {
+    uint visibility[];
+};
+
+#ifdef CULL_LATE
+layout(set = 1, binding = 0) uniform sampler2D pyramid;
+#endif
+
+layout(push_constant) uniform Occlusion {
+    mat4 viewProjection;
+    uint instanceCount;
+    uint levelCount;
+    uvec2 pyramidSize;
+};
+
+const float NEAR_W = 1e-5;
+
+// Projects the bounding box of the instance's sphere. Returns false if it is outside the frustum; otherwise
+// rect is its NDC rectangle and nearest its nearest depth, or nearest is -1 if the box crosses the camera.
+bool ProjectBox(vec3 boxMin, vec3 boxMax, out vec4 rect, out float nearest) {
+    rect = vec4(1e30, 1e30, -1e30, -1e30);
+    nearest = 1e30;
+    uint behind = 0;
+    for (uint corner = 0; corner < 8; corner++) {
+        vec3 p = vec3((corner & 1) != 0 ? boxMax.x : boxMin.x, (corner & 2) != 0 ? boxMax.y : boxMin.y,
+                      (corner & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(p, 1.0);
+        if (clip.w <= NEAR_W) {
+            behind++;
+            continue;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        rect = vec4(min(rect.xy, ndc.xy), max(rect.zw, ndc.xy));
+        nearest = min(nearest, ndc.z);
+    }
+    if (behind != 0) {
+        nearest = -1.0; // A box around the camera covers the whole screen
+        return behind != 8;
+    }
+    return !(rect.z < -1.0 || rect.x > 1.0 || rect.w < -1.0 || rect.y > 1.0 || nearest > 1.0);
+}
+
+#ifdef CULL_LATE
+// Farthest occluder depth over an NDC rectangle, from the finest level where it touches at most three
+// texels each way
+float FarthestOccluder(vec4 rect) {
+    vec2 size = vec2(pyramidSize);
+    uvec4 pixels = uvec4(clamp((rect * 0.5 + 0.5) * size.xyxy, vec4(0.0), size.xyxy - 1.0));
+    uint span = max(pixels.z - pixels.x, pixels.w - pixels.y);
+    uint level = min(span <= 2 ? 0u : uint(findMSB((span - 1) / 2) + 1), levelCount - 1);
+    uvec2 levelSize = max(pyramidSize >> level, uvec2(1));
+    uvec4 texels = min(pixels >> level, (levelSize - 1).xyxy);
+    float farthest = 0.0;
+    for (uint y = texels.y; y <= texels.w; y++) {
+        for (uint x = texels.x; x <= texels.z; x++) {
+            farthest = max(farthest, texelFetch(pyramid, ivec2(x, y), int(level)).r);
+        }
+    }
+    return farthest;
+}
+#endif
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount) {
+        return;
+    }
+    instance inst = instances[index];
+    vec4 rect;
+    float nearest;
+    bool inFrustum = ProjectBox(inst.Center - inst.Radius, inst.Center + inst.Radius, rect, nearest);
+    bool drawnEarly = visibility[index] != 0 && inFrustum;
+#ifdef CULL_LATE
+    bool visible = inFrustum && (nearest < 0.0 || nearest <= FarthestOccluder(rect));
+    visibility[index] = visible ? 1 : 0;
+    if (visible && !drawnEarly) {
+        AppendDraw(index);
+    }
+#else
+    if (drawnEarly) {
+        AppendDraw(index);
+    }
+#endif
+}
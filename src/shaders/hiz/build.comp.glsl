@@ -0,0 +1,36 @@
+#version 450
+
+// Builds one level of the depth pyramid: every texel takes the farthest of the 2x2 texels below it, and
+// on odd sizes the last row and column also take the leftover one. Level 0 copies the depth buffer.
+// Follows occlusion_buffer::Reduce in src/engine/software/occlusion_buffer.hpp.
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) writeonly uniform image2D target;
+
+layout(push_constant) uniform Sizes {
+    uvec2 sourceSize;
+    uvec2 targetSize;
+};
+
+void main() {
+    uvec2 texel = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(texel, targetSize))) {
+        return;
+    }
+    if (sourceSize == targetSize) {
+        imageStore(target, ivec2(texel), vec4(texelFetch(source, ivec2(texel), 0).r));
+        return;
+    }
+    uvec2 first = texel * 2u;
+    uvec2 last = min(first + 2u, sourceSize);
+    last = uvec2(texel.x + 1u == targetSize.x ? sourceSize.x : last.x,
+                 texel.y + 1u == targetSize.y ? sourceSize.y : last.y);
+    float farthest = 0.0;
+    for (uint y = first.y; y < last.y; y++) {
+        for (uint x = first.x; x < last.x; x++) {
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+        }
+    }
+    imageStore(target, ivec2(texel), vec4(farthest));
+}
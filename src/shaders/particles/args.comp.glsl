@@ -0,0 +1,22 @@
+#version 450
+
+// A single thread that turns the live counts into indirect arguments between the particle passes.
+layout(local_size_x = 1) in;
+
+#include "particles/bindings.glsl"
+
+layout(push_constant) uniform Args {
+    uint stage; // 0 after emission, 1 after simulation
+};
+
+void main() {
+    uint parity = frameCounts.z;
+    if (stage == 0u) {
+        uint alive = min(aliveCounts[parity], frameCounts.w);
+        aliveCounts[parity] = alive;
+        aliveCounts[1u - parity] = 0u;
+        simulateArgs = uvec4((alive + 255u) / 256u, 1u, 1u, 0u);
+    } else {
+        drawArgs = uvec4(6u, aliveCounts[1u - parity], 0u, 0u);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PARTICLE_BINDINGS_GLSL
+#define PARTICLE_BINDINGS_GLSL
+
+// Set 0 of the particle compute passes. Each frame emits into particlesIn, simulates it into particlesOut
+// and then swaps the two. Layouts match src/engine/render/particle_system.hpp.
+#include "common/particles.glsl"
+
+layout(set = 0, binding = 0, std430) buffer ParticlesIn {
+    particle particlesIn[];
+};
+layout(set = 0, binding = 1, std430) writeonly buffer ParticlesOut {
+    particle particlesOut[];
+};
+layout(set = 0, binding = 2, std430) buffer ParticleCounters {
+    uint aliveCounts[4];   // Live particles per buffer, indexed by parity
+    uvec4 simulateArgs;    // VkDispatchIndirectCommand for simulate.comp.glsl
+    uvec4 drawArgs;        // VkDrawIndirectCommand for draw.vert.glsl
+};
+layout(set = 0, binding = 3, std430) readonly buffer ParticleFrame {
+    mat4 depthViewProjection; // The camera the depth buffer was rendered with
+    mat4 depthInverse;
+    vec4 gravityDt;       // Gravity, then the time step
+    vec4 response;        // Drag, restitution, thickness
+    uvec4 frameCounts;    // New particles, emitters, parity (which buffer is particlesIn), capacity
+    particle_emitter emitters[];
+};
+
+#endif // PARTICLE_BINDINGS_GLSL
@@ -0,0 +1,35 @@
+#version 450
+
+// Expands particle gl_InstanceIndex into a camera-facing quad; drawn by particle_system::Draw with six
+// vertices per instance. Layouts match src/engine/render/particle_system.hpp.
+#include "common/particles.glsl"
+
+// The set particle_system::Draw binds the particles to
+#ifndef PARTICLE_SET
+#define PARTICLE_SET 0
+#endif
+
+layout(set = PARTICLE_SET, binding = 0, std430) readonly buffer Particles {
+    particle particles[];
+};
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+    vec4 cameraRight;
+    vec4 cameraUp;
+};
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0),
+                               vec2(-1.0, 1.0));
+
+void main() {
+    particle p = particles[gl_InstanceIndex];
+    vec2 corner = corners[gl_VertexIndex];
+    vec3 position = p.Position + (cameraRight.xyz * corner.x + cameraUp.xyz * corner.y) * (p.Size * 0.5);
+    gl_Position = viewProjection * vec4(position, 1.0);
+    fragColor = vec4(p.Color.rgb, p.Color.a * (1.0 - p.Age / p.Lifetime));
+    fragCorner = corner;
+}
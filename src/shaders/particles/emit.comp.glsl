@@ -0,0 +1,37 @@
+#version 450
+
+// One thread per new particle: find its emitter, spawn it and append it to the live particles.
+layout(local_size_x = 64) in;
+
+#include "particles/bindings.glsl"
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= frameCounts.x) {
+        return;
+    }
+    uint e = 0;
+    while (e + 1 < frameCounts.y && index >= emitters[e].First + emitters[e].Count) {
+        e++;
+    }
+    particle_emitter emitter = emitters[e];
+    uint k = index - emitter.First;
+
+    particle p;
+    vec3 offset = ParticleUnitSphere(ParticleRandom(emitter.Seed, k, 0u), ParticleRandom(emitter.Seed, k, 1u)) *
+                  (emitter.Radius * pow(ParticleRandom(emitter.Seed, k, 2u), 1.0 / 3.0));
+    vec3 spread = ParticleUnitSphere(ParticleRandom(emitter.Seed, k, 3u), ParticleRandom(emitter.Seed, k, 4u)) *
+                  (emitter.Spread * pow(ParticleRandom(emitter.Seed, k, 5u), 1.0 / 3.0));
+    p.Position = emitter.Position + offset;
+    p.Age = 0.0;
+    p.Velocity = emitter.Velocity + spread;
+    p.Lifetime = emitter.Lifetime * (1.0 + emitter.LifetimeJitter * (2.0 * ParticleRandom(emitter.Seed, k, 6u) - 1.0));
+    p.Color = emitter.Color;
+    p.Size = emitter.Size;
+
+    uint parity = frameCounts.z;
+    uint slot = atomicAdd(aliveCounts[parity], 1u);
+    if (slot < frameCounts.w) { // A full pool drops the rest; args.comp.glsl clamps the count
+        particlesIn[slot] = p;
+    }
+}
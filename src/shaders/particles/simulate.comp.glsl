@@ -0,0 +1,72 @@
+#version 450
+
+// One thread per live particle: integrate, bounce off the depth buffer when PARTICLE_COLLIDE is defined,
+// age, and append the survivors to particlesOut. Follows particle_simulation in src/engine/particles.hpp.
+layout(local_size_x = 256) in;
+
+#include "particles/bindings.glsl"
+
+#ifdef PARTICLE_COLLIDE
+// Clip z / w under depthViewProjection; 1 where nothing was drawn
+layout(set = 1, binding = 0) uniform sampler2D depthBuffer;
+
+vec3 Unproject(ivec2 pixel, float depth, vec2 size) {
+    vec4 world = depthInverse * vec4((vec2(pixel) + 0.5) / size * 2.0 - 1.0, depth, 1.0);
+    return world.xyz / world.w;
+}
+
+// Pushes a particle that went less than the thickness behind the depth buffer back onto the surface and
+// reflects its velocity about the normal rebuilt from neighbouring depths
+void Collide(inout vec3 position, inout vec3 velocity) {
+    vec4 clip = depthViewProjection * vec4(position, 1.0);
+    if (clip.w <= 0.0) {
+        return;
+    }
+    ivec2 size = textureSize(depthBuffer, 0);
+    vec2 coord = (clip.xy / clip.w * 0.5 + 0.5) * vec2(size);
+    if (any(lessThan(coord, vec2(0.0))) || any(greaterThanEqual(coord, vec2(size)))) {
+        return;
+    }
+    ivec2 pixel = min(ivec2(coord), size - 1);
+    float depth = texelFetch(depthBuffer, pixel, 0).r;
+    if (depth >= 1.0) {
+        return;
+    }
+    vec3 surface = Unproject(pixel, depth, vec2(size));
+    float surfaceW = (depthViewProjection * vec4(surface, 1.0)).w;
+    if (clip.w < surfaceW || clip.w > surfaceW + response.z) {
+        return;
+    }
+    ivec2 px = ivec2(pixel.x + 1 < size.x ? pixel.x + 1 : pixel.x - 1, pixel.y);
+    ivec2 py = ivec2(pixel.x, pixel.y + 1 < size.y ? pixel.y + 1 : pixel.y - 1);
+    vec3 normal = normalize(cross(Unproject(px, texelFetch(depthBuffer, px, 0).r, vec2(size)) - surface,
+                                  Unproject(py, texelFetch(depthBuffer, py, 0).r, vec2(size)) - surface));
+    if (dot(Unproject(pixel, -1.0, vec2(size)) - surface, normal) < 0.0) {
+        normal = -normal;
+    }
+    position += normal * max(dot(surface - position, normal), 0.0);
+    float along = dot(velocity, normal);
+    if (along < 0.0) {
+        velocity -= normal * ((1.0 + response.y) * along);
+    }
+}
+#endif
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    uint parity = frameCounts.z;
+    if (index >= aliveCounts[parity]) {
+        return;
+    }
+    particle p = particlesIn[index];
+    float dt = gravityDt.w;
+    p.Velocity = (p.Velocity + gravityDt.xyz * dt) * max(1.0 - response.x * dt, 0.0);
+    p.Position += p.Velocity * dt;
+#ifdef PARTICLE_COLLIDE
+    Collide(p.Position, p.Velocity);
+#endif
+    p.Age += dt;
+    if (p.Age < p.Lifetime) {
+        particlesOut[atomicAdd(aliveCounts[1u - parity], 1u)] = p;
+    }
+}
@@ -0,0 +1,123 @@
+// Checks both broadphase structures against brute force over many frames of moves, additions and removals.
+// Exits non-zero on the first failure.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "engine/physics/broadphase.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+
+constexpr float Margin = 0.1F;
+
+// The test's own copy of every proxy's fat box
+struct box {
+  mth::vec3<float> Min, Max;
+  bool Static = false;
+  bool Alive = false;
+};
+
+auto Overlap(const box &A, const box &B) -> bool {
+  return A.Min.X <= B.Max.X && B.Min.X <= A.Max.X && A.Min.Y <= B.Max.Y && B.Min.Y <= A.Max.Y &&
+         A.Min.Z <= B.Max.Z && B.Min.Z <= A.Max.Z;
+}
+
+void Compare(broadphase_method Method, const char *Name) {
+  job_system Jobs;
+  broadphase Broadphase(Jobs, Method, Margin);
+  std::mt19937 Random(1234);
+  std::uniform_real_distribution<float> Position(-30, 30), Step(-0.5F, 0.5F), Unit(0, 1);
+  // Mostly small boxes with the odd large one, so the spatial hash uses several levels
+  const auto RandomSize = [&] { return Unit(Random) < 0.05F ? 20 * Unit(Random) : 0.1F + 3 * Unit(Random); };
+  std::vector<box> Boxes;
+  std::vector<mth::vec3<float>> Centers, Halves;
+  const auto Fatten = [&](broadphase::proxy Proxy, const mth::vec3<float> &Min, const mth::vec3<float> &Max) {
+    Boxes[Proxy].Min = Min - mth::vec3<float>(Margin);
+    Boxes[Proxy].Max = Max + mth::vec3<float>(Margin);
+  };
+  const auto Add = [&] {
+    const mth::vec3<float> Center(Position(Random), Position(Random), Position(Random));
+    const mth::vec3<float> Half(RandomSize(), RandomSize(), RandomSize());
+    const bool Static = Unit(Random) < 0.2F;
+    const broadphase::proxy Proxy = Broadphase.Add(Center - Half, Center + Half, Static);
+    if (Proxy >= Boxes.size()) {
+      Boxes.resize(Proxy + 1);
+      Centers.resize(Proxy + 1);
+      Halves.resize(Proxy + 1);
+    }
+    Check(!Boxes[Proxy].Alive, "Add hands out a free id");
+    Boxes[Proxy].Static = Static;
+    Boxes[Proxy].Alive = true;
+    Centers[Proxy] = Center;
+    Halves[Proxy] = Half;
+    Fatten(Proxy, Center - Half, Center + Half);
+  };
+  for (int i = 0; i < 1000; i++) {
+    Add();
+  }
+
+  for (int Frame = 0; Frame < 30; Frame++) {
+    for (broadphase::proxy Proxy = 0; Proxy < Boxes.size(); Proxy++) {
+      if (!Boxes[Proxy].Alive || Boxes[Proxy].Static) {
+        continue;
+      }
+      const float Roll = Unit(Random);
+      if (Roll < 0.01F) {
+        Broadphase.Remove(Proxy);
+        Boxes[Proxy].Alive = false;
+      } else if (Roll < 0.5F) {
+        // Some moves stay inside the fat box, which must not count
+        const float Scale = Roll < 0.25F ? 0.1F : 1;
+        Centers[Proxy] += mth::vec3<float>(Step(Random), Step(Random), Step(Random)) * Scale;
+        const mth::vec3<float> Min = Centers[Proxy] - Halves[Proxy], Max = Centers[Proxy] + Halves[Proxy];
+        const bool Inside = Min.X >= Boxes[Proxy].Min.X && Min.Y >= Boxes[Proxy].Min.Y &&
+                            Min.Z >= Boxes[Proxy].Min.Z && Max.X <= Boxes[Proxy].Max.X &&
+                            Max.Y <= Boxes[Proxy].Max.Y && Max.Z <= Boxes[Proxy].Max.Z;
+        Check(Broadphase.Move(Proxy, Min, Max) == !Inside, "Move reports whether the fat box was left");
+        if (!Inside) {
+          Fatten(Proxy, Min, Max);
+        }
+      }
+    }
+    // Ids removed before the last update are free again
+    for (int i = 0; i < 5; i++) {
+      Add();
+    }
+
+    const std::span<const broadphase::pair> Pairs = Broadphase.Update();
+    std::vector<broadphase::pair> Found(Pairs.begin(), Pairs.end());
+    std::ranges::sort(Found);
+    Check(std::ranges::adjacent_find(Found) == Found.end(), "pairs are reported once");
+    std::vector<broadphase::pair> Expected;
+    for (broadphase::proxy A = 0; A < Boxes.size(); A++) {
+      for (broadphase::proxy B = A + 1; B < Boxes.size(); B++) {
+        if (Boxes[A].Alive && Boxes[B].Alive && !(Boxes[A].Static && Boxes[B].Static) &&
+            Overlap(Boxes[A], Boxes[B])) {
+          Expected.emplace_back(A, B);
+        }
+      }
+    }
+    Check(!Expected.empty(), "the scene has overlaps");
+    if (Found != Expected) {
+      std::fprintf(stderr, "%s, frame %d: %zu pairs, expected %zu\n", Name, Frame, Found.size(), Expected.size());
+      Check(false, "the pairs match brute force");
+    }
+  }
+}
+} // namespace
+
+auto main() -> int {
+  Compare(broadphase_method::SweepAndPrune, "sweep and prune");
+  Compare(broadphase_method::SpatialHash, "spatial hash");
+  std::puts("broadphase: all checks passed");
+  return 0;
+}
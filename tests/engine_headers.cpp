@@ -0,0 +1,47 @@
+// Compiles every engine header, so components nothing instantiates yet are still checked by the build.
+
+#include "engine/assets/mapped_file.hpp"
+#include "engine/assets/mesh_file.hpp"
+#include "engine/assets/mesh_format.hpp"
+#include "engine/assets/texture_file.hpp"
+#include "engine/config.hpp"
+#include "engine/engine.hpp"
+#include "engine/frame_timer.hpp"
+#include "engine/job_system.hpp"
+#include "engine/log.hpp"
+#include "engine/particles.hpp"
+#include "engine/physics/broadphase.hpp"
+#include "engine/physics/rigid_bodies.hpp"
+#include "engine/profiler.hpp"
+#include "engine/render/clustered_lights.hpp"
+#include "engine/render/hiz_pyramid.hpp"
+#include "engine/render/indirect_draw.hpp"
+#include "engine/render/instance_batcher.hpp"
+#include "engine/render/particle_system.hpp"
+#include "engine/render/render_graph.hpp"
+#include "engine/shader/shader_compiler.hpp"
+#include "engine/shader/shader_library.hpp"
+#include "engine/simulation.hpp"
+#include "engine/software/occlusion_buffer.hpp"
+#include "engine/software/path_tracer.hpp"
+#include "engine/software/rasterizer.hpp"
+#include "engine/software/software_renderer.hpp"
+#include "engine/terrain.hpp"
+#include "engine/texture_residency.hpp"
+#include "engine/vulkan/bindless.hpp"
+#include "engine/vulkan/buffer.hpp"
+#include "engine/vulkan/common.hpp"
+#include "engine/vulkan/debug.hpp"
+#include "engine/vulkan/device.hpp"
+#include "engine/vulkan/frame.hpp"
+#include "engine/vulkan/gpu_timer.hpp"
+#include "engine/vulkan/instance.hpp"
+#include "engine/vulkan/memory_budget.hpp"
+#include "engine/vulkan/physical_device.hpp"
+#include "engine/vulkan/pipelines.hpp"
+#include "engine/vulkan/shader_variants.hpp"
+#include "engine/vulkan/surface.hpp"
+#include "engine/vulkan/swapchain.hpp"
+#include "engine/vulkan/terrain_streamer.hpp"
+#include "engine/vulkan/texture_streamer.hpp"
+#include "engine/vulkan/vulkan.hpp"
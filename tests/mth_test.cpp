@@ -0,0 +1,65 @@
+// Known-value checks for the mth matrix routines. Exits non-zero on the first failure.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "mth/mth.h"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+auto Near(FLT A, FLT B) -> bool { return std::abs(A - B) <= 1e-4F * std::max<FLT>(1, std::abs(B)); }
+auto Near(const matr &A, const matr &B) -> bool {
+  for (size_t i = 0; i < 16; i++) {
+    if (!Near(A.A[i], B.A[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Determinant() {
+  Check(Near(matr::Identity().Determ4x4(), 1), "determinant of identity");
+  Check(Near(matr::Scale(vec3(2, 3, 4)).Determ4x4(), 24), "determinant of a scale");
+  // Expanded by hand along the first row
+  const matr M(2, 0, 1, 3, 1, 4, 0, 2, 0, 1, 5, 1, 3, 0, 2, 6);
+  Check(Near(M.Determ4x4(), 58), "determinant of a general matrix");
+  Check(Near(matr(1, 2, 3, 4, 2, 4, 6, 8, 0, 1, 0, 1, 1, 0, 1, 0).Determ4x4(), 0), "determinant of a singular matrix");
+}
+
+void Multiply() {
+  Check(Near(matr::Translate(vec3(1, 2, 3)) * matr::Identity(), matr::Translate(vec3(1, 2, 3))), "M * identity");
+  // Row vectors: the left matrix applies first, so the translation is scaled too
+  const matr M = matr::Translate(vec3(1, 2, 3)) * matr::Scale(vec3(2, 3, 4));
+  Check(Near(M, matr(2, 0, 0, 0, 0, 3, 0, 0, 0, 0, 4, 0, 2, 6, 12, 1)), "translate * scale");
+  const vec3 P = M.PointTransform(vec3(1, 1, 1));
+  Check(Near(P[0], 4) && Near(P[1], 9) && Near(P[2], 16), "point through translate * scale");
+  const matr A(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+  const matr B(2, 0, 0, 1, 0, 1, 0, 0, 1, 0, 1, 0, 0, 0, 0, 1);
+  Check(Near(A * B, matr(5, 2, 3, 5, 17, 6, 7, 13, 29, 10, 11, 21, 41, 14, 15, 29)), "general product");
+}
+
+void Inverse() {
+  const matr M(2, 0, 1, 3, 1, 4, 0, 2, 0, 1, 5, 1, 3, 0, 2, 6);
+  Check(Near(M * M.Inverse(), matr::Identity()), "M * inverse(M) = identity");
+  Check(Near(M.Inverse() * M, matr::Identity()), "inverse(M) * M = identity");
+  const matr Affine = matr::Translate(vec3(4, -5, 6)) * matr::Scale(vec3(2, 3, 4));
+  Check(Near(Affine.Inverse(), matr::Scale(vec3(0.5F, 1 / 3.0F, 0.25F)) * matr::Translate(vec3(-4, 5, -6))),
+        "inverse of an affine transform");
+  const vec3 P = Affine.Inverse().PointTransform(Affine.PointTransform(vec3(1, 2, 3)));
+  Check(Near(P[0], 1) && Near(P[1], 2) && Near(P[2], 3), "inverse undoes a point transform");
+}
+} // namespace
+
+auto main() -> int {
+  Determinant();
+  Multiply();
+  Inverse();
+  std::puts("mth: all checks passed");
+  return 0;
+}
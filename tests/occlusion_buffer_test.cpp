@@ -0,0 +1,47 @@
+// Checks for the CPU hierarchical-Z occlusion buffer: a wall hides what is behind it and nothing else.
+// Exits non-zero on the first failure.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "engine/software/occlusion_buffer.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+} // namespace
+
+auto main() -> int {
+  job_system Jobs;
+  occlusion_buffer Occlusion(Jobs);
+  mth::camera<float> Camera;
+  Camera.Resize(static_cast<int>(Occlusion.GetWidth()), static_cast<int>(Occlusion.GetHeight()));
+  Camera.Set({0, 0, 10}, {0, 0, 0}, {0, 1, 0});
+
+  Check(Occlusion.IsSphereVisible({0, 0, -5}, 1), "everything in the frustum is visible before the first render");
+
+  // A 4 x 4 wall through the origin, facing the camera
+  const std::vector<mesh_format::vertex> Wall = {
+      {.Position = {-2, -2, 0}, .Normal = {0, 0, 1}, .UV = {0, 0}},
+      {.Position = {2, -2, 0}, .Normal = {0, 0, 1}, .UV = {1, 0}},
+      {.Position = {2, 2, 0}, .Normal = {0, 0, 1}, .UV = {1, 1}},
+      {.Position = {-2, 2, 0}, .Normal = {0, 0, 1}, .UV = {0, 1}},
+  };
+  const std::vector<uint32_t> Indices = {0, 1, 2, 0, 2, 3};
+  Occlusion.Draw(Wall, Indices, mth::matr<float>::Identity());
+  Occlusion.Render(Camera);
+
+  Check(!Occlusion.IsSphereVisible({0, 0, -5}, 1), "a sphere behind the wall is culled");
+  Check(Occlusion.IsSphereVisible({0, 0, 5}, 1), "a sphere in front of the wall is visible");
+  Check(Occlusion.IsSphereVisible({4, 0, -5}, 1), "a sphere beside the wall is visible");
+  Check(Occlusion.IsSphereVisible({0, 0, -5}, 4), "a sphere larger than the wall is visible");
+  Check(Occlusion.IsSphereVisible({0, 0, 0}, 0.5F), "a sphere through the wall is visible");
+  Check(!Occlusion.IsSphereVisible({0, 40, -5}, 1), "a sphere outside the frustum is culled");
+  Check(Occlusion.IsSphereVisible({0, 0, 10}, 1), "a sphere around the camera is visible");
+  std::puts("occlusion_buffer: all checks passed");
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Checks for the CPU particle simulation: the steady-state particle count, and particles coming to rest on
+// a floor they only know through a rasterized depth buffer. Exits non-zero on the first failure.
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "engine/particles.hpp"
+#include "engine/software/rasterizer.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+
+constexpr float Dt = 0.01F;
+
+// Emission balances expiry once the oldest particles die, leaving Rate * Lifetime alive
+void SteadyCount(job_system &Jobs) {
+  particle_simulation Simulation(Jobs, {.MaxParticles = 1U << 16});
+  const std::array<particle_emitter, 1> Emitters = {
+      {{.Position = {0, 0, 0}, .Velocity = {0, 1, 0}, .Lifetime = 2, .LifetimeJitter = 0, .Rate = 1000}}};
+  for (int Step = 0; Step < 300; Step++) {
+    Simulation.Update(Dt, Emitters);
+  }
+  const float Expected = Emitters[0].Rate * Emitters[0].Lifetime;
+  Check(std::abs(static_cast<float>(Simulation.GetCount()) - Expected) <= Emitters[0].Rate * Dt * 2,
+        "steady-state count is rate * lifetime");
+  for (const float Age : Simulation.GetAge()) {
+    Check(Age < Emitters[0].Lifetime, "no particle outlives its lifetime");
+  }
+}
+
+// A 20 x 20 floor at y = 0 seen from above at an angle; particles dropped onto it bounce and settle
+void RestOnFloor(job_system &Jobs) {
+  const std::vector<mesh_format::vertex> Floor = {
+      {.Position = {-10, 0, -10}, .Normal = {0, 1, 0}, .UV = {0, 0}},
+      {.Position = {10, 0, -10}, .Normal = {0, 1, 0}, .UV = {1, 0}},
+      {.Position = {10, 0, 10}, .Normal = {0, 1, 0}, .UV = {1, 1}},
+      {.Position = {-10, 0, 10}, .Normal = {0, 1, 0}, .UV = {0, 1}},
+  };
+  const std::vector<uint32_t> Indices = {0, 1, 2, 0, 2, 3};
+  mth::camera<float> Camera;
+  Camera.Resize(256, 256);
+  Camera.Set({0, 6, 8}, {0, 0, 0}, {0, 1, 0});
+  rasterizer Rasterizer(Jobs, 256, 256);
+  Rasterizer.Draw(Floor, Indices, mth::matr<float>::Identity());
+  Rasterizer.Render(Camera);
+  const particle_depth Depth{.Depth = Rasterizer.GetDepth(),
+                             .Width = Rasterizer.GetWidth(),
+                             .Height = Rasterizer.GetHeight(),
+                             .Pitch = Rasterizer.GetPitch(),
+                             .ViewProjection = Camera.MatrVP};
+
+  particle_simulation Simulation(Jobs, {.MaxParticles = 4096});
+  const std::array<particle_emitter, 1> Emitters = {
+      {{.Position = {0, 2, 0}, .Radius = 1, .Velocity = {0, 0, 0}, .Spread = 0, .Lifetime = 100, .Rate = 1000}}};
+  for (int Step = 0; Step < 500; Step++) {
+    // Half a second of emission, then the rest of the time to settle
+    Simulation.Update(Dt, Step < 50 ? std::span<const particle_emitter>(Emitters) : std::span<const particle_emitter>(),
+                      &Depth);
+  }
+  Check(Simulation.GetCount() > 0, "particles were emitted");
+  for (size_t i = 0; i < Simulation.GetCount(); i++) {
+    Check(std::abs(Simulation.GetPositionY()[i]) < 0.05F, "particles rest on the floor");
+    Check(std::abs(Simulation.GetVelocityY()[i]) < 0.5F, "resting particles have stopped bouncing");
+  }
+}
+} // namespace
+
+auto main() -> int {
+  job_system Jobs;
+  SteadyCount(Jobs);
+  RestOnFloor(Jobs);
+  std::puts("particles: all checks passed");
+  return 0;
+}
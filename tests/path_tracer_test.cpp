@@ -0,0 +1,110 @@
+// Checks for the reference path tracer against scenes with exact answers. Under a uniform sky every bounce
+// off a convex or flat surface escapes straight to the sky, so a Lambertian surface shows exactly albedo
+// times sky radiance, without noise. Exits non-zero on the first failure.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "engine/software/path_tracer.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+auto Near(const mth::vec3<float> &A, const mth::vec3<float> &B) -> bool {
+  return std::abs(A.X - B.X) <= 1e-4F && std::abs(A.Y - B.Y) <= 1e-4F && std::abs(A.Z - B.Z) <= 1e-4F;
+}
+
+const mth::vec3<float> Sky(0.5F, 1.0F, 2.0F);
+const path_tracer::settings Settings{.TileSize = 8, .MinSamples = 8, .TimeLimit = std::chrono::seconds(30), .Sky = Sky};
+
+void Spheres(job_system &Jobs) {
+  path_tracer Tracer(Jobs, Settings);
+  const mth::vec3<float> Albedo(0.25F, 0.5F, 0.75F), Emission(3, 2, 1);
+  Tracer.AddSphere({0, 0, 0}, 2, Tracer.AddMaterial({.Albedo = Albedo}));
+  Tracer.AddSphere({4, 0, 0}, 0.5F, Tracer.AddMaterial({.Albedo = mth::vec3<float>(0.0F), .Emission = Emission}));
+  mth::camera<float> Camera;
+  Camera.Resize(32, 32);
+  Camera.Set({0, 0, 10}, {0, 0, 0}, {0, 1, 0});
+  const path_tracer::stats Stats = Tracer.Render(Camera);
+  Check(Stats.ConvergedTiles == Stats.Tiles, "a noise-free scene converges everywhere");
+  Check(Tracer.GetWidth() == 32 && Tracer.GetHeight() == 32, "the image has the camera's size");
+  Check(Near(Tracer.GetPixel(0, 0), Sky), "rays that miss see the sky");
+  // The diffuse sphere also sees the light, but only from pixels off its centre line
+  Check(Near(Tracer.GetPixel(16, 16), Albedo * Sky), "a diffuse sphere reflects albedo times the sky");
+  Check(Near(Tracer.GetPixel(28, 16), Emission), "a black emissive sphere shows its emission");
+}
+
+void Floor(job_system &Jobs) {
+  path_tracer Tracer(Jobs, Settings);
+  const mth::vec3<float> Albedo(0.5F);
+  // Enough triangles for the BVH to split several times
+  std::vector<mesh_format::vertex> Vertices;
+  std::vector<uint32_t> Indices;
+  const int Cells = 16;
+  const auto Corner = [&](int i) { return static_cast<float>(i - Cells / 2) * 10; };
+  for (int Z = 0; Z <= Cells; Z++) {
+    for (int X = 0; X <= Cells; X++) {
+      Vertices.push_back({.Position = {Corner(X), 0, Corner(Z)}, .Normal = {0, 1, 0}, .UV = {0, 0}});
+    }
+  }
+  for (uint32_t Z = 0; Z < Cells; Z++) {
+    for (uint32_t X = 0; X < Cells; X++) {
+      const uint32_t Base = Z * (Cells + 1) + X;
+      Indices.insert(Indices.end(), {Base, Base + Cells + 1, Base + 1, Base + 1, Base + Cells + 1, Base + Cells + 2});
+    }
+  }
+  Tracer.AddMesh(Vertices, Indices, mth::matr<float>::Identity(), Tracer.AddMaterial({.Albedo = Albedo}));
+  mth::camera<float> Camera;
+  Camera.Resize(16, 16);
+  Camera.Set({3, 10, 1}, {3, 0, 1}, {0, 0, -1});
+  Tracer.Render(Camera);
+  for (uint32_t Y = 0; Y < 16; Y++) {
+    for (uint32_t X = 0; X < 16; X++) {
+      Check(Near(Tracer.GetPixel(X, Y), Albedo * Sky), "a diffuse floor reflects albedo times the sky");
+    }
+  }
+}
+
+// Samples are seeded per pixel, so the image does not depend on how the workers shared the tiles
+void Deterministic(job_system &Jobs) {
+  path_tracer::settings Noisy = Settings;
+  Noisy.MinSamples = Noisy.MaxSamples = 16;
+  mth::camera<float> Camera;
+  Camera.Resize(24, 24);
+  Camera.Set({0, 3, 10}, {0, 0, 0}, {0, 1, 0});
+  std::vector<mth::vec3<float>> First;
+  for (int Run = 0; Run < 2; Run++) {
+    path_tracer Tracer(Jobs, Noisy);
+    const path_tracer::material White = Tracer.AddMaterial({});
+    Tracer.AddSphere({-1, 0, 0}, 1, White);
+    Tracer.AddSphere({1, 0, 0}, 1, White);
+    Tracer.AddSphere({0, 3, 0}, 0.5F, Tracer.AddMaterial({.Emission = mth::vec3<float>(10.0F)}));
+    Tracer.Render(Camera);
+    for (uint32_t Y = 0; Y < 24; Y++) {
+      for (uint32_t X = 0; X < 24; X++) {
+        if (Run == 0) {
+          First.push_back(Tracer.GetPixel(X, Y));
+        } else {
+          const mth::vec3<float> &A = First[Y * 24 + X];
+          const mth::vec3<float> B = Tracer.GetPixel(X, Y);
+          Check(A.X == B.X && A.Y == B.Y && A.Z == B.Z, "two renders of a scene are identical");
+        }
+      }
+    }
+  }
+}
+} // namespace
+
+auto main() -> int {
+  job_system Jobs;
+  Spheres(Jobs);
+  Floor(Jobs);
+  Deterministic(Jobs);
+  std::puts("path_tracer: all checks passed");
+  return 0;
+}
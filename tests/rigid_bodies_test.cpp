@@ -0,0 +1,89 @@
+// Checks for rigid-body dynamics against motion with known outcomes: free fall, bodies coming to rest on a
+// floor, a stack that holds, and a head-on collision that conserves momentum. Exits non-zero on the first
+// failure.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "engine/physics/rigid_bodies.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+
+constexpr float Dt = 1.0F / 60;
+
+// Semi-implicit Euler adds the step's gravity to the velocity before moving, so after n steps the body has
+// fallen g * Dt^2 * n (n + 1) / 2
+void FreeFall(job_system &Jobs) {
+  rigid_bodies Bodies(Jobs);
+  const rigid_bodies::body Ball = Bodies.Add({.Shape = body_shape::Sphere, .Position = {0, 100, 0}});
+  const int Steps = 60;
+  for (int i = 0; i < Steps; i++) {
+    Bodies.Step(Dt);
+  }
+  const float Fallen = 9.81F * Dt * Dt * Steps * (Steps + 1) / 2;
+  Check(std::abs(Bodies.GetVelocity(Ball).Y + 9.81F * Dt * Steps) < 1e-3F, "velocity grows by g per second");
+  Check(std::abs(Bodies.GetPosition(Ball).Y - (100 - Fallen)) < 1e-3F, "position follows semi-implicit Euler");
+  Check(Bodies.GetVelocity(Ball).X == 0 && Bodies.GetVelocity(Ball).Z == 0, "gravity only acts along y");
+}
+
+// Two stacks and a ball on one floor: they rest, the stacks stay up, and all three solve as separate islands
+void Stacks(job_system &Jobs) {
+  rigid_bodies Bodies(Jobs);
+  Bodies.AddPlane({0, 1, 0}, 0);
+  std::vector<rigid_bodies::body> Boxes;
+  for (const float X : {-5.0F, 5.0F}) {
+    for (int Level = 0; Level < 3; Level++) {
+      Boxes.push_back(Bodies.Add({.Position = {X, 0.5F + 1.05F * static_cast<float>(Level), 0}}));
+    }
+  }
+  const rigid_bodies::body Ball = Bodies.Add({.Shape = body_shape::Sphere, .Position = {0, 3, 0}});
+  for (int i = 0; i < 300; i++) {
+    Bodies.Step(Dt);
+  }
+  for (size_t i = 0; i < Boxes.size(); i++) {
+    const mth::vec3<float> &Position = Bodies.GetPosition(Boxes[i]);
+    Check(std::abs(Position.Y - (0.5F + static_cast<float>(i % 3))) < 0.05F, "boxes rest on each other");
+    Check(std::abs(Position.X - (i < 3 ? -5.0F : 5.0F)) < 0.05F && std::abs(Position.Z) < 0.05F,
+          "the stacks stay upright");
+    Check(Bodies.GetVelocity(Boxes[i]).Length() < 0.05F, "resting boxes have stopped");
+  }
+  Check(std::abs(Bodies.GetPosition(Ball).Y - 0.5F) < 0.02F, "the ball rests on the floor");
+  Check(Bodies.GetStats().Islands == 3, "the floor does not join its bodies into one island");
+}
+
+// Equal spheres meeting head-on without gravity: momentum is conserved and a perfectly elastic collision
+// swaps their velocities
+void Collision(job_system &Jobs) {
+  rigid_bodies Bodies(Jobs, {.Gravity = {0, 0, 0}});
+  const body_desc Sphere{.Shape = body_shape::Sphere, .Friction = 0, .Restitution = 1};
+  body_desc Left = Sphere, Right = Sphere;
+  Left.Position = {-2, 0, 0};
+  Left.Velocity = {3, 0, 0};
+  Right.Position = {2, 0, 0};
+  Right.Velocity = {-3, 0, 0};
+  const rigid_bodies::body A = Bodies.Add(Left), B = Bodies.Add(Right);
+  for (int i = 0; i < 60; i++) {
+    Bodies.Step(Dt);
+    Check(std::abs(Bodies.GetVelocity(A).X + Bodies.GetVelocity(B).X) < 1e-3F, "momentum is conserved");
+  }
+  Check(std::abs(Bodies.GetVelocity(A).X + 3) < 0.1F && std::abs(Bodies.GetVelocity(B).X - 3) < 0.1F,
+        "an elastic collision swaps the velocities");
+  Check(Bodies.GetPosition(A).X < -1 && Bodies.GetPosition(B).X > 1, "the spheres separate");
+}
+} // namespace
+
+auto main() -> int {
+  job_system Jobs;
+  FreeFall(Jobs);
+  Stacks(Jobs);
+  Collision(Jobs);
+  std::puts("rigid_bodies: all checks passed");
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Checks for terrain: chunks of different levels of detail meet without cracks, and streaming builds every
+// chunk in view. Exits non-zero on the first failure.
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include "engine/terrain.hpp"
+
+namespace {
+void Check(bool Condition, const char *What) {
+  if (!Condition) {
+    std::fprintf(stderr, "FAILED: %s\n", What);
+    std::exit(1);
+  }
+}
+
+using point = std::array<float, 3>;
+
+// Triangle edges lying on the line where Axis equals Value, each as its two endpoints in order
+auto BoundaryEdges(const terrain::chunk_mesh &Mesh, size_t Axis, float Value) -> std::set<std::pair<point, point>> {
+  std::set<std::pair<point, point>> Edges;
+  for (size_t t = 0; t < Mesh.Indices.size(); t += 3) {
+    for (size_t k = 0; k < 3; k++) {
+      const point &A = Mesh.Vertices[Mesh.Indices[t + k]].Position;
+      const point &B = Mesh.Vertices[Mesh.Indices[t + (k + 1) % 3]].Position;
+      if (A[Axis] == Value && B[Axis] == Value) {
+        Edges.insert(std::minmax(A, B));
+      }
+    }
+  }
+  return Edges;
+}
+
+// A chunk told that its neighbour is coarser must share exactly the neighbour's boundary edges, at
+// bit-identical positions, or the seam shows cracks or T-junctions
+void Seams(const terrain &Terrain) {
+  const terrain::settings &Settings = Terrain.GetSettings();
+  // Neighbour offset, and the axis and value of the shared line, per side in -x, +x, -z, +z order
+  const std::array<std::array<int32_t, 2>, 4> Offsets{{{-1, 0}, {1, 0}, {0, -1}, {0, 1}}};
+  const std::array<std::pair<size_t, float>, 4> Lines{
+      {{0, 0.0F}, {0, Settings.ChunkSize}, {2, 0.0F}, {2, Settings.ChunkSize}}};
+  for (uint32_t Fine = 0; Fine < Settings.LodCount; Fine++) {
+    for (uint32_t Coarse = Fine; Coarse < Settings.LodCount; Coarse++) {
+      for (uint32_t Side = 0; Side < 4; Side++) {
+        const uint32_t Key = Fine | (Coarse - Fine) << (8 + 4 * Side);
+        const auto FineMesh = Terrain.Generate(terrain::Id(0, 0), Key);
+        const auto CoarseMesh = Terrain.Generate(terrain::Id(Offsets[Side][0], Offsets[Side][1]), Coarse);
+        const auto [Axis, Value] = Lines[Side];
+        const auto Edges = BoundaryEdges(*FineMesh, Axis, Value);
+        Check(!Edges.empty(), "the chunk has edges on its boundary");
+        Check(Edges == BoundaryEdges(*CoarseMesh, Axis, Value), "neighbouring chunks share their boundary edges");
+      }
+    }
+  }
+}
+
+void Streaming(terrain &Terrain) {
+  const int32_t Radius = Terrain.GetSettings().ViewRadius;
+  size_t InView = 0;
+  for (int32_t Z = -Radius; Z <= Radius; Z++) {
+    for (int32_t X = -Radius; X <= Radius; X++) {
+      InView += X * X + Z * Z <= Radius * Radius ? 1 : 0;
+    }
+  }
+  const auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (Terrain.GetReady().size() < InView && std::chrono::steady_clock::now() < Deadline) {
+    Terrain.Update({0, 0, 0});
+    Check(Terrain.GetJobsInFlight() <= Terrain.GetSettings().MaxJobs, "no more jobs than MaxJobs are in flight");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  Check(Terrain.GetReady().size() == InView, "every chunk in view is built");
+  std::set<terrain::chunk_id> Chunks;
+  for (const auto &Mesh : Terrain.GetReady()) {
+    Chunks.insert(Mesh->Chunk);
+    Check(!Mesh->Indices.empty(), "built chunks have triangles");
+  }
+  Check(Chunks.size() == InView, "each chunk is built once");
+  // The renderer takes the meshes, then drops one and asks for it again
+  Terrain.GetReady().clear();
+  Terrain.Rebuild(terrain::Id(0, 0));
+  while (Terrain.GetReady().empty() && std::chrono::steady_clock::now() < Deadline) {
+    Terrain.Update({0, 0, 0});
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  Check(Terrain.GetReady().size() == 1 && Terrain.GetReady().front()->Chunk == terrain::Id(0, 0),
+        "Rebuild builds just that chunk again");
+  // Moving away evicts everything; jobs still running must be waited for by the destructor
+  Terrain.Update({1e5F, 0, 1e5F});
+  Check(Terrain.TakeEvicted().size() == InView, "chunks out of view are evicted");
+}
+} // namespace
+
+auto main() -> int {
+  job_system Jobs;
+  terrain Terrain(Jobs, {.ChunkSize = 32, .Resolution = 16, .LodCount = 4, .LodDistance = 32, .ViewRadius = 3});
+  Seams(Terrain);
+  Streaming(Terrain);
+  std::puts("terrain: all checks passed");
+  return 0;
+}
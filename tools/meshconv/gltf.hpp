@@ -0,0 +1,215 @@
+#pragma once
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "source_mesh.hpp"
+
+namespace gltf_detail {
+inline auto ReadFile(const std::filesystem::path &Path) -> std::vector<char> {
+  std::ifstream File(Path, std::ios::binary);
+  if (!File) {
+    throw std::runtime_error("failed to open " + Path.string());
+  }
+  return {std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>()};
+}
+
+inline auto DecodeBase64(std::string_view Text) -> std::vector<char> {
+  auto Value = [](char C) -> int {
+    if (C >= 'A' && C <= 'Z') {
+      return C - 'A';
+    }
+    if (C >= 'a' && C <= 'z') {
+      return C - 'a' + 26;
+    }
+    if (C >= '0' && C <= '9') {
+      return C - '0' + 52;
+    }
+    return C == '+' ? 62 : C == '/' ? 63 : -1;
+  };
+  std::vector<char> Out;
+  uint32_t Bits = 0;
+  int Count = 0;
+  for (char C : Text) {
+    const int V = Value(C);
+    if (V < 0) {
+      continue; // Padding and whitespace
+    }
+    Bits = (Bits << 6) | static_cast<uint32_t>(V);
+    if ((Count += 6) >= 8) {
+      Count -= 8;
+      Out.push_back(static_cast<char>((Bits >> Count) & 0xFF));
+    }
+  }
+  return Out;
+}
+
+// Reads accessor element Index, component Component, converted to T.
+struct accessor_view {
+  const char *Data;
+  size_t Stride;
+  size_t Count;
+  int ComponentType;
+  int Components;
+
+  template <class T> [[nodiscard]] auto Get(size_t Index, int Component) const -> T {
+    const char *Element = Data + Index * Stride;
+    switch (ComponentType) {
+    case 5121:
+      return static_cast<T>(reinterpret_cast<const uint8_t *>(Element)[Component]);
+    case 5123: {
+      uint16_t V;
+      std::memcpy(&V, Element + Component * sizeof(V), sizeof(V));
+      return static_cast<T>(V);
+    }
+    case 5125: {
+      uint32_t V;
+      std::memcpy(&V, Element + Component * sizeof(V), sizeof(V));
+      return static_cast<T>(V);
+    }
+    case 5126: {
+      float V;
+      std::memcpy(&V, Element + Component * sizeof(V), sizeof(V));
+      return static_cast<T>(V);
+    }
+    default:
+      throw std::runtime_error("gltf: unsupported component type " + std::to_string(ComponentType));
+    }
+  }
+};
+} // namespace gltf_detail
+
+// glTF 2.0, both .gltf (external or data: URI buffers) and .glb. Every triangle primitive becomes one
+// mesh; node transforms are not applied, the converter exports meshes in their own space.
+inline auto LoadGltf(const std::filesystem::path &Path) -> std::vector<source_mesh> {
+  using namespace gltf_detail;
+  const std::vector<char> File = ReadFile(Path);
+  std::string_view JsonText(File.data(), File.size());
+  std::vector<std::vector<char>> Buffers;
+  std::vector<char> GlbBinary;
+
+  if (File.size() >= 12 && std::memcmp(File.data(), "glTF", 4) == 0) {
+    // Header, then a JSON chunk and an optional BIN chunk
+    size_t Offset = 12;
+    while (Offset + 8 <= File.size()) {
+      uint32_t Length = 0, Type = 0;
+      std::memcpy(&Length, File.data() + Offset, 4);
+      std::memcpy(&Type, File.data() + Offset + 4, 4);
+      if (Offset + 8 + Length > File.size()) {
+        throw std::runtime_error(Path.string() + ": truncated chunk");
+      }
+      if (Type == 0x4E4F534A) { // "JSON"
+        JsonText = std::string_view(File.data() + Offset + 8, Length);
+      } else if (Type == 0x004E4942) { // "BIN\0"
+        GlbBinary.assign(File.data() + Offset + 8, File.data() + Offset + 8 + Length);
+      }
+      Offset += 8 + Length;
+    }
+  }
+  const json Root = json::Parse(JsonText);
+
+  if (Root.Has("buffers")) {
+    for (const json &Buffer : Root["buffers"].Array()) {
+      if (!Buffer.Has("uri")) {
+        Buffers.push_back(GlbBinary);
+      } else if (const std::string &Uri = Buffer["uri"].String(); Uri.starts_with("data:")) {
+        Buffers.push_back(DecodeBase64(std::string_view(Uri).substr(Uri.find(',') + 1)));
+      } else {
+        Buffers.push_back(ReadFile(Path.parent_path() / Uri));
+      }
+    }
+  }
+
+  auto Accessor = [&](int64_t Index) -> accessor_view {
+    static constexpr std::array<std::pair<std::string_view, int>, 5> TypeSizes = {
+        {{"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4}, {"MAT4", 16}}};
+    const json &A = Root["accessors"][static_cast<size_t>(Index)];
+    const json &View = Root["bufferViews"][static_cast<size_t>(A["bufferView"].Int())];
+    const std::vector<char> &Buffer = Buffers.at(static_cast<size_t>(View["buffer"].Int()));
+    const int ComponentType = static_cast<int>(A["componentType"].Int());
+    int Components = 0;
+    for (const auto &[Name, Size] : TypeSizes) {
+      Components = A["type"].String() == Name ? Size : Components;
+    }
+    const size_t ComponentSize = ComponentType == 5121 ? 1 : ComponentType == 5123 ? 2 : 4;
+    const size_t Offset = static_cast<size_t>(View.IntOr("byteOffset", 0) + A.IntOr("byteOffset", 0));
+    const auto Stride = static_cast<size_t>(View.IntOr("byteStride", static_cast<int64_t>(ComponentSize) * Components));
+    const auto Count = static_cast<size_t>(A["count"].Int());
+    if (Count != 0 && Offset + (Count - 1) * Stride + ComponentSize * Components > Buffer.size()) {
+      throw std::runtime_error(Path.string() + ": accessor out of bounds");
+    }
+    return {.Data = Buffer.data() + Offset,
+            .Stride = Stride,
+            .Count = Count,
+            .ComponentType = ComponentType,
+            .Components = Components};
+  };
+
+  std::vector<source_mesh> Meshes;
+  if (!Root.Has("meshes")) {
+    return Meshes;
+  }
+  const json::array &SourceMeshes = Root["meshes"].Array();
+  for (size_t m = 0; m < SourceMeshes.size(); m++) {
+    const json &Mesh = SourceMeshes[m];
+    const json::array &Primitives = Mesh["primitives"].Array();
+    for (size_t p = 0; p < Primitives.size(); p++) {
+      const json &Primitive = Primitives[p];
+      if (Primitive.IntOr("mode", 4) != 4 || !Primitive["attributes"].Has("POSITION")) {
+        continue; // Only indexed or plain triangle lists
+      }
+      source_mesh Out;
+      Out.Name = Mesh.Has("name") ? Mesh["name"].String() : "mesh" + std::to_string(m);
+      if (Primitives.size() > 1) {
+        Out.Name += "." + std::to_string(p);
+      }
+      const json &Attributes = Primitive["attributes"];
+      const accessor_view Positions = Accessor(Attributes["POSITION"].Int());
+      Out.Vertices.resize(Positions.Count);
+      for (size_t i = 0; i < Positions.Count; i++) {
+        for (int c = 0; c < 3; c++) {
+          Out.Vertices[i].Position[c] = Positions.Get<float>(i, c);
+        }
+      }
+      if (Attributes.Has("NORMAL")) {
+        const accessor_view Normals = Accessor(Attributes["NORMAL"].Int());
+        for (size_t i = 0; i < std::min(Normals.Count, Out.Vertices.size()); i++) {
+          for (int c = 0; c < 3; c++) {
+            Out.Vertices[i].Normal[c] = Normals.Get<float>(i, c);
+          }
+        }
+      } else {
+        Out.HasNormals = false;
+      }
+      if (Attributes.Has("TEXCOORD_0")) {
+        const accessor_view UVs = Accessor(Attributes["TEXCOORD_0"].Int());
+        const float Scale = UVs.ComponentType == 5121 ? 1.0F / 255 : UVs.ComponentType == 5123 ? 1.0F / 65535 : 1;
+        for (size_t i = 0; i < std::min(UVs.Count, Out.Vertices.size()); i++) {
+          Out.Vertices[i].UV = {UVs.Get<float>(i, 0) * Scale, UVs.Get<float>(i, 1) * Scale};
+        }
+      }
+      if (Primitive.Has("indices")) {
+        const accessor_view Indices = Accessor(Primitive["indices"].Int());
+        Out.Indices.resize(Indices.Count);
+        for (size_t i = 0; i < Indices.Count; i++) {
+          Out.Indices[i] = Indices.Get<uint32_t>(i, 0);
+          if (Out.Indices[i] >= Out.Vertices.size()) {
+            throw std::runtime_error(Path.string() + ": index out of range");
+          }
+        }
+      } else {
+        Out.Indices.resize(Out.Vertices.size());
+        for (size_t i = 0; i < Out.Indices.size(); i++) {
+          Out.Indices[i] = static_cast<uint32_t>(i);
+        }
+      }
+      Meshes.push_back(std::move(Out));
+    }
+  }
+  return Meshes;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <cctype>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// Just enough JSON to read glTF headers.
+struct json {
+  using array = std::vector<json>;
+  using object = std::map<std::string, json, std::less<>>;
+  std::variant<std::nullptr_t, bool, double, std::string, std::shared_ptr<array>, std::shared_ptr<object>> Value;
+
+  [[nodiscard]] auto IsNull() const -> bool { return std::holds_alternative<std::nullptr_t>(Value); }
+  [[nodiscard]] auto Number() const -> double { return std::get<double>(Value); }
+  [[nodiscard]] auto Int() const -> int64_t { return static_cast<int64_t>(Number()); }
+  [[nodiscard]] auto String() const -> const std::string & { return std::get<std::string>(Value); }
+  [[nodiscard]] auto Array() const -> const array & { return *std::get<std::shared_ptr<array>>(Value); }
+  [[nodiscard]] auto Object() const -> const object & { return *std::get<std::shared_ptr<object>>(Value); }
+
+  // Member lookup; returns a null value if absent so optional fields read naturally.
+  auto operator[](std::string_view Key) const -> const json & {
+    static const json Null;
+    const object &Members = Object();
+    const auto It = Members.find(Key);
+    return It == Members.end() ? Null : It->second;
+  }
+  auto operator[](size_t Index) const -> const json & { return Array().at(Index); }
+  [[nodiscard]] auto Has(std::string_view Key) const -> bool { return !(*this)[Key].IsNull(); }
+  [[nodiscard]] auto IntOr(std::string_view Key, int64_t Default) const -> int64_t {
+    return Has(Key) ? (*this)[Key].Int() : Default;
+  }
+
+  static auto Parse(std::string_view Text) -> json {
+    size_t Pos = 0;
+    json Result = ParseValue(Text, Pos);
+    SkipSpace(Text, Pos);
+    if (Pos != Text.size()) {
+      throw std::runtime_error("json: trailing characters");
+    }
+    return Result;
+  }
+
+private:
+  static void SkipSpace(std::string_view Text, size_t &Pos) {
+    while (Pos < Text.size() && std::isspace(static_cast<unsigned char>(Text[Pos])) != 0) {
+      Pos++;
+    }
+  }
+  static void Expect(std::string_view Text, size_t &Pos, char C) {
+    SkipSpace(Text, Pos);
+    if (Pos >= Text.size() || Text[Pos] != C) {
+      throw std::runtime_error(std::string("json: expected '") + C + "' at " + std::to_string(Pos));
+    }
+    Pos++;
+  }
+  static auto ParseString(std::string_view Text, size_t &Pos) -> std::string {
+    Expect(Text, Pos, '"');
+    std::string Out;
+    while (Pos < Text.size() && Text[Pos] != '"') {
+      char C = Text[Pos++];
+      if (C == '\\' && Pos < Text.size()) {
+        C = Text[Pos++];
+        switch (C) {
+        case 'n':
+          C = '\n';
+          break;
+        case 't':
+          C = '\t';
+          break;
+        case 'u': // glTF keys and URIs are ASCII; keep the escape verbatim otherwise
+          Out += "\\u";
+          continue;
+        default:
+          break;
+        }
+      }
+      Out += C;
+    }
+    Expect(Text, Pos, '"');
+    return Out;
+  }
+  static auto ParseValue(std::string_view Text, size_t &Pos) -> json {
+    SkipSpace(Text, Pos);
+    if (Pos >= Text.size()) {
+      throw std::runtime_error("json: unexpected end");
+    }
+    const char C = Text[Pos];
+    if (C == '{') {
+      auto Members = std::make_shared<object>();
+      Pos++;
+      SkipSpace(Text, Pos);
+      if (Text[Pos] == '}') {
+        Pos++;
+        return {Members};
+      }
+      do {
+        std::string Key = ParseString(Text, Pos);
+        Expect(Text, Pos, ':');
+        (*Members)[Key] = ParseValue(Text, Pos);
+        SkipSpace(Text, Pos);
+      } while (Text[Pos++] == ',');
+      if (Text[Pos - 1] != '}') {
+        throw std::runtime_error("json: expected '}'");
+      }
+      return {Members};
+    }
+    if (C == '[') {
+      auto Elements = std::make_shared<array>();
+      Pos++;
+      SkipSpace(Text, Pos);
+      if (Text[Pos] == ']') {
+        Pos++;
+        return {Elements};
+      }
+      do {
+        Elements->push_back(ParseValue(Text, Pos));
+        SkipSpace(Text, Pos);
+      } while (Text[Pos++] == ',');
+      if (Text[Pos - 1] != ']') {
+        throw std::runtime_error("json: expected ']'");
+      }
+      return {Elements};
+    }
+    if (C == '"') {
+      return {ParseString(Text, Pos)};
+    }
+    if (Text.substr(Pos, 4) == "true") {
+      Pos += 4;
+      return {true};
+    }
+    if (Text.substr(Pos, 5) == "false") {
+      Pos += 5;
+      return {false};
+    }
+    if (Text.substr(Pos, 4) == "null") {
+      Pos += 4;
+      return {nullptr};
+    }
+    size_t End = Pos;
+    while (End < Text.size() && (std::isdigit(static_cast<unsigned char>(Text[End])) != 0 ||
+                                 std::string_view("+-.eE").find(Text[End]) != std::string_view::npos)) {
+      End++;
+    }
+    if (End == Pos) {
+      throw std::runtime_error("json: unexpected character at " + std::to_string(Pos));
+    }
+    const double Number = std::stod(std::string(Text.substr(Pos, End - Pos)));
+    Pos = End;
+    return {Number};
+  }
+};
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gltf.hpp"
+#include "obj.hpp"
+
+namespace {
+// Packs all meshes into one vertex and one index stream, laid out exactly as mesh_file maps them.
+void WriteMeshFile(const std::string &Path, std::vector<source_mesh> &Meshes) {
+  std::vector<mesh_format::mesh> Table;
+  uint64_t VertexCount = 0, IndexCount = 0;
+  for (source_mesh &Mesh : Meshes) {
+    if (!Mesh.HasNormals) {
+      Mesh.ComputeNormals();
+    }
+    mesh_format::mesh Entry{};
+    std::strncpy(Entry.Name.data(), Mesh.Name.c_str(), Entry.Name.size() - 1);
+    Entry.FirstIndex = static_cast<uint32_t>(IndexCount);
+    Entry.IndexCount = static_cast<uint32_t>(Mesh.Indices.size());
+    Entry.VertexOffset = static_cast<int32_t>(VertexCount);
+    Entry.VertexCount = static_cast<uint32_t>(Mesh.Vertices.size());
+    Entry.Bounds = Mesh.Bounds();
+    Table.push_back(Entry);
+    VertexCount += Mesh.Vertices.size();
+    IndexCount += Mesh.Indices.size();
+  }
+  if (VertexCount > INT32_MAX || IndexCount > UINT32_MAX) {
+    throw std::runtime_error("too much geometry for one mesh file");
+  }
+
+  const uint64_t MeshTableOffset = mesh_format::AlignUp(sizeof(mesh_format::header));
+  const uint64_t VertexOffset = mesh_format::AlignUp(MeshTableOffset + Table.size() * sizeof(mesh_format::mesh));
+  const uint64_t IndexOffset = mesh_format::AlignUp(VertexOffset + VertexCount * sizeof(mesh_format::vertex));
+  const mesh_format::header Header{
+      .Magic = mesh_format::Magic,
+      .Version = mesh_format::Version,
+      .MeshCount = static_cast<uint32_t>(Table.size()),
+      .VertexStride = sizeof(mesh_format::vertex),
+      .MeshTableOffset = MeshTableOffset,
+      .VertexOffset = VertexOffset,
+      .VertexCount = VertexCount,
+      .IndexOffset = IndexOffset,
+      .IndexCount = IndexCount,
+      .FileSize = mesh_format::AlignUp(IndexOffset + IndexCount * sizeof(uint32_t)),
+  };
+
+  std::ofstream File(Path, std::ios::binary);
+  if (!File) {
+    throw std::runtime_error("failed to open " + Path);
+  }
+  auto PadTo = [&](uint64_t Offset) {
+    static constexpr std::array<char, mesh_format::Alignment> Zeros{};
+    File.write(Zeros.data(), static_cast<std::streamsize>(Offset - static_cast<uint64_t>(File.tellp())));
+  };
+  File.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  PadTo(Header.MeshTableOffset);
+  File.write(reinterpret_cast<const char *>(Table.data()),
+             static_cast<std::streamsize>(Table.size() * sizeof(mesh_format::mesh)));
+  PadTo(Header.VertexOffset);
+  for (const source_mesh &Mesh : Meshes) {
+    File.write(reinterpret_cast<const char *>(Mesh.Vertices.data()),
+               static_cast<std::streamsize>(Mesh.Vertices.size() * sizeof(mesh_format::vertex)));
+  }
+  PadTo(Header.IndexOffset);
+  for (const source_mesh &Mesh : Meshes) {
+    File.write(reinterpret_cast<const char *>(Mesh.Indices.data()),
+               static_cast<std::streamsize>(Mesh.Indices.size() * sizeof(uint32_t)));
+  }
+  PadTo(Header.FileSize);
+  if (!File) {
+    throw std::runtime_error("failed to write " + Path);
+  }
+}
+} // namespace
+
+// Usage: meshconv input.(obj|gltf|glb) output.kmesh
+auto main(int argc, char *argv[]) -> int {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " input.(obj|gltf|glb) output.kmesh\n";
+    return 2;
+  }
+  try {
+    const std::filesystem::path Input = argv[1];
+    std::string Extension = Input.extension().string();
+    std::ranges::transform(Extension, Extension.begin(), [](unsigned char C) { return std::tolower(C); });
+    std::vector<source_mesh> Meshes;
+    if (Extension == ".obj") {
+      Meshes = LoadObj(Input.string());
+    } else if (Extension == ".gltf" || Extension == ".glb") {
+      Meshes = LoadGltf(Input);
+    } else {
+      std::cerr << "unsupported input format " << Extension << '\n';
+      return 2;
+    }
+    WriteMeshFile(argv[2], Meshes);
+    for (const source_mesh &Mesh : Meshes) {
+      std::cout << Mesh.Name << ": " << Mesh.Vertices.size() << " vertices, " << Mesh.Indices.size() / 3
+                << " triangles\n";
+    }
+  } catch (const std::exception &Error) {
+    std::cerr << Error.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "source_mesh.hpp"
+
+// Position/uv/normal indices of a face corner, -1 when the corner has no uv or normal
+struct obj_corner {
+  int64_t V, T, N;
+  auto operator==(const obj_corner &) const -> bool = default;
+};
+struct obj_corner_hash {
+  auto operator()(const obj_corner &Corner) const -> size_t {
+    size_t Hash = std::hash<int64_t>{}(Corner.V);
+    for (const int64_t Index : {Corner.T, Corner.N}) {
+      Hash ^= std::hash<int64_t>{}(Index) + 0x9E3779B97F4A7C15ULL + (Hash << 6) + (Hash >> 2);
+    }
+    return Hash;
+  }
+};
+
+// Wavefront OBJ: v/vt/vn/f plus o/g to split meshes. Polygons are triangulated as fans and
+// identical position/uv/normal triples are shared.
+inline auto LoadObj(const std::string &Path) -> std::vector<source_mesh> {
+  std::ifstream File(Path);
+  if (!File) {
+    throw std::runtime_error("failed to open " + Path);
+  }
+  std::vector<std::array<float, 3>> Positions, Normals;
+  std::vector<std::array<float, 2>> UVs;
+  std::vector<source_mesh> Meshes;
+  std::unordered_map<obj_corner, uint32_t, obj_corner_hash> Shared; // Corner -> vertex of the current mesh
+
+  auto Current = [&]() -> source_mesh & {
+    if (Meshes.empty()) {
+      Meshes.push_back({.Name = "default", .Vertices = {}, .Indices = {}, .HasNormals = true});
+    }
+    return Meshes.back();
+  };
+  // OBJ indices are 1-based, negative ones count back from the end
+  auto Resolve = [](int64_t Index, size_t Count) -> int64_t {
+    return Index < 0 ? static_cast<int64_t>(Count) + Index : Index - 1;
+  };
+  auto Corner = [&](const std::string &Token) -> uint32_t {
+    int64_t V = 0, T = 0, N = 0;
+    std::istringstream Parts(Token);
+    std::string Part;
+    for (int Slot = 0; std::getline(Parts, Part, '/'); Slot++) {
+      const int64_t Value = Part.empty() ? 0 : std::stoll(Part);
+      (Slot == 0 ? V : Slot == 1 ? T : N) = Value;
+    }
+    V = Resolve(V, Positions.size());
+    T = T == 0 ? -1 : Resolve(T, UVs.size());
+    N = N == 0 ? -1 : Resolve(N, Normals.size());
+    if (V < 0 || V >= static_cast<int64_t>(Positions.size()) || T >= static_cast<int64_t>(UVs.size()) ||
+        N >= static_cast<int64_t>(Normals.size())) {
+      throw std::runtime_error(Path + ": face index out of range");
+    }
+    source_mesh &Mesh = Current();
+    auto [It, Inserted] = Shared.try_emplace({.V = V, .T = T, .N = N}, static_cast<uint32_t>(Mesh.Vertices.size()));
+    if (Inserted) {
+      Mesh.Vertices.push_back({.Position = Positions[V],
+                               .Normal = N < 0 ? std::array<float, 3>{} : Normals[N],
+                               .UV = T < 0 ? std::array<float, 2>{} : UVs[T]});
+      Mesh.HasNormals = Mesh.HasNormals && N >= 0;
+    }
+    return It->second;
+  };
+
+  std::string Line;
+  std::vector<uint32_t> Polygon;
+  while (std::getline(File, Line)) {
+    std::istringstream Stream(Line);
+    std::string Tag;
+    Stream >> Tag;
+    if (Tag == "v") {
+      auto &P = Positions.emplace_back();
+      Stream >> P[0] >> P[1] >> P[2];
+    } else if (Tag == "vn") {
+      auto &N = Normals.emplace_back();
+      Stream >> N[0] >> N[1] >> N[2];
+    } else if (Tag == "vt") {
+      auto &T = UVs.emplace_back();
+      Stream >> T[0] >> T[1];
+      T[1] = 1 - T[1]; // OBJ has V pointing up, Vulkan samples top-down
+    } else if (Tag == "o" || Tag == "g") {
+      std::string Name;
+      std::getline(Stream >> std::ws, Name);
+      if (!Meshes.empty() && Meshes.back().Indices.empty()) {
+        Meshes.back().Name = Name;
+      } else {
+        Meshes.push_back({.Name = Name, .Vertices = {}, .Indices = {}, .HasNormals = true});
+      }
+      Shared.clear();
+    } else if (Tag == "f") {
+      Polygon.clear();
+      std::string Token;
+      while (Stream >> Token) {
+        Polygon.push_back(Corner(Token));
+      }
+      for (size_t i = 1; i + 1 < Polygon.size(); i++) {
+        Current().Indices.insert(Current().Indices.end(), {Polygon[0], Polygon[i], Polygon[i + 1]});
+      }
+    }
+  }
+  std::erase_if(Meshes, [](const source_mesh &Mesh) { return Mesh.Indices.empty(); });
+  return Meshes;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "engine/assets/mesh_format.hpp"
+
+// A mesh as read from a source format, before it is packed into a .kmesh file.
+struct source_mesh {
+  std::string Name;
+  std::vector<mesh_format::vertex> Vertices;
+  std::vector<uint32_t> Indices;
+  bool HasNormals = true;
+
+  // Area-weighted vertex normals for sources that do not provide any.
+  void ComputeNormals() {
+    for (mesh_format::vertex &Vertex : Vertices) {
+      Vertex.Normal = {0, 0, 0};
+    }
+    for (size_t i = 0; i + 2 < Indices.size(); i += 3) {
+      const auto &P0 = Vertices[Indices[i]].Position;
+      const auto &P1 = Vertices[Indices[i + 1]].Position;
+      const auto &P2 = Vertices[Indices[i + 2]].Position;
+      const std::array<float, 3> E1 = {P1[0] - P0[0], P1[1] - P0[1], P1[2] - P0[2]};
+      const std::array<float, 3> E2 = {P2[0] - P0[0], P2[1] - P0[1], P2[2] - P0[2]};
+      const std::array<float, 3> N = {E1[1] * E2[2] - E1[2] * E2[1], E1[2] * E2[0] - E1[0] * E2[2],
+                                      E1[0] * E2[1] - E1[1] * E2[0]};
+      for (size_t k = 0; k < 3; k++) {
+        for (size_t c = 0; c < 3; c++) {
+          Vertices[Indices[i + k]].Normal[c] += N[c];
+        }
+      }
+    }
+    for (mesh_format::vertex &Vertex : Vertices) {
+      auto &N = Vertex.Normal;
+      const float Length = std::sqrt(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+      if (Length > 0) {
+        N = {N[0] / Length, N[1] / Length, N[2] / Length};
+      }
+    }
+    HasNormals = true;
+  }
+
+  [[nodiscard]] auto Bounds() const -> mesh_format::bounds {
+    mesh_format::bounds Result{};
+    if (Vertices.empty()) {
+      return Result;
+    }
+    Result.Min = Result.Max = Vertices[0].Position;
+    for (const mesh_format::vertex &Vertex : Vertices) {
+      for (size_t c = 0; c < 3; c++) {
+        Result.Min[c] = std::min(Result.Min[c], Vertex.Position[c]);
+        Result.Max[c] = std::max(Result.Max[c], Vertex.Position[c]);
+      }
+    }
+    for (size_t c = 0; c < 3; c++) {
+      Result.Center[c] = (Result.Min[c] + Result.Max[c]) / 2;
+    }
+    // Sphere around the AABB center; tighter than the box's circumsphere for most real meshes
+    float Radius2 = 0;
+    for (const mesh_format::vertex &Vertex : Vertices) {
+      float D2 = 0;
+      for (size_t c = 0; c < 3; c++) {
+        D2 += (Vertex.Position[c] - Result.Center[c]) * (Vertex.Position[c] - Result.Center[c]);
+      }
+      Radius2 = std::max(Radius2, D2);
+    }
+    Result.Radius = std::sqrt(Radius2);
+    return Result;
+  }
+};